@@ -8,27 +8,72 @@
 
 #import <Cocoa/Cocoa.h>
 #import <sqlite3.h>
+#import "DKTableDescription.h"
 
-@class DKDatabase;
+@class DKDatabase, DKCompiledSQLQueryCache;
 @interface DKCompiledSQLQuery : NSObject
 {
+@package
 	/* strong */	DKDatabase *mDatabase;
 	/* weak */		sqlite3 *mSQLConnection;
 	/* owner */		sqlite3_stmt *mSQLStatement;
+	/* owner */		NSString *mQueryString;
+	/* n/a */		BOOL mIsCached;
+	/* weak */		DKCompiledSQLQueryCache *mCache;
+	/* n/a */		BOOL mIsExecuting;
+	
+	//Links in the recently used list of the query cache that owns the query.
+	/* weak */		DKCompiledSQLQuery *mOlderCachedQuery;
+	/* weak */		DKCompiledSQLQuery *mNewerCachedQuery;
 }
 - (id)initWithQuery:(NSString *)query database:(DKDatabase *)database error:(NSError **)error;
 
+/*!
+ @property
+ @abstract	The SQL the receiver was compiled from.
+ */
+@property (readonly) NSString *queryString;
+
+/*!
+ @property
+ @abstract		Whether or not the receiver has been handed out and has not yet finished executing.
+ @discussion	A query stops executing when it runs out of rows, when it is evaluated, or when it is reset.
+				Until then its query cache will not hand it out again, even if it has been abandoned.
+ */
+@property (readonly) BOOL isExecuting;
+
+/*!
+ @property
+ @abstract		Whether or not the receiver is known to leave the database unchanged when evaluated.
+ @discussion	This is always NO when DatabaseKit is built against a version of SQLite older than 3.7.4.
+ */
+@property (readonly) BOOL isReadOnly;
+
 #pragma mark -
 #pragma mark Evaluation
 
 - (BOOL)evaluateAndReturnError:(NSError **)error;
 - (BOOL)nextRow;
 
+/*!
+ @method
+ @abstract		Reset the receiver so that it may be evaluated again, clearing any bound parameters.
+ @discussion	Queries that are abandoned before running out of rows should be reset so that
+				their compiled form can be reused by the database's query cache.
+ */
+- (void)reset;
+
 #pragma mark -
 #pragma mark Column Accessor/Mutators
 
 - (void)nullifyParameterAtIndex:(int)columnIndex;
 
+/*!
+ @method
+ @abstract	Check whether the value of a column in the current row is NULL.
+ */
+- (BOOL)isNullColumnAtIndex:(int)columnIndex;
+
 #pragma mark -
 
 - (void)setString:(NSString *)string forParameterAtIndex:(int)index;
@@ -54,4 +99,126 @@
 
 - (void)setObject:(id)object forParameterAtIndex:(int)index;
 - (id)objectForColumnAtIndex:(int)columnIndex;
+
+#pragma mark -
+
+/*!
+ @method
+ @abstract	Read the value of a column, converting it to an object using a specified attribute type.
+ @param		columnIndex		The index of the column to read.
+ @param		type			The type of the attribute the column stores.
+ @result	The value of the column; nil if the column is NULL or the type is unknown.
+ */
+- (id)valueForColumnAtIndex:(int)columnIndex type:(DKAttributeType)type;
+
+/*!
+ @method
+ @abstract	Bind a value to a parameter, converting it using a specified attribute type.
+ @param		value	The value to bind. nil and NSNull bind NULL.
+ @param		type	The type of the attribute the parameter corresponds to.
+ @param		index	The index of the parameter.
+ */
+- (void)setValue:(id)value type:(DKAttributeType)type forParameterAtIndex:(int)index;
+
+/*!
+ @method
+ @abstract		Read the value of a column, decoding it using a specified attribute.
+ @param			columnIndex		The index of the column to read.
+ @param			attribute		The attribute the column stores. May not be nil.
+ @result		The value of the column; nil if the column is NULL.
+ @discussion	Unlike valueForColumnAtIndex:type:, this method honors the attribute's codec and compression.
+ */
+- (id)valueForColumnAtIndex:(int)columnIndex attribute:(DKAttributeDescription *)attribute;
+
+/*!
+ @method
+ @abstract		Bind a value to a parameter, encoding it using a specified attribute.
+ @param			value		The value to bind. nil and NSNull bind NULL.
+ @param			attribute	The attribute the parameter corresponds to. May not be nil.
+ @param			index		The index of the parameter.
+ @discussion	Unlike setValue:type:forParameterAtIndex:, this method honors the attribute's codec and compression.
+ */
+- (void)setValue:(id)value attribute:(DKAttributeDescription *)attribute forParameterAtIndex:(int)index;
+
+/*!
+ @method
+ @abstract		Bind a value to a parameter, converting it based on its class.
+ @param			argument	The value to bind. nil and NSNull bind NULL.
+ @param			index		The index of the parameter.
+ @discussion	Strings, numbers, dates and data are bound natively. Any other object is archived.
+				This is used to bind constants whose attribute type is not known up front.
+ */
+- (void)setArgument:(id)argument forParameterAtIndex:(int)index;
+@end
+
+#pragma mark -
+
+/*!
+ @class
+ @abstract		This class is used by DKDatabase to keep a bounded number of compiled queries around for reuse.
+ @discussion	Queries are keyed by their SQL text and evicted in least-recently-used order.
+				A query that is still executing is never handed out twice; a fresh uncached
+				query is compiled in its place.
+ */
+@interface DKCompiledSQLQueryCache : NSObject
+{
+	/* weak */	DKDatabase *mDatabase;
+	/* weak */	sqlite3 *mSQLiteConnection;
+	/* owner */	NSMutableDictionary *mQueries;
+	/* weak */	DKCompiledSQLQuery *mLeastRecentlyUsedQuery;
+	/* weak */	DKCompiledSQLQuery *mMostRecentlyUsedQuery;
+	/* n/a */	NSUInteger mLimit;
+	/* n/a */	NSUInteger mHitCount;
+	/* n/a */	NSUInteger mMissCount;
+}
+/*!
+ @method
+ @abstract	Initialize a query cache for a specified database with a maximum number of queries.
+ @param		database	The database whose connection queries are compiled against. May not be nil. Not retained.
+ @param		limit		The maximum number of compiled queries to keep around.
+ */
+- (id)initWithDatabase:(DKDatabase *)database limit:(NSUInteger)limit;
+
+/*!
+ @method
+ @abstract	Initialize a query cache for a specific connection of a database with a maximum number of queries.
+ @param		database	The database the queries belong to. May not be nil. Not retained.
+ @param		connection	The connection queries are compiled against. May not be NULL. Not owned.
+ @param		limit		The maximum number of compiled queries to keep around.
+ */
+- (id)initWithDatabase:(DKDatabase *)database connection:(sqlite3 *)connection limit:(NSUInteger)limit;
+
+/*!
+ @method
+ @abstract		Look up a reset compiled query for a specified SQL string, compiling and caching it if necessary.
+ @param			query	The SQL to look up. May not be nil.
+ @param			error	If the query cannot be compiled this will contain an error. May be nil.
+ @result		A compiled query whose bindings have been cleared; nil if an error occurs.
+ */
+- (DKCompiledSQLQuery *)compiledQueryForString:(NSString *)query error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Remove and finalize all of the queries in the receiver.
+ @discussion	This must be invoked before the database's connection is closed.
+ */
+- (void)removeAllQueries;
+
+/*!
+ @property
+ @abstract	The maximum number of compiled queries the receiver will keep around.
+ */
+@property NSUInteger limit;
+
+/*!
+ @property
+ @abstract	The number of lookups that were satisfied by an existing compiled query.
+ */
+@property (readonly) NSUInteger hitCount;
+
+/*!
+ @property
+ @abstract	The number of lookups that required a query to be compiled.
+ */
+@property (readonly) NSUInteger missCount;
 @end
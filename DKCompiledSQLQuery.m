@@ -9,6 +9,59 @@
 #import "DKCompiledSQLQuery.h"
 #import "DKDatabase.h"
 #import "DKDatabasePrivate.h"
+#import "DKTableDescriptionPrivate.h"
+
+///The format dates were stored in before they were stored as numbers.
+static NSString *const kDKLegacyDateFormat = @"%Y-%m-%d %H:%M:%S.%F";
+
+//! @abstract	The DKCompiledSQLQuery private continuation.
+@interface DKCompiledSQLQuery () //Continuation
+
+/*!
+ @method
+ @abstract		Initialize a compiled query, specifying whether or not it is owned by a query cache.
+ @discussion	Cached queries do not retain their database. The database owns the cache and retaining
+				it from the cache's queries would create a cycle.
+ */
+- (id)initWithQuery:(NSString *)query database:(DKDatabase *)database cached:(BOOL)cached error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Initialize a compiled query against a specific connection of a database.
+ @discussion	This is used to compile queries against a database's read-only connections.
+ */
+- (id)initWithQuery:(NSString *)query database:(DKDatabase *)database connection:(sqlite3 *)connection cached:(BOOL)cached error:(NSError **)error;
+
+/*!
+ @method
+ @abstract	Note the query cache that owns the receiver.
+ */
+- (void)attachToCache:(DKCompiledSQLQueryCache *)cache;
+
+/*!
+ @method
+ @abstract	Finalize the receiver's statement.
+ */
+- (void)cleanUp;
+
+/*!
+ @method
+ @abstract		Detach the receiver from the query cache that owns it.
+ @discussion	Once detached the receiver retains its database like any other query.
+ */
+- (void)detachFromCache;
+
+/*!
+ @method
+ @abstract		Mark the receiver as executing or not.
+ @discussion	A cached query is checked out of and back into its cache this way, so the
+				flag is only ever changed with the cache locked.
+ */
+- (void)setExecuting:(BOOL)isExecuting;
+
+@end
+
+#pragma mark -
 
 @implementation DKCompiledSQLQuery
 
@@ -21,6 +74,9 @@
 		sqlite3_finalize(mSQLStatement);
 		mSQLStatement = NULL;
 	}
+	
+	//A finalized query can't be handed out again, and its cache may be about to go away.
+	mCache = nil;
 }
 
 - (void)finalize
@@ -33,9 +89,13 @@
 {
 	[self cleanUp];
 	
-	[mDatabase release];
+	if(!mIsCached)
+		[mDatabase release];
 	mDatabase = nil;
 	
+	[mQueryString release];
+	mQueryString = nil;
+	
 	[super dealloc];
 }
 
@@ -43,14 +103,27 @@
 #pragma mark Construction
 
 - (id)initWithQuery:(NSString *)query database:(DKDatabase *)database error:(NSError **)error
+{
+	return [self initWithQuery:query database:database cached:NO error:error];
+}
+
+- (id)initWithQuery:(NSString *)query database:(DKDatabase *)database cached:(BOOL)cached error:(NSError **)error
+{
+	return [self initWithQuery:query database:database connection:database.sqliteConnection cached:cached error:error];
+}
+
+- (id)initWithQuery:(NSString *)query database:(DKDatabase *)database connection:(sqlite3 *)connection cached:(BOOL)cached error:(NSError **)error
 {
 	NSParameterAssert(query);
 	NSParameterAssert(database);
+	NSParameterAssert(connection);
 	
 	if((self = [super init]))
 	{
-		mDatabase = [database retain];
-		mSQLConnection = database.sqliteConnection;
+		mIsCached = cached;
+		mDatabase = mIsCached? database : [database retain];
+		mSQLConnection = connection;
+		mQueryString = [query copy];
 		
 		SQLiteStatus status = sqlite3_prepare_v2(mSQLConnection, //in SQLite3 handle
 												 [query UTF8String], //in cleanQuery
@@ -62,8 +135,9 @@
 			if(error) *error = DKLocalizedError(DKInitializationErrorDomain, 
 												status, 
 												nil, 
-												@"Could not prepare statement", query, status, error);
-			return NO;
+												@"Could not prepare statement", query, status, sqlite3_errmsg(mSQLConnection));
+			[self release];
+			return nil;
 		}
 		
 		return self;
@@ -71,6 +145,61 @@
 	return nil;
 }
 
+#pragma mark -
+#pragma mark Properties
+
+@synthesize queryString = mQueryString;
+@synthesize isExecuting = mIsExecuting;
+
+@dynamic isReadOnly;
+- (BOOL)isReadOnly
+{
+#if SQLITE_VERSION_NUMBER >= 3007004
+	return (sqlite3_stmt_readonly(mSQLStatement) != 0);
+#else
+	//Without sqlite3_stmt_readonly we can't tell, so we assume the worst.
+	return NO;
+#endif /* SQLITE_VERSION_NUMBER >= 3007004 */
+}
+
+#pragma mark -
+#pragma mark Cache Support
+
+- (void)attachToCache:(DKCompiledSQLQueryCache *)cache
+{
+	mCache = cache;
+}
+
+- (void)detachFromCache
+{
+	if(mIsCached)
+	{
+		[mDatabase retain];
+		mIsCached = NO;
+	}
+	
+	mCache = nil;
+}
+
+- (void)setExecuting:(BOOL)isExecuting
+{
+	DKCompiledSQLQueryCache *cache = mCache;
+	if(cache)
+	{
+		@synchronized(cache)
+		{
+			mIsExecuting = isExecuting;
+		}
+	}
+	else
+	{
+		mIsExecuting = isExecuting;
+	}
+}
+
+#pragma mark -
+#pragma mark Evaluation
+
 - (BOOL)evaluateAndReturnError:(NSError **)error
 {
 	SQLiteStatus status = sqlite3_step(mSQLStatement);
@@ -80,15 +209,42 @@
 											status, 
 											nil, 
 											@"%s", sqlite3_errmsg(mSQLConnection));
+		sqlite3_reset(mSQLStatement);
+		[self setExecuting:NO];
+		
 		return NO;
 	}
 	
+	//
+	//	Evaluated queries are reset immediately so they stop holding
+	//	locks and can be handed out again by the query cache.
+	//
+	sqlite3_reset(mSQLStatement);
+	[self setExecuting:NO];
+	
 	return YES;
 }
 
 - (BOOL)nextRow
 {
-	return (sqlite3_step(mSQLStatement) == SQLITE_ROW);
+	if(sqlite3_step(mSQLStatement) == SQLITE_ROW)
+	{
+		//Only the first row checks the query back out, so stepping through the rest stays lock free.
+		if(!mIsExecuting)
+			[self setExecuting:YES];
+		
+		return YES;
+	}
+	
+	[self setExecuting:NO];
+	return NO;
+}
+
+- (void)reset
+{
+	sqlite3_reset(mSQLStatement);
+	sqlite3_clear_bindings(mSQLStatement);
+	[self setExecuting:NO];
 }
 
 #pragma mark -
@@ -102,6 +258,11 @@
 			 @"Remove value for column %d. Got error %d \"%s\".", index, status, sqlite3_errmsg(mSQLConnection));
 }
 
+- (BOOL)isNullColumnAtIndex:(int)index
+{
+	return (sqlite3_column_type(mSQLStatement, index) == SQLITE_NULL);
+}
+
 #pragma mark -
 
 - (void)setString:(NSString *)string forParameterAtIndex:(int)index
@@ -131,13 +292,12 @@
 {
 	NSParameterAssert(date);
 	
-	//The DATETIME type expects values to be in the form of YY-MM-DD HH:MM:SS.MMM.
-	NSString *dateString = [date descriptionWithCalendarFormat:@"%Y-%m-%d %H:%M:%S.%F" timeZone:nil locale:nil];
-	SQLiteStatus status = sqlite3_bind_text(mSQLStatement, //in statement
-											index, //in index
-											[dateString UTF8String], //in stringData
-											[dateString lengthOfBytesUsingEncoding:NSUTF8StringEncoding], //in stringDataLength
-											SQLITE_STATIC); //in dataDestructor
+	//
+	//	Dates are stored as the number of seconds since 1970 so that they keep their
+	//	sub-millisecond precision and compare numerically, which lets date ranges use
+	//	indexes. Nothing has to be formatted or parsed on the way in or out.
+	//
+	SQLiteStatus status = sqlite3_bind_double(mSQLStatement, index, [date timeIntervalSince1970]);
 	
 	NSAssert((status == SQLITE_OK), 
 			 @"Could not set date for column %d. Got error %d \"%s\".", index, status, sqlite3_errmsg(mSQLConnection));
@@ -145,11 +305,24 @@
 
 - (NSDate *)dateForColumnAtIndex:(int)index
 {
-	const char *cStringData = (const char *)sqlite3_column_text(mSQLStatement, index);
-	if(cStringData)
+	switch (sqlite3_column_type(mSQLStatement, index))
 	{
-		NSString *dateString = [NSString stringWithUTF8String:cStringData];
-		return [NSDate dateWithString:dateString];
+		case SQLITE_INTEGER:
+		case SQLITE_FLOAT:
+			return [NSDate dateWithTimeIntervalSince1970:sqlite3_column_double(mSQLStatement, index)];
+			
+		case SQLITE_TEXT:
+		{
+			//
+			//	Older versions of DatabaseKit stored dates as local time text. These
+			//	are read the slow way until the database's dates have been migrated.
+			//
+			NSString *dateString = [NSString stringWithUTF8String:(const char *)sqlite3_column_text(mSQLStatement, index)];
+			return [NSCalendarDate dateWithString:dateString calendarFormat:kDKLegacyDateFormat];
+		}
+			
+		default:
+			break;
 	}
 	
 	return nil;
@@ -240,4 +413,404 @@
 	return [NSKeyedUnarchiver unarchiveObjectWithData:[self dataForColumnAtIndex:index]];
 }
 
+#pragma mark -
+
+- (id)valueForColumnAtIndex:(int)index type:(DKAttributeType)type
+{
+	//
+	//	NULL columns are nil regardless of their type. Without this check
+	//	numeric columns would come back as zero instead of nil.
+	//
+	if(sqlite3_column_type(mSQLStatement, index) == SQLITE_NULL)
+		return nil;
+	
+	switch (type)
+	{
+		case DKAttributeTypeString:
+			return [self stringForColumnAtIndex:index];
+			
+		case DKAttributeTypeDate:
+			return [self dateForColumnAtIndex:index];
+			
+		case DKAttributeTypeInt8:
+		case DKAttributeTypeInt16:
+		case DKAttributeTypeInt32:
+			return [NSNumber numberWithInt:[self intForColumnAtIndex:index]];
+			
+		case DKAttributeTypeInt64:
+			return [NSNumber numberWithLongLong:[self longLongForColumnAtIndex:index]];
+			
+		case DKAttributeTypeFloat:
+			return [NSNumber numberWithDouble:[self doubleForColumnAtIndex:index]];
+			
+		case DKAttributeTypeData:
+			return [self dataForColumnAtIndex:index];
+			
+		case DKAttributeTypeObject:
+			return [self objectForColumnAtIndex:index];
+			
+		default:
+			break;
+	}
+	
+	return nil;
+}
+
+- (void)setValue:(id)value type:(DKAttributeType)type forParameterAtIndex:(int)index
+{
+	if(!value || (value == [NSNull null]))
+	{
+		[self nullifyParameterAtIndex:index];
+		return;
+	}
+	
+	switch (type)
+	{
+		case DKAttributeTypeString:
+			[self setString:value forParameterAtIndex:index];
+			break;
+			
+		case DKAttributeTypeDate:
+			[self setDate:value forParameterAtIndex:index];
+			break;
+			
+		case DKAttributeTypeInt8:
+		case DKAttributeTypeInt16:
+		case DKAttributeTypeInt32:
+			[self setInt:[value intValue] forParameterAtIndex:index];
+			break;
+			
+		case DKAttributeTypeInt64:
+			[self setLongLong:[value longLongValue] forParameterAtIndex:index];
+			break;
+			
+		case DKAttributeTypeFloat:
+			[self setDouble:[value doubleValue] forParameterAtIndex:index];
+			break;
+			
+		case DKAttributeTypeData:
+			[self setData:value forParameterAtIndex:index];
+			break;
+			
+		case DKAttributeTypeObject:
+			[self setObject:value forParameterAtIndex:index];
+			break;
+			
+		default:
+			//This should never happen, but if it does we just write null.
+			[self nullifyParameterAtIndex:index];
+			break;
+	}
+}
+
+#pragma mark -
+
+- (id)valueForColumnAtIndex:(int)index attribute:(DKAttributeDescription *)attribute
+{
+	NSParameterAssert(attribute);
+	
+	DKAttributeType type = attribute.type;
+	if((type != DKAttributeTypeData) && (type != DKAttributeTypeObject))
+		return [self valueForColumnAtIndex:index type:type];
+	
+	if(sqlite3_column_type(mSQLStatement, index) == SQLITE_NULL)
+		return nil;
+	
+	return [attribute valueForEncodedData:[self dataForColumnAtIndex:index]];
+}
+
+- (void)setValue:(id)value attribute:(DKAttributeDescription *)attribute forParameterAtIndex:(int)index
+{
+	NSParameterAssert(attribute);
+	
+	DKAttributeType type = attribute.type;
+	if((type != DKAttributeTypeData) && (type != DKAttributeTypeObject))
+	{
+		[self setValue:value type:type forParameterAtIndex:index];
+		return;
+	}
+	
+	if(!value || (value == [NSNull null]))
+	{
+		[self nullifyParameterAtIndex:index];
+		return;
+	}
+	
+	[self setData:[attribute encodedDataForValue:value] forParameterAtIndex:index];
+}
+
+- (void)setArgument:(id)argument forParameterAtIndex:(int)index
+{
+	if(!argument || (argument == [NSNull null]))
+	{
+		[self nullifyParameterAtIndex:index];
+	}
+	else if([argument isKindOfClass:[NSString class]])
+	{
+		[self setString:argument forParameterAtIndex:index];
+	}
+	else if([argument isKindOfClass:[NSNumber class]])
+	{
+		//
+		//	Floating point numbers have to be bound as doubles or
+		//	comparisons against REAL columns would be truncated.
+		//
+		const char *objCType = [argument objCType];
+		if(([argument isKindOfClass:[NSDecimalNumber class]]) || (strcmp(objCType, @encode(double)) == 0) || (strcmp(objCType, @encode(float)) == 0))
+			[self setDouble:[argument doubleValue] forParameterAtIndex:index];
+		else
+			[self setLongLong:[argument longLongValue] forParameterAtIndex:index];
+	}
+	else if([argument isKindOfClass:[NSDate class]])
+	{
+		[self setDate:argument forParameterAtIndex:index];
+	}
+	else if([argument isKindOfClass:[NSData class]])
+	{
+		[self setData:argument forParameterAtIndex:index];
+	}
+	else
+	{
+		[self setObject:argument forParameterAtIndex:index];
+	}
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKCompiledSQLQueryCache
+
+#pragma mark Destruction
+
+- (void)dealloc
+{
+	[self removeAllQueries];
+	
+	[mQueries release];
+	mQueries = nil;
+	
+	[super dealloc];
+}
+
+#pragma mark -
+#pragma mark Construction
+
+- (id)init
+{
+	[self doesNotRecognizeSelector:_cmd];
+	return nil;
+}
+
+- (id)initWithDatabase:(DKDatabase *)database limit:(NSUInteger)limit
+{
+	return [self initWithDatabase:database connection:database.sqliteConnection limit:limit];
+}
+
+- (id)initWithDatabase:(DKDatabase *)database connection:(sqlite3 *)connection limit:(NSUInteger)limit
+{
+	NSParameterAssert(database);
+	NSParameterAssert(connection);
+	
+	if((self = [super init]))
+	{
+		mDatabase = database;
+		mSQLiteConnection = connection;
+		mLimit = limit;
+		
+		mQueries = [NSMutableDictionary new];
+		
+		return self;
+	}
+	return nil;
+}
+
+#pragma mark -
+#pragma mark Recently Used List
+
+//
+//	Cached queries are linked together from least to most recently used, so
+//	that a hit only has to relink the query it found rather than search for it.
+//	The links are only ever touched with the cache locked.
+//
+
+- (void)unlinkQuery:(DKCompiledSQLQuery *)query
+{
+	if(query->mOlderCachedQuery)
+		query->mOlderCachedQuery->mNewerCachedQuery = query->mNewerCachedQuery;
+	else
+		mLeastRecentlyUsedQuery = query->mNewerCachedQuery;
+	
+	if(query->mNewerCachedQuery)
+		query->mNewerCachedQuery->mOlderCachedQuery = query->mOlderCachedQuery;
+	else
+		mMostRecentlyUsedQuery = query->mOlderCachedQuery;
+	
+	query->mOlderCachedQuery = nil;
+	query->mNewerCachedQuery = nil;
+}
+
+- (void)linkQueryAsMostRecentlyUsed:(DKCompiledSQLQuery *)query
+{
+	query->mOlderCachedQuery = mMostRecentlyUsedQuery;
+	query->mNewerCachedQuery = nil;
+	
+	if(mMostRecentlyUsedQuery)
+		mMostRecentlyUsedQuery->mNewerCachedQuery = query;
+	else
+		mLeastRecentlyUsedQuery = query;
+	
+	mMostRecentlyUsedQuery = query;
+}
+
+#pragma mark -
+#pragma mark Eviction
+
+- (void)evictQuery:(DKCompiledSQLQuery *)query
+{
+	[[query retain] autorelease];
+	
+	[self unlinkQuery:query];
+	
+	//
+	//	If someone is still holding on to the query we let them keep it.
+	//	Detaching it means it will retain the database like any other
+	//	query, so it can never outlive the connection it was compiled on.
+	//
+	[query detachFromCache];
+	
+	[mQueries removeObjectForKey:query->mQueryString];
+}
+
+- (void)evictQueriesOverLimit
+{
+	while ([mQueries count] > mLimit)
+		[self evictQuery:mLeastRecentlyUsedQuery];
+}
+
+- (void)removeAllQueries
+{
+	@synchronized(self)
+	{
+		//
+		//	We finalize every query ourselves rather than leaving it to
+		//	dealloc. A query that is still referenced elsewhere would otherwise
+		//	be finalized a second time after its connection is gone.
+		//
+		for (DKCompiledSQLQuery *query in [mQueries allValues])
+		{
+			query->mOlderCachedQuery = nil;
+			query->mNewerCachedQuery = nil;
+			[query cleanUp];
+		}
+		
+		mLeastRecentlyUsedQuery = nil;
+		mMostRecentlyUsedQuery = nil;
+		[mQueries removeAllObjects];
+	}
+}
+
+#pragma mark -
+#pragma mark Properties
+
+@dynamic hitCount;
+- (NSUInteger)hitCount
+{
+	@synchronized(self)
+	{
+		return mHitCount;
+	}
+}
+
+@dynamic missCount;
+- (NSUInteger)missCount
+{
+	@synchronized(self)
+	{
+		return mMissCount;
+	}
+}
+
+@dynamic limit;
+- (void)setLimit:(NSUInteger)limit
+{
+	@synchronized(self)
+	{
+		mLimit = limit;
+		[self evictQueriesOverLimit];
+	}
+}
+
+- (NSUInteger)limit
+{
+	@synchronized(self)
+	{
+		return mLimit;
+	}
+}
+
+#pragma mark -
+#pragma mark Lookup
+
+- (DKCompiledSQLQuery *)compiledQueryForString:(NSString *)queryString error:(NSError **)error
+{
+	NSParameterAssert(queryString);
+	
+	@synchronized(self)
+	{
+		DKCompiledSQLQuery *query = [mQueries objectForKey:queryString];
+		if(query)
+		{
+			//
+			//	A query that is still executing is checked out to someone else. It's
+			//	checked back in, under our lock, once it finishes or is reset.
+			//
+			if(!query.isExecuting)
+			{
+				mHitCount++;
+				
+				if(query != mMostRecentlyUsedQuery)
+				{
+					[self unlinkQuery:query];
+					[self linkQueryAsMostRecentlyUsed:query];
+				}
+				
+				[query reset];
+				[query setExecuting:YES];
+				
+				return [[query retain] autorelease];
+			}
+			
+			//
+			//	The cached query is busy so we compile a private copy for the caller.
+			//
+			mMissCount++;
+			return [[[DKCompiledSQLQuery alloc] initWithQuery:queryString database:mDatabase connection:mSQLiteConnection cached:NO error:error] autorelease];
+		}
+		
+		
+		mMissCount++;
+		
+		query = [[DKCompiledSQLQuery alloc] initWithQuery:queryString database:mDatabase connection:mSQLiteConnection cached:YES error:error];
+		if(!query)
+			return nil;
+		
+		if(mLimit > 0)
+		{
+			[query attachToCache:self];
+			[mQueries setObject:query forKey:queryString];
+			[self linkQueryAsMostRecentlyUsed:query];
+			[self evictQueriesOverLimit];
+		}
+		else
+		{
+			[query detachFromCache];
+		}
+		
+		[query setExecuting:YES];
+		
+		return [query autorelease];
+	}
+}
+
 @end
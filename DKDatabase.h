@@ -11,7 +11,72 @@
 #import <dispatch/dispatch.h>
 
 @protocol DKDatabaseLayout;
-@class DKFetchRequest, DKCompiledSQLQuery, DKTableDescription, DKManagedObject;
+@class DKFetchRequest, DKDatabaseOperation, DKCompiledSQLQuery, DKCompiledSQLQueryCache, DKTableDescription, DKManagedObject, DKDatabaseChangeSet;
+
+typedef enum _DKDatabaseOptions {
+	/*!
+	 @enum		DKDatabaseOptions
+	 @abstract	This enum is used to configure how a database is opened.
+	 */
+	
+	/*!
+	 @constant	kDKDatabaseOptionNone
+	 @abstract	The database uses a single connection for reading and writing.
+	 */
+	kDKDatabaseOptionNone = 0,
+	
+	/*!
+	 @constant		kDKDatabaseOptionConcurrentReads
+	 @abstract		The database is put in write-ahead logging mode and reads are spread over a pool of read-only connections.
+	 @discussion	Each thread reads through a connection of its own, so reads on different threads run in
+					parallel with each other and with writes. Reads made on the writer queue, or while a
+					transaction is open, use the write connection so they see uncommitted changes.
+					
+					This option has no effect on transient databases, or if SQLite cannot enable write-ahead logging.
+	 */
+	kDKDatabaseOptionConcurrentReads = (1 << 0),
+} DKDatabaseOptions;
+
+/*!
+ @const
+ @abstract		Posted by a DKDatabase after a transaction that changed rows in its layout's tables is committed.
+ @discussion	One notification is posted for each committed transaction, on the database's writer queue. By the
+				time it is posted, the managed objects of changed rows have already dropped their cached values,
+				apart from the values they wrote to their rows themselves.
+				
+				The userInfo dictionary contains the keys DKInsertedUniqueIdentifiersKey, DKUpdatedUniqueIdentifiersKey,
+				and DKDeletedUniqueIdentifiersKey, each of which maps table names to sets of unique identifiers, and
+				DKChangedTableNamesKey. Changes rolled back to a savepoint are not included.
+ */
+DK_EXTERN NSString *const DKDatabaseObjectsDidChangeNotification;
+
+/*!
+ @const
+ @abstract	The unique identifiers of the rows inserted by a transaction, by table name.
+ */
+DK_EXTERN NSString *const DKInsertedUniqueIdentifiersKey;
+
+/*!
+ @const
+ @abstract	The unique identifiers of the rows updated by a transaction, by table name.
+ */
+DK_EXTERN NSString *const DKUpdatedUniqueIdentifiersKey;
+
+/*!
+ @const
+ @abstract		The unique identifiers of the rows deleted by a transaction, by table name.
+ @discussion	A deleted row's unique identifier is gone along with it, so only the
+				rows of managed objects that were in memory are included here.
+ */
+DK_EXTERN NSString *const DKDeletedUniqueIdentifiersKey;
+
+/*!
+ @const
+ @abstract		The names of the tables a transaction changed too many rows in to list them one by one.
+ @discussion	Every row of these tables should be treated as possibly changed. Their names do not
+				appear in the sets of inserted, updated, or deleted unique identifiers.
+ */
+DK_EXTERN NSString *const DKChangedTableNamesKey;
 
 /*!
  @method
@@ -23,7 +88,35 @@
 	/* owner */	sqlite3 *mSQLiteConnection;
 	/* owner */	id < DKDatabaseLayout > mDatabaseLayout;
 	/* owner */	NSURL *mLocation;
-	/* owner */	NSMapTable *mManagedObjects;
+	/* owner */	__strong struct _DKManagedObjectStripe *mManagedObjectStripes;
+	/* owner */	DKCompiledSQLQueryCache *mCompiledQueryCache;
+	/* owner */	NSMutableSet *mObjectsWithChanges;
+	/* owner */	NSMutableArray *mObjectsBeingDeleted;
+	/* n/a */	BOOL mDefersChangesUntilSave;
+	/* owner */	dispatch_queue_t mWriterQueue;
+	/* weak */	void *mWriterThread;
+	/* owner */	dispatch_queue_t mBackgroundQueue;
+	/* owner */	NSMutableArray *mReaderConnections;
+	/* n/a */	NSUInteger mReaderConnectionKey;
+	/* n/a */	BOOL mUsesConcurrentReads;
+	/* n/a */	NSUInteger mTransactionDepth;
+	/* weak */	NSThread *mTransactionThread;
+	/* n/a */	NSTimeInterval mGroupCommitInterval;
+	/* n/a */	BOOL mGroupCommitIsOpen;
+	/* n/a */	BOOL mGroupCommitIsDue;
+	/* owner */	NSMutableArray *mGroupCommitWaiters;
+	/* owner */	volatile int32_t *mRelationshipGenerations;
+	/* owner */	NSMapTable *mRelationshipGenerationIndexes;
+	/* owner */	NSMapTable *mRelationshipGenerationIndexesBySQLName;
+	/* n/a */	NSUInteger mManagedObjectLimit;
+	/* n/a */	volatile int32_t mNumberOfManagedObjects;
+	/* n/a */	volatile int32_t mIsEvicting;
+	/* n/a */	NSUInteger mEvictionHand;
+	/* owner */	NSMapTable *mTablesBySQLName;
+	/* owner */	DKDatabaseChangeSet *mUncommittedChanges;
+	/* owner */	NSMutableArray *mSavepointChanges;
+	/* weak */	DKManagedObject *mWriteThroughObject;
+	/* owner */	NSMutableArray *mCommittedChanges;
 }
 #pragma mark Initialization
 
@@ -36,7 +129,7 @@
 
 /*!
  @method
- @abstract		Initialize a database with a storage location and layout. Designated initializer.
+ @abstract		Initialize a database with a storage location and layout.
  @param			location	A file URL describing the location the database should place its storage file. May be nil.
  @param			layout		An object describing the layout of the database. May not be nil.
  @param			Will contain an error if any problem occurs during initialization.
@@ -45,6 +138,21 @@
  */
 - (id)initWithDatabaseAtURL:(NSURL *)location layout:(id < DKDatabaseLayout >)layout error:(NSError **)error;
 
+/*!
+ @method
+ @abstract		Initialize a database with a storage location, layout and options. Designated initializer.
+ @param			location	A file URL describing the location the database should place its storage file. May be nil.
+ @param			layout		An object describing the layout of the database. May not be nil.
+ @param			options		Options describing how the database should be opened.
+ @param			Will contain an error if any problem occurs during initialization.
+ @result		A fully initialized database object if no problems occur; nil otherwise.
+ @discussion	Passing in a nil location will cause a transient database to be created.
+				
+				Regardless of options, every write is performed on a serial writer queue owned by the
+				database, so writes from different threads never interleave on the write connection.
+ */
+- (id)initWithDatabaseAtURL:(NSURL *)location layout:(id < DKDatabaseLayout >)layout options:(DKDatabaseOptions)options error:(NSError **)error;
+
 #pragma mark -
 #pragma mark Database Attributes
 
@@ -67,6 +175,12 @@
  */
 @property (readonly) double databaseVersion;
 
+/*!
+ @property
+ @abstract	Whether or not the receiver reads through a pool of read-only connections.
+ */
+@property (readonly) BOOL usesConcurrentReads;
+
 #pragma mark -
 
 /*!
@@ -85,11 +199,46 @@
  @abstract		Compile an SQL query for use with the receiver's SQLite connection.
  @param			query	The SQL query to compile. May not be nil.
  @param			error	If the query cannot be compiled this will contain an error. May be nil.
- @result		nil if an error occurs; a new autoreleased compiled SQL query.
+ @result		nil if an error occurs; an autoreleased compiled SQL query with no parameters bound.
  @discussion	This method should only be executed from within the context of a transaction.
+				
+				Compiled queries are cached by their SQL, so queries should use ? parameters
+				instead of formatting values into the query string. Queries that are abandoned
+				before they run out of rows should be reset so they can be reused.
  */
 - (DKCompiledSQLQuery *)compileSQLQuery:(NSString *)query error:(NSError **)error;
 
+/*!
+ @property
+ @abstract		The maximum number of compiled queries the receiver keeps around for reuse.
+ @discussion	The default value is 64. Setting this to 0 disables compiled query caching.
+ */
+@property NSUInteger compiledQueryCacheLimit;
+
+/*!
+ @property
+ @abstract	The number of times compileSQLQuery:error: was able to reuse a cached compiled query.
+ */
+@property (readonly) NSUInteger compiledQueryCacheHitCount;
+
+/*!
+ @property
+ @abstract	The number of times compileSQLQuery:error: had to compile a query.
+ */
+@property (readonly) NSUInteger compiledQueryCacheMissCount;
+
+/*!
+ @property
+ @abstract		The number of managed objects the receiver tries to keep in memory.
+ @discussion	The default value is 0, which means there is no limit and managed objects are kept until they are deleted.
+				
+				When the limit is exceeded, managed objects are swept in a clock order. Objects used since the last
+				sweep are passed over once. The receiver lets go of the others and drops their cached values. Those
+				that nothing else holds on to, and that have no unsaved changes, are destroyed. Destroyed objects and
+				dropped values are read again from the database the next time they are asked for.
+ */
+@property NSUInteger managedObjectLimit;
+
 /*!
  @method
  @abstract		Execute an SQL query on the receiver's SQLite connection.
@@ -105,13 +254,64 @@
 
 /*!
  @method
- @abstract	Returns an array of objects that meet the criteria specified by a given fetch request.
- @param		fetchRequest	A fetch request that specifies the search criteria for the fetch. May not be nil.
- @param		error			If there is a problem executing the fetch, upon return contains an instance of NSError that describes the problem.
- @result	A sorted array of objects that meet the criteria specified.
+ @abstract		Returns an array of objects that meet the criteria specified by a given fetch request.
+ @param			fetchRequest	A fetch request that specifies the search criteria for the fetch. May not be nil.
+ @param			error			If there is a problem executing the fetch, upon return contains an instance of NSError that describes the problem.
+ @result		A sorted array of objects that meet the criteria specified.
+ @discussion	Sorting, limits, offsets and paging are done by SQLite, so only the rows that are
+				returned are read. Sort descriptors on a single attribute using compare: or
+				caseInsensitiveCompare: can be evaluated by SQLite; any others are applied in memory.
+				
+				If the fetch request's result type is kDKFetchRequestResultTypeAggregate, its aggregates are
+				computed by SQLite with a single SELECT and an array of dictionaries is returned, one per group.
+				
+				Requests with the unique identifier or dictionary result types select only the columns they
+				need and return NSNumbers or dictionaries without creating managed objects. They read what
+				is in the database, so unsaved changes are not reflected in them.
  */
 - (NSArray *)executeFetchRequest:(DKFetchRequest *)fetchRequest error:(NSError **)error;
 
+/*!
+ @method
+ @abstract		Returns the number of objects a given fetch request would return.
+ @param			fetchRequest	A fetch request that specifies the search criteria for the fetch. May not be nil.
+ @param			error			If there is a problem counting, upon return contains an instance of NSError that describes the problem.
+ @result		The number of objects the fetch request would return; NSNotFound if an error occurs.
+ @discussion	The rows are counted by SQLite with COUNT(*). No objects are created.
+ */
+- (NSUInteger)countForFetchRequest:(DKFetchRequest *)fetchRequest error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Enumerate the objects that meet the criteria specified by a given fetch request without fetching them all at once.
+ @param			fetchRequest	A fetch request that specifies the search criteria for the fetch. May not be nil.
+ @param			error			If there is a problem executing the fetch, upon return contains an instance of NSError that describes the problem.
+ @param			block			The block to invoke with each object. Set `stop` to YES to end the enumeration early. May not be nil.
+ @result		YES if the fetch could be executed; NO otherwise.
+ @discussion	Rows are read from a single query in batches of the fetch request's fetchBatchSize. Objects
+				that are brought into memory by a batch are destroyed once the batch is done with unless
+				the block retains them, so large tables can be scanned in constant memory.
+				
+				If the fetch request's sort descriptors have to be evaluated in memory, all of the objects
+				are fetched before the enumeration begins.
+ */
+- (BOOL)enumerateObjectsForFetchRequest:(DKFetchRequest *)fetchRequest error:(NSError **)error usingBlock:(void (^)(id object, BOOL *stop))block;
+
+/*!
+ @method
+ @abstract		Execute a fetch request in the background, handing the results to a block when it's done.
+ @param			fetchRequest		A fetch request that specifies the search criteria for the fetch. May not be nil. Should not be changed until the fetch completes.
+ @param			completionHandler	The block to invoke with the fetched objects, or nil and an error if the fetch fails. May not be nil.
+ @result		An operation that can be used to cancel the fetch.
+ @discussion	The fetch is performed on a background queue owned by the receiver, and the completion handler
+				is invoked on the main queue. When the fetch request does not return objects as promises,
+				the objects arrive with their attributes already read.
+				
+				Cancelling the returned operation stops the fetch between rows. The completion handler is
+				always invoked exactly once.
+ */
+- (DKDatabaseOperation *)executeFetchRequest:(DKFetchRequest *)fetchRequest completionHandler:(void (^)(NSArray *objects, NSError *error))completionHandler;
+
 #pragma mark -
 #pragma mark Managed Object Life Cycle
 
@@ -125,28 +325,190 @@
  */
 - (id)insertNewObjectIntoTable:(DKTableDescription *)table error:(NSError **)error;
 
+/*!
+ @method
+ @abstract		Insert a number of new objects into a specified table in one pass, returning the objects.
+ @param			table	The table to insert the new database objects into. May not be nil.
+ @param			count	The number of objects to insert.
+ @param			values	An array of count dictionaries mapping attribute names to initial values. May be nil.
+ @param			error	If the insertion fails, this will contain an error. May be nil.
+ @result		An array of the new database objects in the same order as values if successful; nil otherwise.
+ @discussion	The unique identifiers for all of the new objects are reserved with a single update of the
+				database's sequence, and the rows are written with reused compiled queries inside of one
+				transaction. Initial values are written as part of each row's INSERT. If any row cannot
+				be inserted, none of them are. Naming a column that isn't an attribute of the table is
+				an error, and nothing is written.
+ */
+- (NSArray *)insertNewObjectsIntoTable:(DKTableDescription *)table count:(NSUInteger)count values:(NSArray *)values error:(NSError **)error;
+
 /*!
  @method
  @abstract		Delete a managed object from the receiver.
  @param			object	The managed object to delete. May not be nil.
- @discussion	The managed object passed in should be considered invalid after this method returns
-				and all references should be destroyed.
+ @discussion	The object's prepareForDeletion method is invoked first, deleting the objects at the other ends
+				of its cascading relationships. Every relationship in the layout pointing at the object's row is
+				then nullified, and the row is deleted by its unique identifier inside of one transaction.
+				
+				The managed object passed in is marked as deleted after this method returns. If nothing else
+				is holding on to it, it is destroyed immediately and all references to it should be dropped.
  */
 - (void)deleteObject:(DKManagedObject *)object;
 
+/*!
+ @method
+ @abstract		Delete every object matched by a specified fetch request from the receiver.
+ @param			fetchRequest	The fetch request whose table, filter string, predicate, limit and offset select the rows to delete. May not be nil.
+ @param			error			If the objects cannot be deleted, on return this will contain an error. May be nil.
+ @result		YES if the objects were deleted; NO otherwise.
+ @discussion	The rows are deleted with a handful of set-based statements inside of one transaction. No
+				managed objects are created for them, and prepareForDeletion is not invoked. Relationship
+				delete actions are applied to the whole set: rows at the other end of cascading relationships
+				are deleted too, and every other relationship in the layout pointing at the deleted rows is
+				nullified, whether or not it has an inverse.
+				
+				Managed objects already in memory for deleted rows are marked as deleted and given up by
+				the receiver. Objects that are still retained elsewhere live on until they are released.
+				
+				A fetch request with a limit or offset must have sort descriptors that can be evaluated by SQLite.
+ */
+- (BOOL)deleteObjectsMatchingFetchRequest:(DKFetchRequest *)fetchRequest error:(NSError **)error;
+
+#pragma mark -
+#pragma mark Updating
+
+/*!
+ @method
+ @abstract		Set attributes of every object matched by a specified fetch request with a single UPDATE.
+ @param			fetchRequest	The fetch request whose table, filter string, predicate, limit and offset select the rows to update. May not be nil.
+ @param			values			A dictionary of attribute names to new values. NSNull clears an attribute. May not be nil.
+ @param			error			If the objects cannot be updated, on return this will contain an error. May be nil.
+ @result		YES if the objects were updated; NO otherwise.
+ @discussion	No managed objects are created for the updated rows. The updated attributes are removed from the
+				cache of the updated rows' managed objects already in memory, and are read again when next used.
+				Unsaved changes to the same attributes are kept, and are written by the next save.
+				
+				A fetch request with a limit or offset must have sort descriptors that can be evaluated by SQLite.
+ */
+- (BOOL)updateObjectsMatchingFetchRequest:(DKFetchRequest *)fetchRequest withValues:(NSDictionary *)values error:(NSError **)error;
+
+#pragma mark -
+#pragma mark Saving
+
+/*!
+ @property
+ @abstract		Whether or not changes to managed object attributes are held until the receiver is saved.
+ @discussion	When NO, the default, every attribute change is written to the database immediately.
+				
+				When YES, attribute changes are recorded on their managed objects and written by save:.
+				Each changed object is written with a single UPDATE, and all of them are written in one
+				transaction. Relationship changes are always written immediately.
+ */
+@property BOOL defersChangesUntilSave;
+
+/*!
+ @property
+ @abstract	Whether or not any of the receiver's managed objects have unsaved changes.
+ */
+@property (readonly) BOOL hasChanges;
+
+/*!
+ @method
+ @abstract		Write the unsaved changes of all of the receiver's managed objects to the database.
+ @param			error	If the changes cannot be written, on return this will contain an error. May be nil.
+ @result		YES if the changes were saved; NO otherwise.
+ @discussion	If the receiver is not already in a transaction the changes are written inside of one,
+				and if any of them fail none of them are kept. Changes that fail to save remain unsaved.
+ */
+- (BOOL)save:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Write the unsaved changes of all of the receiver's managed objects to the database in the background.
+ @param			completionHandler	The block to invoke once the changes have been written, or have failed to be. May be nil.
+ @discussion	The changes are written on the receiver's writer queue, and the completion handler is
+				invoked on the main queue. Changes made after this method returns may or may not be
+				included in the save.
+ */
+- (void)saveWithCompletionHandler:(void (^)(BOOL success, NSError *error))completionHandler;
+
 #pragma mark -
 #pragma mark Transactions
 
 /*!
  @method
- @abstract	Begin a transaction in the receiver's SQL connection.
+ @abstract		Begin a transaction in the receiver's SQL connection.
+ @discussion	Transactions may be nested. The outermost transaction is a real SQLite transaction,
+				and the ones inside of it are savepoints which can be rolled back on their own.
  */
 - (void)beginTransaction;
 
 /*!
  @method
- @abstract	Commit the top most transaction in the receiver's SQL connection.
+ @abstract		Commit the top most transaction in the receiver's SQL connection.
+ @discussion	Committing a nested transaction keeps its changes as part of the transaction enclosing it.
  */
 - (void)commitTransaction;
 
+/*!
+ @method
+ @abstract	Discard the changes made in the top most transaction in the receiver's SQL connection.
+ */
+- (void)rollbackTransaction;
+
+/*!
+ @method
+ @abstract		Perform a block inside of a transaction on the receiver's writer queue.
+ @param			block	The block to perform. Return NO from the block to roll the transaction back. May not be nil.
+ @param			error	If the transaction fails or is rolled back, on return this may contain an error. May be nil.
+ @result		YES if the transaction was committed; NO otherwise.
+ @discussion	The block is performed on the receiver's writer queue, and this method does not return until
+				it has finished. Transactions performed inside of the block are nested in this one.
+				
+				If the receiver has a groupCommitInterval, transactions performed from outside of the writer
+				queue become part of a group that is committed with a single SQLite transaction. This method
+				does not return until the group has been committed.
+ */
+- (BOOL)performTransaction:(BOOL (^)(NSError **error))block error:(NSError **)error;
+
+/*!
+ @property
+ @abstract		The number of transactions currently open in the receiver's SQL connection.
+ */
+@property (readonly) NSUInteger transactionDepth;
+
+/*!
+ @property
+ @abstract		How long, in seconds, the receiver collects transactions before committing them as a group.
+ @discussion	The default value is 0, which disables group commit.
+				
+				When greater than zero, the first transaction performed with performTransaction:error: from
+				outside of the writer queue opens a group, and every transaction that arrives within this many
+				seconds joins it. Each transaction in the group is still rolled back on its own if its block
+				fails. The whole group is made durable with one commit, so writers on many threads share the
+				cost of syncing the database to disk rather than paying for it one at a time.
+				
+				Any other write made while a group is open commits the group before it is made, so that its
+				outcome is never reported before it is durable.
+ */
+@property NSTimeInterval groupCommitInterval;
+
+#pragma mark -
+#pragma mark Migration
+
+/*!
+ @method
+ @abstract		Convert the dates stored by older versions of DatabaseKit into the current format.
+ @param			batchSize	The number of rows to convert in each transaction. 0 uses a default.
+ @param			error		If the dates cannot be converted, on return this will contain an error. May be nil.
+ @result		YES if every date that could be converted was; NO otherwise.
+ @discussion	Dates used to be stored as local time text, and are now stored as the number of seconds
+				since 1970. Text dates are still read correctly, but they compare as text in queries so
+				date ranges neither match correctly nor use indexes until they have been converted.
+				
+				Each batch of rows is converted in its own transaction, so other readers and writers are
+				only held up for one batch at a time. Text that cannot be read as a date is left alone.
+				Calling this method on a database that has already been converted does nothing.
+ */
+- (BOOL)migrateLegacyDatesWithBatchSize:(NSUInteger)batchSize error:(NSError **)error;
+
 @end
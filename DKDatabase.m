@@ -11,27 +11,370 @@
 
 #import "DKDatabaseLayout.h"
 #import "DKTableDescription.h"
+#import "DKTableDescriptionPrivate.h"
 
 #import "DKFetchRequest.h"
+#import "DKDatabaseOperation.h"
 
 #import "DKManagedObjectPrivate.h"
 #import "DKManagedObject.h"
 
 #import "DKCompiledSQLQuery.h"
 #import "NSString+Database.h"
+#import "NSPredicate+Database.h"
+#import "NSSortDescriptor+Database.h"
 
 NSString *const kDKDatabaseConfigurationTableName = @"_DKDatabaseConfiguration";
 NSString *const kDKDatabaseSequenceTableName = @"_DKTableSequence";
 NSString *const kDKDatabaseRelationshipDescriptionTableName = @"_DKRelationshipDescription";
 
+NSString *const DKDatabaseObjectsDidChangeNotification = @"DKDatabaseObjectsDidChangeNotification";
+NSString *const DKInsertedUniqueIdentifiersKey = @"DKInsertedUniqueIdentifiersKey";
+NSString *const DKUpdatedUniqueIdentifiersKey = @"DKUpdatedUniqueIdentifiersKey";
+NSString *const DKDeletedUniqueIdentifiersKey = @"DKDeletedUniqueIdentifiersKey";
+NSString *const DKChangedTableNamesKey = @"DKChangedTableNamesKey";
+
+///The temporary table the unique identifiers of rows being deleted are collected in.
+static NSString *const kDKDatabaseDeletionTableName = @"_dk_deletion";
+
+static NSUInteger const kDKDatabaseDefaultCompiledQueryCacheLimit = 64;
+static NSUInteger const kDKDatabaseDefaultFetchBatchSize = 100;
+static NSUInteger const kDKDatabaseDefaultMigrationBatchSize = 1000;
+static NSUInteger const kDKDatabasePrefetchBatchSize = 500;
+static NSUInteger const kDKDatabaseChangeLookupBatchSize = 500;
+static NSUInteger const kDKDatabaseChangeLookupLimit = 5000;
+
+static const char *const kDKDatabaseWriterQueueLabel = "com.roundabout.DatabaseKit.writer";
+static const char *const kDKDatabaseBackgroundQueueLabel = "com.roundabout.DatabaseKit.background";
+
+#pragma mark Managed Object Map
+
+/*!
+ @typedef
+ @abstract	The key used to identify managed objects in a database's managed object map.
+ @field		table				The table the object belongs to. Table descriptions are unique within a layout.
+ @field		uniqueIdentifier	The unique identifier of the object within its table.
+ */
+typedef struct _DKManagedObjectKey {
+	DKTableDescription *table;
+	int64_t uniqueIdentifier;
+} DKManagedObjectKey;
+
+static NSUInteger DKManagedObjectKeyHash(NSMapTable *table, const void *rawKey)
+{
+	const DKManagedObjectKey *key = rawKey;
+	
+	//
+	//	Unique identifiers are sequential so we mix them with the table's
+	//	address, which has its low bits stripped of alignment zeros.
+	//
+	uint64_t hash = ((uint64_t)key->uniqueIdentifier * 0x9E3779B97F4A7C15ULL) ^ ((uintptr_t)key->table >> 4);
+	return (NSUInteger)(hash ^ (hash >> 32));
+}
+
+static BOOL DKManagedObjectKeyIsEqual(NSMapTable *table, const void *rawLeftKey, const void *rawRightKey)
+{
+	const DKManagedObjectKey *leftKey = rawLeftKey;
+	const DKManagedObjectKey *rightKey = rawRightKey;
+	
+	return (leftKey->uniqueIdentifier == rightKey->uniqueIdentifier) && (leftKey->table == rightKey->table);
+}
+
+static void DKManagedObjectKeyRelease(NSMapTable *table, void *rawKey)
+{
+	free(rawKey);
+}
+
+static NSString *DKManagedObjectKeyDescribe(NSMapTable *table, const void *rawKey)
+{
+	const DKManagedObjectKey *key = rawKey;
+	return [NSString stringWithFormat:@"(%@, %lld)", key->table.name, key->uniqueIdentifier];
+}
+
+static const NSMapTableKeyCallBacks DKManagedObjectKeyCallBacks = {
+	&DKManagedObjectKeyHash,
+	&DKManagedObjectKeyIsEqual,
+	NULL,
+	&DKManagedObjectKeyRelease,
+	&DKManagedObjectKeyDescribe,
+	NULL,
+};
+
+DK_INLINE DKManagedObjectStripe *DKDatabaseStripeForKey(DKDatabase *database, const DKManagedObjectKey *key)
+{
+	return &database->mManagedObjectStripes[DKManagedObjectKeyHash(NULL, key) % DK_MANAGED_OBJECT_STRIPE_COUNT];
+}
+
+///Give up the reference a database holds on a managed object. The object's stripe must be locked.
+static BOOL DKDatabaseDisownObject(DKDatabase *self, DKManagedObject *databaseObject)
+{
+	if(!databaseObject->_dk_mIsOwnedByDatabase)
+		return NO;
+	
+	databaseObject->_dk_mIsOwnedByDatabase = NO;
+	OSAtomicDecrement32Barrier(&self->mNumberOfManagedObjects);
+	
+	return YES;
+}
+
+///Release the reference a database held on a managed object it has disowned. Must be called with no stripe locked.
+static void DKDatabaseReleaseDisownedObject(DKDatabase *self, DKManagedObject *databaseObject)
+{
+#if __OBJC_GC__
+	//
+	//	We disable collection for objects managed by DKDatabase so we have control over their life cycle.
+	//	Here we re-enable it so that it will be destroyed on the next collection cycle.
+	//
+	[[NSGarbageCollector defaultCollector] enableCollectorForPointer:databaseObject];
+#else
+	//
+	//	If this is the last reference, the object takes itself out of the map on its way
+	//	out, which takes the stripe's lock. Otherwise it lives on until its owners let go.
+	//
+	[databaseObject release];
+#endif /* __OBJC_GC__ */
+}
+
+///Returns the number of managed objects a database holds a reference to.
+DK_INLINE NSUInteger DKDatabaseNumberOfOwnedObjects(DKDatabase *self)
+{
+	return (NSUInteger)OSAtomicAdd32Barrier(0, &self->mNumberOfManagedObjects);
+}
+
+#pragma mark -
+#pragma mark SQL Table Names
+
+//
+//	The update hook is handed the name of a changed table as a C string. We look
+//	tables up by it directly so that noting a change doesn't create an NSString.
+//
+
+static NSUInteger DKSQLTableNameHash(NSMapTable *table, const void *rawKey)
+{
+	//FNV-1a.
+	NSUInteger hash = 2166136261U;
+	for (const unsigned char *character = rawKey; *character; character++)
+		hash = (hash ^ *character) * 16777619U;
+	
+	return hash;
+}
+
+static BOOL DKSQLTableNameIsEqual(NSMapTable *table, const void *rawLeftKey, const void *rawRightKey)
+{
+	return (strcmp(rawLeftKey, rawRightKey) == 0);
+}
+
+static void DKSQLTableNameRelease(NSMapTable *table, void *rawKey)
+{
+	free(rawKey);
+}
+
+static NSString *DKSQLTableNameDescribe(NSMapTable *table, const void *rawKey)
+{
+	return [NSString stringWithUTF8String:rawKey];
+}
+
+static const NSMapTableKeyCallBacks DKSQLTableNameCallBacks = {
+	&DKSQLTableNameHash,
+	&DKSQLTableNameIsEqual,
+	NULL,
+	&DKSQLTableNameRelease,
+	&DKSQLTableNameDescribe,
+	NULL,
+};
+
+///Returns the name of the table whose rows a relationship's value is read from.
+static NSString *DKRelationshipStorageTableName(DKRelationshipDescription *relationship)
+{
+	if([relationship usesJoinTable])
+		return [relationship joinTableName];
+	
+	//One-to-one relationships are a column of their own table, and the rest are their inverse's column.
+	if(relationship.relationshipType == kDKRelationshipTypeOneToOne)
+		return relationship.table.name;
+	
+	return relationship.targetTable.name;
+}
+
+#pragma mark -
+#pragma mark Change Hooks
+
+//
+//	These are invoked by SQLite in the middle of evaluating a statement on the write connection,
+//	so they may not touch the connection themselves. They only note what changed, and leave the
+//	work of bringing managed objects up to date to processCommittedChanges.
+//
+
+static void DKDatabaseUpdateHook(void *context, int operation, const char *databaseName, const char *tableName, sqlite3_int64 rowIdentifier)
+{
+	//Temporary tables are our own bookkeeping.
+	if(strcmp(databaseName, "main") != 0)
+		return;
+	
+	DKDatabase *self = (DKDatabase *)context;
+	if(!self->mUncommittedChanges)
+		self->mUncommittedChanges = [DKDatabaseChangeSet new];
+	
+	DKTableDescription *table = NSMapGet(self->mTablesBySQLName, tableName);
+	
+	//A managed object writing its own row already has the values it wrote cached, and only writes attributes.
+	DKManagedObject *writeThroughObject = self->mWriteThroughObject;
+	if(writeThroughObject && (operation == SQLITE_UPDATE) && (table == writeThroughObject.tableDescription))
+	{
+		[self->mUncommittedChanges noteWriteThroughOfDatabaseObject:writeThroughObject];
+		return;
+	}
+	
+	[self->mUncommittedChanges noteOperation:operation onRowWithIdentifier:rowIdentifier inTable:table];
+	
+	//
+	//	Relationships stored in the table are invalidated right away for the writer's sake, and
+	//	again once the change is committed for the sake of anyone reading from another connection.
+	//
+	NSUInteger generationIndex = (NSUInteger)NSMapGet(self->mRelationshipGenerationIndexesBySQLName, tableName);
+	if(generationIndex != 0)
+	{
+		OSAtomicIncrement32Barrier(&self->mRelationshipGenerations[generationIndex]);
+		[self->mUncommittedChanges noteChangeToRelationshipGenerationAtIndex:generationIndex];
+	}
+}
+
+///Queue a change set to be processed on the writer queue.
+static void DKDatabaseEnqueueChanges(DKDatabase *self, DKDatabaseChangeSet *changes)
+{
+	@synchronized(self->mCommittedChanges)
+	{
+		[self->mCommittedChanges addObject:changes];
+	}
+	
+	//
+	//	Writers that went through performWriterBlock:error: have their changes processed before it returns,
+	//	so by the time this runs there is usually nothing left to do. Everyone else is taken care of here.
+	//
+	dispatch_async(self->mWriterQueue, [self writerQueueBlockWithBlock:^{
+		NSAutoreleasePool *pool = [NSAutoreleasePool new];
+		
+		[self processCommittedChanges];
+		
+		[pool drain];
+	}]);
+}
+
+static int DKDatabaseCommitHook(void *context)
+{
+	DKDatabase *self = (DKDatabase *)context;
+	if(self->mUncommittedChanges)
+	{
+		DKDatabaseEnqueueChanges(self, self->mUncommittedChanges);
+		
+		[self->mUncommittedChanges release];
+		self->mUncommittedChanges = nil;
+	}
+	
+	//Returning non-zero would turn the commit into a rollback.
+	return 0;
+}
+
+static void DKDatabaseRollbackHook(void *context)
+{
+	DKDatabase *self = (DKDatabase *)context;
+	
+	//
+	//	Nothing was committed, but objects may have cached values that were read
+	//	or written inside of the transaction. Every savepoint is gone along with it.
+	//
+	for (id savepointChanges in self->mSavepointChanges)
+	{
+		if(savepointChanges == [NSNull null])
+			continue;
+		
+		if(!self->mUncommittedChanges)
+			self->mUncommittedChanges = [DKDatabaseChangeSet new];
+		[self->mUncommittedChanges addChangesFromChangeSet:savepointChanges];
+	}
+	[self->mSavepointChanges removeAllObjects];
+	
+	if(!self->mUncommittedChanges)
+		return;
+	
+	[self invalidateRelationshipCachesForChanges:self->mUncommittedChanges];
+	
+	self->mUncommittedChanges.isRolledBack = YES;
+	DKDatabaseEnqueueChanges(self, self->mUncommittedChanges);
+	
+	[self->mUncommittedChanges release];
+	self->mUncommittedChanges = nil;
+}
+
+#pragma mark -
+#pragma mark Reader Connections
+
+//
+//	Each thread keeps its reader connections in a dictionary of its own, keyed by a number
+//	unique to each database. There is one thread-specific key shared by every database, so
+//	that databases coming and going never have to delete a key out from under threads that
+//	are still holding on to connections.
+//
+
+static pthread_key_t DKDatabaseReaderConnectionsKey;
+static pthread_once_t DKDatabaseReaderConnectionsKeyOnce = PTHREAD_ONCE_INIT;
+static volatile int32_t DKDatabaseLastReaderConnectionKey = 0;
+
+///Invoked when a thread holding reader connections exits.
+static void DKDatabaseReaderConnectionsThreadDidExit(void *value)
+{
+	CFMutableDictionaryRef threadReaderConnections = (CFMutableDictionaryRef)value;
+	
+	CFIndex count = CFDictionaryGetCount(threadReaderConnections);
+	const void **readerConnections = malloc(sizeof(void *) * count);
+	CFDictionaryGetKeysAndValues(threadReaderConnections, NULL, readerConnections);
+	for (CFIndex index = 0; index < count; index++)
+		[(DKDatabaseReaderConnection *)readerConnections[index] relinquish];
+	free(readerConnections);
+	
+	CFRelease(threadReaderConnections);
+}
+
+static void DKDatabaseCreateReaderConnectionsKey(void)
+{
+	pthread_key_create(&DKDatabaseReaderConnectionsKey, &DKDatabaseReaderConnectionsThreadDidExit);
+}
+
 @implementation DKDatabase
 
 #pragma mark Destruction
 
 - (void)cleanUp
 {
+	//
+	//	Reader connections may still be claimed by running threads, but they're
+	//	useless once we're gone so we close them all now. Threads that outlive
+	//	us are left holding closed connections which are freed when they exit,
+	//	or when they next open a connection for another database.
+	//
+	if(mReaderConnections)
+	{
+		mUsesConcurrentReads = NO;
+		
+		[mReaderConnections makeObjectsPerformSelector:@selector(close)];
+		[mReaderConnections release];
+		mReaderConnections = nil;
+		
+		CFMutableDictionaryRef threadReaderConnections = pthread_getspecific(DKDatabaseReaderConnectionsKey);
+		if(threadReaderConnections)
+			CFDictionaryRemoveValue(threadReaderConnections, (const void *)mReaderConnectionKey);
+	}
+	
 	if(mSQLiteConnection)
 	{
+		//Nothing that happens from here on out is a change anyone is waiting to hear about.
+		sqlite3_update_hook(mSQLiteConnection, NULL, NULL);
+		sqlite3_commit_hook(mSQLiteConnection, NULL, NULL);
+		sqlite3_rollback_hook(mSQLiteConnection, NULL, NULL);
+		
+		//Finalize the cached statements first so their owners know they're gone.
+		[mCompiledQueryCache removeAllQueries];
+		
 		//Finalize any active statements.
 		sqlite3_stmt *activeStatement = NULL;
 		while ((activeStatement = sqlite3_next_stmt(mSQLiteConnection, 0)))
@@ -43,20 +386,101 @@ NSString *const kDKDatabaseRelationshipDescriptionTableName = @"_DKRelationshipD
 		sqlite3_close(mSQLiteConnection);
 		mSQLiteConnection = NULL;
 	}
+	
+	if(mWriterQueue)
+	{
+		dispatch_release(mWriterQueue);
+		mWriterQueue = NULL;
+	}
+	
+	if(mBackgroundQueue)
+	{
+		dispatch_release(mBackgroundQueue);
+		mBackgroundQueue = NULL;
+	}
 }
 
 - (void)dealloc
 {
 	[self cleanUp];
 	
+	[mCompiledQueryCache release];
+	mCompiledQueryCache = nil;
+	
 	[mDatabaseLayout release];
 	mDatabaseLayout = nil;
 	
 	[mLocation release];
 	mLocation = nil;
 	
-	NSFreeMapTable(mManagedObjects);
-	mManagedObjects = nil;
+	[mObjectsWithChanges release];
+	mObjectsWithChanges = nil;
+	
+	[mObjectsBeingDeleted release];
+	mObjectsBeingDeleted = nil;
+	
+	[mGroupCommitWaiters release];
+	mGroupCommitWaiters = nil;
+	
+	[mUncommittedChanges release];
+	mUncommittedChanges = nil;
+	
+	[mSavepointChanges release];
+	mSavepointChanges = nil;
+	
+	[mCommittedChanges release];
+	mCommittedChanges = nil;
+	
+	if(mTablesBySQLName)
+		NSFreeMapTable(mTablesBySQLName);
+	mTablesBySQLName = nil;
+	
+	if(mRelationshipGenerationIndexes)
+		NSFreeMapTable(mRelationshipGenerationIndexes);
+	mRelationshipGenerationIndexes = nil;
+	
+	if(mRelationshipGenerationIndexesBySQLName)
+		NSFreeMapTable(mRelationshipGenerationIndexesBySQLName);
+	mRelationshipGenerationIndexesBySQLName = nil;
+	
+	if(mRelationshipGenerations)
+		free((void *)mRelationshipGenerations);
+	mRelationshipGenerations = NULL;
+	
+	if(mManagedObjectStripes)
+	{
+		for (NSUInteger index = 0; index < DK_MANAGED_OBJECT_STRIPE_COUNT; index++)
+		{
+			DKManagedObjectStripe *stripe = &mManagedObjectStripes[index];
+			if(!stripe->objects)
+				continue;
+			
+			//
+			//	Objects that outlive us can't reach back into a map that's about to go
+			//	away, so we cut them loose before giving up our references to them.
+			//
+			NSMutableArray *ownedObjects = [NSMutableArray array];
+			NSMapEnumerator enumerator = NSEnumerateMapTable(stripe->objects);
+			DKManagedObjectKey *key = NULL;
+			DKManagedObject *databaseObject = nil;
+			while (NSNextMapEnumeratorPair(&enumerator, (void **)&key, (void **)&databaseObject))
+			{
+				databaseObject->_dk_mDatabase = nil;
+				if(DKDatabaseDisownObject(self, databaseObject))
+					[ownedObjects addObject:databaseObject];
+			}
+			NSEndMapTableEnumeration(&enumerator);
+			
+			NSFreeMapTable(stripe->objects);
+			stripe->objects = nil;
+			
+			for (DKManagedObject *ownedObject in ownedObjects)
+				DKDatabaseReleaseDisownedObject(self, ownedObject);
+		}
+		
+		free(mManagedObjectStripes);
+		mManagedObjectStripes = NULL;
+	}
 	
 	[super dealloc];
 }
@@ -78,6 +502,11 @@ NSString *const kDKDatabaseRelationshipDescriptionTableName = @"_DKRelationshipD
 }
 
 - (id)initWithDatabaseAtURL:(NSURL *)location layout:(id < DKDatabaseLayout >)layout error:(NSError **)error
+{
+	return [self initWithDatabaseAtURL:location layout:layout options:kDKDatabaseOptionNone error:error];
+}
+
+- (id)initWithDatabaseAtURL:(NSURL *)location layout:(id < DKDatabaseLayout >)layout options:(DKDatabaseOptions)options error:(NSError **)error
 {
 	NSParameterAssert(layout);
 	if(location)
@@ -85,19 +514,12 @@ NSString *const kDKDatabaseRelationshipDescriptionTableName = @"_DKRelationshipD
 	
 	if((self = [super init]))
 	{
+		mLocation = [location retain];
+		
 		SQLiteStatus status = SQLITE_OK;
 		if(location)
 		{
-			NSString *path = [location path];
-			
-			//
-			//	If the path has a : prefix, we prepend ./ to it so that
-			//	it doesn't end up invoking a special function in sqlite.
-			//
-			if([path hasPrefix:@":"])
-				path = [@"./" stringByAppendingString:path];
-			
-			status = sqlite3_open([path fileSystemRepresentation], &mSQLiteConnection);
+			status = sqlite3_open([[self databasePath] fileSystemRepresentation], &mSQLiteConnection);
 		}
 		else
 		{
@@ -117,6 +539,35 @@ NSString *const kDKDatabaseRelationshipDescriptionTableName = @"_DKRelationshipD
 			return nil;
 		}
 		
+		mCompiledQueryCache = [[DKCompiledSQLQueryCache alloc] initWithDatabase:self limit:kDKDatabaseDefaultCompiledQueryCacheLimit];
+		mObjectsWithChanges = [NSMutableSet new];
+		mObjectsBeingDeleted = [NSMutableArray new];
+		
+		//
+		//	Every write goes through this queue so that writes made from
+		//	different threads never interleave on the write connection.
+		//
+		mWriterQueue = dispatch_queue_create(kDKDatabaseWriterQueueLabel, NULL);
+		
+		//Asynchronous fetches are performed on this queue.
+		mBackgroundQueue = dispatch_queue_create(kDKDatabaseBackgroundQueueLabel, NULL);
+		
+		//
+		//	Managed objects are spread over several independently locked maps
+		//	so that threads faulting in objects don't all contend on one lock.
+		//	The maps don't retain their values, we own them outright.
+		//
+#if __OBJC_GC__
+		mManagedObjectStripes = NSAllocateCollectable(sizeof(DKManagedObjectStripe) * DK_MANAGED_OBJECT_STRIPE_COUNT, NSScannedOption);
+#else
+		mManagedObjectStripes = calloc(DK_MANAGED_OBJECT_STRIPE_COUNT, sizeof(DKManagedObjectStripe));
+#endif /* __OBJC_GC__ */
+		for (NSUInteger index = 0; index < DK_MANAGED_OBJECT_STRIPE_COUNT; index++)
+		{
+			mManagedObjectStripes[index].lock = OS_SPINLOCK_INIT;
+			mManagedObjectStripes[index].objects = NSCreateMapTable(DKManagedObjectKeyCallBacks, NSNonRetainedObjectMapValueCallBacks, 0);
+		}
+		
 		if(![self ensureDatabaseIsUsingLayout:layout error:error])
 		{
 			[self release];
@@ -125,9 +576,59 @@ NSString *const kDKDatabaseRelationshipDescriptionTableName = @"_DKRelationshipD
 		}
 		
 		mDatabaseLayout = [layout retain];
-		mLocation = [location retain];
 		
-		mManagedObjects = NSCreateMapTable(NSIntegerMapKeyCallBacks, NSObjectMapValueCallBacks, 0);
+		//
+		//	From here on, every row changed through the write connection is noted so that
+		//	the managed objects of changed rows can be brought up to date once it commits.
+		//
+		mTablesBySQLName = NSCreateMapTable(DKSQLTableNameCallBacks, NSNonRetainedObjectMapValueCallBacks, 0);
+		for (DKTableDescription *table in [layout tables])
+			NSMapInsert(mTablesBySQLName, strdup([[table.name stringByEscapingStringForLiteralUseInSQLQueries] UTF8String]), table);
+		
+		//
+		//	Each relationship is stored in one table: its own, its target's, or a join table. Cached
+		//	relationships are invalidated by a generation kept for each of those tables, so a change
+		//	to one table leaves the relationships stored everywhere else alone.
+		//
+		mRelationshipGenerationIndexes = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSIntegerMapValueCallBacks, 0);
+		mRelationshipGenerationIndexesBySQLName = NSCreateMapTable(DKSQLTableNameCallBacks, NSIntegerMapValueCallBacks, 0);
+		for (DKTableDescription *table in [layout tables])
+		{
+			for (DKRelationshipDescription *relationship in table.properties)
+			{
+				if(![relationship isKindOfClass:[DKRelationshipDescription class]])
+					continue;
+				
+				NSString *storageTableName = DKRelationshipStorageTableName(relationship);
+				const char *escapedStorageTableName = [[storageTableName stringByEscapingStringForLiteralUseInSQLQueries] UTF8String];
+				
+				//Indexes are stored off by one so that a missing table can be told apart from the first.
+				NSUInteger generationIndex = (NSUInteger)NSMapGet(mRelationshipGenerationIndexesBySQLName, escapedStorageTableName);
+				if(generationIndex == 0)
+				{
+					generationIndex = NSCountMapTable(mRelationshipGenerationIndexesBySQLName) + 1;
+					NSMapInsertKnownAbsent(mRelationshipGenerationIndexesBySQLName, strdup(escapedStorageTableName), (void *)generationIndex);
+				}
+				
+				NSMapInsertKnownAbsent(mRelationshipGenerationIndexes, relationship, (void *)generationIndex);
+			}
+		}
+		mRelationshipGenerations = calloc(NSCountMapTable(mRelationshipGenerationIndexesBySQLName) + 1, sizeof(int32_t));
+		
+		mCommittedChanges = [NSMutableArray new];
+		mSavepointChanges = [NSMutableArray new];
+		
+		sqlite3_update_hook(mSQLiteConnection, &DKDatabaseUpdateHook, self);
+		sqlite3_commit_hook(mSQLiteConnection, &DKDatabaseCommitHook, self);
+		sqlite3_rollback_hook(mSQLiteConnection, &DKDatabaseRollbackHook, self);
+		
+		//
+		//	Concurrent reads are turned on last so that the reader connections
+		//	never see the database before its layout is in place. Transient
+		//	databases can't be shared between connections.
+		//
+		if((options & kDKDatabaseOptionConcurrentReads) && location)
+			[self enableConcurrentReads];
 		
 		return self;
 	}
@@ -139,6 +640,21 @@ NSString *const kDKDatabaseRelationshipDescriptionTableName = @"_DKRelationshipD
 
 @synthesize sqliteConnection = mSQLiteConnection;
 @synthesize location = mLocation;
+@synthesize usesConcurrentReads = mUsesConcurrentReads;
+
+- (NSString *)databasePath
+{
+	NSString *path = [mLocation path];
+	
+	//
+	//	If the path has a : prefix, we prepend ./ to it so that
+	//	it doesn't end up invoking a special function in sqlite.
+	//
+	if([path hasPrefix:@":"])
+		path = [@"./" stringByAppendingString:path];
+	
+	return path;
+}
 
 #pragma mark -
 
@@ -161,7 +677,10 @@ NSString *const kDKDatabaseRelationshipDescriptionTableName = @"_DKRelationshipD
 	NSAssert((selectDatabaseVersionQuery && [selectDatabaseVersionQuery nextRow]),
 			 @"Could not find database version. Got error %@.", error);
 	
-	return [selectDatabaseVersionQuery doubleForColumnAtIndex:0];
+	version = [selectDatabaseVersionQuery doubleForColumnAtIndex:0];
+	[selectDatabaseVersionQuery reset];
+	
+	return version;
 }
 
 #pragma mark -
@@ -169,353 +688,3416 @@ NSString *const kDKDatabaseRelationshipDescriptionTableName = @"_DKRelationshipD
 
 - (NSString *)description
 {
-	return [NSString stringWithFormat:@"<%@:%p (%ld objects active)>", [self className], self, NSCountMapTable(mManagedObjects)];
+	return [NSString stringWithFormat:@"<%@:%p (%ld objects active)>", [self className], self, [self numberOfManagedObjects]];
 }
 
 #pragma mark -
-#pragma mark Cache
+#pragma mark Connections
 
-- (id)databaseObjectInTable:(DKTableDescription *)table withUniqueIdentifier:(int64_t)uniqueIdentifier
+- (BOOL)enableConcurrentReads
 {
-	@synchronized(self)
-	{
+	//
+	//	Readers can only run alongside the writer in write-ahead logging mode.
+	//	SQLite answers with the journal mode it actually ended up in, which
+	//	won't be WAL if it is too old or the file system can't support it.
+	//
+	NSError *error = nil;
+	DKCompiledSQLQuery *journalModeQuery = [self compileSQLQuery:dk_stringify_sql(PRAGMA journal_mode = WAL) error:&error];
+	if(!journalModeQuery)
+		return NO;
+	
+	BOOL isUsingWriteAheadLog = ([journalModeQuery nextRow] && 
+								 ([[journalModeQuery stringForColumnAtIndex:0] caseInsensitiveCompare:@"wal"] == NSOrderedSame));
+	[journalModeQuery reset];
+	
+	if(!isUsingWriteAheadLog)
+		return NO;
+	
+	pthread_once(&DKDatabaseReaderConnectionsKeyOnce, &DKDatabaseCreateReaderConnectionsKey);
+	mReaderConnectionKey = OSAtomicIncrement32Barrier(&DKDatabaseLastReaderConnectionKey);
+	
+	mReaderConnections = [NSMutableArray new];
+	mUsesConcurrentReads = YES;
+	
+	return YES;
+}
+
+- (BOOL)isOnWriterQueue
+{
+	//
+	//	Only the thread running a writer block ever sets this to itself, and it puts
+	//	back what was there before when it's done, so no other thread can see its own
+	//	identity here unless it really is running one of our writer blocks.
+	//
+	return (mWriterThread == (void *)pthread_self());
+}
+
+- (dispatch_block_t)writerQueueBlockWithBlock:(dispatch_block_t)block
+{
+	NSParameterAssert(block);
+	
+	return [[^{
+		void *previousWriterThread = mWriterThread;
+		mWriterThread = (void *)pthread_self();
+		
+		block();
+		
 		//
-		//	If an existing object already exists, we use it.
-		//	If one doesn't exist we create a new one and cache it.
+		//	A group that came due while a transaction was open is committed as soon
+		//	as the outermost transaction is over, instead of waiting another interval.
 		//
-		id databaseObject = nil;//NSMapGet(mManagedObjects, (const void *)uniqueIdentifier);
-		
-		if(!databaseObject)
+		if(mGroupCommitIsDue && (mTransactionDepth == 0))
 		{
-			databaseObject = [[table.databaseObjectClass alloc] initWithUniqueIdentifier:uniqueIdentifier table:table database:self];
-			
-			//
-			//	Note the address of the database object. We own this object (its our slave)
-			//	and we need to be able to destroy it later when we no longer have a use for it.
-			//
-#if __OBJC_GC__
-			[[NSGarbageCollector defaultCollector] disableCollectorForPointer:databaseObject];
-#endif /* __OBJC_GC__ */
-			NSMapInsert(mManagedObjects, (const void *)uniqueIdentifier, databaseObject);
+			NSAutoreleasePool *pool = [NSAutoreleasePool new];
+			[self commitGroup];
+			[pool drain];
 		}
 		
-		return databaseObject;
-	}
+		mWriterThread = previousWriterThread;
+	} copy] autorelease];
 }
 
-#pragma mark -
-#pragma mark Fetching
+- (BOOL)performWriterBlock:(BOOL (^)(NSError **error))block error:(NSError **)error
+{
+	return [self performWriterBlock:block joiningGroup:NO error:error];
+}
 
-- (NSSet *)fetchObjectsInTable:(DKTableDescription *)table matchingQuery:(NSString *)query returnsObjectsAsPromises:(BOOL)returnsObjectsAsPromises error:(NSError **)error
+- (BOOL)performWriterBlock:(BOOL (^)(NSError **error))block joiningGroup:(BOOL)joinsGroup error:(NSError **)error
 {
-	NSParameterAssert(table);
-	
-	NSString *escapedTableName = [table.name stringByEscapingStringForLiteralUseInSQLQueries];
-	
-	//
-	//	We create an SQL SELECT query based on the passed in partial query.
-	//	If there is no partial query, we just select everything thats in
-	//	`table` indiscriminately like a common whore.
-	//
-	NSString *selectQueryString = nil;
-	if(query)
-		selectQueryString = dk_string_from_format(
-			dk_stringify_sql(
-				SELECT _dk_uniqueIdentifier FROM %@ WHERE %@
-			),
-			escapedTableName, query
-		);
-	else
-		selectQueryString = dk_string_from_format(
-			dk_stringify_sql(
-				SELECT _dk_uniqueIdentifier FROM %@
-			),
-			escapedTableName
-		);
-	
-	//Execute the select query.
-	DKCompiledSQLQuery *selectQuery = [self compileSQLQuery:selectQueryString error:error];
-	if(!selectQuery)
-		return nil;
-	
-	//
-	//	We need to verify that the database-object-class the table specifies
-	//	inherits from DKManagedObject. If it doesn't then we have a problem.
-	//
-	Class databaseObjectClass = table.databaseObjectClass;
-	NSAssert(((databaseObjectClass == [DKManagedObject class]) || [databaseObjectClass isSubclassOfClass:[DKManagedObject class]]), 
-			 @"Database object class %@ does not inherit DKManagedObject. You fail at life.", NSStringFromClass(databaseObjectClass));
+	NSParameterAssert(block);
 	
+	if([self isOnWriterQueue])
+		return block(error);
 	
 	//
-	//	We enumerate all of the rows returned by the select query
-	//	and create a database-object for each given unique identifier.
+	//	The block runs inside of its own autorelease pool on the writer
+	//	queue, so the error has to be kept alive on its way back to us.
 	//
-	NSMutableSet *objects = [NSMutableSet set];
-	while ([selectQuery nextRow])
-	{
-		int64_t uniqueIdentifier = [selectQuery longLongForColumnAtIndex:0];
-		id databaseObject = [self databaseObjectInTable:table withUniqueIdentifier:uniqueIdentifier];
+	__block BOOL success = NO;
+	__block NSError *writerError = nil;
+	dispatch_sync(mWriterQueue, [self writerQueueBlockWithBlock:^{
+		NSAutoreleasePool *pool = [NSAutoreleasePool new];
 		
 		//
-		//	If we've been asked to fulfill promises immediately then we
-		//	tell each database object to cache all of their columns.
+		//	Anything written while a group is open would be committed with it, long
+		//	after we told the writer it had succeeded. Writers that aren't waiting on
+		//	the group get it committed first so that their own outcome is the real one.
 		//
-		if(!returnsObjectsAsPromises)
-			[databaseObject cacheAllColumnsInTable];
+		if(!joinsGroup)
+			[self commitGroup];
 		
-		[objects addObject:databaseObject];
-	}
+		//Changes committed outside of a transaction are looked up by row identifier before anything can reuse them.
+		[self processCommittedChanges];
+		
+		success = block(&writerError);
+		[writerError retain];
+		
+		//Whatever the block committed is reflected in our objects by the time we return.
+		[self processCommittedChanges];
+		
+		[pool drain];
+	}]);
 	
-	return objects;
+	[writerError autorelease];
+	if(!success && error)
+		*error = writerError;
+	
+	return success;
 }
 
-- (NSArray *)executeFetchRequest:(DKFetchRequest *)fetchRequest error:(NSError **)error
+- (DKDatabaseReaderConnection *)readerConnectionForCurrentThreadAndReturnError:(NSError **)error
 {
-	NSParameterAssert(fetchRequest);
+	NSAssert(mUsesConcurrentReads, @"Attempting to look up a reader connection for a database without concurrent reads.");
 	
-	NSSet *objects = [self fetchObjectsInTable:fetchRequest.table 
-								 matchingQuery:fetchRequest.filterString 
-					  returnsObjectsAsPromises:fetchRequest.returnsObjectsAsPromises 
-										 error:error];
-	if(objects)
+	CFMutableDictionaryRef threadReaderConnections = pthread_getspecific(DKDatabaseReaderConnectionsKey);
+	DKDatabaseReaderConnection *readerConnection = nil;
+	if(threadReaderConnections)
+		readerConnection = (DKDatabaseReaderConnection *)CFDictionaryGetValue(threadReaderConnections, (const void *)mReaderConnectionKey);
+	
+	if(readerConnection)
+		return readerConnection;
+	
+	//
+	//	We hand out connections relinquished by threads that have exited
+	//	before we open any new ones. GCD reuses its worker threads, so in
+	//	practice the pool levels off at the number of threads reading.
+	//
+	@synchronized(mReaderConnections)
 	{
-		NSArray *sortDescriptors = fetchRequest.sortDescriptors;
-		if(sortDescriptors)
-			return [objects sortedArrayUsingDescriptors:sortDescriptors];
+		for (DKDatabaseReaderConnection *existingReaderConnection in mReaderConnections)
+		{
+			if([existingReaderConnection claim])
+			{
+				readerConnection = existingReaderConnection;
+				break;
+			}
+		}
 		
-		return [objects allObjects];
+		if(!readerConnection)
+		{
+			readerConnection = [[[DKDatabaseReaderConnection alloc] initWithPath:[self databasePath] 
+																		database:self 
+														 compiledQueryCacheLimit:mCompiledQueryCache.limit 
+																		   error:error] autorelease];
+			if(!readerConnection)
+				return nil;
+			
+			[readerConnection claim];
+			[mReaderConnections addObject:readerConnection];
+		}
 	}
-	return nil;
+	
+	//
+	//	The thread holds on to its connection until it exits. While we're here, we
+	//	let go of any connections it's still holding for databases that are gone.
+	//
+	if(!threadReaderConnections)
+	{
+		threadReaderConnections = CFDictionaryCreateMutable(NULL, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+		pthread_setspecific(DKDatabaseReaderConnectionsKey, threadReaderConnections);
+	}
+	else
+	{
+		CFIndex count = CFDictionaryGetCount(threadReaderConnections);
+		const void **connectionKeys = malloc(sizeof(void *) * count);
+		const void **threadConnections = malloc(sizeof(void *) * count);
+		CFDictionaryGetKeysAndValues(threadReaderConnections, connectionKeys, threadConnections);
+		for (CFIndex index = 0; index < count; index++)
+		{
+			if(!((DKDatabaseReaderConnection *)threadConnections[index]).sqliteConnection)
+				CFDictionaryRemoveValue(threadReaderConnections, connectionKeys[index]);
+		}
+		free(connectionKeys);
+		free(threadConnections);
+	}
+	
+	CFDictionarySetValue(threadReaderConnections, (const void *)mReaderConnectionKey, readerConnection);
+	
+	return readerConnection;
 }
 
 #pragma mark -
-#pragma mark Inserting
+#pragma mark Cache
 
-- (id)insertNewObjectIntoTable:(DKTableDescription *)table error:(NSError **)error
+- (id)existingDatabaseObjectInTable:(DKTableDescription *)table withUniqueIdentifier:(int64_t)uniqueIdentifier
 {
 	NSParameterAssert(table);
 	
-	NSError *transientError = nil;
-	
-	//The table name could very well contain single quotes so we escape it.
-	NSString *escapedTableName = [table.name stringByEscapingStringForLiteralUseInSQLQueries];
+	DKManagedObjectKey key = { table, uniqueIdentifier };
+	DKManagedObjectStripe *stripe = DKDatabaseStripeForKey(self, &key);
 	
 	//
-	//	First things first, we need to fetch the last unique identifier from
-	//	the database's internal sequence table. We use this to calculate the new
-	//	unique identifier for the object we're about to insert.
+	//	The object is retained while the stripe is locked so that it
+	//	can't be discarded by another thread before the caller is done.
 	//
-	NSString *selectOffsetQueryString = dk_string_from_format(
-		dk_stringify_sql(
-			SELECT offset FROM %@ WHERE name='%@'
-		),
-		kDKDatabaseSequenceTableName, escapedTableName
-	);
-	DKCompiledSQLQuery *selectOffsetQuery = [self compileSQLQuery:selectOffsetQueryString error:&transientError];
-	if(!selectOffsetQuery)
-		return nil;
+	OSSpinLockLock(&stripe->lock);
+	DKManagedObject *databaseObject = NSMapGet(stripe->objects, &key);
+	if(databaseObject)
+	{
+		databaseObject->_dk_mWasRecentlyUsed = YES;
+		[databaseObject retain];
+	}
+	OSSpinLockUnlock(&stripe->lock);
+	
+	return [databaseObject autorelease];
+}
+
+- (NSArray *)existingDatabaseObjectsInTable:(DKTableDescription *)table
+{
+	NSParameterAssert(table);
 	
+	NSMutableArray *databaseObjects = [NSMutableArray array];
+	for (NSUInteger index = 0; index < DK_MANAGED_OBJECT_STRIPE_COUNT; index++)
+	{
+		DKManagedObjectStripe *stripe = &mManagedObjectStripes[index];
+		
+		OSSpinLockLock(&stripe->lock);
+		NSMapEnumerator enumerator = NSEnumerateMapTable(stripe->objects);
+		DKManagedObjectKey *key = NULL;
+		DKManagedObject *databaseObject = nil;
+		while (NSNextMapEnumeratorPair(&enumerator, (void **)&key, (void **)&databaseObject))
+		{
+			if(key->table == table)
+				[databaseObjects addObject:databaseObject];
+		}
+		NSEndMapTableEnumeration(&enumerator);
+		OSSpinLockUnlock(&stripe->lock);
+	}
 	
+	return databaseObjects;
+}
+
+- (id)databaseObjectInTable:(DKTableDescription *)table withUniqueIdentifier:(int64_t)uniqueIdentifier
+{
 	//
-	//	If we find an entry in the database sequence describing the last unique identifier
-	//	given to a row in `table` we increment that value by one and use that as the
-	//	unique identifier of the row we're about to create. If we don't find an existing row
-	//	then we're the first object to be inserted into this table and we use the identifier '0'.
+	//	If an existing object already exists, we use it.
+	//	If one doesn't exist we create a new one and cache it.
 	//
-	int64_t newUniqueIdentifier = 1;
-	if([selectOffsetQuery nextRow])
-		newUniqueIdentifier = [selectOffsetQuery longLongForColumnAtIndex:0] + 1;
+	id databaseObject = [self existingDatabaseObjectInTable:table withUniqueIdentifier:uniqueIdentifier];
+	if(databaseObject)
+		return databaseObject;
 	
 	
 	//
-	//	Its time to insert a new row into `table`. We pass in the unique identifier
-	//	we just created and prey to someone's god that this works. If it does, it
-	//	confirms our suspicions that there is no god. After all, what kind of god
-	//	would insert a new row into our database, its not like it attends church.
+	//	We create the new object outside of the stripe's lock. Another thread may
+	//	beat us to inserting an object for the same row, in which case we throw ours
+	//	away and use theirs so there is only ever one object per row.
 	//
-	NSString *insertNewRowQueryString = dk_string_from_format(
-		dk_stringify_sql(
-			INSERT INTO '%@' (_dk_uniqueIdentifier) VALUES (%lld)
-		),
-		escapedTableName, newUniqueIdentifier
-	);
-	DKCompiledSQLQuery *insertNewRowQuery = [self compileSQLQuery:insertNewRowQueryString error:&transientError];
-	if(!insertNewRowQuery)
-		return nil;
+	DKManagedObject *newDatabaseObject = [[table.databaseObjectClass alloc] initWithUniqueIdentifier:uniqueIdentifier table:table database:self];
+	newDatabaseObject->_dk_mWasRecentlyUsed = YES;
 	
-	//
-	//	If the insertion was successful then the query should have one row waiting
-	//	for us. If it doesn't the insertion failed and we're in a world of hurt.
-	//
-	NSAssert([insertNewRowQuery evaluateAndReturnError:&transientError], 
-			 @"Could not create new row for table named %@. Got error %@.", table.name, transientError);
+	databaseObject = [self registerDatabaseObject:newDatabaseObject];
+	[newDatabaseObject release];
 	
-	NSString *updateLastUniqueIdentifierQueryString = dk_string_from_format(
-		dk_stringify_sql(
-			UPDATE %@ SET offset=%lld WHERE name='%@'
-		),
-		kDKDatabaseSequenceTableName, newUniqueIdentifier, escapedTableName
-	);
-	NSAssert([self executeSQLQuery:updateLastUniqueIdentifierQueryString error:&transientError],
-			 @"Could not update unique identifier in DKDatabase internal state. Got error %@.", transientError);
+	if(databaseObject != newDatabaseObject)
+		return databaseObject;
 	
+	//Every new object may be the one that takes us over our limit.
+	if((mManagedObjectLimit > 0) && (DKDatabaseNumberOfOwnedObjects(self) > mManagedObjectLimit))
+		[self evictDatabaseObjects];
 	
-	//
-	//	We need to verify that the database-object-class the table specifies
-	//	inherits from DKManagedObject. If it doesn't then we have a problem.
-	//
-	Class databaseObjectClass = table.databaseObjectClass;
-	NSAssert(((databaseObjectClass == [DKManagedObject class]) || [databaseObjectClass isSubclassOfClass:[DKManagedObject class]]), 
-			 @"Database object class %@ does not inherit DKManagedObject. You fail at life.", NSStringFromClass(databaseObjectClass));
+	return databaseObject;
+}
+
+- (id)registerDatabaseObject:(DKManagedObject *)databaseObject
+{
+	NSParameterAssert(databaseObject);
 	
-	//
-	//	Now that we have a nice new row in `table`, we can create a wrapper object for it.
-	//	We use the database-object-class specified by `table`. It could be something other
-	//	then DKManagedObject.
-	//
-	id databaseObject = [[databaseObjectClass alloc] initWithUniqueIdentifier:newUniqueIdentifier 
-																		table:table 
-																	 database:self];
-	[databaseObject awakeFromInsertion];
+	DKManagedObjectKey *key = malloc(sizeof(DKManagedObjectKey));
+	key->table = databaseObject.tableDescription;
+	key->uniqueIdentifier = databaseObject.uniqueIdentifier;
 	
+	DKManagedObjectStripe *stripe = DKDatabaseStripeForKey(self, key);
 	
-	@synchronized(self)
+	OSSpinLockLock(&stripe->lock);
+	id existingDatabaseObject = NSMapGet(stripe->objects, key);
+	if(!existingDatabaseObject)
 	{
 		//
-		//	Note the address of the database object. We own this object (its our slave)
-		//	and we need to be able to destroy it later when we no longer have a use for it.
+		//	The map doesn't retain the object, so we take a reference of our own to keep
+		//	it in memory. The object takes itself out of the map when it's destroyed.
 		//
 #if __OBJC_GC__
 		[[NSGarbageCollector defaultCollector] disableCollectorForPointer:databaseObject];
 #endif /* __OBJC_GC__ */
-		NSMapInsert(mManagedObjects, (const void *)newUniqueIdentifier, databaseObject);
+		NSMapInsertKnownAbsent(stripe->objects, key, databaseObject);
+		
+		[databaseObject retain];
+		databaseObject->_dk_mIsOwnedByDatabase = YES;
+		OSAtomicIncrement32Barrier(&mNumberOfManagedObjects);
 	}
 	
-	return databaseObject;
+	//As with lookups, whichever object we hand back is retained before anyone else can see it.
+	[(existingDatabaseObject ?: databaseObject) retain];
+	OSSpinLockUnlock(&stripe->lock);
+	
+	if(existingDatabaseObject)
+	{
+		free(key);
+		return [existingDatabaseObject autorelease];
+	}
+	
+	return [databaseObject autorelease];
 }
 
-#pragma mark -
-#pragma mark Deleting
+- (void)unregisterDatabaseObject:(DKManagedObject *)databaseObject
+{
+	NSParameterAssert(databaseObject);
+	
+	DKManagedObjectKey key = { databaseObject.tableDescription, databaseObject.uniqueIdentifier };
+	DKManagedObjectStripe *stripe = DKDatabaseStripeForKey(self, &key);
+	
+	OSSpinLockLock(&stripe->lock);
+	if(NSMapGet(stripe->objects, &key) == databaseObject)
+		NSMapRemove(stripe->objects, &key);
+	BOOL wasOwned = DKDatabaseDisownObject(self, databaseObject);
+	OSSpinLockUnlock(&stripe->lock);
+	
+	if(wasOwned)
+		DKDatabaseReleaseDisownedObject(self, databaseObject);
+}
 
-- (void)deleteObject:(DKManagedObject *)object
+- (void)relinquishDatabaseObject:(DKManagedObject *)databaseObject
 {
-	NSParameterAssert(object);
+	NSParameterAssert(databaseObject);
+	
+	DKManagedObjectKey key = { databaseObject.tableDescription, databaseObject.uniqueIdentifier };
+	DKManagedObjectStripe *stripe = DKDatabaseStripeForKey(self, &key);
 	
 	//
-	//	We let the managed object know that we're about to delete the row it
-	//	represents from the database. If it doesn't like that, too bad.
+	//	The object stays in the map for as long as anyone else holds on to it, so
+	//	it's still the only object for its row. Objects with unsaved changes are
+	//	retained by the receiver until they're saved, so they can't be lost here.
 	//
-	[object prepareForDeletion];
+	OSSpinLockLock(&stripe->lock);
+	BOOL wasOwned = DKDatabaseDisownObject(self, databaseObject);
+	OSSpinLockUnlock(&stripe->lock);
+	
+	if(wasOwned)
+		DKDatabaseReleaseDisownedObject(self, databaseObject);
+}
+
+- (BOOL)removeDatabaseObjectIfUnreferenced:(DKManagedObject *)databaseObject
+{
+	NSParameterAssert(databaseObject);
 	
+	DKManagedObjectKey key = { databaseObject->_dk_mTableDescription, databaseObject->_dk_mUniqueIdentifier };
+	DKManagedObjectStripe *stripe = DKDatabaseStripeForKey(self, &key);
 	
 	//
-	//	We use a SQL DELETE statement with the object's unique identifier to remove the value
-	//	it represents from the database. If this fails, something is wrong and we explode.
+	//	Every object handed out of the map is retained while its stripe is locked, so
+	//	once we have the lock nobody can be part way through getting hold of this one.
+	//	If its count is still 1 the last reference is the one being released.
 	//
-	int64_t uniqueIdentifier = object.uniqueIdentifier;
-	NSString *deleteQueryString = dk_string_from_format(
-		dk_stringify_sql(
-			DELETE FROM %@ WHERE _dk_uniqueIdentifier=%lld
-		),
-		[object.tableDescription.name stringByEscapingStringForLiteralUseInSQLQueries], uniqueIdentifier
-	);
-	NSError *error = nil;
-	NSAssert([self executeSQLQuery:deleteQueryString error:&error],
-			 @"Could not delete object %@. Got error %@.", error);
+	OSSpinLockLock(&stripe->lock);
+	BOOL isUnreferenced = OSAtomicCompareAndSwapLongBarrier(1, 0, (volatile long *)&databaseObject->_dk_mExtraRetainCount);
+	if(isUnreferenced && (NSMapGet(stripe->objects, &key) == databaseObject))
+		NSMapRemove(stripe->objects, &key);
+	OSSpinLockUnlock(&stripe->lock);
+	
+	return isUnreferenced;
+}
+
+- (void)evictDatabaseObjects
+{
+	//
+	//	Only one thread sweeps at a time. Anyone else who finds us over
+	//	our limit while a sweep is running just carries on with their work.
+	//
+	if(!OSAtomicCompareAndSwap32Barrier(0, 1, &mIsEvicting))
+		return;
 	
+	//
+	//	We sweep down to a little under the limit so that
+	//	we don't have to sweep again on the very next object.
+	//
+	NSUInteger limit = mManagedObjectLimit;
+	NSUInteger target = limit - (limit / 8);
 	
-	@synchronized(self)
+	for (NSUInteger step = 0; (step < DK_MANAGED_OBJECT_STRIPE_COUNT) && (DKDatabaseNumberOfOwnedObjects(self) > target); step++)
 	{
+		DKManagedObjectStripe *stripe = &mManagedObjectStripes[mEvictionHand];
+		mEvictionHand = (mEvictionHand + 1) % DK_MANAGED_OBJECT_STRIPE_COUNT;
+		
+		OSSpinLockLock(&stripe->lock);
+		
+		//
+		//	This is a clock sweep. Objects used since the hand last passed them get a second
+		//	chance. We give up our reference to the rest. Nothing else has to be known about
+		//	them: objects nobody else holds on to are destroyed when we let go, and the rest
+		//	stay in the map until their owners do. We can't release an object or take its
+		//	lock while holding the stripe's, so that is done after.
+		//
+		DKManagedObject **evictedObjects = malloc(sizeof(DKManagedObject *) * NSCountMapTable(stripe->objects));
+		NSUInteger numberOfEvictedObjects = 0;
+		
+		NSMapEnumerator enumerator = NSEnumerateMapTable(stripe->objects);
+		DKManagedObjectKey *key = NULL;
+		DKManagedObject *databaseObject = nil;
+		while (NSNextMapEnumeratorPair(&enumerator, (void **)&key, (void **)&databaseObject))
+		{
+			if(!databaseObject->_dk_mIsOwnedByDatabase)
+				continue;
+			
+			if(databaseObject->_dk_mWasRecentlyUsed)
+			{
+				databaseObject->_dk_mWasRecentlyUsed = NO;
+				continue;
+			}
+			
+			DKDatabaseDisownObject(self, databaseObject);
+			evictedObjects[numberOfEvictedObjects++] = databaseObject;
+		}
+		NSEndMapTableEnumeration(&enumerator);
+		
+		OSSpinLockUnlock(&stripe->lock);
+		
 		//
-		//	We're done with the managed object. Its time we destroy it its not useful anymore.
+		//	Objects that someone else is holding on to live on, but they're cold,
+		//	so their cached values go. Our reference keeps them alive until then.
 		//
-		NSMapRemove(mManagedObjects, (const void *)uniqueIdentifier);
+		for (NSUInteger index = 0; index < numberOfEvictedObjects; index++)
+		{
+			[evictedObjects[index] invalidateCache];
+			DKDatabaseReleaseDisownedObject(self, evictedObjects[index]);
+		}
+		
+		free(evictedObjects);
 	}
 	
-#if __OBJC_GC__
-	//
-	//	We disable collection for objects managed by DKDatabase so we have control over their life cycle.
-	//	Here we re-enable it so that it will be destroyed on the next collection cycle.
-	//
-	[[NSGarbageCollector defaultCollector] enableCollectorForPointer:databaseObject];
-#else
-	//
-	//	-[NSObject dealloc] will destroy the memory that the managed object occupies.
-	//	Yes, yes, I know. This is evil and the documentation expressly forbids it.
-	//	Well I never was one for listening to directions.
-	//
-	[object dealloc];
-#endif /* __OBJC_GC__ */
+	OSAtomicCompareAndSwap32Barrier(1, 0, &mIsEvicting);
 }
 
-#pragma mark -
-#pragma mark Database Queries
-
-- (DKCompiledSQLQuery *)compileSQLQuery:(NSString *)query error:(NSError **)error
+- (int32_t)generationOfRelationship:(DKRelationshipDescription *)relationship
 {
-	return [[[DKCompiledSQLQuery alloc] initWithQuery:query database:self error:error] autorelease];
+	NSParameterAssert(relationship);
+	
+	//The map is never changed after initialization, so it can be read from any thread.
+	NSUInteger generationIndex = (NSUInteger)NSMapGet(mRelationshipGenerationIndexes, relationship);
+	return mRelationshipGenerations[generationIndex];
 }
 
-- (BOOL)executeSQLQuery:(NSString *)query error:(NSError **)error
+- (void)invalidateRelationshipCachesForChanges:(DKDatabaseChangeSet *)changes
 {
-	NSParameterAssert(query);
+	NSParameterAssert(changes);
 	
-	char *errorMessage = NULL;
-	int status = SQLITE_OK;
-	if((status = sqlite3_exec(mSQLiteConnection, //in SQLite3 handle
-							  [query UTF8String], //in cleanQuery
-							  NULL, //in callback
-							  NULL, //in callbackUserData
-							  &errorMessage /* out bycopy errorMessage */)) != SQLITE_OK)
+	NSIndexSet *generationIndexes = changes.changedRelationshipGenerationIndexes;
+	for (NSUInteger index = [generationIndexes firstIndex]; index != NSNotFound; index = [generationIndexes indexGreaterThanIndex:index])
+		OSAtomicIncrement32Barrier(&mRelationshipGenerations[index]);
+}
+
+- (NSUInteger)numberOfManagedObjects
+{
+	NSUInteger numberOfManagedObjects = 0;
+	for (NSUInteger index = 0; index < DK_MANAGED_OBJECT_STRIPE_COUNT; index++)
 	{
-		if(error) *error = DKLocalizedError(DKEvaluationErrorDomain, 
-											status, 
-											nil, 
-											@"Update query failed", query, status, errorMessage);
-		
-		sqlite3_free(errorMessage);
+		DKManagedObjectStripe *stripe = &mManagedObjectStripes[index];
 		
-		return NO;
+		OSSpinLockLock(&stripe->lock);
+		numberOfManagedObjects += NSCountMapTable(stripe->objects);
+		OSSpinLockUnlock(&stripe->lock);
 	}
 	
-	return YES;
+	return numberOfManagedObjects;
 }
 
 #pragma mark -
+#pragma mark Fetching
 
-- (BOOL)tableExistsWithName:(NSString *)name
+- (NSString *)orderingTermsForFetchRequest:(DKFetchRequest *)fetchRequest
 {
-	NSString *tableInfoQueryString = dk_string_from_format(
-		dk_stringify_sql(
-			PRAGMA table_info(%@)
-		), 
-		[name stringByEscapingStringForLiteralUseInSQLQueries]
-	);
+	NSParameterAssert(fetchRequest);
 	
-	NSError *error = nil;
-	DKCompiledSQLQuery *tableInfoQuery = [self compileSQLQuery:tableInfoQueryString error:&error];
-	NSAssert((tableInfoQuery != nil),
-			 @"Could not compile table info query. Got error %@.", error);
+	DKTableDescription *table = fetchRequest.table;
+	NSMutableArray *orderingTerms = [NSMutableArray array];
+	for (NSSortDescriptor *sortDescriptor in fetchRequest.sortDescriptors)
+	{
+		NSString *orderingTerm = [sortDescriptor SQLOrderingTermForTable:table];
+		if(!orderingTerm)
+			return nil;
+		
+		[orderingTerms addObject:orderingTerm];
+	}
 	
-	return [tableInfoQuery nextRow];
-}
-
+	//
+	//	The unique identifier breaks ties so rows always come back in the same
+	//	order. Paging with an offset or after an object depends on this.
+	//
+	[orderingTerms addObject:@"_dk_uniqueIdentifier ASC"];
+	
+	return [orderingTerms componentsJoinedByString:@", "];
+}
+
+- (NSString *)expressionForRowsAfterObjectInFetchRequest:(DKFetchRequest *)fetchRequest arguments:(NSMutableArray *)arguments
+{
+	NSParameterAssert(fetchRequest);
+	NSParameterAssert(arguments);
+	
+	DKTableDescription *table = fetchRequest.table;
+	DKManagedObject *afterObject = fetchRequest.fetchAfterObject;
+	NSAssert((afterObject.tableDescription == table), 
+			 @"Cannot fetch objects in %@ after %@, it belongs to another table.", table.name, afterObject);
+	
+	NSMutableArray *sortDescriptors = [NSMutableArray array];
+	if(fetchRequest.sortDescriptors)
+		[sortDescriptors addObjectsFromArray:fetchRequest.sortDescriptors];
+	[sortDescriptors addObject:[NSSortDescriptor sortDescriptorWithKey:@"uniqueIdentifier" ascending:YES]];
+	
+	//
+	//	Look up the values the object is sorted by. Its unique identifier
+	//	isn't a column value so it has to be special cased.
+	//
+	NSMutableArray *values = [NSMutableArray arrayWithCapacity:[sortDescriptors count]];
+	for (NSSortDescriptor *sortDescriptor in sortDescriptors)
+	{
+		NSString *key = sortDescriptor.key;
+		id value = nil;
+		if([key isEqualToString:@"uniqueIdentifier"] || [key isEqualToString:@"SELF"])
+			value = [NSNumber numberWithLongLong:afterObject.uniqueIdentifier];
+		else
+			value = [afterObject valueForColumnNamed:key];
+		
+		[values addObject:(value? value : [NSNull null])];
+	}
+	
+	//
+	//	A row comes after the object if it sorts after it on the first key, or
+	//	ties on the first key and sorts after it on the second, and so on:
+	//	
+	//		(a > ?) OR (a = ? AND b > ?) OR (a = ? AND b = ? AND uid > ?)
+	//	
+	//	Unlike OFFSET this lets SQLite seek straight to the next page.
+	//
+	NSMutableArray *alternatives = [NSMutableArray arrayWithCapacity:[sortDescriptors count]];
+	for (NSUInteger index = 0, count = [sortDescriptors count]; index < count; index++)
+	{
+		NSMutableArray *terms = [NSMutableArray arrayWithCapacity:index + 1];
+		for (NSUInteger tieIndex = 0; tieIndex < index; tieIndex++)
+		{
+			NSSortDescriptor *tiedSortDescriptor = [sortDescriptors objectAtIndex:tieIndex];
+			[terms addObject:[tiedSortDescriptor SQLExpressionForRowsEqualToValue:[values objectAtIndex:tieIndex] 
+																		  inTable:table 
+																		arguments:arguments]];
+		}
+		
+		NSSortDescriptor *sortDescriptor = [sortDescriptors objectAtIndex:index];
+		[terms addObject:[sortDescriptor SQLExpressionForRowsAfterValue:[values objectAtIndex:index] 
+																inTable:table 
+															  arguments:arguments]];
+		
+		[alternatives addObject:dk_string_from_format(@"(%@)", [terms componentsJoinedByString:@" AND "])];
+	}
+	
+	return [alternatives componentsJoinedByString:@" OR "];
+}
+
+- (NSArray *)filterClausesForFetchRequest:(DKFetchRequest *)fetchRequest arguments:(NSMutableArray *)arguments error:(NSError **)error
+{
+	NSParameterAssert(fetchRequest);
+	NSParameterAssert(arguments);
+	
+	//
+	//	The raw filter string and the predicate are both used to filter
+	//	the rows we select. The predicate is translated into SQL with its
+	//	constants pulled out into parameters, so fetches that only differ
+	//	by their constants end up sharing the same compiled query.
+	//
+	NSMutableArray *clauses = [NSMutableArray array];
+	
+	NSString *filterString = fetchRequest.filterString;
+	if(filterString)
+		[clauses addObject:dk_string_from_format(@"(%@)", filterString)];
+	
+	NSPredicate *predicate = fetchRequest.predicate;
+	if(predicate)
+	{
+		NSString *predicateExpression = [predicate SQLExpressionForTable:fetchRequest.table arguments:arguments error:error];
+		if(!predicateExpression)
+			return nil;
+		
+		[clauses addObject:dk_string_from_format(@"(%@)", predicateExpression)];
+	}
+	
+	if(fetchRequest.fetchAfterObject)
+		[clauses addObject:dk_string_from_format(@"(%@)", [self expressionForRowsAfterObjectInFetchRequest:fetchRequest arguments:arguments])];
+	
+	return clauses;
+}
+
+- (NSString *)selectQueryStringForFetchRequest:(DKFetchRequest *)fetchRequest columns:(NSString *)columns arguments:(NSMutableArray *)arguments error:(NSError **)error
+{
+	NSParameterAssert(fetchRequest);
+	NSParameterAssert(columns);
+	NSParameterAssert(arguments);
+	
+	DKTableDescription *table = fetchRequest.table;
+	NSAssert((table != nil), @"Fetch request %@ does not have a table.", fetchRequest);
+	
+	NSString *escapedTableName = [table.name stringByEscapingStringForLiteralUseInSQLQueries];
+	
+	//
+	//	Rows are only ordered in SQL when they need to be. If any of the sort
+	//	descriptors can't be evaluated by SQLite, the caller sorts in memory
+	//	and we can't apply the limit or offset here either.
+	//
+	BOOL isPaged = ((fetchRequest.fetchLimit > 0) || (fetchRequest.fetchOffset > 0) || (fetchRequest.fetchAfterObject != nil));
+	NSString *orderingTerms = nil;
+	if(([fetchRequest.sortDescriptors count] > 0) || isPaged)
+	{
+		orderingTerms = [self orderingTermsForFetchRequest:fetchRequest];
+		
+		if(!orderingTerms && fetchRequest.fetchAfterObject)
+		{
+			if(error) *error = DKLocalizedError(DKEvaluationErrorDomain, 0, nil, @"Unsupported sort descriptors", fetchRequest.sortDescriptors);
+			return nil;
+		}
+	}
+	
+	NSArray *clauses = [self filterClausesForFetchRequest:fetchRequest arguments:arguments error:error];
+	if(!clauses)
+		return nil;
+	
+	//
+	//	If there are no clauses, we just select everything thats in
+	//	`table` indiscriminately like a common whore.
+	//
+	NSMutableString *selectQueryString = [NSMutableString stringWithFormat:
+		dk_stringify_sql(
+			SELECT %@ FROM %@
+		),
+		columns, escapedTableName
+	];
+	
+	if([clauses count] > 0)
+		[selectQueryString appendFormat:@" WHERE %@", [clauses componentsJoinedByString:@" AND "]];
+	
+	//
+	//	The limit and offset are bound as parameters so that every page
+	//	of a request is fetched with the same compiled query.
+	//
+	if(orderingTerms)
+	{
+		[selectQueryString appendFormat:@" ORDER BY %@", orderingTerms];
+		
+		if(isPaged)
+		{
+			[selectQueryString appendString:@" LIMIT ? OFFSET ?"];
+			
+			//A negative limit means there is no limit.
+			long long fetchLimit = fetchRequest.fetchLimit;
+			[arguments addObject:[NSNumber numberWithLongLong:(fetchLimit > 0)? fetchLimit : -1]];
+			[arguments addObject:[NSNumber numberWithUnsignedInteger:fetchRequest.fetchOffset]];
+		}
+	}
+	
+	return selectQueryString;
+}
+
+- (DKCompiledSQLQuery *)compileSelectQueryForFetchRequest:(DKFetchRequest *)fetchRequest columns:(NSString *)columns error:(NSError **)error
+{
+	NSMutableArray *arguments = [NSMutableArray array];
+	NSString *selectQueryString = [self selectQueryStringForFetchRequest:fetchRequest columns:columns arguments:arguments error:error];
+	if(!selectQueryString)
+		return nil;
+	
+	DKCompiledSQLQuery *selectQuery = [self compileSQLQuery:selectQueryString error:error];
+	if(!selectQuery)
+		return nil;
+	
+	int parameterIndex = 1;
+	for (id argument in arguments)
+		[selectQuery setArgument:argument forParameterAtIndex:parameterIndex++];
+	
+	return selectQuery;
+}
+
+- (NSSet *)fetchObjectsInTable:(DKTableDescription *)table matchingQuery:(NSString *)query returnsObjectsAsPromises:(BOOL)returnsObjectsAsPromises error:(NSError **)error
+{
+	NSParameterAssert(table);
+	
+	DKFetchRequest *fetchRequest = [DKFetchRequest fetchRequestWithTable:table];
+	fetchRequest.filterString = query;
+	fetchRequest.returnsObjectsAsPromises = returnsObjectsAsPromises;
+	
+	NSArray *objects = [self executeFetchRequest:fetchRequest error:error];
+	if(objects)
+		return [NSSet setWithArray:objects];
+	
+	return nil;
+}
+
+///Returns the value a projection fetch produces for the current row of its query.
+static id DKProjectionValueForRow(DKCompiledSQLQuery *query, DKFetchRequestResultType resultType, NSArray *properties)
+{
+	if(resultType == kDKFetchRequestResultTypeUniqueIdentifier)
+		return [NSNumber numberWithLongLong:[query longLongForColumnAtIndex:0]];
+	
+	//
+	//	One-to-one relationships are returned as the unique identifier of the
+	//	object they point at. NULL columns are left out of the dictionary.
+	//
+	NSMutableDictionary *result = [NSMutableDictionary dictionaryWithCapacity:[properties count]];
+	int columnIndex = 0;
+	for (DKPropertyDescription *property in properties)
+	{
+		id value = nil;
+		if([property isKindOfClass:[DKAttributeDescription class]])
+			value = [query valueForColumnAtIndex:columnIndex attribute:(DKAttributeDescription *)property];
+		else
+			value = [query valueForColumnAtIndex:columnIndex type:DKAttributeTypeInt64];
+		
+		if(value)
+			[result setObject:value forKey:property.name];
+		
+		columnIndex++;
+	}
+	
+	return result;
+}
+
+- (NSArray *)executeFetchRequest:(DKFetchRequest *)fetchRequest error:(NSError **)error
+{
+	return [self executeFetchRequest:fetchRequest operation:nil error:error];
+}
+
+- (NSArray *)executeFetchRequest:(DKFetchRequest *)fetchRequest operation:(DKDatabaseOperation *)operation error:(NSError **)error
+{
+	NSParameterAssert(fetchRequest);
+	
+	if(fetchRequest.resultType == kDKFetchRequestResultTypeAggregate)
+		return [self executeAggregateFetchRequest:fetchRequest operation:operation error:error];
+	
+	if(fetchRequest.resultType != kDKFetchRequestResultTypeManagedObject)
+		return [self executeProjectionFetchRequest:fetchRequest operation:operation error:error];
+	
+	DKTableDescription *table = fetchRequest.table;
+	
+	//
+	//	If we've been asked to fulfill promises immediately we select every
+	//	attribute along with the unique identifier. Each row then carries
+	//	everything needed to fill in its database object's cache, so the
+	//	whole fetch is a single pass over the table.
+	//
+	NSArray *attributes = fetchRequest.returnsObjectsAsPromises? nil : table.attributes;
+	NSString *columns = @"_dk_uniqueIdentifier";
+	if([attributes count] > 0)
+		columns = [columns stringByAppendingFormat:@", %@", [table escapedAttributeColumnList]];
+	
+	DKCompiledSQLQuery *selectQuery = [self compileSelectQueryForFetchRequest:fetchRequest columns:columns error:error];
+	if(!selectQuery)
+		return nil;
+	
+	//
+	//	We need to verify that the database-object-class the table specifies
+	//	inherits from DKManagedObject. If it doesn't then we have a problem.
+	//
+	Class databaseObjectClass = table.databaseObjectClass;
+	NSAssert(((databaseObjectClass == [DKManagedObject class]) || [databaseObjectClass isSubclassOfClass:[DKManagedObject class]]), 
+			 @"Database object class %@ does not inherit DKManagedObject. You fail at life.", NSStringFromClass(databaseObjectClass));
+	
+	//
+	//	We enumerate all of the rows returned by the select query
+	//	and create a database-object for each given unique identifier.
+	//
+	NSMutableArray *objects = [NSMutableArray array];
+	while ([selectQuery nextRow])
+	{
+		//
+		//	If whoever asked for the fetch has lost interest in it
+		//	we stop reading rows right away and hand back nothing.
+		//
+		if(operation.isCancelled)
+		{
+			[selectQuery reset];
+			
+			if(error) *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil];
+			return nil;
+		}
+		
+		int64_t uniqueIdentifier = [selectQuery longLongForColumnAtIndex:0];
+		id databaseObject = [self databaseObjectInTable:table withUniqueIdentifier:uniqueIdentifier];
+		
+		//
+		//	If we've been asked to fulfill promises immediately then we
+		//	fill each database object's cache from the row we're on.
+		//
+		if([attributes count] > 0)
+			[databaseObject cacheAttributes:attributes fromRowOfQuery:selectQuery startingAtColumnIndex:1];
+		
+		[objects addObject:databaseObject];
+	}
+	
+	//
+	//	If SQLite couldn't sort the rows for us we have to sort them in
+	//	memory, and then apply the limit and offset ourselves.
+	//
+	NSArray *sortDescriptors = fetchRequest.sortDescriptors;
+	if(([sortDescriptors count] > 0) && ![self orderingTermsForFetchRequest:fetchRequest])
+	{
+		[objects sortUsingDescriptors:sortDescriptors];
+		
+		NSUInteger numberOfObjects = [objects count];
+		NSUInteger offset = MIN(fetchRequest.fetchOffset, numberOfObjects);
+		NSUInteger length = numberOfObjects - offset;
+		if(fetchRequest.fetchLimit > 0)
+			length = MIN(length, fetchRequest.fetchLimit);
+		
+		[objects setArray:[objects subarrayWithRange:NSMakeRange(offset, length)]];
+	}
+	
+	//
+	//	Relationships are prefetched for the objects we're actually returning,
+	//	a batch of objects per query rather than a query per object.
+	//
+	NSArray *keyPathsForPrefetching = fetchRequest.relationshipKeyPathsForPrefetching;
+	if(([keyPathsForPrefetching count] > 0) && 
+	   ![self prefetchRelationshipKeyPaths:keyPathsForPrefetching forObjects:objects inTable:table error:error])
+		return nil;
+	
+	return objects;
+}
+
+- (BOOL)enumerateObjectsForFetchRequest:(DKFetchRequest *)fetchRequest error:(NSError **)error usingBlock:(void (^)(id object, BOOL *stop))block
+{
+	NSParameterAssert(fetchRequest);
+	NSParameterAssert(block);
+	
+	//
+	//	Rows can only be streamed if SQLite is doing the sorting. If it can't,
+	//	every object has to be in memory to be sorted so we just fetch them.
+	//	Aggregates are only ever a handful of rows, so they're fetched too.
+	//
+	if((fetchRequest.resultType == kDKFetchRequestResultTypeAggregate) || 
+	   (([fetchRequest.sortDescriptors count] > 0) && ![self orderingTermsForFetchRequest:fetchRequest]))
+	{
+		NSArray *objects = [self executeFetchRequest:fetchRequest error:error];
+		if(!objects)
+			return NO;
+		
+		[objects enumerateObjectsUsingBlock:^(id object, NSUInteger index, BOOL *stop) {
+			block(object, stop);
+		}];
+		
+		return YES;
+	}
+	
+	//
+	//	Projections don't create objects, so there's nothing to clean up between
+	//	batches besides the values themselves. They're streamed a batch at a time.
+	//
+	if(fetchRequest.resultType != kDKFetchRequestResultTypeManagedObject)
+	{
+		NSArray *properties = nil;
+		DKCompiledSQLQuery *projectionQuery = [self compileProjectionQueryForFetchRequest:fetchRequest properties:&properties error:error];
+		if(!projectionQuery)
+			return NO;
+		
+		[projectionQuery retain];
+		[properties retain];
+		
+		NSUInteger batchSize = fetchRequest.fetchBatchSize;
+		if(batchSize == 0)
+			batchSize = kDKDatabaseDefaultFetchBatchSize;
+		
+		BOOL hasMoreRows = YES;
+		BOOL stop = NO;
+		while (hasMoreRows && !stop)
+		{
+			NSAutoreleasePool *pool = [NSAutoreleasePool new];
+			
+			for (NSUInteger index = 0; (index < batchSize) && !stop && (hasMoreRows = [projectionQuery nextRow]); index++)
+				block(DKProjectionValueForRow(projectionQuery, fetchRequest.resultType, properties), &stop);
+			
+			[pool drain];
+		}
+		
+		if(hasMoreRows)
+			[projectionQuery reset];
+		[projectionQuery release];
+		[properties release];
+		
+		return YES;
+	}
+	
+	DKTableDescription *table = fetchRequest.table;
+	
+	NSArray *attributes = fetchRequest.returnsObjectsAsPromises? nil : table.attributes;
+	NSString *columns = @"_dk_uniqueIdentifier";
+	if([attributes count] > 0)
+		columns = [columns stringByAppendingFormat:@", %@", [table escapedAttributeColumnList]];
+	
+	DKCompiledSQLQuery *selectQuery = [self compileSelectQueryForFetchRequest:fetchRequest columns:columns error:error];
+	if(!selectQuery)
+		return NO;
+	
+	//
+	//	We keep the query alive across batches. It may be handed back
+	//	to the query cache when a batch's autorelease pool drains.
+	//
+	[selectQuery retain];
+	
+	NSUInteger batchSize = fetchRequest.fetchBatchSize;
+	if(batchSize == 0)
+		batchSize = kDKDatabaseDefaultFetchBatchSize;
+	
+	DKManagedObject **createdObjects = malloc(sizeof(DKManagedObject *) * batchSize);
+	
+	NSArray *keyPathsForPrefetching = fetchRequest.relationshipKeyPathsForPrefetching;
+	BOOL didPrefetch = YES;
+	NSError *prefetchError = nil;
+	
+	BOOL hasMoreRows = YES;
+	BOOL stop = NO;
+	while (hasMoreRows && !stop)
+	{
+		NSAutoreleasePool *pool = [NSAutoreleasePool new];
+		
+		//
+		//	Pull the next batch of rows off of the query, hydrating the
+		//	objects as we go. We note which objects didn't exist before
+		//	this batch so we can get rid of them once it's done.
+		//
+		NSMutableArray *batch = [[NSMutableArray alloc] initWithCapacity:batchSize];
+		NSUInteger numberOfCreatedObjects = 0;
+		while (([batch count] < batchSize) && (hasMoreRows = [selectQuery nextRow]))
+		{
+			int64_t uniqueIdentifier = [selectQuery longLongForColumnAtIndex:0];
+			id databaseObject = [self existingDatabaseObjectInTable:table withUniqueIdentifier:uniqueIdentifier];
+			if(!databaseObject)
+			{
+				databaseObject = [self databaseObjectInTable:table withUniqueIdentifier:uniqueIdentifier];
+				createdObjects[numberOfCreatedObjects++] = databaseObject;
+			}
+			
+			if([attributes count] > 0)
+				[databaseObject cacheAttributes:attributes fromRowOfQuery:selectQuery startingAtColumnIndex:1];
+			
+			[batch addObject:databaseObject];
+		}
+		
+		//
+		//	Each batch has its relationships prefetched before the block sees it. If
+		//	that fails we stop, holding on to the error past the autorelease pool.
+		//
+		if(([keyPathsForPrefetching count] > 0) && 
+		   ![self prefetchRelationshipKeyPaths:keyPathsForPrefetching forObjects:batch inTable:table error:&prefetchError])
+		{
+			[prefetchError retain];
+			didPrefetch = NO;
+			stop = YES;
+		}
+		
+		for (id databaseObject in batch)
+		{
+			if(stop)
+				break;
+			
+			block(databaseObject, &stop);
+		}
+		
+		[batch release];
+		[pool drain];
+		
+		//
+		//	Objects brought into memory by this batch that the block didn't
+		//	hold on to are destroyed so that memory use stays flat no matter
+		//	how many rows the table has.
+		//
+		for (NSUInteger index = 0; index < numberOfCreatedObjects; index++)
+			[self relinquishDatabaseObject:createdObjects[index]];
+	}
+	
+	free(createdObjects);
+	
+	//The query has to be reset if we stopped before running out of rows.
+	if(hasMoreRows)
+		[selectQuery reset];
+	[selectQuery release];
+	
+	[prefetchError autorelease];
+	if(!didPrefetch)
+	{
+		if(error) *error = prefetchError;
+		return NO;
+	}
+	
+	return YES;
+}
+
+- (DKDatabaseOperation *)executeFetchRequest:(DKFetchRequest *)fetchRequest completionHandler:(void (^)(NSArray *objects, NSError *error))completionHandler
+{
+	NSParameterAssert(fetchRequest);
+	NSParameterAssert(completionHandler);
+	
+	DKDatabaseOperation *operation = [[DKDatabaseOperation new] autorelease];
+	
+	//
+	//	The completion handler is invoked on the main queue. The block we
+	//	send there holds on to the fetch's results and error after the
+	//	background queue's autorelease pool has been drained.
+	//
+	dispatch_async(mBackgroundQueue, ^{
+		NSAutoreleasePool *pool = [NSAutoreleasePool new];
+		
+		NSError *error = nil;
+		NSArray *objects = [self executeFetchRequest:fetchRequest operation:operation error:&error];
+		if(objects)
+			error = nil;
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			completionHandler(objects, error);
+		});
+		
+		[pool drain];
+	});
+	
+	return operation;
+}
+
+#pragma mark -
+#pragma mark Projections
+
+- (DKCompiledSQLQuery *)compileProjectionQueryForFetchRequest:(DKFetchRequest *)fetchRequest properties:(NSArray **)outProperties error:(NSError **)error
+{
+	NSParameterAssert(fetchRequest);
+	
+	DKTableDescription *table = fetchRequest.table;
+	NSAssert((table != nil), @"Fetch request %@ does not have a table.", fetchRequest);
+	
+	//
+	//	Plain values can't be sorted in memory the way objects are,
+	//	so SQLite has to be able to evaluate the sort descriptors.
+	//
+	if(([fetchRequest.sortDescriptors count] > 0) && ![self orderingTermsForFetchRequest:fetchRequest])
+	{
+		if(error) *error = DKLocalizedError(DKEvaluationErrorDomain, 0, nil, @"Unsupported projection sort descriptors", fetchRequest.sortDescriptors);
+		return nil;
+	}
+	
+	NSArray *properties = nil;
+	NSString *columns = @"_dk_uniqueIdentifier";
+	if(fetchRequest.resultType == kDKFetchRequestResultTypeDictionary)
+	{
+		NSArray *propertiesToFetch = fetchRequest.propertiesToFetch;
+		if(propertiesToFetch)
+		{
+			NSMutableArray *requestedProperties = [NSMutableArray arrayWithCapacity:[propertiesToFetch count]];
+			NSMutableArray *requestedColumns = [NSMutableArray arrayWithCapacity:[propertiesToFetch count]];
+			for (NSString *propertyName in propertiesToFetch)
+			{
+				DKPropertyDescription *property = [table propertyWithName:propertyName];
+				NSAssert(((property != nil) && 
+						  (![property isKindOfClass:[DKRelationshipDescription class]] || ![(DKRelationshipDescription *)property isToMany])), 
+						 @"%@ is not an attribute or one-to-one relationship of the table %@.", propertyName, table.name);
+				
+				[requestedProperties addObject:property];
+				[requestedColumns addObject:[propertyName stringByEscapingStringForLiteralUseInSQLQueries]];
+			}
+			
+			properties = requestedProperties;
+			columns = [requestedColumns componentsJoinedByString:@", "];
+		}
+		else
+		{
+			properties = table.attributes;
+			columns = [table escapedAttributeColumnList];
+		}
+		
+		NSAssert(([properties count] > 0), @"Dictionary fetch request %@ does not fetch any properties.", fetchRequest);
+	}
+	
+	if(outProperties)
+		*outProperties = properties;
+	
+	return [self compileSelectQueryForFetchRequest:fetchRequest columns:columns error:error];
+}
+
+- (NSArray *)executeProjectionFetchRequest:(DKFetchRequest *)fetchRequest operation:(DKDatabaseOperation *)operation error:(NSError **)error
+{
+	NSParameterAssert(fetchRequest);
+	
+	NSArray *properties = nil;
+	DKCompiledSQLQuery *projectionQuery = [self compileProjectionQueryForFetchRequest:fetchRequest properties:&properties error:error];
+	if(!projectionQuery)
+		return nil;
+	
+	NSMutableArray *results = [NSMutableArray array];
+	while ([projectionQuery nextRow])
+	{
+		if(operation.isCancelled)
+		{
+			[projectionQuery reset];
+			
+			if(error) *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil];
+			return nil;
+		}
+		
+		[results addObject:DKProjectionValueForRow(projectionQuery, fetchRequest.resultType, properties)];
+	}
+	
+	return results;
+}
+
+#pragma mark -
+#pragma mark Aggregates
+
+- (NSUInteger)countForFetchRequest:(DKFetchRequest *)fetchRequest error:(NSError **)error
+{
+	NSParameterAssert(fetchRequest);
+	
+	DKTableDescription *table = fetchRequest.table;
+	NSAssert((table != nil), @"Fetch request %@ does not have a table.", fetchRequest);
+	
+	//
+	//	Without paging the order of the rows doesn't matter, so they're counted straight
+	//	off of the table. Paged requests count the page their SELECT would return.
+	//
+	BOOL isPaged = ((fetchRequest.fetchLimit > 0) || (fetchRequest.fetchOffset > 0) || (fetchRequest.fetchAfterObject != nil));
+	NSMutableArray *arguments = [NSMutableArray array];
+	NSString *countQueryString = nil;
+	if(isPaged)
+	{
+		NSString *selectQueryString = [self selectQueryStringForFetchRequest:fetchRequest columns:@"_dk_uniqueIdentifier" arguments:arguments error:error];
+		if(!selectQueryString)
+			return NSNotFound;
+		
+		countQueryString = dk_string_from_format(dk_stringify_sql(SELECT COUNT(*) FROM (%@)), selectQueryString);
+	}
+	else
+	{
+		NSArray *clauses = [self filterClausesForFetchRequest:fetchRequest arguments:arguments error:error];
+		if(!clauses)
+			return NSNotFound;
+		
+		countQueryString = dk_string_from_format(dk_stringify_sql(SELECT COUNT(*) FROM %@), [table.name stringByEscapingStringForLiteralUseInSQLQueries]);
+		if([clauses count] > 0)
+			countQueryString = [countQueryString stringByAppendingFormat:@" WHERE %@", [clauses componentsJoinedByString:@" AND "]];
+	}
+	
+	DKCompiledSQLQuery *countQuery = [self compileSQLQuery:countQueryString error:error];
+	if(!countQuery)
+		return NSNotFound;
+	
+	int parameterIndex = 1;
+	for (id argument in arguments)
+		[countQuery setArgument:argument forParameterAtIndex:parameterIndex++];
+	
+	NSUInteger count = 0;
+	if([countQuery nextRow])
+		count = (NSUInteger)[countQuery longLongForColumnAtIndex:0];
+	[countQuery reset];
+	
+	//
+	//	If SQLite couldn't sort the rows it couldn't page them either. How many
+	//	rows are on a page doesn't depend on their order, so we page the count.
+	//
+	if(isPaged && ([fetchRequest.sortDescriptors count] > 0) && ![self orderingTermsForFetchRequest:fetchRequest])
+	{
+		count = (count > fetchRequest.fetchOffset)? (count - fetchRequest.fetchOffset) : 0;
+		if(fetchRequest.fetchLimit > 0)
+			count = MIN(count, fetchRequest.fetchLimit);
+	}
+	
+	return count;
+}
+
+///Returns the SQL aggregate expression for an aggregate description, and the attribute it is computed over by reference.
+static NSString *DKSQLExpressionForAggregate(DKAggregateDescription *aggregate, DKTableDescription *table, DKAttributeDescription **outAttribute)
+{
+	DKAttributeDescription *attribute = nil;
+	NSString *column = @"*";
+	if(aggregate.attributeName)
+	{
+		attribute = (DKAttributeDescription *)[table propertyWithName:aggregate.attributeName];
+		NSCAssert([attribute isKindOfClass:[DKAttributeDescription class]], 
+				  @"%@ is not an attribute of the table %@.", aggregate.attributeName, table.name);
+		
+		column = [attribute.name stringByEscapingStringForLiteralUseInSQLQueries];
+	}
+	
+	if(outAttribute)
+		*outAttribute = attribute;
+	
+	switch (aggregate.function)
+	{
+		case kDKAggregateFunctionCount:
+			return dk_string_from_format(@"COUNT(%@)", column);
+			
+		case kDKAggregateFunctionSum:
+			return dk_string_from_format(@"SUM(%@)", column);
+			
+		case kDKAggregateFunctionAverage:
+			return dk_string_from_format(@"AVG(%@)", column);
+			
+		case kDKAggregateFunctionMinimum:
+			return dk_string_from_format(@"MIN(%@)", column);
+			
+		case kDKAggregateFunctionMaximum:
+			return dk_string_from_format(@"MAX(%@)", column);
+	}
+	
+	return nil;
+}
+
+- (NSArray *)executeAggregateFetchRequest:(DKFetchRequest *)fetchRequest operation:(DKDatabaseOperation *)operation error:(NSError **)error
+{
+	NSParameterAssert(fetchRequest);
+	
+	DKTableDescription *table = fetchRequest.table;
+	NSAssert((table != nil), @"Fetch request %@ does not have a table.", fetchRequest);
+	NSAssert((fetchRequest.fetchAfterObject == nil), @"Aggregate fetch requests cannot fetch after an object.");
+	
+	NSArray *aggregates = fetchRequest.aggregates;
+	NSAssert(([aggregates count] > 0), @"Aggregate fetch request %@ does not have any aggregates.", fetchRequest);
+	
+	//
+	//	The attributes rows are grouped by come first in each result
+	//	row, followed by the aggregates in the order they were given.
+	//
+	NSMutableArray *groupAttributes = [NSMutableArray array];
+	NSMutableArray *groupColumns = [NSMutableArray array];
+	for (NSString *attributeName in fetchRequest.propertiesToGroupBy)
+	{
+		DKAttributeDescription *attribute = (DKAttributeDescription *)[table propertyWithName:attributeName];
+		NSAssert([attribute isKindOfClass:[DKAttributeDescription class]], 
+				 @"%@ is not an attribute of the table %@.", attributeName, table.name);
+		
+		[groupAttributes addObject:attribute];
+		[groupColumns addObject:[attributeName stringByEscapingStringForLiteralUseInSQLQueries]];
+	}
+	
+	NSMutableArray *columns = [NSMutableArray arrayWithArray:groupColumns];
+	NSMutableArray *aggregateAttributes = [NSMutableArray arrayWithCapacity:[aggregates count]];
+	NSMutableDictionary *aggregateColumnsByName = [NSMutableDictionary dictionaryWithCapacity:[aggregates count]];
+	for (DKAggregateDescription *aggregate in aggregates)
+	{
+		DKAttributeDescription *attribute = nil;
+		NSString *aggregateColumn = dk_string_from_format(@"_dk_aggregate_%lu", (unsigned long)[aggregateAttributes count]);
+		[columns addObject:dk_string_from_format(@"%@ AS %@", DKSQLExpressionForAggregate(aggregate, table, &attribute), aggregateColumn)];
+		[aggregateColumnsByName setObject:aggregateColumn forKey:aggregate.name];
+		[aggregateAttributes addObject:(attribute ?: (id)[NSNull null])];
+	}
+	
+	//
+	//	Groups can be sorted by the attributes they're grouped by and by their aggregates.
+	//	Sorting by anything else means nothing once the rows have been folded together.
+	//
+	NSMutableArray *orderingTerms = [NSMutableArray array];
+	for (NSSortDescriptor *sortDescriptor in fetchRequest.sortDescriptors)
+	{
+		NSString *orderingTerm = nil;
+		NSString *aggregateColumn = [aggregateColumnsByName objectForKey:sortDescriptor.key];
+		if(aggregateColumn)
+			orderingTerm = dk_string_from_format(@"%@ %@", aggregateColumn, sortDescriptor.ascending? @"ASC" : @"DESC");
+		else if([fetchRequest.propertiesToGroupBy containsObject:sortDescriptor.key])
+			orderingTerm = [sortDescriptor SQLOrderingTermForTable:table];
+		
+		if(!orderingTerm)
+		{
+			if(error) *error = DKLocalizedError(DKEvaluationErrorDomain, 0, nil, @"Unsupported aggregate sort descriptors", fetchRequest.sortDescriptors);
+			return nil;
+		}
+		
+		[orderingTerms addObject:orderingTerm];
+	}
+	
+	NSMutableArray *arguments = [NSMutableArray array];
+	NSArray *clauses = [self filterClausesForFetchRequest:fetchRequest arguments:arguments error:error];
+	if(!clauses)
+		return nil;
+	
+	NSMutableString *aggregateQueryString = [NSMutableString stringWithFormat:
+		dk_stringify_sql(
+			SELECT %@ FROM %@
+		),
+		[columns componentsJoinedByString:@", "], [table.name stringByEscapingStringForLiteralUseInSQLQueries]
+	];
+	
+	if([clauses count] > 0)
+		[aggregateQueryString appendFormat:@" WHERE %@", [clauses componentsJoinedByString:@" AND "]];
+	
+	if([groupColumns count] > 0)
+		[aggregateQueryString appendFormat:@" GROUP BY %@", [groupColumns componentsJoinedByString:@", "]];
+	
+	if([orderingTerms count] > 0)
+		[aggregateQueryString appendFormat:@" ORDER BY %@", [orderingTerms componentsJoinedByString:@", "]];
+	
+	if((fetchRequest.fetchLimit > 0) || (fetchRequest.fetchOffset > 0))
+	{
+		[aggregateQueryString appendString:@" LIMIT ? OFFSET ?"];
+		
+		//A negative limit means there is no limit.
+		long long fetchLimit = fetchRequest.fetchLimit;
+		[arguments addObject:[NSNumber numberWithLongLong:(fetchLimit > 0)? fetchLimit : -1]];
+		[arguments addObject:[NSNumber numberWithUnsignedInteger:fetchRequest.fetchOffset]];
+	}
+	
+	DKCompiledSQLQuery *aggregateQuery = [self compileSQLQuery:aggregateQueryString error:error];
+	if(!aggregateQuery)
+		return nil;
+	
+	int parameterIndex = 1;
+	for (id argument in arguments)
+		[aggregateQuery setArgument:argument forParameterAtIndex:parameterIndex++];
+	
+	//
+	//	Each group becomes a dictionary. NULL values, like the sum of
+	//	no rows, are left out of it rather than stored as NSNull.
+	//
+	NSMutableArray *results = [NSMutableArray array];
+	while ([aggregateQuery nextRow])
+	{
+		if(operation.isCancelled)
+		{
+			[aggregateQuery reset];
+			
+			if(error) *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil];
+			return nil;
+		}
+		
+		NSMutableDictionary *result = [NSMutableDictionary dictionaryWithCapacity:[columns count]];
+		
+		int columnIndex = 0;
+		for (DKAttributeDescription *attribute in groupAttributes)
+		{
+			id value = [aggregateQuery valueForColumnAtIndex:columnIndex++ attribute:attribute];
+			if(value)
+				[result setObject:value forKey:attribute.name];
+		}
+		
+		NSUInteger aggregateIndex = 0;
+		for (DKAggregateDescription *aggregate in aggregates)
+		{
+			id attribute = [aggregateAttributes objectAtIndex:aggregateIndex++];
+			
+			id value = nil;
+			switch (aggregate.function)
+			{
+				case kDKAggregateFunctionCount:
+					value = [aggregateQuery valueForColumnAtIndex:columnIndex type:DKAttributeTypeInt64];
+					break;
+					
+				case kDKAggregateFunctionSum:
+					value = [aggregateQuery valueForColumnAtIndex:columnIndex type:(((DKAttributeDescription *)attribute).type == DKAttributeTypeFloat)? DKAttributeTypeFloat : DKAttributeTypeInt64];
+					break;
+					
+				case kDKAggregateFunctionAverage:
+					value = [aggregateQuery valueForColumnAtIndex:columnIndex type:DKAttributeTypeFloat];
+					break;
+					
+				case kDKAggregateFunctionMinimum:
+				case kDKAggregateFunctionMaximum:
+					value = [aggregateQuery valueForColumnAtIndex:columnIndex attribute:attribute];
+					break;
+			}
+			
+			if(value)
+				[result setObject:value forKey:aggregate.name];
+			
+			columnIndex++;
+		}
+		
+		[results addObject:result];
+	}
+	
+	return results;
+}
+
+#pragma mark -
+#pragma mark Prefetching
+
+///Returns the escaped attribute columns of a specified table, each qualified with a table alias.
+static NSString *DKQualifiedAttributeColumnList(DKTableDescription *table, NSString *alias)
+{
+	NSMutableArray *columns = [NSMutableArray arrayWithCapacity:[table.attributes count]];
+	for (DKAttributeDescription *attribute in table.attributes)
+		[columns addObject:dk_string_from_format(@"%@.%@", alias, [attribute.name stringByEscapingStringForLiteralUseInSQLQueries])];
+	
+	return [columns componentsJoinedByString:@", "];
+}
+
+///Read a relationship of a list of objects, returning the distinct objects at its other end.
+static NSArray *DKDatabasePrefetchRelationship(DKDatabase *self, DKRelationshipDescription *relationship, NSArray *objects, NSError **error)
+{
+	DKTableDescription *sourceTable = relationship.table;
+	DKTableDescription *targetTable = relationship.targetTable;
+	NSString *escapedTargetTableName = [targetTable.name stringByEscapingStringForLiteralUseInSQLQueries];
+	
+	//
+	//	Every query returns the unique identifier of the object a row belongs to, followed
+	//	by the related row itself. The objects at the other end of the relationship are
+	//	hydrated by the same query that finds them, so walking into them is free.
+	//
+	NSArray *targetAttributes = targetTable.attributes;
+	NSString *targetColumns = @"target._dk_uniqueIdentifier";
+	if([targetAttributes count] > 0)
+		targetColumns = [targetColumns stringByAppendingFormat:@", %@", DKQualifiedAttributeColumnList(targetTable, @"target")];
+	
+	NSString *queryPrefix = nil;
+	if(![relationship isToMany])
+	{
+		queryPrefix = dk_string_from_format(
+			dk_stringify_sql(
+				SELECT source._dk_uniqueIdentifier, %@ FROM %@ AS source 
+				INNER JOIN %@ AS target ON (target._dk_uniqueIdentifier = source.%@) 
+				WHERE source._dk_uniqueIdentifier
+			),
+			targetColumns, 
+			[sourceTable.name stringByEscapingStringForLiteralUseInSQLQueries], 
+			escapedTargetTableName, 
+			[relationship.name stringByEscapingStringForLiteralUseInSQLQueries]
+		);
+	}
+	else if([relationship usesJoinTable])
+	{
+		queryPrefix = dk_string_from_format(
+			dk_stringify_sql(
+				SELECT joinTable.%@, %@ FROM %@ AS joinTable 
+				INNER JOIN %@ AS target ON (target._dk_uniqueIdentifier = joinTable.%@) 
+				WHERE joinTable.%@
+			),
+			[relationship joinTableSourceColumnName], 
+			targetColumns, 
+			[[relationship joinTableName] stringByEscapingStringForLiteralUseInSQLQueries], 
+			escapedTargetTableName, 
+			[relationship joinTableDestinationColumnName], 
+			[relationship joinTableSourceColumnName]
+		);
+	}
+	else
+	{
+		NSString *escapedForeignKeyName = [relationship.inverseRelationship.name stringByEscapingStringForLiteralUseInSQLQueries];
+		queryPrefix = dk_string_from_format(
+			dk_stringify_sql(
+				SELECT target.%@, %@ FROM %@ AS target WHERE target.%@
+			),
+			escapedForeignKeyName, targetColumns, escapedTargetTableName, escapedForeignKeyName
+		);
+	}
+	
+	//
+	//	The generation is noted before anything is read so that a change
+	//	made while we're reading throws away what we're about to cache.
+	//
+	int32_t generation = [self generationOfRelationship:relationship];
+	
+	NSMutableDictionary *relatedObjectsBySource = [NSMutableDictionary dictionaryWithCapacity:[objects count]];
+	NSMutableSet *allRelatedObjects = [NSMutableSet set];
+	
+	NSUInteger numberOfObjects = [objects count];
+	for (NSUInteger batchStart = 0; batchStart < numberOfObjects; batchStart += kDKDatabasePrefetchBatchSize)
+	{
+		NSArray *batch = [objects subarrayWithRange:NSMakeRange(batchStart, MIN(kDKDatabasePrefetchBatchSize, numberOfObjects - batchStart))];
+		NSString *selectQueryString = dk_string_from_format(@"%@ IN (%@)", queryPrefix, [NSString SQLParameterListWithCount:[batch count]]);
+		
+		DKCompiledSQLQuery *selectQuery = [self compileSQLQuery:selectQueryString error:error];
+		if(!selectQuery)
+			return nil;
+		
+		int parameterIndex = 1;
+		for (DKManagedObject *object in batch)
+			[selectQuery setLongLong:object.uniqueIdentifier forParameterAtIndex:parameterIndex++];
+		
+		while ([selectQuery nextRow])
+		{
+			NSNumber *sourceUniqueIdentifier = [NSNumber numberWithLongLong:[selectQuery longLongForColumnAtIndex:0]];
+			DKManagedObject *relatedObject = [self databaseObjectInTable:targetTable withUniqueIdentifier:[selectQuery longLongForColumnAtIndex:1]];
+			if([targetAttributes count] > 0)
+				[relatedObject cacheAttributes:targetAttributes fromRowOfQuery:selectQuery startingAtColumnIndex:2];
+			
+			NSMutableArray *relatedObjects = [relatedObjectsBySource objectForKey:sourceUniqueIdentifier];
+			if(!relatedObjects)
+			{
+				relatedObjects = [NSMutableArray array];
+				[relatedObjectsBySource setObject:relatedObjects forKey:sourceUniqueIdentifier];
+			}
+			
+			[relatedObjects addObject:relatedObject];
+			[allRelatedObjects addObject:relatedObject];
+		}
+		
+		[selectQuery reset];
+	}
+	
+	//
+	//	Objects without any rows are given an empty relationship,
+	//	which is just as much worth remembering as a full one.
+	//
+	NSArray *noObjects = [NSArray array];
+	for (DKManagedObject *object in objects)
+	{
+		NSArray *relatedObjects = [relatedObjectsBySource objectForKey:[NSNumber numberWithLongLong:object.uniqueIdentifier]];
+		[object cacheRelatedObjects:(relatedObjects ?: noObjects) forRelationship:relationship generation:generation];
+	}
+	
+	return [allRelatedObjects allObjects];
+}
+
+- (BOOL)prefetchRelationshipKeyPaths:(NSArray *)keyPaths forObjects:(NSArray *)objects inTable:(DKTableDescription *)table error:(NSError **)error
+{
+	NSParameterAssert(keyPaths);
+	NSParameterAssert(objects);
+	NSParameterAssert(table);
+	
+	if([objects count] == 0)
+		return YES;
+	
+	//
+	//	Key paths that start with the same relationship are prefetched together,
+	//	so `author.name` and `author.publisher` only read `author` once.
+	//
+	NSMutableDictionary *remainingKeyPathsByKey = [NSMutableDictionary dictionary];
+	for (NSString *keyPath in keyPaths)
+	{
+		NSRange separatorRange = [keyPath rangeOfString:@"."];
+		NSString *key = (separatorRange.location != NSNotFound)? [keyPath substringToIndex:separatorRange.location] : keyPath;
+		
+		NSMutableArray *remainingKeyPaths = [remainingKeyPathsByKey objectForKey:key];
+		if(!remainingKeyPaths)
+		{
+			remainingKeyPaths = [NSMutableArray array];
+			[remainingKeyPathsByKey setObject:remainingKeyPaths forKey:key];
+		}
+		
+		if(separatorRange.location != NSNotFound)
+			[remainingKeyPaths addObject:[keyPath substringFromIndex:NSMaxRange(separatorRange)]];
+	}
+	
+	for (NSString *key in remainingKeyPathsByKey)
+	{
+		DKRelationshipDescription *relationship = (DKRelationshipDescription *)[table propertyWithName:key];
+		NSAssert([relationship isKindOfClass:[DKRelationshipDescription class]], 
+				 @"%@ is not a relationship of the table %@.", key, table.name);
+		
+		NSArray *relatedObjects = DKDatabasePrefetchRelationship(self, relationship, objects, error);
+		if(!relatedObjects)
+			return NO;
+		
+		NSArray *remainingKeyPaths = [remainingKeyPathsByKey objectForKey:key];
+		if(([remainingKeyPaths count] > 0) && 
+		   ![self prefetchRelationshipKeyPaths:remainingKeyPaths forObjects:relatedObjects inTable:relationship.targetTable error:error])
+			return NO;
+	}
+	
+	return YES;
+}
+
+#pragma mark -
+#pragma mark Inserting
+
+- (id)insertNewObjectIntoTable:(DKTableDescription *)table error:(NSError **)error
+{
+	NSParameterAssert(table);
+	
+	if(![self isOnWriterQueue])
+	{
+		__block id databaseObject = nil;
+		[self performWriterBlock:^(NSError **writerError) {
+			databaseObject = [self insertNewObjectIntoTable:table error:writerError];
+			return (BOOL)(databaseObject != nil);
+		} error:error];
+		
+		return databaseObject;
+	}
+	
+	NSError *transientError = nil;
+	
+	//The table name could very well contain single quotes so we escape it.
+	NSString *escapedTableName = [table.name stringByEscapingStringForLiteralUseInSQLQueries];
+	
+	//
+	//	First things first, we need to fetch the last unique identifier from
+	//	the database's internal sequence table. We use this to calculate the new
+	//	unique identifier for the object we're about to insert.
+	//
+	NSString *selectOffsetQueryString = dk_string_from_format(
+		dk_stringify_sql(
+			SELECT offset FROM %@ WHERE name = ?
+		),
+		kDKDatabaseSequenceTableName
+	);
+	DKCompiledSQLQuery *selectOffsetQuery = [self compileSQLQuery:selectOffsetQueryString error:&transientError];
+	if(!selectOffsetQuery)
+		return nil;
+	
+	[selectOffsetQuery setString:escapedTableName forParameterAtIndex:1];
+	
+	
+	//
+	//	If we find an entry in the database sequence describing the last unique identifier
+	//	given to a row in `table` we increment that value by one and use that as the
+	//	unique identifier of the row we're about to create. If we don't find an existing row
+	//	then we're the first object to be inserted into this table and we use the identifier '0'.
+	//
+	int64_t newUniqueIdentifier = 1;
+	if([selectOffsetQuery nextRow])
+		newUniqueIdentifier = [selectOffsetQuery longLongForColumnAtIndex:0] + 1;
+	[selectOffsetQuery reset];
+	
+	
+	//
+	//	Its time to insert a new row into `table`. We pass in the unique identifier
+	//	we just created and prey to someone's god that this works. If it does, it
+	//	confirms our suspicions that there is no god. After all, what kind of god
+	//	would insert a new row into our database, its not like it attends church.
+	//
+	NSString *insertNewRowQueryString = dk_string_from_format(
+		dk_stringify_sql(
+			INSERT INTO '%@' (_dk_uniqueIdentifier) VALUES (?)
+		),
+		escapedTableName
+	);
+	DKCompiledSQLQuery *insertNewRowQuery = [self compileSQLQuery:insertNewRowQueryString error:&transientError];
+	if(!insertNewRowQuery)
+		return nil;
+	
+	[insertNewRowQuery setLongLong:newUniqueIdentifier forParameterAtIndex:1];
+	
+	//
+	//	If the insertion was successful then the query should have one row waiting
+	//	for us. If it doesn't the insertion failed and we're in a world of hurt.
+	//
+	BOOL success = [insertNewRowQuery evaluateAndReturnError:&transientError];
+	NSAssert(success, @"Could not create new row for table named %@. Got error %@.", table.name, transientError);
+	
+	NSString *updateLastUniqueIdentifierQueryString = dk_string_from_format(
+		dk_stringify_sql(
+			UPDATE %@ SET offset = ? WHERE name = ?
+		),
+		kDKDatabaseSequenceTableName
+	);
+	DKCompiledSQLQuery *updateLastUniqueIdentifierQuery = [self compileSQLQuery:updateLastUniqueIdentifierQueryString error:&transientError];
+	NSAssert((updateLastUniqueIdentifierQuery != nil),
+			 @"Could not compile unique identifier update query. Got error %@.", transientError);
+	
+	[updateLastUniqueIdentifierQuery setLongLong:newUniqueIdentifier forParameterAtIndex:1];
+	[updateLastUniqueIdentifierQuery setString:escapedTableName forParameterAtIndex:2];
+	success = [updateLastUniqueIdentifierQuery evaluateAndReturnError:&transientError];
+	NSAssert(success, @"Could not update unique identifier in DKDatabase internal state. Got error %@.", transientError);
+	
+	
+	//
+	//	We need to verify that the database-object-class the table specifies
+	//	inherits from DKManagedObject. If it doesn't then we have a problem.
+	//
+	Class databaseObjectClass = table.databaseObjectClass;
+	NSAssert(((databaseObjectClass == [DKManagedObject class]) || [databaseObjectClass isSubclassOfClass:[DKManagedObject class]]), 
+			 @"Database object class %@ does not inherit DKManagedObject. You fail at life.", NSStringFromClass(databaseObjectClass));
+	
+	//
+	//	Now that we have a nice new row in `table`, we can create a wrapper object for it.
+	//	We use the database-object-class specified by `table`. It could be something other
+	//	then DKManagedObject.
+	//
+	id databaseObject = [[databaseObjectClass alloc] initWithUniqueIdentifier:newUniqueIdentifier 
+																		table:table 
+																	 database:self];
+	[databaseObject awakeFromInsertion];
+	
+	[self registerDatabaseObject:databaseObject];
+	[databaseObject release];
+	
+	return databaseObject;
+}
+
+- (BOOL)reserveUniqueIdentifiers:(NSUInteger)count inTable:(DKTableDescription *)table firstUniqueIdentifier:(int64_t *)outFirstUniqueIdentifier error:(NSError **)error
+{
+	NSParameterAssert(table);
+	NSParameterAssert(outFirstUniqueIdentifier);
+	
+	NSString *escapedTableName = [table.name stringByEscapingStringForLiteralUseInSQLQueries];
+	
+	//
+	//	We claim the whole block of identifiers by bumping the table's sequence
+	//	entry once, then read back where the block ends.
+	//
+	NSString *updateOffsetQueryString = dk_string_from_format(
+		dk_stringify_sql(
+			UPDATE %@ SET offset = offset + ? WHERE name = ?
+		),
+		kDKDatabaseSequenceTableName
+	);
+	DKCompiledSQLQuery *updateOffsetQuery = [self compileSQLQuery:updateOffsetQueryString error:error];
+	if(!updateOffsetQuery)
+		return NO;
+	
+	[updateOffsetQuery setLongLong:count forParameterAtIndex:1];
+	[updateOffsetQuery setString:escapedTableName forParameterAtIndex:2];
+	if(![updateOffsetQuery evaluateAndReturnError:error])
+		return NO;
+	
+	
+	//
+	//	If the table has no sequence entry yet, it has never had anything
+	//	inserted into it and our block starts at the very beginning.
+	//
+	if(sqlite3_changes(mSQLiteConnection) == 0)
+	{
+		NSString *insertOffsetQueryString = dk_string_from_format(
+			dk_stringify_sql(
+				INSERT INTO %@ (name, offset) VALUES (?, ?)
+			),
+			kDKDatabaseSequenceTableName
+		);
+		DKCompiledSQLQuery *insertOffsetQuery = [self compileSQLQuery:insertOffsetQueryString error:error];
+		if(!insertOffsetQuery)
+			return NO;
+		
+		[insertOffsetQuery setString:escapedTableName forParameterAtIndex:1];
+		[insertOffsetQuery setLongLong:count forParameterAtIndex:2];
+		if(![insertOffsetQuery evaluateAndReturnError:error])
+			return NO;
+		
+		*outFirstUniqueIdentifier = 1;
+		return YES;
+	}
+	
+	
+	NSString *selectOffsetQueryString = dk_string_from_format(
+		dk_stringify_sql(
+			SELECT offset FROM %@ WHERE name = ?
+		),
+		kDKDatabaseSequenceTableName
+	);
+	DKCompiledSQLQuery *selectOffsetQuery = [self compileSQLQuery:selectOffsetQueryString error:error];
+	if(!selectOffsetQuery)
+		return NO;
+	
+	[selectOffsetQuery setString:escapedTableName forParameterAtIndex:1];
+	
+	int64_t lastUniqueIdentifier = 0;
+	if([selectOffsetQuery nextRow])
+		lastUniqueIdentifier = [selectOffsetQuery longLongForColumnAtIndex:0];
+	[selectOffsetQuery reset];
+	
+	*outFirstUniqueIdentifier = lastUniqueIdentifier - (int64_t)count + 1;
+	return YES;
+}
+
+- (BOOL)insertRowsIntoTable:(DKTableDescription *)table count:(NSUInteger)count values:(NSArray *)values firstUniqueIdentifier:(int64_t)firstUniqueIdentifier error:(NSError **)error
+{
+	NSString *escapedTableName = [table.name stringByEscapingStringForLiteralUseInSQLQueries];
+	
+	//
+	//	Rows are grouped by the set of columns they provide values for. Each group
+	//	gets one compiled INSERT that is bound and evaluated again for every row.
+	//
+	NSMutableDictionary *insertQueries = [NSMutableDictionary dictionary];
+	
+	BOOL success = YES;
+	NSAutoreleasePool *pool = [NSAutoreleasePool new];
+	for (NSUInteger index = 0; index < count; index++)
+	{
+		NSDictionary *rowValues = values? [values objectAtIndex:index] : nil;
+		NSArray *columnNames = [[rowValues allKeys] sortedArrayUsingSelector:@selector(compare:)];
+		
+		NSString *columnKey = [columnNames componentsJoinedByString:@"\n"];
+		DKCompiledSQLQuery *insertQuery = [insertQueries objectForKey:columnKey];
+		if(!insertQuery)
+		{
+			NSMutableString *columns = [NSMutableString stringWithString:@"_dk_uniqueIdentifier"];
+			NSMutableString *parameters = [NSMutableString stringWithString:@"?"];
+			for (NSString *columnName in columnNames)
+			{
+				[columns appendFormat:@", '%@'", [columnName stringByEscapingStringForLiteralUseInSQLQueries]];
+				[parameters appendString:@", ?"];
+			}
+			
+			NSString *insertQueryString = dk_string_from_format(
+				dk_stringify_sql(
+					INSERT INTO '%@' (%@) VALUES (%@)
+				),
+				escapedTableName, columns, parameters
+			);
+			insertQuery = [self compileSQLQuery:insertQueryString error:error];
+			if(!insertQuery)
+			{
+				success = NO;
+				break;
+			}
+			
+			[insertQueries setObject:insertQuery forKey:columnKey];
+		}
+		
+		[insertQuery setLongLong:(firstUniqueIdentifier + index) forParameterAtIndex:1];
+		
+		int parameterIndex = 2;
+		for (NSString *columnName in columnNames)
+		{
+			DKAttributeDescription *attribute = (DKAttributeDescription *)[table propertyWithName:columnName];
+			[insertQuery setValue:[rowValues objectForKey:columnName] attribute:attribute forParameterAtIndex:parameterIndex];
+			
+			parameterIndex++;
+		}
+		
+		if(![insertQuery evaluateAndReturnError:error])
+		{
+			success = NO;
+			break;
+		}
+		
+		//Don't let the temporaries for millions of rows pile up.
+		if((index % 1000) == 999)
+		{
+			[pool drain];
+			pool = [NSAutoreleasePool new];
+		}
+	}
+	
+	//
+	//	The error was created in the pool we're about to drain,
+	//	so it has to be kept alive for the caller.
+	//
+	if(!success && error)
+		[*error retain];
+	[pool drain];
+	if(!success && error)
+		[*error autorelease];
+	
+	return success;
+}
+
+- (NSArray *)insertNewObjectsIntoTable:(DKTableDescription *)table count:(NSUInteger)count values:(NSArray *)values error:(NSError **)error
+{
+	NSParameterAssert(table);
+	if(values)
+		NSParameterAssert([values count] == count);
+	
+	if(![self isOnWriterQueue])
+	{
+		__block NSArray *objects = nil;
+		[self performWriterBlock:^(NSError **writerError) {
+			objects = [[self insertNewObjectsIntoTable:table count:count values:values error:writerError] retain];
+			return (BOOL)(objects != nil);
+		} error:error];
+		
+		return [objects autorelease];
+	}
+	
+	if(count == 0)
+		return [NSArray array];
+	
+	
+	//
+	//	We need to verify that the database-object-class the table specifies
+	//	inherits from DKManagedObject. If it doesn't then we have a problem.
+	//
+	Class databaseObjectClass = table.databaseObjectClass;
+	NSAssert(((databaseObjectClass == [DKManagedObject class]) || [databaseObjectClass isSubclassOfClass:[DKManagedObject class]]), 
+			 @"Database object class %@ does not inherit DKManagedObject. You fail at life.", NSStringFromClass(databaseObjectClass));
+	
+	
+	//
+	//	Every column is checked up front. Finding a bad one halfway through
+	//	the inserts would leave the transaction open with rows already in it.
+	//
+	for (NSDictionary *rowValues in values)
+	{
+		for (NSString *columnName in rowValues)
+		{
+			if(![[table propertyWithName:columnName] isKindOfClass:[DKAttributeDescription class]])
+			{
+				if(error) *error = DKLocalizedError(DKEvaluationErrorDomain, 0, nil, @"Unknown attribute", columnName, table.name);
+				return nil;
+			}
+		}
+	}
+	
+	//
+	//	Reserving the identifiers and inserting the rows all happen in one transaction.
+	//	If we're already inside of someone else's transaction ours is nested in it.
+	//
+	if(![self beginTransactionAndReturnError:error])
+		return nil;
+	
+	int64_t firstUniqueIdentifier = 0;
+	BOOL success = ([self reserveUniqueIdentifiers:count inTable:table firstUniqueIdentifier:&firstUniqueIdentifier error:error] && 
+					[self insertRowsIntoTable:table count:count values:values firstUniqueIdentifier:firstUniqueIdentifier error:error]);
+	
+	if(success)
+		success = [self commitTransactionAndReturnError:error];
+	else
+		[self rollbackTransaction];
+	
+	if(!success)
+		return nil;
+	
+	
+	//
+	//	The rows are in the database, so its time to create their wrapper objects.
+	//	We already know the initial values so we cache them right away.
+	//
+	NSMutableArray *databaseObjects = [NSMutableArray arrayWithCapacity:count];
+	for (NSUInteger index = 0; index < count; index++)
+	{
+		DKManagedObject *databaseObject = [[databaseObjectClass alloc] initWithUniqueIdentifier:(firstUniqueIdentifier + index) 
+																						   table:table 
+																						database:self];
+		
+		NSDictionary *rowValues = values? [values objectAtIndex:index] : nil;
+		for (DKAttributeDescription *attribute in (rowValues? table.attributes : nil))
+		{
+			id value = [rowValues objectForKey:attribute.name];
+			if(value && (value != [NSNull null]))
+				[databaseObject cacheValue:value forAttribute:attribute];
+		}
+		
+		[databaseObject awakeFromInsertion];
+		
+		[databaseObjects addObject:[self registerDatabaseObject:databaseObject]];
+		[databaseObject release];
+	}
+	
+	return databaseObjects;
+}
+
+#pragma mark -
+#pragma mark Deleting
+
+///Evaluate one of the queries that make up a deletion, adding its number of changes to a running total.
+static BOOL DKDatabaseCollectRowsForDeletion(DKDatabase *self, NSString *queryString, NSArray *arguments, NSUInteger *numberOfRows, NSError **error)
+{
+	DKCompiledSQLQuery *query = [self compileSQLQuery:queryString error:error];
+	if(!query)
+		return NO;
+	
+	int parameterIndex = 1;
+	for (id argument in arguments)
+		[query setArgument:argument forParameterAtIndex:parameterIndex++];
+	
+	if(![query evaluateAndReturnError:error])
+		return NO;
+	
+	if(numberOfRows)
+		*numberOfRows += sqlite3_changes(self->mSQLiteConnection);
+	
+	return YES;
+}
+
+///Remove every reference to the rows of a table selected by a parenthesized expression, from anywhere in the layout.
+static BOOL DKDatabaseDetachRows(DKDatabase *self, DKTableDescription *table, NSString *rowsExpression, NSArray *arguments, NSError **error)
+{
+	//
+	//	Every relationship in the layout that can point at the table is looked at, not just the
+	//	inverses of the table's own relationships. One without an inverse would otherwise be left
+	//	holding the unique identifier of a row that's gone. Join tables shared by a relationship
+	//	and its inverse are reached from both ends, so we only clean each one up once.
+	//
+	NSMutableSet *detachQueryStrings = [NSMutableSet set];
+	for (DKTableDescription *sourceTable in [self->mDatabaseLayout tables])
+	{
+		for (DKPropertyDescription *property in sourceTable.properties)
+		{
+			if(![property isKindOfClass:[DKRelationshipDescription class]])
+				continue;
+			
+			DKRelationshipDescription *relationship = (DKRelationshipDescription *)property;
+			if([relationship usesJoinTable])
+			{
+				NSString *escapedJoinTableName = [[relationship joinTableName] stringByEscapingStringForLiteralUseInSQLQueries];
+				if(sourceTable == table)
+				{
+					[detachQueryStrings addObject:dk_string_from_format(
+						dk_stringify_sql(
+							DELETE FROM %@ WHERE %@ IN %@
+						),
+						escapedJoinTableName, [relationship joinTableSourceColumnName], rowsExpression
+					)];
+				}
+				
+				if(relationship.targetTable == table)
+				{
+					[detachQueryStrings addObject:dk_string_from_format(
+						dk_stringify_sql(
+							DELETE FROM %@ WHERE %@ IN %@
+						),
+						escapedJoinTableName, [relationship joinTableDestinationColumnName], rowsExpression
+					)];
+				}
+			}
+			else if(![relationship isToMany] && (relationship.targetTable == table))
+			{
+				NSString *escapedColumnName = [relationship.name stringByEscapingStringForLiteralUseInSQLQueries];
+				[detachQueryStrings addObject:dk_string_from_format(
+					dk_stringify_sql(
+						UPDATE %@ SET '%@' = NULL WHERE %@ IN %@
+					),
+					[sourceTable.name stringByEscapingStringForLiteralUseInSQLQueries], 
+					escapedColumnName, escapedColumnName, rowsExpression
+				)];
+			}
+		}
+	}
+	
+	for (NSString *detachQueryString in detachQueryStrings)
+	{
+		if(!DKDatabaseCollectRowsForDeletion(self, detachQueryString, arguments, NULL, error))
+			return NO;
+	}
+	
+	return YES;
+}
+
+- (void)deleteObject:(DKManagedObject *)object
+{
+	NSParameterAssert(object);
+	
+	if(![self isOnWriterQueue])
+	{
+		[self performWriterBlock:^(NSError **writerError) {
+			[self deleteObject:object];
+			return YES;
+		} error:NULL];
+		
+		return;
+	}
+	
+	//
+	//	Cascading relationships can lead back to an object that is already being
+	//	deleted further up. Its deletion takes care of it, so we leave it alone.
+	//
+	if(object.isDeleted || ([mObjectsBeingDeleted indexOfObjectIdenticalTo:object] != NSNotFound))
+		return;
+	
+	[mObjectsBeingDeleted addObject:object];
+	
+	DKTableDescription *table = object.tableDescription;
+	NSArray *arguments = [NSArray arrayWithObject:[NSNumber numberWithLongLong:object.uniqueIdentifier]];
+	
+	NSError *error = nil;
+	BOOL success = [self performTransaction:^(NSError **transactionError) {
+		//
+		//	We let the managed object know that we're about to delete the row it
+		//	represents from the database. If it doesn't like that, too bad. The
+		//	objects at the other ends of its cascading relationships go with it.
+		//
+		[object prepareForDeletion];
+		
+		
+		//
+		//	Only one row is going away, so there's no need for a deletion table. We let
+		//	go of every reference to the row and then delete it by its unique identifier.
+		//
+		if(!DKDatabaseDetachRows(self, table, @"(?)", arguments, transactionError))
+			return NO;
+		
+		NSString *deleteQueryString = dk_string_from_format(
+			dk_stringify_sql(
+				DELETE FROM %@ WHERE _dk_uniqueIdentifier = ?
+			),
+			[table.name stringByEscapingStringForLiteralUseInSQLQueries]
+		);
+		return DKDatabaseCollectRowsForDeletion(self, deleteQueryString, arguments, NULL, transactionError);
+	} error:&error];
+	
+	[mObjectsBeingDeleted removeObjectIdenticalTo:object];
+	
+	//If this fails, something is wrong and we explode.
+	NSAssert(success, @"Could not delete object %@. Got error %@.", object, error);
+	
+	[self destroyDeletedDatabaseObject:object];
+}
+
+- (BOOL)deleteObjectsMatchingFetchRequest:(DKFetchRequest *)fetchRequest error:(NSError **)error
+{
+	NSParameterAssert(fetchRequest);
+	
+	if(![self isOnWriterQueue])
+	{
+		return [self performWriterBlock:^(NSError **writerError) {
+			return [self deleteObjectsMatchingFetchRequest:fetchRequest error:writerError];
+		} error:error];
+	}
+	
+	//
+	//	Fetching can sort in memory when SQLite can't, but deleting can't. Deleting
+	//	the first N rows by an order we can't express would delete the wrong rows.
+	//
+	BOOL isLimited = ((fetchRequest.fetchLimit > 0) || (fetchRequest.fetchOffset > 0));
+	if(isLimited && ([fetchRequest.sortDescriptors count] > 0) && ![self orderingTermsForFetchRequest:fetchRequest])
+	{
+		if(error) *error = DKLocalizedError(DKEvaluationErrorDomain, 0, nil, @"Unsupported sort descriptors for deletion", fetchRequest.sortDescriptors);
+		return NO;
+	}
+	
+	NSMutableArray *arguments = [NSMutableArray array];
+	NSString *selectQueryString = [self selectQueryStringForFetchRequest:fetchRequest columns:@"_dk_uniqueIdentifier" arguments:arguments error:error];
+	if(!selectQueryString)
+		return NO;
+	
+	return [self deleteRowsInTable:fetchRequest.table matchingSelectQuery:selectQueryString arguments:arguments error:error];
+}
+
+#pragma mark -
+
+- (BOOL)deleteRowsInTable:(DKTableDescription *)table matchingSelectQuery:(NSString *)selectQueryString arguments:(NSArray *)arguments error:(NSError **)error
+{
+	NSParameterAssert(table);
+	NSParameterAssert(selectQueryString);
+	NSParameterAssert(arguments);
+	NSAssert([self isOnWriterQueue], @"Rows can only be deleted on the writer queue.");
+	
+	//
+	//	Deleted rows are never loaded. Their unique identifiers are gathered into a temporary
+	//	table along with the table they belong to, and every statement after that works on
+	//	the whole set at once with `IN (SELECT ...)`, no matter how many rows there are.
+	//
+	NSString *doomedRowsQueryString = dk_string_from_format(
+		dk_stringify_sql(
+			SELECT uniqueIdentifier FROM %@ WHERE tableName = ?
+		),
+		kDKDatabaseDeletionTableName
+	);
+	
+	NSMutableArray *involvedTables = [NSMutableArray arrayWithObject:table];
+	NSMutableArray *deletedObjects = [NSMutableArray array];
+	
+	BOOL success = [self performTransaction:^(NSError **transactionError) {
+		NSString *createQueryString = dk_string_from_format(
+			dk_stringify_sql(
+				CREATE TEMP TABLE IF NOT EXISTS %@ (
+					tableName TEXT NOT NULL, 
+					uniqueIdentifier BIGINT NOT NULL, 
+					PRIMARY KEY (tableName, uniqueIdentifier)
+				)
+			),
+			kDKDatabaseDeletionTableName
+		);
+		if(![self executeSQLQuery:createQueryString error:transactionError])
+			return NO;
+		
+		NSString *insertQueryString = dk_string_from_format(
+			dk_stringify_sql(
+				INSERT OR IGNORE INTO %@ (tableName, uniqueIdentifier) SELECT ?, _dk_uniqueIdentifier FROM (%@)
+			),
+			kDKDatabaseDeletionTableName, selectQueryString
+		);
+		NSArray *insertArguments = [[NSArray arrayWithObject:table.name] arrayByAddingObjectsFromArray:arguments];
+		if(!DKDatabaseCollectRowsForDeletion(self, insertQueryString, insertArguments, NULL, transactionError))
+			return NO;
+		
+		
+		//
+		//	Cascading relationships pull the rows at their other ends into the set. We keep
+		//	passing over every table involved until a pass adds nothing, so chains of cascades
+		//	are followed to the end. Rows already in the set are ignored, so cycles terminate.
+		//
+		NSUInteger numberOfNewRows = 0;
+		do
+		{
+			numberOfNewRows = 0;
+			
+			for (NSUInteger tableIndex = 0; tableIndex < [involvedTables count]; tableIndex++)
+			{
+				DKTableDescription *sourceTable = [involvedTables objectAtIndex:tableIndex];
+				NSString *doomedSourceRows = dk_string_from_format(@"(%@)", doomedRowsQueryString);
+				
+				for (DKPropertyDescription *property in sourceTable.properties)
+				{
+					if(![property isKindOfClass:[DKRelationshipDescription class]])
+						continue;
+					
+					DKRelationshipDescription *relationship = (DKRelationshipDescription *)property;
+					if(relationship.deleteAction != kDKRelationshipDeleteActionActionCascade)
+						continue;
+					
+					DKTableDescription *targetTable = relationship.targetTable;
+					NSString *cascadeQueryString = nil;
+					if(![relationship isToMany])
+					{
+						NSString *escapedColumnName = [relationship.name stringByEscapingStringForLiteralUseInSQLQueries];
+						cascadeQueryString = dk_string_from_format(
+							dk_stringify_sql(
+								INSERT OR IGNORE INTO %@ (tableName, uniqueIdentifier) 
+								SELECT ?, %@ FROM %@ WHERE (%@ IS NOT NULL) AND _dk_uniqueIdentifier IN %@
+							),
+							kDKDatabaseDeletionTableName, escapedColumnName, 
+							[sourceTable.name stringByEscapingStringForLiteralUseInSQLQueries], escapedColumnName, doomedSourceRows
+						);
+					}
+					else if([relationship usesJoinTable])
+					{
+						cascadeQueryString = dk_string_from_format(
+							dk_stringify_sql(
+								INSERT OR IGNORE INTO %@ (tableName, uniqueIdentifier) 
+								SELECT ?, %@ FROM %@ WHERE %@ IN %@
+							),
+							kDKDatabaseDeletionTableName, [relationship joinTableDestinationColumnName], 
+							[[relationship joinTableName] stringByEscapingStringForLiteralUseInSQLQueries], 
+							[relationship joinTableSourceColumnName], doomedSourceRows
+						);
+					}
+					else
+					{
+						cascadeQueryString = dk_string_from_format(
+							dk_stringify_sql(
+								INSERT OR IGNORE INTO %@ (tableName, uniqueIdentifier) 
+								SELECT ?, _dk_uniqueIdentifier FROM %@ WHERE %@ IN %@
+							),
+							kDKDatabaseDeletionTableName, [targetTable.name stringByEscapingStringForLiteralUseInSQLQueries], 
+							[relationship.inverseRelationship.name stringByEscapingStringForLiteralUseInSQLQueries], doomedSourceRows
+						);
+					}
+					
+					NSArray *cascadeArguments = [NSArray arrayWithObjects:targetTable.name, sourceTable.name, nil];
+					if(!DKDatabaseCollectRowsForDeletion(self, cascadeQueryString, cascadeArguments, &numberOfNewRows, transactionError))
+						return NO;
+					
+					if(![involvedTables containsObject:targetTable])
+						[involvedTables addObject:targetTable];
+				}
+			}
+		}
+		while (numberOfNewRows > 0);
+		
+		
+		//
+		//	Rows that survive are let go of by the rows being deleted. Every foreign key and join
+		//	table row pointing at the set is removed. The set's own foreign keys go away with its rows.
+		//
+		for (DKTableDescription *involvedTable in involvedTables)
+		{
+			NSString *doomedRows = dk_string_from_format(@"(%@)", doomedRowsQueryString);
+			NSArray *detachArguments = [NSArray arrayWithObject:involvedTable.name];
+			if(!DKDatabaseDetachRows(self, involvedTable, doomedRows, detachArguments, transactionError))
+				return NO;
+		}
+		
+		
+		//
+		//	Now the rows themselves are deleted, a table at a time. Any of them that
+		//	have managed objects in memory are noted so they can be given up once
+		//	the deletion is sure to have happened.
+		//
+		for (DKTableDescription *involvedTable in involvedTables)
+		{
+			DKCompiledSQLQuery *doomedRowsQuery = [self compileSQLQuery:doomedRowsQueryString error:transactionError];
+			if(!doomedRowsQuery)
+				return NO;
+			
+			[doomedRowsQuery setString:involvedTable.name forParameterAtIndex:1];
+			while ([doomedRowsQuery nextRow])
+			{
+				DKManagedObject *object = [self existingDatabaseObjectInTable:involvedTable withUniqueIdentifier:[doomedRowsQuery longLongForColumnAtIndex:0]];
+				if(object)
+					[deletedObjects addObject:object];
+			}
+			[doomedRowsQuery reset];
+			
+			NSString *deleteQueryString = dk_string_from_format(
+				dk_stringify_sql(
+					DELETE FROM %@ WHERE _dk_uniqueIdentifier IN (%@)
+				),
+				[involvedTable.name stringByEscapingStringForLiteralUseInSQLQueries], doomedRowsQueryString
+			);
+			NSArray *deleteArguments = [NSArray arrayWithObject:involvedTable.name];
+			if(!DKDatabaseCollectRowsForDeletion(self, deleteQueryString, deleteArguments, NULL, transactionError))
+				return NO;
+		}
+		
+		NSString *clearQueryString = dk_string_from_format(dk_stringify_sql(DELETE FROM %@), kDKDatabaseDeletionTableName);
+		return [self executeSQLQuery:clearQueryString error:transactionError];
+	} error:error];
+	
+	if(!success)
+		return NO;
+	
+	//
+	//	Relationships other objects have cached deleted objects in were invalidated by the
+	//	update hook as their foreign keys and join table rows were deleted along with them.
+	//
+	for (DKManagedObject *deletedObject in deletedObjects)
+		[self destroyDeletedDatabaseObject:deletedObject];
+	
+	return YES;
+}
+
+- (void)destroyDeletedDatabaseObject:(DKManagedObject *)object
+{
+	NSParameterAssert(object);
+	
+	//
+	//	We're done with the managed object. Any changes it had are meaningless now
+	//	that its row is gone. Once it's out of the map nobody new can get hold of it.
+	//
+	//
+	//	Someone else may still be holding on to the object, in an array or an autorelease
+	//	pool, so we can't destroy it out from under them. It's marked as deleted first,
+	//	then we give up our own reference. Whoever lets go of it last destroys it.
+	//
+	[object retain];
+	@synchronized(mObjectsWithChanges)
+	{
+		[mObjectsWithChanges removeObject:object];
+	}
+	[object markDeleted];
+	[self unregisterDatabaseObject:object];
+	[object release];
+}
+
+#pragma mark -
+#pragma mark Updating
+
+- (BOOL)updateObjectsMatchingFetchRequest:(DKFetchRequest *)fetchRequest withValues:(NSDictionary *)values error:(NSError **)error
+{
+	NSParameterAssert(fetchRequest);
+	NSParameterAssert(values);
+	
+	if(![self isOnWriterQueue])
+	{
+		return [self performWriterBlock:^(NSError **writerError) {
+			return [self updateObjectsMatchingFetchRequest:fetchRequest withValues:values error:writerError];
+		} error:error];
+	}
+	
+	if([values count] == 0)
+		return YES;
+	
+	//
+	//	Just like deleting, we can't update the first N rows in an order we can't express.
+	//
+	BOOL isLimited = ((fetchRequest.fetchLimit > 0) || (fetchRequest.fetchOffset > 0));
+	if(isLimited && ([fetchRequest.sortDescriptors count] > 0) && ![self orderingTermsForFetchRequest:fetchRequest])
+	{
+		if(error) *error = DKLocalizedError(DKEvaluationErrorDomain, 0, nil, @"Unsupported sort descriptors for update", fetchRequest.sortDescriptors);
+		return NO;
+	}
+	
+	DKTableDescription *table = fetchRequest.table;
+	NSMutableArray *attributes = [NSMutableArray arrayWithCapacity:[values count]];
+	NSMutableArray *assignments = [NSMutableArray arrayWithCapacity:[values count]];
+	for (NSString *key in values)
+	{
+		DKAttributeDescription *attribute = (DKAttributeDescription *)[table propertyWithName:key];
+		NSAssert([attribute isKindOfClass:[DKAttributeDescription class]], 
+				 @"%@ is not an attribute of the table %@.", key, table.name);
+		
+		[attributes addObject:attribute];
+		[assignments addObject:dk_string_from_format(@"'%@' = ?", [key stringByEscapingStringForLiteralUseInSQLQueries])];
+	}
+	
+	//
+	//	The whole change is made by a single UPDATE. The rows it touches are picked by the
+	//	same SELECT a fetch would use, so filters, predicates, limits and paging all apply.
+	//
+	NSMutableArray *arguments = [NSMutableArray array];
+	NSString *selectQueryString = [self selectQueryStringForFetchRequest:fetchRequest columns:@"_dk_uniqueIdentifier" arguments:arguments error:error];
+	if(!selectQueryString)
+		return NO;
+	
+	//
+	//	The rows are looked up before they're updated so that only the objects in memory
+	//	for them lose their cached values. Nothing else can write between the two
+	//	statements, we're on the writer queue.
+	//
+	DKCompiledSQLQuery *selectQuery = [self compileSQLQuery:selectQueryString error:error];
+	if(!selectQuery)
+		return NO;
+	
+	int argumentIndex = 1;
+	for (id argument in arguments)
+		[selectQuery setArgument:argument forParameterAtIndex:argumentIndex++];
+	
+	NSMutableData *updatedUniqueIdentifiers = [NSMutableData data];
+	while ([selectQuery nextRow])
+	{
+		int64_t uniqueIdentifier = [selectQuery longLongForColumnAtIndex:0];
+		[updatedUniqueIdentifiers appendBytes:&uniqueIdentifier length:sizeof(uniqueIdentifier)];
+	}
+	
+	if([updatedUniqueIdentifiers length] == 0)
+		return YES;
+	
+	NSString *updateQueryString = dk_string_from_format(
+		dk_stringify_sql(
+			UPDATE %@ SET %@ WHERE _dk_uniqueIdentifier IN (%@)
+		),
+		[table.name stringByEscapingStringForLiteralUseInSQLQueries], [assignments componentsJoinedByString:@", "], selectQueryString
+	);
+	DKCompiledSQLQuery *updateQuery = [self compileSQLQuery:updateQueryString error:error];
+	if(!updateQuery)
+		return NO;
+	
+	//The values come first in the statement, then the fetch request's constants.
+	int parameterIndex = 1;
+	for (DKAttributeDescription *attribute in attributes)
+	{
+		id value = [values objectForKey:attribute.name];
+		if(value == [NSNull null])
+			value = nil;
+		
+		[updateQuery setValue:value attribute:attribute forParameterAtIndex:parameterIndex++];
+	}
+	
+	for (id argument in arguments)
+		[updateQuery setArgument:argument forParameterAtIndex:parameterIndex++];
+	
+	if(![updateQuery evaluateAndReturnError:error])
+		return NO;
+	
+	//
+	//	The updated attributes are dropped from the cache of the updated rows' objects
+	//	that are in memory. They're read again the next time they're asked for.
+	//
+	const int64_t *uniqueIdentifiers = [updatedUniqueIdentifiers bytes];
+	NSUInteger numberOfUniqueIdentifiers = [updatedUniqueIdentifiers length] / sizeof(int64_t);
+	for (NSUInteger index = 0; index < numberOfUniqueIdentifiers; index++)
+	{
+		DKManagedObject *databaseObject = [self existingDatabaseObjectInTable:table withUniqueIdentifier:uniqueIdentifiers[index]];
+		for (DKAttributeDescription *attribute in attributes)
+			[databaseObject removeCacheForAttribute:attribute];
+	}
+	
+	return YES;
+}
+
+#pragma mark -
+#pragma mark Saving
+
+@synthesize defersChangesUntilSave = mDefersChangesUntilSave;
+
+- (void)databaseObjectDidChange:(DKManagedObject *)databaseObject
+{
+	NSParameterAssert(databaseObject);
+	
+	@synchronized(mObjectsWithChanges)
+	{
+		[mObjectsWithChanges addObject:databaseObject];
+	}
+}
+
+@dynamic hasChanges;
+- (BOOL)hasChanges
+{
+	@synchronized(mObjectsWithChanges)
+	{
+		return ([mObjectsWithChanges count] > 0);
+	}
+}
+
+- (BOOL)save:(NSError **)error
+{
+	if(![self isOnWriterQueue])
+	{
+		return [self performWriterBlock:^(NSError **writerError) {
+			return [self save:writerError];
+		} error:error];
+	}
+	
+	//
+	//	We take the current set of changed objects. Anything that
+	//	changes while we're saving will be picked up by the next save.
+	//
+	NSArray *objectsToSave = nil;
+	@synchronized(mObjectsWithChanges)
+	{
+		objectsToSave = [mObjectsWithChanges allObjects];
+		[mObjectsWithChanges removeAllObjects];
+	}
+	
+	if([objectsToSave count] == 0)
+		return YES;
+	
+	
+	//
+	//	All of the changes are written in a single transaction so they pay for one
+	//	commit rather than one per statement. If we're already inside of someone
+	//	else's transaction ours is nested in it, and committing is left to them.
+	//
+	if(![self beginTransactionAndReturnError:error])
+	{
+		@synchronized(mObjectsWithChanges)
+		{
+			[mObjectsWithChanges addObjectsFromArray:objectsToSave];
+		}
+		
+		return NO;
+	}
+	
+	BOOL success = YES;
+	NSMutableArray *savedChanges = [NSMutableArray arrayWithCapacity:[objectsToSave count]];
+	for (DKManagedObject *object in objectsToSave)
+	{
+		NSDictionary *changedValues = [object takeChangedValues] ?: [NSDictionary dictionary];
+		[savedChanges addObject:changedValues];
+		
+		if(![object writeChangedValues:changedValues error:error])
+		{
+			success = NO;
+			break;
+		}
+	}
+	
+	if(success)
+		success = [self commitTransactionAndReturnError:error];
+	else
+		[self rollbackTransaction];
+	
+	
+	//
+	//	If anything went wrong none of our writes were kept,
+	//	so every object gets its changes back.
+	//
+	if(!success)
+	{
+		[savedChanges enumerateObjectsUsingBlock:^(id changedValues, NSUInteger index, BOOL *stop) {
+			[[objectsToSave objectAtIndex:index] restoreChangedValues:changedValues];
+		}];
+		
+		@synchronized(mObjectsWithChanges)
+		{
+			[mObjectsWithChanges addObjectsFromArray:objectsToSave];
+		}
+	}
+	
+	return success;
+}
+
+- (void)saveWithCompletionHandler:(void (^)(BOOL success, NSError *error))completionHandler
+{
+	dispatch_async(mWriterQueue, [self writerQueueBlockWithBlock:^{
+		NSAutoreleasePool *pool = [NSAutoreleasePool new];
+		
+		//The save's outcome has to be its own, not that of a group committed later.
+		[self commitGroup];
+		
+		NSError *error = nil;
+		BOOL success = [self save:&error];
+		if(success)
+			error = nil;
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if(completionHandler)
+				completionHandler(success, error);
+		});
+		
+		[pool drain];
+	}]);
+}
+
+#pragma mark -
+#pragma mark Database Queries
+
+///Returns whether or not a query looks like it only reads from the database.
+DK_INLINE BOOL DKQueryIsSelect(NSString *query)
+{
+	NSString *trimmedQuery = [query stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+	return ([trimmedQuery rangeOfString:@"SELECT" options:(NSAnchoredSearch | NSCaseInsensitiveSearch)].location != NSNotFound);
+}
+
+- (DKCompiledSQLQuery *)compileSQLQuery:(NSString *)query error:(NSError **)error
+{
+	//
+	//	Cached queries don't retain us, so we make sure we outlive
+	//	the query we're handing out until the caller is done with it.
+	//
+	[[self retain] autorelease];
+	
+	//
+	//	When reads are concurrent, SELECTs go to the calling thread's own read-only
+	//	connection unless they have to see changes that haven't been committed yet.
+	//
+	if(DKQueryIsSelect(query) && ![self readsThroughWriteConnection])
+	{
+		DKDatabaseReaderConnection *readerConnection = [self readerConnectionForCurrentThreadAndReturnError:error];
+		if(!readerConnection)
+			return nil;
+		
+		DKCompiledSQLQuery *compiledQuery = [readerConnection.compiledQueryCache compiledQueryForString:query error:error];
+		if(!compiledQuery || compiledQuery.isReadOnly)
+			return compiledQuery;
+		
+		//It looked like a read but isn't one, so it has to go to the writer.
+		[compiledQuery reset];
+	}
+	
+	return [mCompiledQueryCache compiledQueryForString:query error:error];
+}
+
+- (BOOL)readsThroughWriteConnection
+{
+	if(!mUsesConcurrentReads || [self isOnWriterQueue])
+		return YES;
+	
+	//An open group's changes only exist on the write connection until it's committed.
+	if(mGroupCommitIsOpen)
+		return YES;
+	
+	//
+	//	Only the thread that began the open transaction can see its changes. Like the
+	//	writer thread, this is only ever set to a thread by that thread itself, so
+	//	nobody else can mistake it for their own.
+	//
+	return (mTransactionThread == [NSThread currentThread]);
+}
+
+- (sqlite3 *)sqliteConnectionForReadingAndReturnError:(NSError **)error
+{
+	if([self readsThroughWriteConnection])
+		return mSQLiteConnection;
+	
+	return [self readerConnectionForCurrentThreadAndReturnError:error].sqliteConnection;
+}
+
+#pragma mark -
+
+@dynamic compiledQueryCacheLimit;
+- (void)setCompiledQueryCacheLimit:(NSUInteger)limit
+{
+	mCompiledQueryCache.limit = limit;
+	
+	if(mReaderConnections)
+	{
+		@synchronized(mReaderConnections)
+		{
+			for (DKDatabaseReaderConnection *readerConnection in mReaderConnections)
+				readerConnection.compiledQueryCache.limit = limit;
+		}
+	}
+}
+
+- (NSUInteger)compiledQueryCacheLimit
+{
+	return mCompiledQueryCache.limit;
+}
+
+#pragma mark -
+
+@dynamic managedObjectLimit;
+- (void)setManagedObjectLimit:(NSUInteger)limit
+{
+	mManagedObjectLimit = limit;
+	
+	//A lower limit takes effect right away rather than on the next new object.
+	if((limit > 0) && (DKDatabaseNumberOfOwnedObjects(self) > limit))
+		[self evictDatabaseObjects];
+}
+
+- (NSUInteger)managedObjectLimit
+{
+	return mManagedObjectLimit;
+}
+
+@dynamic compiledQueryCacheHitCount;
+- (NSUInteger)compiledQueryCacheHitCount
+{
+	return mCompiledQueryCache.hitCount;
+}
+
+@dynamic compiledQueryCacheMissCount;
+- (NSUInteger)compiledQueryCacheMissCount
+{
+	return mCompiledQueryCache.missCount;
+}
+
+- (BOOL)executeSQLQuery:(NSString *)query error:(NSError **)error
+{
+	NSParameterAssert(query);
+	
+	if(![self isOnWriterQueue])
+	{
+		return [self performWriterBlock:^(NSError **writerError) {
+			return [self executeSQLQuery:query error:writerError];
+		} error:error];
+	}
+	
+	char *errorMessage = NULL;
+	int status = SQLITE_OK;
+	if((status = sqlite3_exec(mSQLiteConnection, //in SQLite3 handle
+							  [query UTF8String], //in cleanQuery
+							  NULL, //in callback
+							  NULL, //in callbackUserData
+							  &errorMessage /* out bycopy errorMessage */)) != SQLITE_OK)
+	{
+		if(error) *error = DKLocalizedError(DKEvaluationErrorDomain, 
+											status, 
+											nil, 
+											@"Update query failed", query, status, errorMessage);
+		
+		sqlite3_free(errorMessage);
+		
+		return NO;
+	}
+	
+	return YES;
+}
+
+#pragma mark -
+
+- (BOOL)tableExistsWithName:(NSString *)name
+{
+	NSString *tableInfoQueryString = dk_string_from_format(
+		dk_stringify_sql(
+			PRAGMA table_info(%@)
+		), 
+		[name stringByEscapingStringForLiteralUseInSQLQueries]
+	);
+	
+	NSError *error = nil;
+	DKCompiledSQLQuery *tableInfoQuery = [self compileSQLQuery:tableInfoQueryString error:&error];
+	NSAssert((tableInfoQuery != nil),
+			 @"Could not compile table info query. Got error %@.", error);
+	
+	BOOL tableExists = [tableInfoQuery nextRow];
+	[tableInfoQuery reset];
+	
+	return tableExists;
+}
+
 #pragma mark -
 #pragma mark Transactions
 
+///A writer waiting on the group commit that will make its transaction durable.
+typedef struct _DKGroupCommitWaiter {
+	dispatch_semaphore_t semaphore;
+	BOOL success;
+	NSError *error;
+} DKGroupCommitWaiter;
+
+@synthesize transactionDepth = mTransactionDepth;
+@synthesize groupCommitInterval = mGroupCommitInterval;
+
+- (BOOL)beginTransactionAndReturnError:(NSError **)error
+{
+	NSAssert([self isOnWriterQueue], @"Transactions can only be begun on the writer queue.");
+	
+	//
+	//	Only the outermost transaction is a real transaction. Everything
+	//	inside of it, including everything inside of an open group, is a
+	//	savepoint so that it can be rolled back without losing the rest.
+	//
+	BOOL isSavepoint = ((mTransactionDepth > 0) || mGroupCommitIsOpen);
+	
+	NSString *beginQuery = nil;
+	if(!isSavepoint)
+		beginQuery = dk_stringify_sql(BEGIN TRANSACTION);
+	else
+		beginQuery = dk_stringify_sql(SAVEPOINT _dk_savepoint);
+	
+	if(![self executeSQLQuery:beginQuery error:error])
+		return NO;
+	
+	//
+	//	A savepoint's changes are collected on their own so that they can
+	//	be told apart from the enclosing transaction's if it's rolled back.
+	//
+	if(isSavepoint)
+	{
+		[mSavepointChanges addObject:(mUncommittedChanges ?: (id)[NSNull null])];
+		[mUncommittedChanges release];
+		mUncommittedChanges = nil;
+	}
+	
+	mTransactionDepth++;
+	
+	return YES;
+}
+
+///Finish collecting the changes made inside of the innermost savepoint, returning them.
+static DKDatabaseChangeSet *DKDatabasePopSavepointChanges(DKDatabase *self)
+{
+	DKDatabaseChangeSet *savepointChanges = [self->mUncommittedChanges autorelease];
+	self->mUncommittedChanges = nil;
+	
+	//An automatic rollback may have taken the savepoint with it already.
+	id enclosingChanges = [self->mSavepointChanges lastObject];
+	if(enclosingChanges)
+	{
+		if(enclosingChanges != [NSNull null])
+			self->mUncommittedChanges = [enclosingChanges retain];
+		
+		[self->mSavepointChanges removeLastObject];
+	}
+	
+	return savepointChanges;
+}
+
+- (BOOL)commitTransactionAndReturnError:(NSError **)error
+{
+	NSAssert([self isOnWriterQueue], @"Transactions can only be committed on the writer queue.");
+	NSAssert((mTransactionDepth > 0), @"Attempting to commit a transaction when none is open.");
+	
+	mTransactionDepth--;
+	
+	BOOL isSavepoint = ((mTransactionDepth > 0) || mGroupCommitIsOpen);
+	
+	//The commit hook takes the changes, so we hold on to them to know which relationships they touched.
+	DKDatabaseChangeSet *committedChanges = isSavepoint? nil : [[mUncommittedChanges retain] autorelease];
+	
+	NSString *commitQuery = nil;
+	if(!isSavepoint)
+	{
+		commitQuery = dk_stringify_sql(COMMIT TRANSACTION);
+		
+		//Row identifiers only name the rows we changed until someone else gets to reuse them.
+		if(mUncommittedChanges)
+			[self resolveChanges:mUncommittedChanges];
+	}
+	else
+	{
+		commitQuery = dk_stringify_sql(RELEASE _dk_savepoint);
+	}
+	
+	if(![self executeSQLQuery:commitQuery error:error])
+	{
+		//
+		//	The transaction is still open. We put the depth back and roll it
+		//	back so that the connection is left in the state callers expect.
+		//
+		mTransactionDepth++;
+		[self rollbackTransaction];
+		
+		return NO;
+	}
+	
+	if(mTransactionDepth == 0)
+		mTransactionThread = nil;
+	
+	//The savepoint's changes are now part of the enclosing transaction.
+	if(isSavepoint)
+	{
+		DKDatabaseChangeSet *savepointChanges = DKDatabasePopSavepointChanges(self);
+		if(savepointChanges && mUncommittedChanges)
+			[mUncommittedChanges addChangesFromChangeSet:savepointChanges];
+		else if(savepointChanges)
+			mUncommittedChanges = [savepointChanges retain];
+	}
+	
+	//
+	//	Reader connections couldn't see the transaction's changes until now, so any
+	//	relationship they cached while it was open may already be out of date.
+	//
+	if(committedChanges)
+		[self invalidateRelationshipCachesForChanges:committedChanges];
+	
+	return YES;
+}
+
 - (void)beginTransaction
 {
+	if(![self isOnWriterQueue])
+	{
+		NSThread *callingThread = [NSThread currentThread];
+		[self performWriterBlock:^(NSError **writerError) {
+			[self beginTransaction];
+			
+			//The thread that began the transaction reads through the write connection until it's over.
+			if(mTransactionDepth == 1)
+				mTransactionThread = callingThread;
+			
+			return YES;
+		} error:NULL];
+		
+		return;
+	}
+	
 	NSError *error = nil;
-	NSAssert([self executeSQLQuery:dk_stringify_sql(BEGIN TRANSACTION) error:&error],
+	NSAssert([self beginTransactionAndReturnError:&error],
 			 @"Could not begin transaction. Got error %@.", error);
 }
 
 - (void)commitTransaction
 {
-	NSError *error = nil;
-	NSAssert([self executeSQLQuery:dk_stringify_sql(COMMIT TRANSACTION) error:&error],
-			 @"Could not commit transaction. Got error %@.", error);
+	if(![self isOnWriterQueue])
+	{
+		[self performWriterBlock:^(NSError **writerError) {
+			[self commitTransaction];
+			return YES;
+		} error:NULL];
+		
+		return;
+	}
+	
+	NSError *error = nil;
+	NSAssert([self commitTransactionAndReturnError:&error],
+			 @"Could not commit transaction. Got error %@.", error);
+}
+
+- (void)rollbackTransaction
+{
+	if(![self isOnWriterQueue])
+	{
+		[self performWriterBlock:^(NSError **writerError) {
+			[self rollbackTransaction];
+			return YES;
+		} error:NULL];
+		
+		return;
+	}
+	
+	NSAssert((mTransactionDepth > 0), @"Attempting to roll back a transaction when none is open.");
+	
+	mTransactionDepth--;
+	if(mTransactionDepth == 0)
+		mTransactionThread = nil;
+	
+	//
+	//	Relationships cached during the transaction may have seen changes that are undone here.
+	//	The rollback hook takes care of them when the whole transaction is rolled back.
+	//
+	//
+	//	Rolling back to a savepoint leaves it open, so it
+	//	has to be released to take it off of the stack.
+	//
+	NSError *error = nil;
+	if((mTransactionDepth == 0) && !mGroupCommitIsOpen)
+	{
+		NSAssert([self executeSQLQuery:dk_stringify_sql(ROLLBACK TRANSACTION) error:&error],
+				 @"Could not roll back transaction. Got error %@.", error);
+	}
+	else
+	{
+		NSAssert(([self executeSQLQuery:dk_stringify_sql(ROLLBACK TO _dk_savepoint) error:&error] && 
+				  [self executeSQLQuery:dk_stringify_sql(RELEASE _dk_savepoint) error:&error]),
+				 @"Could not roll back to savepoint. Got error %@.", error);
+		
+		//
+		//	SQLite doesn't invoke the rollback hook for savepoints, so the changes made
+		//	inside of this one are dropped from the transaction's here. Objects may still
+		//	have cached values that were read or written inside of it.
+		//
+		DKDatabaseChangeSet *savepointChanges = DKDatabasePopSavepointChanges(self);
+		if(savepointChanges)
+		{
+			[self invalidateRelationshipCachesForChanges:savepointChanges];
+			
+			savepointChanges.isRolledBack = YES;
+			DKDatabaseEnqueueChanges(self, savepointChanges);
+		}
+	}
+}
+
+#pragma mark -
+
+- (BOOL)performTransaction:(BOOL (^)(NSError **error))block error:(NSError **)error
+{
+	NSParameterAssert(block);
+	
+	//
+	//	Writers outside of the writer queue wait on a group commit when it's
+	//	enabled. Everything else commits (or nests) like a normal transaction.
+	//
+	BOOL joinsGroup = ((mGroupCommitInterval > 0.0) && ![self isOnWriterQueue]);
+	NSThread *callingThread = [NSThread currentThread];
+	
+	//
+	//	The waiter outlives the block that registers it, and is only read
+	//	by the group commit, so it lives on the heap until we're done with it.
+	//
+	__block DKGroupCommitWaiter *waiter = NULL;
+	
+	BOOL success = [self performWriterBlock:^(NSError **writerError) {
+		//
+		//	The first writer to arrive opens the group and schedules its commit.
+		//	If someone is already inside of a transaction begun with beginTransaction
+		//	we can't start a group, so we just nest in their transaction instead.
+		//
+		//	A caller that began that transaction itself must never wait on the group,
+		//	because the group can't be committed until the caller's transaction is.
+		//
+		BOOL holdsTransaction = ((mTransactionDepth > 0) && (mTransactionThread == callingThread));
+		BOOL isInGroup = (joinsGroup && !holdsTransaction && (mGroupCommitIsOpen || (mTransactionDepth == 0)));
+		if(isInGroup && !mGroupCommitIsOpen)
+		{
+			if(![self executeSQLQuery:dk_stringify_sql(BEGIN TRANSACTION) error:writerError])
+				return NO;
+			
+			mGroupCommitIsOpen = YES;
+			[self scheduleGroupCommit];
+		}
+		
+		if(![self beginTransactionAndReturnError:writerError])
+			return NO;
+		
+		if(!block(writerError))
+		{
+			[self rollbackTransaction];
+			return NO;
+		}
+		
+		if(![self commitTransactionAndReturnError:writerError])
+			return NO;
+		
+		if(isInGroup)
+		{
+			waiter = calloc(1, sizeof(DKGroupCommitWaiter));
+			waiter->semaphore = dispatch_semaphore_create(0);
+			
+			if(!mGroupCommitWaiters)
+				mGroupCommitWaiters = [NSMutableArray new];
+			[mGroupCommitWaiters addObject:[NSValue valueWithPointer:waiter]];
+		}
+		
+		return YES;
+	} joiningGroup:joinsGroup error:error];
+	
+	if(!success || !waiter)
+		return success;
+	
+	//
+	//	Our changes are in, but they aren't durable until the group is committed.
+	//
+	dispatch_semaphore_wait(waiter->semaphore, DISPATCH_TIME_FOREVER);
+	dispatch_release(waiter->semaphore);
+	
+	success = waiter->success;
+	[waiter->error autorelease];
+	if(!success && error)
+		*error = waiter->error;
+	
+	free(waiter);
+	
+	return success;
+}
+
+- (void)scheduleGroupCommit
+{
+	dispatch_time_t commitTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(mGroupCommitInterval * NSEC_PER_SEC));
+	dispatch_after(commitTime, mWriterQueue, [self writerQueueBlockWithBlock:^{
+		NSAutoreleasePool *pool = [NSAutoreleasePool new];
+		
+		[self commitGroup];
+		
+		[pool drain];
+	}]);
+}
+
+- (void)commitGroup
+{
+	NSAssert([self isOnWriterQueue], @"Groups can only be committed on the writer queue.");
+	
+	if(!mGroupCommitIsOpen)
+	{
+		mGroupCommitIsDue = NO;
+		return;
+	}
+	
+	//
+	//	Committing now would commit half of someone's transaction along with the
+	//	group. It's committed by the writer queue once their transaction is over.
+	//
+	if(mTransactionDepth > 0)
+	{
+		mGroupCommitIsDue = YES;
+		return;
+	}
+	
+	mGroupCommitIsOpen = NO;
+	mGroupCommitIsDue = NO;
+	
+	DKDatabaseChangeSet *committedChanges = [[mUncommittedChanges retain] autorelease];
+	if(committedChanges)
+		[self resolveChanges:committedChanges];
+	
+	NSError *error = nil;
+	BOOL success = [self executeSQLQuery:dk_stringify_sql(COMMIT TRANSACTION) error:&error];
+	if(!success)
+		[self executeSQLQuery:dk_stringify_sql(ROLLBACK TRANSACTION) error:NULL];
+	
+	//Relationships cached while the group was open were read from either side of it.
+	if(committedChanges)
+		[self invalidateRelationshipCachesForChanges:committedChanges];
+	
+	//Every writer in the group shares the outcome of its commit.
+	for (NSValue *waiterValue in mGroupCommitWaiters)
+	{
+		DKGroupCommitWaiter *waiter = [waiterValue pointerValue];
+		waiter->success = success;
+		waiter->error = [error retain];
+		
+		//The writer frees the waiter as soon as it wakes up, so we don't touch it after this.
+		dispatch_semaphore_t semaphore = waiter->semaphore;
+		dispatch_retain(semaphore);
+		dispatch_semaphore_signal(semaphore);
+		dispatch_release(semaphore);
+	}
+	
+	[mGroupCommitWaiters removeAllObjects];
+}
+
+#pragma mark -
+#pragma mark Committed Changes
+
+///Look up the unique identifiers of the rows with a specified set of SQLite row identifiers in a table.
+static NSMutableSet *DKDatabaseUniqueIdentifiersOfRows(DKDatabase *self, DKTableDescription *table, NSIndexSet *rows, NSError **error)
+{
+	NSString *queryPrefix = dk_string_from_format(
+		dk_stringify_sql(
+			SELECT _dk_uniqueIdentifier FROM %@ WHERE rowid
+		),
+		[table.name stringByEscapingStringForLiteralUseInSQLQueries]
+	);
+	
+	NSMutableSet *uniqueIdentifiers = [NSMutableSet setWithCapacity:[rows count]];
+	
+	NSUInteger *rowBuffer = malloc(sizeof(NSUInteger) * kDKDatabaseChangeLookupBatchSize);
+	NSRange remainingRange = NSMakeRange([rows firstIndex], [rows lastIndex] - [rows firstIndex] + 1);
+	NSUInteger numberOfRows = 0;
+	while ((numberOfRows = [rows getIndexes:rowBuffer maxCount:kDKDatabaseChangeLookupBatchSize inIndexRange:&remainingRange]) > 0)
+	{
+		NSString *selectQueryString = dk_string_from_format(@"%@ IN (%@)", queryPrefix, [NSString SQLParameterListWithCount:numberOfRows]);
+		DKCompiledSQLQuery *selectQuery = [self compileSQLQuery:selectQueryString error:error];
+		if(!selectQuery)
+		{
+			free(rowBuffer);
+			return nil;
+		}
+		
+		for (NSUInteger index = 0; index < numberOfRows; index++)
+			[selectQuery setLongLong:(long long)rowBuffer[index] forParameterAtIndex:(int)(index + 1)];
+		
+		while ([selectQuery nextRow])
+			[uniqueIdentifiers addObject:[NSNumber numberWithLongLong:[selectQuery longLongForColumnAtIndex:0]]];
+		
+		[selectQuery reset];
+	}
+	
+	free(rowBuffer);
+	
+	return uniqueIdentifiers;
+}
+
+///Find the managed objects in a specified array whose rows no longer exist.
+static NSArray *DKDatabaseObjectsWithMissingRows(DKDatabase *self, DKTableDescription *table, NSArray *objects, NSError **error)
+{
+	NSString *queryPrefix = dk_string_from_format(
+		dk_stringify_sql(
+			SELECT _dk_uniqueIdentifier FROM %@ WHERE _dk_uniqueIdentifier
+		),
+		[table.name stringByEscapingStringForLiteralUseInSQLQueries]
+	);
+	
+	NSMutableSet *existingUniqueIdentifiers = [NSMutableSet setWithCapacity:[objects count]];
+	
+	NSUInteger numberOfObjects = [objects count];
+	for (NSUInteger batchStart = 0; batchStart < numberOfObjects; batchStart += kDKDatabaseChangeLookupBatchSize)
+	{
+		NSArray *batch = [objects subarrayWithRange:NSMakeRange(batchStart, MIN(kDKDatabaseChangeLookupBatchSize, numberOfObjects - batchStart))];
+		NSString *selectQueryString = dk_string_from_format(@"%@ IN (%@)", queryPrefix, [NSString SQLParameterListWithCount:[batch count]]);
+		
+		DKCompiledSQLQuery *selectQuery = [self compileSQLQuery:selectQueryString error:error];
+		if(!selectQuery)
+			return nil;
+		
+		int parameterIndex = 1;
+		for (DKManagedObject *object in batch)
+			[selectQuery setLongLong:object.uniqueIdentifier forParameterAtIndex:parameterIndex++];
+		
+		while ([selectQuery nextRow])
+			[existingUniqueIdentifiers addObject:[NSNumber numberWithLongLong:[selectQuery longLongForColumnAtIndex:0]]];
+		
+		[selectQuery reset];
+	}
+	
+	NSMutableArray *objectsWithMissingRows = [NSMutableArray array];
+	for (DKManagedObject *object in objects)
+	{
+		if(![existingUniqueIdentifiers containsObject:[NSNumber numberWithLongLong:object.uniqueIdentifier]])
+			[objectsWithMissingRows addObject:object];
+	}
+	
+	return objectsWithMissingRows;
+}
+
+- (void)noteIncrementalWriteToRowWithIdentifier:(int64_t)rowIdentifier inTable:(DKTableDescription *)table
+{
+	NSParameterAssert(table);
+	
+	//sqlite3_blob_write() never invokes the update hook, so we do it ourselves.
+	DKDatabaseUpdateHook(self, SQLITE_UPDATE, "main", [[table.name stringByEscapingStringForLiteralUseInSQLQueries] UTF8String], rowIdentifier);
+}
+
+- (void)resolveChanges:(DKDatabaseChangeSet *)changes
+{
+	NSParameterAssert(changes);
+	NSAssert([self isOnWriterQueue], @"Changes can only be resolved on the writer queue.");
+	
+	if(changes.isResolved)
+		return;
+	
+	changes.isResolved = YES;
+	
+	//
+	//	Looking up a huge number of rows one batch at a time would hold up the writer
+	//	queue for longer than just telling everyone that the whole table has changed.
+	//
+	NSMapTable *rowsByTable[] = { changes.insertedRows, changes.updatedRows };
+	NSMapTable *uniqueIdentifiersByTable[] = { changes.insertedUniqueIdentifiers, changes.updatedUniqueIdentifiers };
+	for (NSUInteger index = 0; index < 2; index++)
+	{
+		NSMapEnumerator enumerator = NSEnumerateMapTable(rowsByTable[index]);
+		DKTableDescription *table = nil;
+		NSIndexSet *rows = nil;
+		while (NSNextMapEnumeratorPair(&enumerator, (void **)&table, (void **)&rows))
+		{
+			if([changes.tablesWithTooManyChanges containsObject:table])
+				continue;
+			
+			NSSet *uniqueIdentifiers = nil;
+			if([rows count] <= kDKDatabaseChangeLookupLimit)
+				uniqueIdentifiers = DKDatabaseUniqueIdentifiersOfRows(self, table, rows, NULL);
+			
+			if(uniqueIdentifiers)
+				NSMapInsert(uniqueIdentifiersByTable[index], table, uniqueIdentifiers);
+			else
+				[changes.tablesWithTooManyChanges addObject:table];
+		}
+		NSEndMapTableEnumeration(&enumerator);
+	}
+	
+	NSMapEnumerator enumerator = NSEnumerateMapTable(changes.writtenThroughRows);
+	DKTableDescription *table = nil;
+	NSIndexSet *uniqueIdentifiers = nil;
+	while (NSNextMapEnumeratorPair(&enumerator, (void **)&table, (void **)&uniqueIdentifiers))
+	{
+		if([uniqueIdentifiers count] > kDKDatabaseChangeLookupLimit)
+			[changes.tablesWithTooManyChanges addObject:table];
+	}
+	NSEndMapTableEnumeration(&enumerator);
+}
+
+///Invalidate the cached values of every managed object a rolled back change set may have touched.
+static void DKDatabaseDiscardRolledBackChanges(DKDatabase *self, DKDatabaseChangeSet *changes)
+{
+	//
+	//	Rollbacks are rare, so rather than look rows up we just drop the caches of every
+	//	object in a table with updated rows. New rows can't have been cached by anyone,
+	//	and deleted rows are looked after by the deletion itself.
+	//
+	NSMapEnumerator enumerator = NSEnumerateMapTable(changes.updatedRows);
+	DKTableDescription *table = nil;
+	NSIndexSet *rows = nil;
+	while (NSNextMapEnumeratorPair(&enumerator, (void **)&table, (void **)&rows))
+		[[self existingDatabaseObjectsInTable:table] makeObjectsPerformSelector:@selector(invalidateCache)];
+	NSEndMapTableEnumeration(&enumerator);
+	
+	NSIndexSet *uniqueIdentifiers = nil;
+	enumerator = NSEnumerateMapTable(changes.writtenThroughRows);
+	while (NSNextMapEnumeratorPair(&enumerator, (void **)&table, (void **)&uniqueIdentifiers))
+	{
+		for (NSUInteger uniqueIdentifier = [uniqueIdentifiers firstIndex]; uniqueIdentifier != NSNotFound; uniqueIdentifier = [uniqueIdentifiers indexGreaterThanIndex:uniqueIdentifier])
+			[[self existingDatabaseObjectInTable:table withUniqueIdentifier:(int64_t)uniqueIdentifier] invalidateCache];
+	}
+	NSEndMapTableEnumeration(&enumerator);
+}
+
+- (void)processCommittedChanges
+{
+	NSAssert([self isOnWriterQueue], @"Committed changes can only be processed on the writer queue.");
+	
+	NSArray *committedChanges = nil;
+	@synchronized(mCommittedChanges)
+	{
+		if([mCommittedChanges count] == 0)
+			return;
+		
+		committedChanges = [[mCommittedChanges copy] autorelease];
+		[mCommittedChanges removeAllObjects];
+	}
+	
+	for (DKDatabaseChangeSet *changes in committedChanges)
+	{
+		//Only the relationships stored in the tables that were written to can have changed.
+		[self invalidateRelationshipCachesForChanges:changes];
+		
+		if(changes.isRolledBack)
+		{
+			DKDatabaseDiscardRolledBackChanges(self, changes);
+			continue;
+		}
+		
+		//
+		//	Changes committed by a transaction were resolved before its commit. Ones
+		//	made outside of a transaction are committed as soon as they're made, so
+		//	this is the first chance anyone's had to look them up.
+		//
+		[self resolveChanges:changes];
+		
+		NSMutableDictionary *insertedUniqueIdentifiers = [NSMutableDictionary dictionary];
+		NSMutableDictionary *updatedUniqueIdentifiers = [NSMutableDictionary dictionary];
+		NSMutableDictionary *deletedUniqueIdentifiers = [NSMutableDictionary dictionary];
+		NSMutableSet *changedTableNames = [NSMutableSet set];
+		
+		NSMapEnumerator enumerator;
+		DKTableDescription *table = nil;
+		id uniqueIdentifiers = nil;
+		
+		//
+		//	Tables with too many changes to list have the caches of all of their objects
+		//	dropped, and are left out of everything else. The rows managed objects wrote
+		//	themselves are already in their caches, so they don't count.
+		//
+		for (table in changes.tablesWithTooManyChanges)
+		{
+			if(NSMapGet(changes.updatedRows, table) || NSMapGet(changes.deletedRows, table))
+				[[self existingDatabaseObjectsInTable:table] makeObjectsPerformSelector:@selector(invalidateCache)];
+			
+			[changedTableNames addObject:table.name];
+		}
+		
+		//
+		//	A new row can't have anything cached for it yet, so
+		//	inserts only have to be named in the notification.
+		//
+		enumerator = NSEnumerateMapTable(changes.insertedUniqueIdentifiers);
+		while (NSNextMapEnumeratorPair(&enumerator, (void **)&table, (void **)&uniqueIdentifiers))
+		{
+			if([uniqueIdentifiers count] > 0)
+				[insertedUniqueIdentifiers setObject:uniqueIdentifiers forKey:table.name];
+		}
+		NSEndMapTableEnumeration(&enumerator);
+		
+		//Only the objects of updated rows have their caches dropped.
+		enumerator = NSEnumerateMapTable(changes.updatedUniqueIdentifiers);
+		while (NSNextMapEnumeratorPair(&enumerator, (void **)&table, (void **)&uniqueIdentifiers))
+		{
+			for (NSNumber *uniqueIdentifier in uniqueIdentifiers)
+				[[self existingDatabaseObjectInTable:table withUniqueIdentifier:[uniqueIdentifier longLongValue]] invalidateCache];
+			
+			if([uniqueIdentifiers count] > 0)
+				[updatedUniqueIdentifiers setObject:[[uniqueIdentifiers mutableCopy] autorelease] forKey:table.name];
+		}
+		NSEndMapTableEnumeration(&enumerator);
+		
+		enumerator = NSEnumerateMapTable(changes.writtenThroughRows);
+		while (NSNextMapEnumeratorPair(&enumerator, (void **)&table, (void **)&uniqueIdentifiers))
+		{
+			if([changes.tablesWithTooManyChanges containsObject:table])
+				continue;
+			
+			NSMutableSet *tableUniqueIdentifiers = [updatedUniqueIdentifiers objectForKey:table.name];
+			if(!tableUniqueIdentifiers)
+			{
+				tableUniqueIdentifiers = [NSMutableSet setWithCapacity:[uniqueIdentifiers count]];
+				[updatedUniqueIdentifiers setObject:tableUniqueIdentifiers forKey:table.name];
+			}
+			
+			for (NSUInteger uniqueIdentifier = [uniqueIdentifiers firstIndex]; uniqueIdentifier != NSNotFound; uniqueIdentifier = [uniqueIdentifiers indexGreaterThanIndex:uniqueIdentifier])
+				[tableUniqueIdentifiers addObject:[NSNumber numberWithLongLong:(int64_t)uniqueIdentifier]];
+		}
+		NSEndMapTableEnumeration(&enumerator);
+		
+		//
+		//	Deleted rows can't be looked up, so we go the other way around
+		//	and look for the objects in memory whose rows have gone missing.
+		//
+		NSIndexSet *rows = nil;
+		enumerator = NSEnumerateMapTable(changes.deletedRows);
+		while (NSNextMapEnumeratorPair(&enumerator, (void **)&table, (void **)&rows))
+		{
+			if([changes.tablesWithTooManyChanges containsObject:table])
+				continue;
+			
+			NSArray *existingObjects = [self existingDatabaseObjectsInTable:table];
+			if([existingObjects count] == 0)
+				continue;
+			
+			NSArray *deletedObjects = DKDatabaseObjectsWithMissingRows(self, table, existingObjects, NULL);
+			if(!deletedObjects)
+			{
+				[existingObjects makeObjectsPerformSelector:@selector(invalidateCache)];
+				[changedTableNames addObject:table.name];
+				continue;
+			}
+			
+			NSMutableSet *deletedTableUniqueIdentifiers = [NSMutableSet setWithCapacity:[deletedObjects count]];
+			for (DKManagedObject *deletedObject in deletedObjects)
+			{
+				[deletedObject invalidateCache];
+				[deletedTableUniqueIdentifiers addObject:[NSNumber numberWithLongLong:deletedObject.uniqueIdentifier]];
+			}
+			
+			if([deletedTableUniqueIdentifiers count] > 0)
+				[deletedUniqueIdentifiers setObject:deletedTableUniqueIdentifiers forKey:table.name];
+		}
+		NSEndMapTableEnumeration(&enumerator);
+		
+		if(([insertedUniqueIdentifiers count] == 0) && ([updatedUniqueIdentifiers count] == 0) && 
+		   ([deletedUniqueIdentifiers count] == 0) && ([changedTableNames count] == 0))
+			continue;
+		
+		NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:
+								  insertedUniqueIdentifiers, DKInsertedUniqueIdentifiersKey, 
+								  updatedUniqueIdentifiers, DKUpdatedUniqueIdentifiersKey, 
+								  deletedUniqueIdentifiers, DKDeletedUniqueIdentifiersKey, 
+								  changedTableNames, DKChangedTableNamesKey, 
+								  nil];
+		[[NSNotificationCenter defaultCenter] postNotificationName:DKDatabaseObjectsDidChangeNotification object:self userInfo:userInfo];
+	}
+}
+
+- (BOOL)evaluateQuery:(DKCompiledSQLQuery *)query writingThroughDatabaseObject:(DKManagedObject *)databaseObject error:(NSError **)error
+{
+	NSParameterAssert(query);
+	NSParameterAssert(databaseObject);
+	NSAssert([self isOnWriterQueue], @"Rows can only be written on the writer queue.");
+	
+	//The update hook notes the row by the object rather than by its row identifier while this is set.
+	mWriteThroughObject = databaseObject;
+	BOOL success = [query evaluateAndReturnError:error];
+	mWriteThroughObject = nil;
+	
+	return success;
 }
 
 #pragma mark -
@@ -613,6 +4195,39 @@ NSString *const kDKDatabaseRelationshipDescriptionTableName = @"_DKRelationshipD
 			return NO;
 	}
 	
+	
+	//
+	//	The built in tables are searched by table name on every insert and by
+	//	either end on every relationship lookup, so they're indexed accordingly.
+	//	Databases created before these indexes existed get them here too.
+	//
+	NSArray *createBuiltInIndexQueryStrings = [NSArray arrayWithObjects:
+		dk_string_from_format(
+			dk_stringify_sql(
+				CREATE INDEX IF NOT EXISTS _dk_index_%@_name ON %@ (name)
+			),
+			kDKDatabaseSequenceTableName, kDKDatabaseSequenceTableName
+		),
+		dk_string_from_format(
+			dk_stringify_sql(
+				CREATE INDEX IF NOT EXISTS _dk_index_%@_source ON %@ (sourceTable, sourceID)
+			),
+			kDKDatabaseRelationshipDescriptionTableName, kDKDatabaseRelationshipDescriptionTableName
+		),
+		dk_string_from_format(
+			dk_stringify_sql(
+				CREATE INDEX IF NOT EXISTS _dk_index_%@_destination ON %@ (destinationTable, destinationID)
+			),
+			kDKDatabaseRelationshipDescriptionTableName, kDKDatabaseRelationshipDescriptionTableName
+		),
+		nil
+	];
+	for (NSString *createBuiltInIndexQueryString in createBuiltInIndexQueryStrings)
+	{
+		if(![self executeSQLQuery:createBuiltInIndexQueryString error:error])
+			return NO;
+	}
+	
 	return YES;
 }
 
@@ -644,6 +4259,13 @@ NSString *const kDKDatabaseRelationshipDescriptionTableName = @"_DKRelationshipD
 			return NO;
 		
 		
+		//
+		//	Bring the table's indexes in line with its description.
+		//
+		if(![self ensureIndexesArePresentForTable:table error:error])
+			return NO;
+		
+		
 		//
 		//	If the table didn't exist before this method invocation then we create
 		//	an entry in the database sequence table.
@@ -775,7 +4397,443 @@ NSString *const kDKDatabaseRelationshipDescriptionTableName = @"_DKRelationshipD
 	//
 	[createTableQueryString appendString:@");"];
 	
-	return [self executeSQLQuery:createTableQueryString error:error];
+	if(![self executeSQLQuery:createTableQueryString error:error])
+		return NO;
+	
+	
+	//
+	//	To-many relationships without a foreign key are stored in join tables. The primary
+	//	key covers lookups from the source end, and the destination is indexed separately
+	//	for lookups from the other end. Both ends of a relationship create the same table.
+	//
+	for (id property in tableDescription.properties)
+	{
+		if(![property isKindOfClass:[DKRelationshipDescription class]] || ![property usesJoinTable])
+			continue;
+		
+		NSString *escapedJoinTableName = [[property joinTableName] stringByEscapingStringForLiteralUseInSQLQueries];
+		NSArray *createJoinTableQueryStrings = [NSArray arrayWithObjects:
+			dk_string_from_format(
+				dk_stringify_sql(
+					CREATE TABLE IF NOT EXISTS '%@' (
+						sourceID BIGINT NOT NULL, 
+						destinationID BIGINT NOT NULL, 
+						PRIMARY KEY (sourceID, destinationID)
+					)
+				),
+				escapedJoinTableName
+			),
+			dk_string_from_format(
+				dk_stringify_sql(
+					CREATE INDEX IF NOT EXISTS _dk_index_%@_destinationID ON '%@' (destinationID)
+				),
+				escapedJoinTableName, escapedJoinTableName
+			),
+			nil
+		];
+		for (NSString *createJoinTableQueryString in createJoinTableQueryStrings)
+		{
+			if(![self executeSQLQuery:createJoinTableQueryString error:error])
+				return NO;
+		}
+	}
+	
+	return YES;
+}
+
+#pragma mark -
+
+- (BOOL)ensureIndexesArePresentForTable:(DKTableDescription *)tableDescription error:(NSError **)error
+{
+	NSParameterAssert(tableDescription);
+	
+	NSString *escapedTableName = [tableDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
+	
+	//
+	//	Every index we create is named after its table, columns and uniqueness,
+	//	so an index whose definition changes gets a new name. The _dk_index_
+	//	prefix lets us tell our indexes apart from anyone else's.
+	//
+	NSMutableDictionary *createIndexQueryStrings = [NSMutableDictionary dictionary];
+	for (DKIndexDescription *index in [tableDescription allIndexes])
+	{
+		NSMutableArray *escapedColumnNames = [NSMutableArray arrayWithCapacity:[index.keys count]];
+		for (NSString *key in index.keys)
+		{
+			NSString *escapedColumnName = [tableDescription escapedColumnNameForKey:key];
+			NSAssert((escapedColumnName != nil), 
+					 @"Index %@ in table %@ refers to %@, which does not have a column.", index, tableDescription.name, key);
+			
+			[escapedColumnNames addObject:escapedColumnName];
+		}
+		
+		NSString *indexName = dk_string_from_format(@"_dk_index_%@%@_%@", 
+													(index.isUnique? @"unique_" : @""), 
+													escapedTableName, 
+													[escapedColumnNames componentsJoinedByString:@"_"]);
+		NSString *createIndexQueryString = dk_string_from_format(@"CREATE %@INDEX IF NOT EXISTS \"%@\" ON '%@' (%@)", 
+																 (index.isUnique? @"UNIQUE " : @""), 
+																 indexName, 
+																 escapedTableName, 
+																 [escapedColumnNames componentsJoinedByString:@", "]);
+		[createIndexQueryStrings setObject:createIndexQueryString forKey:indexName];
+	}
+	
+	
+	//
+	//	Look up the indexes we've already created on the table.
+	//
+	NSString *selectIndexNamesQueryString = dk_stringify_sql(
+		SELECT name FROM sqlite_master WHERE type = 'index' AND tbl_name = ?
+	);
+	DKCompiledSQLQuery *selectIndexNamesQuery = [self compileSQLQuery:selectIndexNamesQueryString error:error];
+	if(!selectIndexNamesQuery)
+		return NO;
+	
+	[selectIndexNamesQuery setString:escapedTableName forParameterAtIndex:1];
+	
+	NSMutableSet *existingIndexNames = [NSMutableSet set];
+	while ([selectIndexNamesQuery nextRow])
+	{
+		NSString *indexName = [selectIndexNamesQuery stringForColumnAtIndex:0];
+		if([indexName hasPrefix:@"_dk_index_"])
+			[existingIndexNames addObject:indexName];
+	}
+	
+	
+	//
+	//	Drop the indexes that aren't described anymore, then create the ones
+	//	that don't exist yet. Dropping first matters for unique indexes that
+	//	have been relaxed into regular ones.
+	//
+	for (NSString *indexName in existingIndexNames)
+	{
+		if([createIndexQueryStrings objectForKey:indexName])
+			continue;
+		
+		if(![self executeSQLQuery:dk_string_from_format(@"DROP INDEX IF EXISTS \"%@\"", indexName) error:error])
+			return NO;
+	}
+	
+	for (NSString *indexName in createIndexQueryStrings)
+	{
+		if([existingIndexNames containsObject:indexName])
+			continue;
+		
+		if(![self executeSQLQuery:[createIndexQueryStrings objectForKey:indexName] error:error])
+			return NO;
+	}
+	
+	return YES;
+}
+
+#pragma mark -
+#pragma mark Migration
+
+- (BOOL)migrateLegacyDatesWithBatchSize:(NSUInteger)batchSize error:(NSError **)error
+{
+	if(batchSize == 0)
+		batchSize = kDKDatabaseDefaultMigrationBatchSize;
+	
+	for (DKTableDescription *table in [mDatabaseLayout tables])
+	{
+		NSString *escapedTableName = [table.name stringByEscapingStringForLiteralUseInSQLQueries];
+		for (DKAttributeDescription *attribute in table.attributes)
+		{
+			if(attribute.type != DKAttributeTypeDate)
+				continue;
+			
+			NSString *escapedColumnName = [attribute.name stringByEscapingStringForLiteralUseInSQLQueries];
+			
+			//
+			//	Legacy dates are local time text, which julianday() can read. The utc
+			//	modifier shifts them into UTC, and from there it's simple arithmetic
+			//	to get to seconds since 1970. Rows whose text can't be read are never
+			//	selected, otherwise we'd keep selecting them and never finish.
+			//
+			//	Names are double quoted throughout. SQLite reads a single quoted name
+			//	inside of an expression as a string, so typeof() and julianday() would
+			//	be looking at the column's name rather than its value.
+			//
+			NSString *migrateQueryString = dk_string_from_format(
+				dk_stringify_sql(
+					UPDATE "%@" SET "%@" = ((julianday("%@", 'utc') - 2440587.5) * 86400.0) 
+					WHERE _dk_uniqueIdentifier IN (
+						SELECT _dk_uniqueIdentifier FROM "%@" WHERE (typeof("%@") = 'text') AND (julianday("%@") IS NOT NULL) LIMIT ?
+					)
+				),
+				escapedTableName, escapedColumnName, escapedColumnName, 
+				escapedTableName, escapedColumnName, escapedColumnName
+			);
+			
+			__block int numberOfMigratedRows = 0;
+			do
+			{
+				BOOL success = [self performTransaction:^(NSError **transactionError) {
+					DKCompiledSQLQuery *migrateQuery = [self compileSQLQuery:migrateQueryString error:transactionError];
+					if(!migrateQuery)
+						return NO;
+					
+					[migrateQuery setLongLong:batchSize forParameterAtIndex:1];
+					if(![migrateQuery evaluateAndReturnError:transactionError])
+						return NO;
+					
+					numberOfMigratedRows = sqlite3_changes(mSQLiteConnection);
+					return YES;
+				} error:error];
+				
+				if(!success)
+					return NO;
+			} while (numberOfMigratedRows > 0);
+		}
+	}
+	
+	return YES;
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKDatabaseReaderConnection
+
+#pragma mark Destruction
+
+- (void)dealloc
+{
+	[self close];
+	
+	[super dealloc];
+}
+
+- (void)finalize
+{
+	[self close];
+	[super finalize];
+}
+
+- (void)close
+{
+	if(mSQLiteConnection)
+	{
+		[mCompiledQueryCache removeAllQueries];
+		[mCompiledQueryCache release];
+		mCompiledQueryCache = nil;
+		
+		sqlite3_stmt *activeStatement = NULL;
+		while ((activeStatement = sqlite3_next_stmt(mSQLiteConnection, 0)))
+		{
+			sqlite3_finalize(activeStatement);
+		}
+		
+		sqlite3_close(mSQLiteConnection);
+		mSQLiteConnection = NULL;
+	}
+}
+
+#pragma mark -
+#pragma mark Construction
+
+- (id)init
+{
+	[self doesNotRecognizeSelector:_cmd];
+	return nil;
+}
+
+- (id)initWithPath:(NSString *)path database:(DKDatabase *)database compiledQueryCacheLimit:(NSUInteger)limit error:(NSError **)error
+{
+	NSParameterAssert(path);
+	NSParameterAssert(database);
+	
+	if((self = [super init]))
+	{
+		SQLiteStatus status = sqlite3_open_v2([path fileSystemRepresentation], &mSQLiteConnection, SQLITE_OPEN_READONLY, NULL);
+		if(status != SQLITE_OK)
+		{
+			if(error) *error = DKLocalizedError(DKGeneralErrorDomain, 
+												status, 
+												nil, 
+												@"Failed to open database", path, status);
+			
+			[self release];
+			return nil;
+		}
+		
+		mCompiledQueryCache = [[DKCompiledSQLQueryCache alloc] initWithDatabase:database connection:mSQLiteConnection limit:limit];
+		
+		return self;
+	}
+	return nil;
+}
+
+#pragma mark -
+#pragma mark Properties
+
+@synthesize compiledQueryCache = mCompiledQueryCache;
+@synthesize sqliteConnection = mSQLiteConnection;
+
+- (BOOL)claim
+{
+	return OSAtomicCompareAndSwap32Barrier(0, 1, &mIsClaimed);
+}
+
+- (void)relinquish
+{
+	OSAtomicCompareAndSwap32Barrier(1, 0, &mIsClaimed);
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKDatabaseChangeSet
+
+#pragma mark Destruction
+
+- (void)dealloc
+{
+	NSFreeMapTable(mInsertedRows);
+	mInsertedRows = nil;
+	
+	NSFreeMapTable(mUpdatedRows);
+	mUpdatedRows = nil;
+	
+	NSFreeMapTable(mDeletedRows);
+	mDeletedRows = nil;
+	
+	NSFreeMapTable(mWrittenThroughRows);
+	mWrittenThroughRows = nil;
+	
+	NSFreeMapTable(mInsertedUniqueIdentifiers);
+	mInsertedUniqueIdentifiers = nil;
+	
+	NSFreeMapTable(mUpdatedUniqueIdentifiers);
+	mUpdatedUniqueIdentifiers = nil;
+	
+	[mTablesWithTooManyChanges release];
+	mTablesWithTooManyChanges = nil;
+	
+	[mChangedRelationshipGenerationIndexes release];
+	mChangedRelationshipGenerationIndexes = nil;
+	
+	[super dealloc];
+}
+
+#pragma mark -
+#pragma mark Construction
+
+- (id)init
+{
+	if((self = [super init]))
+	{
+		//Table descriptions are owned by the database's layout, which outlives us.
+		mInsertedRows = NSCreateMapTable(NSNonRetainedObjectMapKeyCallBacks, NSObjectMapValueCallBacks, 0);
+		mUpdatedRows = NSCreateMapTable(NSNonRetainedObjectMapKeyCallBacks, NSObjectMapValueCallBacks, 0);
+		mDeletedRows = NSCreateMapTable(NSNonRetainedObjectMapKeyCallBacks, NSObjectMapValueCallBacks, 0);
+		mWrittenThroughRows = NSCreateMapTable(NSNonRetainedObjectMapKeyCallBacks, NSObjectMapValueCallBacks, 0);
+		mInsertedUniqueIdentifiers = NSCreateMapTable(NSNonRetainedObjectMapKeyCallBacks, NSObjectMapValueCallBacks, 0);
+		mUpdatedUniqueIdentifiers = NSCreateMapTable(NSNonRetainedObjectMapKeyCallBacks, NSObjectMapValueCallBacks, 0);
+		mTablesWithTooManyChanges = [NSMutableSet new];
+		mChangedRelationshipGenerationIndexes = [NSMutableIndexSet new];
+		
+		return self;
+	}
+	return nil;
+}
+
+#pragma mark -
+#pragma mark Changes
+
+///Add an index to the index set a map table holds for a table, creating the set if needed.
+static void DKChangeSetAddIndex(NSMapTable *indexesByTable, DKTableDescription *table, NSUInteger index)
+{
+	NSMutableIndexSet *indexes = NSMapGet(indexesByTable, table);
+	if(!indexes)
+	{
+		indexes = [NSMutableIndexSet new];
+		NSMapInsertKnownAbsent(indexesByTable, table, indexes);
+		[indexes release];
+	}
+	
+	[indexes addIndex:index];
+}
+
+///Add every index set in one map table to the index sets of another.
+static void DKChangeSetAddIndexes(NSMapTable *indexesByTable, NSMapTable *otherIndexesByTable)
+{
+	NSMapEnumerator enumerator = NSEnumerateMapTable(otherIndexesByTable);
+	DKTableDescription *table = nil;
+	NSIndexSet *otherIndexes = nil;
+	while (NSNextMapEnumeratorPair(&enumerator, (void **)&table, (void **)&otherIndexes))
+	{
+		NSMutableIndexSet *indexes = NSMapGet(indexesByTable, table);
+		if(indexes)
+		{
+			[indexes addIndexes:otherIndexes];
+		}
+		else
+		{
+			indexes = [otherIndexes mutableCopy];
+			NSMapInsertKnownAbsent(indexesByTable, table, indexes);
+			[indexes release];
+		}
+	}
+	NSEndMapTableEnumeration(&enumerator);
+}
+
+- (void)noteOperation:(int)operation onRowWithIdentifier:(int64_t)rowIdentifier inTable:(DKTableDescription *)table
+{
+	//Changes to our own tables and to join tables are only worth knowing about as a whole.
+	if(!table)
+		return;
+	
+	NSMapTable *rowsByTable = nil;
+	if(operation == SQLITE_INSERT)
+		rowsByTable = mInsertedRows;
+	else if(operation == SQLITE_UPDATE)
+		rowsByTable = mUpdatedRows;
+	else
+		rowsByTable = mDeletedRows;
+	
+	DKChangeSetAddIndex(rowsByTable, table, (NSUInteger)rowIdentifier);
+}
+
+- (void)noteWriteThroughOfDatabaseObject:(DKManagedObject *)databaseObject
+{
+	NSParameterAssert(databaseObject);
+	
+	DKChangeSetAddIndex(mWrittenThroughRows, databaseObject.tableDescription, (NSUInteger)databaseObject.uniqueIdentifier);
+}
+
+- (void)noteChangeToRelationshipGenerationAtIndex:(NSUInteger)generationIndex
+{
+	[mChangedRelationshipGenerationIndexes addIndex:generationIndex];
+}
+
+- (void)addChangesFromChangeSet:(DKDatabaseChangeSet *)changes
+{
+	NSParameterAssert(changes);
+	
+	DKChangeSetAddIndexes(mInsertedRows, changes.insertedRows);
+	DKChangeSetAddIndexes(mUpdatedRows, changes.updatedRows);
+	DKChangeSetAddIndexes(mDeletedRows, changes.deletedRows);
+	DKChangeSetAddIndexes(mWrittenThroughRows, changes.writtenThroughRows);
+	
+	[mChangedRelationshipGenerationIndexes addIndexes:changes.changedRelationshipGenerationIndexes];
 }
 
+#pragma mark -
+#pragma mark Properties
+
+@synthesize insertedRows = mInsertedRows;
+@synthesize updatedRows = mUpdatedRows;
+@synthesize deletedRows = mDeletedRows;
+@synthesize writtenThroughRows = mWrittenThroughRows;
+@synthesize insertedUniqueIdentifiers = mInsertedUniqueIdentifiers;
+@synthesize updatedUniqueIdentifiers = mUpdatedUniqueIdentifiers;
+@synthesize tablesWithTooManyChanges = mTablesWithTooManyChanges;
+@synthesize changedRelationshipGenerationIndexes = mChangedRelationshipGenerationIndexes;
+@synthesize isResolved = mIsResolved;
+@synthesize isRolledBack = mIsRolledBack;
+
 @end
@@ -0,0 +1,39 @@
+//
+//  DKDatabaseOperation.h
+//  DatabaseKit
+//
+//  Created by agent on 10/17/26.
+//  Copyright 2026 Roundabout Software. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+/*!
+ @class
+ @abstract		This class is used to represent work a DKDatabase is performing in the background.
+ @discussion	Instances of DKDatabaseOperation are returned by the asynchronous methods of DKDatabase.
+				You do not create them yourself.
+ */
+@interface DKDatabaseOperation : NSObject
+{
+	/* n/a */	volatile int32_t mIsCancelled;
+}
+
+/*!
+ @method
+ @abstract		Ask the receiver to stop performing its work.
+ @discussion	Cancellation is checked between rows, so a cancelled fetch stops reading from
+				SQLite almost immediately. Its completion handler is still invoked, with an
+				NSUserCancelledError in the NSCocoaErrorDomain.
+
+				This method may be invoked from any thread.
+ */
+- (void)cancel;
+
+/*!
+ @property
+ @abstract	Whether or not the receiver has been cancelled.
+ */
+@property (readonly) BOOL isCancelled;
+
+@end
@@ -0,0 +1,25 @@
+//
+//  DKDatabaseOperation.m
+//  DatabaseKit
+//
+//  Created by agent on 10/17/26.
+//  Copyright 2026 Roundabout Software. All rights reserved.
+//
+
+#import "DKDatabaseOperation.h"
+#import <libkern/OSAtomic.h>
+
+@implementation DKDatabaseOperation
+
+- (void)cancel
+{
+	OSAtomicCompareAndSwap32Barrier(0, 1, &mIsCancelled);
+}
+
+@dynamic isCancelled;
+- (BOOL)isCancelled
+{
+	return (mIsCancelled != 0);
+}
+
+@end
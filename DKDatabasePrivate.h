@@ -8,8 +8,27 @@
  */
 
 #import <Cocoa/Cocoa.h>
+#import <pthread.h>
+#import <libkern/OSAtomic.h>
 #import "DKDatabase.h"
 
+/*!
+ @defined
+ @abstract	The number of independently locked stripes DKDatabase splits its managed objects across.
+ */
+#define DK_MANAGED_OBJECT_STRIPE_COUNT	16
+
+/*!
+ @typedef
+ @abstract	One stripe of a database's managed object map.
+ @field		lock	The lock guarding the stripe.
+ @field		objects	A map of (table, unique identifier) keys to managed objects.
+ */
+typedef struct _DKManagedObjectStripe {
+	OSSpinLock lock;
+	NSMapTable *objects;
+} DKManagedObjectStripe;
+
 /*!
  @const
  @abstract	The database configuration table's name.
@@ -29,6 +48,8 @@ DK_EXTERN NSString *const kDKDatabaseSequenceTableName;
 DK_EXTERN NSString *const kDKDatabaseRelationshipDescriptionTableName;
 
 
+@class DKDatabaseReaderConnection, DKRelationshipDescription;
+
 //! @abstract	The DKDatabase private continuation.
 @interface DKDatabase () //Continuation
 
@@ -39,6 +60,125 @@ DK_EXTERN NSString *const kDKDatabaseRelationshipDescriptionTableName;
  */
 @property (readonly) sqlite3 *sqliteConnection;
 
+#pragma mark -
+#pragma mark Connections
+
+/*!
+ @method
+ @abstract	The path of the receiver's database file, suitable for passing to SQLite.
+ */
+- (NSString *)databasePath;
+
+/*!
+ @method
+ @abstract		Put the receiver's database in write-ahead logging mode and start reading through reader connections.
+ @result		YES if concurrent reads were enabled; NO otherwise.
+ @discussion	This is invoked once by the designated initializer.
+ */
+- (BOOL)enableConcurrentReads;
+
+/*!
+ @method
+ @abstract	Whether or not the calling code is running on the receiver's writer queue.
+ */
+- (BOOL)isOnWriterQueue;
+
+/*!
+ @method
+ @abstract		Run a block that writes to the database on the receiver's writer queue, waiting for it to finish.
+ @param			block	The block to run. It returns YES on success, or NO with an error. May not be nil.
+ @param			error	If the block fails, on return this will contain its error. May be nil.
+ @result		The result of the block.
+ @discussion	If the caller is already on the writer queue the block is run immediately.
+ */
+- (BOOL)performWriterBlock:(BOOL (^)(NSError **error))block error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Run a block that writes to the database on the receiver's writer queue, waiting for it to finish.
+ @param			block		The block to run. It returns YES on success, or NO with an error. May not be nil.
+ @param			joinsGroup	Whether or not the block's writes are allowed to become part of an open group.
+ @param			error		If the block fails, on return this will contain its error. May be nil.
+ @result		The result of the block.
+ @discussion	Unless joinsGroup is YES, an open group is committed before the block is run so that
+				the block's writes are not reported as successful before they are durable.
+ */
+- (BOOL)performWriterBlock:(BOOL (^)(NSError **error))block joiningGroup:(BOOL)joinsGroup error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Wrap a block so that the receiver knows it is on its writer queue while the block runs.
+ @param			block	The block to wrap. May not be nil.
+ @result		An autoreleased block. Every block submitted to the writer queue must be wrapped with this method.
+ */
+- (dispatch_block_t)writerQueueBlockWithBlock:(dispatch_block_t)block;
+
+/*!
+ @method
+ @abstract		Look up the read-only connection of the calling thread, opening one if necessary.
+ @param			error	If a connection cannot be opened, on return this will contain an error. May be nil.
+ @result		A reader connection; nil if one couldn't be opened.
+ @discussion	This method may only be used when the receiver uses concurrent reads. Connections released
+				by threads that have exited are handed to new threads before any new connections are opened.
+ */
+- (DKDatabaseReaderConnection *)readerConnectionForCurrentThreadAndReturnError:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Whether or not reads made by the calling code have to go through the write connection.
+ @discussion	This is the case when reads aren't concurrent, on the writer queue, and on the thread
+				that began the open transaction, so that it sees its own uncommitted changes. Other
+				threads keep reading through their own connections while a transaction is open.
+ */
+- (BOOL)readsThroughWriteConnection;
+
+/*!
+ @method
+ @abstract		Look up the SQLite handle that reads made by the calling code should go through.
+ @param			error	If the calling thread's reader connection cannot be opened, on return this will contain an error. May be nil.
+ @result		A SQLite handle; NULL if an error occurs.
+ @discussion	This follows the same rules compileSQLQuery:error: uses to route SELECT queries, so
+				rows looked up with a compiled query can be read through the returned handle.
+ */
+- (sqlite3 *)sqliteConnectionForReadingAndReturnError:(NSError **)error;
+
+#pragma mark -
+#pragma mark Transactions
+
+/*!
+ @method
+ @abstract		Begin a transaction, or a savepoint if a transaction is already open.
+ @param			error	If the transaction cannot be begun, on return this will contain an error. May be nil.
+ @result		YES if the transaction was begun; NO otherwise.
+ @discussion	This method must be invoked on the writer queue.
+ */
+- (BOOL)beginTransactionAndReturnError:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Commit the top most transaction.
+ @param			error	If the transaction cannot be committed, on return this will contain an error. May be nil.
+ @result		YES if the transaction was committed; NO otherwise.
+ @discussion	This method must be invoked on the writer queue. A transaction that cannot be committed is rolled back.
+ */
+- (BOOL)commitTransactionAndReturnError:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Commit the receiver's open group of transactions.
+ @discussion	This method must be invoked on the writer queue, and does nothing if no group is open. If a
+				transaction begun with beginTransaction is still open the group is left alone, and committed
+				by the writer queue as soon as that transaction is over. Every writer waiting on the group is
+				told whether or not it was committed.
+ */
+- (void)commitGroup;
+
+/*!
+ @method
+ @abstract	Arrange for the receiver's open group of transactions to be committed once the group commit interval has passed.
+ */
+- (void)scheduleGroupCommit;
+
 #pragma mark -
 #pragma mark Cache
 
@@ -47,10 +187,181 @@ DK_EXTERN NSString *const kDKDatabaseRelationshipDescriptionTableName;
  @abstract	Look for an existing database object with a specified unique identifier, creating a new object if one cannot be found.
  @param		table				The table the database object belongs to. May not be nil.
  @param		uniqueIdentifier	The unique identifier of the database object.
- @result	A DKManagedObject owned by the receiver.
+ @result	A DKManagedObject owned by the receiver, retained and autoreleased on behalf of the caller.
  */
 - (id)databaseObjectInTable:(DKTableDescription *)table withUniqueIdentifier:(int64_t)uniqueIdentifier;
 
+/*!
+ @method
+ @abstract	Look for an existing database object with a specified unique identifier without creating one.
+ @param		table				The table the database object belongs to. May not be nil.
+ @param		uniqueIdentifier	The unique identifier of the database object.
+ @result	A DKManagedObject owned by the receiver if one is live, retained and autoreleased on behalf of the caller; nil otherwise.
+ */
+- (id)existingDatabaseObjectInTable:(DKTableDescription *)table withUniqueIdentifier:(int64_t)uniqueIdentifier;
+
+/*!
+ @method
+ @abstract	Returns every managed object of a specified table that the receiver has in memory.
+ @param		table	The table whose objects are returned. May not be nil.
+ */
+- (NSArray *)existingDatabaseObjectsInTable:(DKTableDescription *)table;
+
+/*!
+ @method
+ @abstract		Take ownership of a newly created database object.
+ @param			databaseObject	The database object to register. May not be nil.
+ @result		The database object registered for the object's row. If another object was registered
+				for the same row first, that object is returned and the caller should discard its own.
+				Either way the object returned is retained and autoreleased on behalf of the caller,
+				who still has to release its own reference to the object passed in.
+ */
+- (id)registerDatabaseObject:(DKManagedObject *)databaseObject;
+
+/*!
+ @method
+ @abstract		Stop tracking a specified database object.
+ @param			databaseObject	The database object to forget about. May not be nil.
+ @discussion	The object is taken out of the receiver's map, and the receiver gives up its reference to it.
+ */
+- (void)unregisterDatabaseObject:(DKManagedObject *)databaseObject;
+
+/*!
+ @method
+ @abstract		Give up the receiver's reference to a specified database object.
+ @param			databaseObject	The database object to let go of. May not be nil.
+ @discussion	The object is destroyed if nothing else is holding on to it. Otherwise it stays in the
+				receiver's map, and is found by lookups, until whoever is holding on to it lets go.
+ */
+- (void)relinquishDatabaseObject:(DKManagedObject *)databaseObject;
+
+/*!
+ @method
+ @abstract		Take a database object that is losing its last reference out of the receiver's map.
+ @param			databaseObject	The database object being released. May not be nil.
+ @result		YES if the object's last reference is gone and it should be destroyed; NO if it was
+				retained by a lookup in the meantime and should try releasing again.
+ @discussion	Invoked by DKManagedObject's release. The object's retain count is dropped to zero
+				under the same lock lookups retain objects under, so it can never be handed out again.
+ */
+- (BOOL)removeDatabaseObjectIfUnreferenced:(DKManagedObject *)databaseObject;
+
+/*!
+ @method
+ @abstract	Count the database objects the receiver currently has in memory.
+ */
+- (NSUInteger)numberOfManagedObjects;
+
+/*!
+ @method
+ @abstract		Sweep the receiver's managed objects until it is back under its managed object limit.
+ @discussion	The receiver gives up its reference to objects that haven't been used recently, which
+				destroys the ones nothing else is holding on to. The rest lose their cached values. At
+				most one full sweep is made per call.
+ */
+- (void)evictDatabaseObjects;
+
+#pragma mark -
+
+/*!
+ @method
+ @abstract		Returns a number that changes every time a specified relationship might have changed.
+ @param			relationship	A relationship of one of the receiver's tables. May not be nil.
+ @discussion	Database objects note this when they cache the value of a relationship, and throw the
+				cached value away once it no longer matches. Relationships stored in the same table
+				share a generation, which moves on whenever a row of that table is changed.
+ */
+- (int32_t)generationOfRelationship:(DKRelationshipDescription *)relationship;
+
+/*!
+ @method
+ @abstract		Invalidate the cached values of the relationships stored in the tables a change set wrote to.
+ @param			changes	The change set. May not be nil.
+ @discussion	The update hook invalidates these relationships as the rows are changed. This is invoked again
+				once the changes are committed or rolled back, because a relationship read from another
+				connection in the meantime may have been cached from the other side of the change.
+ */
+- (void)invalidateRelationshipCachesForChanges:(DKDatabaseChangeSet *)changes;
+
+#pragma mark -
+#pragma mark Deleting
+
+/*!
+ @method
+ @abstract		Delete the rows of a specified table selected by a query, applying the delete actions of their relationships.
+ @param			table				The table the rows belong to. May not be nil.
+ @param			selectQueryString	A SELECT query whose only column is the unique identifier of each row to delete. May not be nil.
+ @param			arguments			The values to bind to the query's parameters, in order. May not be nil.
+ @param			error				If the rows cannot be deleted, on return this will contain an error. May be nil.
+ @result		YES if the rows were deleted; NO otherwise.
+ @discussion	This method must be invoked on the writer queue. Managed objects in memory for any of the
+				deleted rows, including those deleted by a cascade, are destroyed once the deletion succeeds.
+ */
+- (BOOL)deleteRowsInTable:(DKTableDescription *)table matchingSelectQuery:(NSString *)selectQueryString arguments:(NSArray *)arguments error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Forget a managed object whose row has been deleted.
+ @param			object	The managed object to forget. May not be nil.
+ @discussion	The object is marked as deleted and the receiver gives up its reference to it. It is
+				destroyed right away if nothing else is holding on to it, or once the last holder lets go.
+ */
+- (void)destroyDeletedDatabaseObject:(DKManagedObject *)object;
+
+#pragma mark -
+#pragma mark Change Tracking
+
+/*!
+ @method
+ @abstract	Note that a specified database object has unsaved changes.
+ @param		databaseObject	The changed database object. May not be nil.
+ */
+- (void)databaseObjectDidChange:(DKManagedObject *)databaseObject;
+
+/*!
+ @method
+ @abstract		Note that a row was written to through an incremental blob handle.
+ @param			rowIdentifier	The rowid of the row that was written to.
+ @param			table			The table the row belongs to. May not be nil.
+ @discussion	This method must be invoked on the writer queue, before the blob handle is closed. The row is
+				recorded in the pending change set just as the update hook records an UPDATE, so its managed
+				object is brought up to date and the row is included in the change notification.
+ */
+- (void)noteIncrementalWriteToRowWithIdentifier:(int64_t)rowIdentifier inTable:(DKTableDescription *)table;
+
+/*!
+ @method
+ @abstract		Bring managed objects up to date with the transactions committed since the last time this was invoked.
+ @discussion	This method must be invoked on the writer queue. The cached values of managed objects whose
+				rows were changed are dropped, and a DKDatabaseObjectsDidChangeNotification is posted for
+				each transaction. Changes are noted by SQLite hooks on the write connection, so this covers
+				every write made through the receiver, including ones made with executeSQLQuery:error:.
+				
+				Changes that were rolled back only have the cached values of their objects dropped.
+ */
+- (void)processCommittedChanges;
+
+/*!
+ @method
+ @abstract		Look up the unique identifiers of the rows in a change set while their row identifiers still name them.
+ @param			changes	The change set to resolve. May not be nil.
+ @discussion	This method must be invoked on the writer queue, and is invoked just before a transaction is
+				committed. Tables with too many changed rows are noted as changed as a whole instead.
+ */
+- (void)resolveChanges:(DKDatabaseChangeSet *)changes;
+
+/*!
+ @method
+ @abstract		Evaluate a query that updates a managed object's row with values the object has already cached.
+ @param			query			The UPDATE query to evaluate. May not be nil.
+ @param			databaseObject	The managed object whose row is updated. May not be nil.
+ @param			error			If the query fails, on return this will contain an error. May be nil.
+ @result		YES if the query was evaluated; NO otherwise.
+ @discussion	This method must be invoked on the writer queue. The change is still reported once it is
+				committed, but the object's cached values are not dropped because of it.
+ */
+- (BOOL)evaluateQuery:(DKCompiledSQLQuery *)query writingThroughDatabaseObject:(DKManagedObject *)databaseObject error:(NSError **)error;
+
 #pragma mark -
 #pragma mark Database Layout
 
@@ -83,9 +394,126 @@ DK_EXTERN NSString *const kDKDatabaseRelationshipDescriptionTableName;
  */
 - (BOOL)createTableWithDescriptionIfAbsent:(DKTableDescription *)tableDescription error:(NSError **)error;
 
+/*!
+ @method
+ @abstract		Create and drop the indexes of a table so they match its description.
+ @param			tableDescription	The description of the table whose indexes are reconciled. May not be nil.
+ @param			error				If an index cannot be created or dropped this will contain an error. May be nil.
+ @result		YES if the table's indexes match its description; NO otherwise.
+ @discussion	Only indexes created by DatabaseKit are ever dropped.
+ */
+- (BOOL)ensureIndexesArePresentForTable:(DKTableDescription *)tableDescription error:(NSError **)error;
+
 #pragma mark -
 #pragma mark Fetching
 
+/*!
+ @method
+ @abstract	Translate the sort descriptors of a specified fetch request into an SQL ORDER BY list.
+ @param		fetchRequest	The fetch request whose sort descriptors are translated. May not be nil.
+ @result	The ordering terms, ending with the unique identifier; nil if a sort descriptor cannot be evaluated by SQLite.
+ */
+- (NSString *)orderingTermsForFetchRequest:(DKFetchRequest *)fetchRequest;
+
+/*!
+ @method
+ @abstract	Create an SQL expression matching the rows sorted after a specified fetch request's fetchAfterObject.
+ @param		fetchRequest	A fetch request whose ordering terms can be evaluated by SQLite. May not be nil.
+ @param		arguments		On return the values of the object the expression compares against. May not be nil.
+ */
+- (NSString *)expressionForRowsAfterObjectInFetchRequest:(DKFetchRequest *)fetchRequest arguments:(NSMutableArray *)arguments;
+
+/*!
+ @method
+ @abstract	Translate the filter string, predicate and fetchAfterObject of a specified fetch request into SQL WHERE clauses.
+ @param		fetchRequest	The fetch request whose filters are translated. May not be nil.
+ @param		arguments		On return the constants the clauses are compared against, in order. May not be nil.
+ @param		error			If the predicate cannot be translated, on return this will contain an error. May be nil.
+ @result	An array of parenthesized clauses to be joined with AND, empty if the request doesn't filter its rows; nil if an error occurs.
+ */
+- (NSArray *)filterClausesForFetchRequest:(DKFetchRequest *)fetchRequest arguments:(NSMutableArray *)arguments error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Create the SQL of a SELECT query for the rows matched by a specified fetch request.
+ @param			fetchRequest	The fetch request whose table, filter string and predicate are used. May not be nil.
+ @param			columns			The SQL column list to select. May not be nil.
+ @param			arguments		On return the values to bind to the query's parameters, in order. May not be nil.
+ @param			error			If the request cannot be translated, on return this will contain an error. May be nil.
+ @result		The query's SQL; nil if an error occurs.
+ @discussion	This is used by compileSelectQueryForFetchRequest:columns:error:, and by anything that
+				needs to embed the rows a fetch request matches in a larger statement.
+ */
+- (NSString *)selectQueryStringForFetchRequest:(DKFetchRequest *)fetchRequest columns:(NSString *)columns arguments:(NSMutableArray *)arguments error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Compile a SELECT query for the rows matched by a specified fetch request.
+ @param			fetchRequest	The fetch request whose table, filter string and predicate are used. May not be nil.
+ @param			columns			The SQL column list to select. May not be nil.
+ @param			error			If the request cannot be translated or compiled, on return this will contain an error. May be nil.
+ @result		A compiled query with the fetch request's constants bound to it; nil if an error occurs.
+ @discussion	The filter string and the predicate are combined with AND when both are present. The
+				request's ordering, limit and offset are only applied if its sort descriptors can be
+				evaluated by SQLite; otherwise they are left to the caller.
+ */
+- (DKCompiledSQLQuery *)compileSelectQueryForFetchRequest:(DKFetchRequest *)fetchRequest columns:(NSString *)columns error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Returns an array of objects that meet the criteria specified by a given fetch request, stopping early if an operation is cancelled.
+ @param			fetchRequest	A fetch request that specifies the search criteria for the fetch. May not be nil.
+ @param			operation		The operation performing the fetch. May be nil.
+ @param			error			If there is a problem executing the fetch, or it is cancelled, on return this will contain an error. May be nil.
+ @result		A sorted array of objects that meet the criteria specified; nil if an error occurs or the fetch is cancelled.
+ */
+- (NSArray *)executeFetchRequest:(DKFetchRequest *)fetchRequest operation:(DKDatabaseOperation *)operation error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Compile the SELECT query of a fetch request whose results are unique identifiers or dictionaries.
+ @param			fetchRequest	A fetch request with the unique identifier or dictionary result type. May not be nil.
+ @param			outProperties	On return the properties selected for a dictionary fetch, in column order. May be NULL.
+ @param			error			If the request cannot be translated or compiled, on return this will contain an error. May be nil.
+ @result		The compiled query; nil if an error occurs.
+ @discussion	Only the requested columns are selected. The request's sort descriptors must be able to be evaluated by SQLite.
+ */
+- (DKCompiledSQLQuery *)compileProjectionQueryForFetchRequest:(DKFetchRequest *)fetchRequest properties:(NSArray **)outProperties error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Fetch the unique identifiers or dictionaries matched by a specified fetch request without creating any managed objects.
+ @param			fetchRequest	A fetch request with the unique identifier or dictionary result type. May not be nil.
+ @param			operation		The operation performing the fetch. May be nil.
+ @param			error			If the fetch fails, or is cancelled, on return this will contain an error. May be nil.
+ @result		An array of NSNumbers or NSDictionaries; nil if an error occurs.
+ */
+- (NSArray *)executeProjectionFetchRequest:(DKFetchRequest *)fetchRequest operation:(DKDatabaseOperation *)operation error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Compute the aggregates of a specified fetch request with a single SELECT.
+ @param			fetchRequest	An aggregate fetch request. May not be nil.
+ @param			operation		The operation performing the fetch. May be nil.
+ @param			error			If the aggregates cannot be computed, or the fetch is cancelled, on return this will contain an error. May be nil.
+ @result		An array of dictionaries, one per group; nil if an error occurs.
+ */
+- (NSArray *)executeAggregateFetchRequest:(DKFetchRequest *)fetchRequest operation:(DKDatabaseOperation *)operation error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Load the objects at the end of a list of relationship key paths for a set of objects.
+ @param			keyPaths	The relationship key paths to load, e.g. `author` or `author.publisher`. May not be nil.
+ @param			objects		The objects the key paths start from. May not be nil.
+ @param			table		The table the objects belong to. May not be nil.
+ @param			error		If the relationships cannot be loaded, on return this will contain an error. May be nil.
+ @result		YES if the relationships were loaded; NO otherwise.
+ @discussion	Each relationship along each key path is read for all of the objects at once, a batch of objects
+				per query, and the objects it leads to have their attributes cached. Every object is then given
+				the relationship's value so that looking it up later doesn't touch the database.
+ */
+- (BOOL)prefetchRelationshipKeyPaths:(NSArray *)keyPaths forObjects:(NSArray *)objects inTable:(DKTableDescription *)table error:(NSError **)error;
+
 /*!
  @method
  @abstract	Fetch an unordered set of promise-database-objects from a specified table matching a specified query in the receiver.
@@ -102,3 +530,177 @@ DK_EXTERN NSString *const kDKDatabaseRelationshipDescriptionTableName;
 - (NSSet *)fetchObjectsInTable:(DKTableDescription *)table matchingQuery:(NSString *)query returnsObjectsAsPromises:(BOOL)returnsObjectsAsPromises error:(NSError **)error;
 
 @end
+
+#pragma mark -
+
+/*!
+ @class
+ @abstract		This class is used by DKDatabase to manage one of its read-only connections.
+ @discussion	A reader connection is claimed by one thread at a time. It is relinquished when that
+				thread exits so that it can be claimed by another.
+ */
+@interface DKDatabaseReaderConnection : NSObject
+{
+	/* owner */	sqlite3 *mSQLiteConnection;
+	/* owner */	DKCompiledSQLQueryCache *mCompiledQueryCache;
+	/* n/a */	volatile int32_t mIsClaimed;
+}
+/*!
+ @method
+ @abstract	Open a read-only connection to the database file at a specified path.
+ @param		path		The path of the database file. May not be nil.
+ @param		database	The database the connection belongs to. May not be nil. Not retained.
+ @param		limit		The maximum number of compiled queries the connection keeps around.
+ @param		error		If the connection cannot be opened this will contain an error. May be nil.
+ */
+- (id)initWithPath:(NSString *)path database:(DKDatabase *)database compiledQueryCacheLimit:(NSUInteger)limit error:(NSError **)error;
+
+/*!
+ @property
+ @abstract	The cache used to compile queries against the receiver's connection.
+ */
+@property (readonly) DKCompiledSQLQueryCache *compiledQueryCache;
+
+/*!
+ @property
+ @abstract	The SQLite handle of the receiver.
+ */
+@property (readonly) sqlite3 *sqliteConnection;
+
+/*!
+ @method
+ @abstract	Atomically claim the receiver for the calling thread.
+ @result	YES if the receiver was unclaimed; NO otherwise.
+ */
+- (BOOL)claim;
+
+/*!
+ @method
+ @abstract	Make the receiver available to be claimed by another thread.
+ */
+- (void)relinquish;
+
+/*!
+ @method
+ @abstract		Finalize the receiver's queries and close its connection.
+ @discussion	This must be invoked before the receiver's database is destroyed.
+ */
+- (void)close;
+@end
+
+#pragma mark -
+
+/*!
+ @class
+ @abstract		This class is used by DKDatabase to collect the rows changed by one transaction.
+ @discussion	Rows are noted by their SQLite row identifiers, which are all the update hook is given.
+				They are turned into unique identifiers just before the transaction is committed, while
+				the row identifiers still name the rows that were changed.
+				
+				Rows a managed object wrote itself are noted by unique identifier, separately from the
+				rest, so that the object's cached values can survive the change being processed.
+ */
+@interface DKDatabaseChangeSet : NSObject
+{
+	/* owner */	NSMapTable *mInsertedRows;
+	/* owner */	NSMapTable *mUpdatedRows;
+	/* owner */	NSMapTable *mDeletedRows;
+	/* owner */	NSMapTable *mWrittenThroughRows;
+	/* owner */	NSMapTable *mInsertedUniqueIdentifiers;
+	/* owner */	NSMapTable *mUpdatedUniqueIdentifiers;
+	/* owner */	NSMutableSet *mTablesWithTooManyChanges;
+	/* owner */	NSMutableIndexSet *mChangedRelationshipGenerationIndexes;
+	/* n/a */	BOOL mIsResolved;
+	/* n/a */	BOOL mIsRolledBack;
+}
+/*!
+ @method
+ @abstract	Note that a row in a specified table was changed.
+ @param		operation		The SQLITE_INSERT, SQLITE_UPDATE, or SQLITE_DELETE operation that changed the row.
+ @param		rowIdentifier	The SQLite row identifier of the row.
+ @param		table			The table the row belongs to. May be nil for tables outside of the database's layout.
+ */
+- (void)noteOperation:(int)operation onRowWithIdentifier:(int64_t)rowIdentifier inTable:(DKTableDescription *)table;
+
+/*!
+ @method
+ @abstract		Note that a managed object updated its own row with values it has already cached.
+ @param			databaseObject	The managed object. May not be nil.
+ */
+- (void)noteWriteThroughOfDatabaseObject:(DKManagedObject *)databaseObject;
+
+/*!
+ @method
+ @abstract	Note that a table relationships are stored in was changed.
+ @param		generationIndex	The index of the table's relationship generation in the database.
+ */
+- (void)noteChangeToRelationshipGenerationAtIndex:(NSUInteger)generationIndex;
+
+/*!
+ @method
+ @abstract		Add the changes collected by another change set to the receiver's.
+ @param			changes	The change set to add. May not be nil. Should not be resolved.
+ @discussion	This is used to fold the changes made inside of a savepoint into the enclosing transaction's.
+ */
+- (void)addChangesFromChangeSet:(DKDatabaseChangeSet *)changes;
+
+/*!
+ @property
+ @abstract	A map of tables to index sets of the row identifiers inserted into them.
+ */
+@property (readonly) NSMapTable *insertedRows;
+
+/*!
+ @property
+ @abstract	A map of tables to index sets of the row identifiers updated in them.
+ */
+@property (readonly) NSMapTable *updatedRows;
+
+/*!
+ @property
+ @abstract	A map of tables to index sets of the row identifiers deleted from them.
+ */
+@property (readonly) NSMapTable *deletedRows;
+
+/*!
+ @property
+ @abstract	A map of tables to index sets of the unique identifiers of rows managed objects wrote themselves.
+ */
+@property (readonly) NSMapTable *writtenThroughRows;
+
+/*!
+ @property
+ @abstract	A map of tables to sets of the unique identifiers of the inserted rows. Filled in when the receiver is resolved.
+ */
+@property (readonly) NSMapTable *insertedUniqueIdentifiers;
+
+/*!
+ @property
+ @abstract	A map of tables to sets of the unique identifiers of the updated rows. Filled in when the receiver is resolved.
+ */
+@property (readonly) NSMapTable *updatedUniqueIdentifiers;
+
+/*!
+ @property
+ @abstract	The tables whose changed rows were too many to be looked up one by one, or couldn't be looked up.
+ */
+@property (readonly) NSMutableSet *tablesWithTooManyChanges;
+
+/*!
+ @property
+ @abstract	The indexes of the relationship generations of the tables changed by the receiver.
+ */
+@property (readonly) NSIndexSet *changedRelationshipGenerationIndexes;
+
+/*!
+ @property
+ @abstract	Whether or not the receiver's row identifiers have been turned into unique identifiers.
+ */
+@property BOOL isResolved;
+
+/*!
+ @property
+ @abstract	Whether or not the receiver's changes were rolled back rather than committed.
+ */
+@property BOOL isRolledBack;
+@end
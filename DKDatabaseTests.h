@@ -8,10 +8,15 @@
 
 #import <SenTestingKit/SenTestingKit.h>
 
-@class DKDatabase;
+@class DKDatabase, DKDatabaseLayout, DKTableDescription;
 @interface DKDatabaseTests : SenTestCase
 {
 	NSURL *mTestDatabaseURL;
+	DKDatabaseLayout *mTestLayout;
+	DKTableDescription *mNotesTable;
+	DKTableDescription *mAuthorsTable;
+	DKTableDescription *mBooksTable;
+	DKTableDescription *mTagsTable;
 }
 
 @end
@@ -8,18 +8,1710 @@
 
 #import "DKDatabaseTests.h"
 #import <DatabaseKit/DatabaseKit.h>
+#import <DatabaseKit/DKCompiledSQLQuery.h>
+#import "NSString+Database.h"
+#import "NSPredicate+Database.h"
+#import "DKManagedObjectPrivate.h"
+#import "DKDatabasePrivate.h"
+
+///A value stored with kDKAttributeCodecCustom.
+@interface DKTestPoint : NSObject < DKCoding >
+{
+	double mX;
+	double mY;
+}
+- (id)initWithX:(double)x y:(double)y;
+@property (readonly) double x;
+@property (readonly) double y;
+@end
+
+@implementation DKTestPoint
+@synthesize x = mX;
+@synthesize y = mY;
+
+- (id)initWithX:(double)x y:(double)y
+{
+	if((self = [super init]))
+	{
+		mX = x;
+		mY = y;
+	}
+	
+	return self;
+}
+
+- (BOOL)isEqual:(id)object
+{
+	return [object isKindOfClass:[DKTestPoint class]] && ([object x] == mX) && ([object y] == mY);
+}
+
+- (NSUInteger)hash
+{
+	return (NSUInteger)(mX * 31.0 + mY);
+}
+
+- (NSData *)databaseRepresentation
+{
+	double coordinates[2] = { mX, mY };
+	return [NSData dataWithBytes:coordinates length:sizeof(coordinates)];
+}
+
++ (id)objectWithDatabaseRepresentation:(NSData *)data
+{
+	if([data length] != sizeof(double) * 2)
+		return nil;
+	
+	const double *coordinates = [data bytes];
+	return [[[self alloc] initWithX:coordinates[0] y:coordinates[1]] autorelease];
+}
+
+@end
+
+///Once set, every DKTestBlockingObject waits on this before it is initialized.
+static dispatch_semaphore_t DKTestBlockingObjectSemaphore = NULL;
+
+///A managed object that lets a test hold up the fetch creating it.
+@interface DKTestBlockingObject : DKManagedObject
+@end
+
+@implementation DKTestBlockingObject
+
+- (id)initWithUniqueIdentifier:(int64_t)uniqueIdentifier table:(DKTableDescription *)table database:(DKDatabase *)database
+{
+	if(DKTestBlockingObjectSemaphore)
+		dispatch_semaphore_wait(DKTestBlockingObjectSemaphore, DISPATCH_TIME_FOREVER);
+	
+	return [super initWithUniqueIdentifier:uniqueIdentifier table:table database:database];
+}
+
+@end
+
+///The accessors DKManagedObject generates for the attributes of the Notes table.
+@interface DKManagedObject (DKDatabaseTestsAccessors)
+- (NSString *)title;
+- (void)setTitle:(NSString *)title;
+- (int64_t)count;
+- (void)setCount:(int64_t)count;
+- (double)score;
+- (void)setScore:(double)score;
+@end
+
+#pragma mark -
 
 @implementation DKDatabaseTests
 
 - (void)setUp
 {
 	mTestDatabaseURL = [[NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"DatabaseKitTest.sqlite3"]] retain];
+	[[NSFileManager defaultManager] removeItemAtURL:mTestDatabaseURL error:nil];
+	
+	DKAttributeDescription *payload = [DKAttributeDescription attributeWithName:@"payload" type:DKAttributeTypeData];
+	payload.compressionThreshold = 64;
+	
+	DKAttributeDescription *list = [DKAttributeDescription attributeWithName:@"list" type:DKAttributeTypeObject];
+	list.codec = kDKAttributeCodecPropertyList;
+	
+	DKAttributeDescription *point = [DKAttributeDescription attributeWithName:@"point" type:DKAttributeTypeObject];
+	point.codec = kDKAttributeCodecCustom;
+	point.valueClass = [DKTestPoint class];
+	
+	//A note can point at a book, but books don't know about notes.
+	DKRelationshipDescription *noteBook = [[DKRelationshipDescription new] autorelease];
+	noteBook.name = @"book";
+	noteBook.relationshipType = kDKRelationshipTypeOneToOne;
+	
+	NSArray *noteProperties = [NSArray arrayWithObjects:
+							   [DKAttributeDescription attributeWithName:@"title" type:DKAttributeTypeString],
+							   [DKAttributeDescription attributeWithName:@"count" type:DKAttributeTypeInt64],
+							   [DKAttributeDescription attributeWithName:@"score" type:DKAttributeTypeFloat],
+							   [DKAttributeDescription attributeWithName:@"created" type:DKAttributeTypeDate],
+							   payload,
+							   [DKAttributeDescription attributeWithName:@"raw" type:DKAttributeTypeData],
+							   list,
+							   point,
+							   [DKAttributeDescription attributeWithName:@"archive" type:DKAttributeTypeObject],
+							   noteBook,
+							   nil];
+	mNotesTable = [[DKTableDescription alloc] initWithName:@"Notes" databaseObjectClass:[DKManagedObject class] properties:noteProperties];
+	
+	//
+	//	Authors have many books, and books and tags belong to many of each other.
+	//	Both ends of a relationship have to exist before they can point at each other.
+	//
+	DKRelationshipDescription *authorBooks = [[DKRelationshipDescription new] autorelease];
+	authorBooks.name = @"books";
+	authorBooks.relationshipType = kDKRelationshipTypeOneToMany;
+	authorBooks.deleteAction = kDKRelationshipDeleteActionActionCascade;
+	
+	DKRelationshipDescription *bookAuthor = [[DKRelationshipDescription new] autorelease];
+	bookAuthor.name = @"author";
+	bookAuthor.relationshipType = kDKRelationshipTypeOneToOne;
+	bookAuthor.inverseRelationship = authorBooks;
+	authorBooks.inverseRelationship = bookAuthor;
+	
+	DKRelationshipDescription *bookTags = [[DKRelationshipDescription new] autorelease];
+	bookTags.name = @"tags";
+	bookTags.relationshipType = kDKRelationshipTypeManyToMany;
+	
+	DKRelationshipDescription *tagBooks = [[DKRelationshipDescription new] autorelease];
+	tagBooks.name = @"books";
+	tagBooks.relationshipType = kDKRelationshipTypeManyToMany;
+	tagBooks.inverseRelationship = bookTags;
+	bookTags.inverseRelationship = tagBooks;
+	
+	mAuthorsTable = [[DKTableDescription alloc] initWithName:@"Authors"
+										 databaseObjectClass:[DKManagedObject class]
+												  properties:[NSArray arrayWithObjects:[DKAttributeDescription attributeWithName:@"name" type:DKAttributeTypeString], authorBooks, nil]];
+	mBooksTable = [[DKTableDescription alloc] initWithName:@"Books"
+									   databaseObjectClass:[DKManagedObject class]
+												properties:[NSArray arrayWithObjects:[DKAttributeDescription attributeWithName:@"title" type:DKAttributeTypeString], bookAuthor, bookTags, nil]];
+	mTagsTable = [[DKTableDescription alloc] initWithName:@"Tags"
+									  databaseObjectClass:[DKManagedObject class]
+											   properties:[NSArray arrayWithObjects:[DKAttributeDescription attributeWithName:@"name" type:DKAttributeTypeString], tagBooks, nil]];
+	
+	noteBook.targetTable = mBooksTable;
+	authorBooks.targetTable = mBooksTable;
+	bookAuthor.targetTable = mAuthorsTable;
+	bookTags.targetTable = mTagsTable;
+	tagBooks.targetTable = mBooksTable;
+	
+	mTestLayout = [[DKDatabaseLayout alloc] initWithName:@"DatabaseKitTest"
+												 version:1.0
+												  tables:[NSArray arrayWithObjects:mNotesTable, mAuthorsTable, mBooksTable, mTagsTable, nil]];
 }
 
 - (void)tearDown
 {
+	[mTestLayout release];
+	[mNotesTable release];
+	[mAuthorsTable release];
+	[mBooksTable release];
+	[mTagsTable release];
+	
 	[[NSFileManager defaultManager] removeItemAtURL:mTestDatabaseURL error:nil];
 	[mTestDatabaseURL release];
 }
 
+#pragma mark -
+#pragma mark Utilities
+
+- (DKDatabase *)databaseAtURL:(NSURL *)location options:(DKDatabaseOptions)options
+{
+	NSError *error = nil;
+	DKDatabase *database = [[DKDatabase alloc] initWithDatabaseAtURL:location layout:mTestLayout options:options error:&error];
+	STAssertNotNil(database, @"Could not open database. Got error %@.", error);
+	
+	return [database autorelease];
+}
+
+- (DKManagedObject *)insertObjectIntoTable:(DKTableDescription *)table database:(DKDatabase *)database values:(NSDictionary *)values
+{
+	NSError *error = nil;
+	DKManagedObject *object = [database insertNewObjectIntoTable:table error:&error];
+	STAssertNotNil(object, @"Could not insert object into %@. Got error %@.", table.name, error);
+	
+	for (NSString *key in values)
+		[object setValue:[values objectForKey:key] forColumnNamed:key];
+	
+	return object;
+}
+
+- (NSArray *)objectsInTable:(DKTableDescription *)table database:(DKDatabase *)database matchingPredicate:(NSPredicate *)predicate
+{
+	DKFetchRequest *fetchRequest = [DKFetchRequest fetchRequestWithTable:table];
+	fetchRequest.predicate = predicate;
+	
+	NSError *error = nil;
+	NSArray *objects = [database executeFetchRequest:fetchRequest error:&error];
+	STAssertNotNil(objects, @"Could not fetch objects from %@. Got error %@.", table.name, error);
+	
+	return objects;
+}
+
+- (NSArray *)valuesOfColumn:(NSString *)column inObjects:(NSArray *)objects
+{
+	NSMutableArray *values = [NSMutableArray arrayWithCapacity:[objects count]];
+	for (DKManagedObject *object in objects)
+		[values addObject:([object valueForColumnNamed:column] ?: [NSNull null])];
+	
+	return values;
+}
+
+- (NSSet *)valuesOfColumn:(NSString *)column inTable:(DKTableDescription *)table database:(DKDatabase *)database matchingPredicate:(NSPredicate *)predicate
+{
+	NSMutableSet *values = [NSMutableSet set];
+	for (DKManagedObject *object in [self objectsInTable:table database:database matchingPredicate:predicate])
+		[values addObject:([object valueForColumnNamed:column] ?: [NSNull null])];
+	
+	return values;
+}
+
+- (NSUInteger)countOfTable:(DKTableDescription *)table database:(DKDatabase *)database
+{
+	NSError *error = nil;
+	NSUInteger count = [database countForFetchRequest:[DKFetchRequest fetchRequestWithTable:table] error:&error];
+	STAssertNil(error, @"Could not count objects in %@. Got error %@.", table.name, error);
+	
+	return count;
+}
+
+- (NSString *)storageTypeOfColumn:(NSString *)column forObject:(DKManagedObject *)object
+{
+	NSString *queryString = [NSString stringWithFormat:@"SELECT typeof(%@) FROM %@ WHERE _dk_uniqueIdentifier = ?", 
+							 [column stringByEscapingStringForLiteralUseInSQLQueries], 
+							 [object.tableDescription.name stringByEscapingStringForLiteralUseInSQLQueries]];
+	
+	NSError *error = nil;
+	DKCompiledSQLQuery *query = [object.database compileSQLQuery:queryString error:&error];
+	STAssertNotNil(query, @"Could not compile query. Got error %@.", error);
+	
+	[query setLongLong:object.uniqueIdentifier forParameterAtIndex:1];
+	NSString *type = [query nextRow]? [query stringForColumnAtIndex:0] : nil;
+	[query reset];
+	
+	return type;
+}
+
+- (BOOL)runMainRunLoopUntil:(BOOL (^)(void))condition
+{
+	NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:10.0];
+	while (!condition() && ([deadline timeIntervalSinceNow] > 0.0))
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+	
+	return condition();
+}
+
+#pragma mark -
+#pragma mark Compiled Query Cache
+
+- (void)testCompiledQueriesAreReused
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	NSString *queryString = [NSString stringWithFormat:@"SELECT count(*) FROM %@", [mNotesTable.name stringByEscapingStringForLiteralUseInSQLQueries]];
+	
+	NSUInteger hitCount = database.compiledQueryCacheHitCount;
+	NSUInteger missCount = database.compiledQueryCacheMissCount;
+	
+	NSError *error = nil;
+	DKCompiledSQLQuery *query = [database compileSQLQuery:queryString error:&error];
+	STAssertNotNil(query, @"Could not compile query. Got error %@.", error);
+	STAssertEquals(database.compiledQueryCacheMissCount, missCount + 1, @"A query that was never compiled before was not counted as a miss.");
+	
+	//The cached query is still checked out, so a second caller gets a private copy.
+	DKCompiledSQLQuery *busyQuery = [database compileSQLQuery:queryString error:&error];
+	STAssertNotNil(busyQuery, @"Could not compile query. Got error %@.", error);
+	STAssertTrue(busyQuery != query, @"A query that was checked out was handed out again.");
+	STAssertEquals(database.compiledQueryCacheMissCount, missCount + 2, @"A private copy of a busy query was not counted as a miss.");
+	
+	[busyQuery reset];
+	[query reset];
+	
+	DKCompiledSQLQuery *reusedQuery = [database compileSQLQuery:queryString error:&error];
+	STAssertEquals(reusedQuery, query, @"A query that was checked back in was not reused.");
+	STAssertEquals(database.compiledQueryCacheHitCount, hitCount + 1, @"A reused query was not counted as a hit.");
+	STAssertEquals(database.compiledQueryCacheMissCount, missCount + 2, @"A reused query was counted as a miss.");
+	[reusedQuery reset];
+}
+
+- (void)testQueryCacheEvictsLeastRecentlyUsedQuery
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	database.compiledQueryCacheLimit = 2;
+	
+	NSString *tableName = [mNotesTable.name stringByEscapingStringForLiteralUseInSQLQueries];
+	NSMutableArray *queryStrings = [NSMutableArray array];
+	for (NSString *columnName in [NSArray arrayWithObjects:@"title", @"count", @"score", nil])
+		[queryStrings addObject:[NSString stringWithFormat:@"SELECT %@ FROM %@", [columnName stringByEscapingStringForLiteralUseInSQLQueries], tableName]];
+	
+	NSError *error = nil;
+	for (NSString *queryString in queryStrings)
+	{
+		DKCompiledSQLQuery *query = [database compileSQLQuery:queryString error:&error];
+		STAssertNotNil(query, @"Could not compile query. Got error %@.", error);
+		[query reset];
+	}
+	
+	NSUInteger hitCount = database.compiledQueryCacheHitCount;
+	NSUInteger missCount = database.compiledQueryCacheMissCount;
+	
+	[[database compileSQLQuery:[queryStrings lastObject] error:&error] reset];
+	STAssertEquals(database.compiledQueryCacheHitCount, hitCount + 1, @"The most recently used query was evicted.");
+	
+	//The first query was used least recently, so it was evicted to make room for the third.
+	[[database compileSQLQuery:[queryStrings objectAtIndex:0] error:&error] reset];
+	STAssertEquals(database.compiledQueryCacheMissCount, missCount + 1, @"The least recently used query was not evicted.");
+}
+
+#pragma mark -
+#pragma mark Identity and Lifetime
+
+- (void)testFetchesShareOneObjectPerRow
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	DKManagedObject *note = [self insertObjectIntoTable:mNotesTable database:database values:[NSDictionary dictionaryWithObject:@"identity" forKey:@"title"]];
+	
+	DKFetchRequest *fetchRequest = [DKFetchRequest fetchRequestWithTable:mNotesTable];
+	fetchRequest.predicate = [NSPredicate predicateWithFormat:@"title == %@", @"identity"];
+	
+	NSUInteger numberOfFetches = 32;
+	DKManagedObject **fetchedObjects = calloc(numberOfFetches, sizeof(DKManagedObject *));
+	dispatch_apply(numberOfFetches, dispatch_get_global_queue(0, 0), ^(size_t index) {
+		NSAutoreleasePool *pool = [NSAutoreleasePool new];
+		fetchedObjects[index] = [[[database executeFetchRequest:fetchRequest error:NULL] lastObject] retain];
+		[pool drain];
+	});
+	
+	for (NSUInteger index = 0; index < numberOfFetches; index++)
+	{
+		STAssertEquals(fetchedObjects[index], note, @"Fetch %ld returned a different object for the same row.", (long)index);
+		[fetchedObjects[index] release];
+	}
+	
+	free(fetchedObjects);
+}
+
+#pragma mark -
+#pragma mark Predicates
+
+- (void)insertPredicateTestNotesIntoDatabase:(DKDatabase *)database
+{
+	NSArray *titles = [NSArray arrayWithObjects:@"Apple", @"apricot", @"Banana", @"cherry pie", [NSNull null], nil];
+	NSUInteger count = 1;
+	for (id title in titles)
+	{
+		NSMutableDictionary *values = [NSMutableDictionary dictionary];
+		[values setObject:[NSNumber numberWithUnsignedInteger:count] forKey:@"count"];
+		[values setObject:[NSNumber numberWithDouble:count - 0.5] forKey:@"score"];
+		if(title != [NSNull null])
+			[values setObject:title forKey:@"title"];
+		
+		[self insertObjectIntoTable:mNotesTable database:database values:values];
+		count++;
+	}
+}
+
+- (void)testComparisonPredicates
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	[self insertPredicateTestNotesIntoDatabase:database];
+	
+	NSPredicate *predicate = [NSPredicate predicateWithFormat:@"count IN %@", [NSArray arrayWithObjects:[NSNumber numberWithInt:1], [NSNumber numberWithInt:3], nil]];
+	STAssertEqualObjects([self valuesOfColumn:@"title" inTable:mNotesTable database:database matchingPredicate:predicate],
+						 ([NSSet setWithObjects:@"Apple", @"Banana", nil]), @"IN matched the wrong rows.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"count IN %@", [NSArray array]];
+	STAssertEquals([[self objectsInTable:mNotesTable database:database matchingPredicate:predicate] count], (NSUInteger)0, @"IN with no values matched rows.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"title IN[c] %@", [NSSet setWithObjects:@"apple", @"BANANA", nil]];
+	STAssertEqualObjects([self valuesOfColumn:@"title" inTable:mNotesTable database:database matchingPredicate:predicate],
+						 ([NSSet setWithObjects:@"Apple", @"Banana", nil]), @"Case insensitive IN matched the wrong rows.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"count BETWEEN {2, 4}"];
+	STAssertEqualObjects([self valuesOfColumn:@"title" inTable:mNotesTable database:database matchingPredicate:predicate],
+						 ([NSSet setWithObjects:@"apricot", @"Banana", @"cherry pie", nil]), @"BETWEEN did not include both of its bounds.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"score BETWEEN %@", [NSArray arrayWithObjects:[NSNumber numberWithDouble:1.0], [NSNumber numberWithDouble:3.0], nil]];
+	STAssertEqualObjects([self valuesOfColumn:@"title" inTable:mNotesTable database:database matchingPredicate:predicate],
+						 ([NSSet setWithObjects:@"apricot", @"Banana", nil]), @"BETWEEN matched the wrong rows.");
+	
+	//The constant is on the left, so the comparison has to be flipped.
+	predicate = [NSPredicate predicateWithFormat:@"3 < count"];
+	STAssertEqualObjects([self valuesOfColumn:@"count" inTable:mNotesTable database:database matchingPredicate:predicate],
+						 ([NSSet setWithObjects:[NSNumber numberWithInt:4], [NSNumber numberWithInt:5], nil]), @"Flipped comparison matched the wrong rows.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"count > 1 AND NOT (title BEGINSWITH[c] %@)", @"a"];
+	STAssertEqualObjects([self valuesOfColumn:@"title" inTable:mNotesTable database:database matchingPredicate:predicate],
+						 ([NSSet setWithObjects:@"Banana", @"cherry pie", nil]), @"Compound predicate matched the wrong rows.");
+}
+
+- (void)testStringPredicates
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	[self insertPredicateTestNotesIntoDatabase:database];
+	
+	NSPredicate *predicate = [NSPredicate predicateWithFormat:@"title BEGINSWITH %@", @"Ap"];
+	STAssertEqualObjects([self valuesOfColumn:@"title" inTable:mNotesTable database:database matchingPredicate:predicate],
+						 [NSSet setWithObject:@"Apple"], @"BEGINSWITH ignored case.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"title BEGINSWITH[c] %@", @"ap"];
+	STAssertEqualObjects([self valuesOfColumn:@"title" inTable:mNotesTable database:database matchingPredicate:predicate],
+						 ([NSSet setWithObjects:@"Apple", @"apricot", nil]), @"BEGINSWITH[c] did not ignore case.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"title ENDSWITH %@", @"pie"];
+	STAssertEqualObjects([self valuesOfColumn:@"title" inTable:mNotesTable database:database matchingPredicate:predicate],
+						 [NSSet setWithObject:@"cherry pie"], @"ENDSWITH matched the wrong rows.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"title CONTAINS %@", @"AN"];
+	STAssertEquals([[self objectsInTable:mNotesTable database:database matchingPredicate:predicate] count], (NSUInteger)0, @"CONTAINS ignored case.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"title CONTAINS[c] %@", @"AN"];
+	STAssertEqualObjects([self valuesOfColumn:@"title" inTable:mNotesTable database:database matchingPredicate:predicate],
+						 [NSSet setWithObject:@"Banana"], @"CONTAINS[c] did not ignore case.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"title LIKE[c] %@", @"a*"];
+	STAssertEqualObjects([self valuesOfColumn:@"title" inTable:mNotesTable database:database matchingPredicate:predicate],
+						 ([NSSet setWithObjects:@"Apple", @"apricot", nil]), @"LIKE[c] did not translate its wildcards.");
+	
+	//Wildcards of the underlying SQL operators are matched literally.
+	for (NSString *wildcard in [NSArray arrayWithObjects:@"*", @"?", @"%", @"_", @"[", nil])
+	{
+		predicate = [NSPredicate predicateWithFormat:@"title CONTAINS %@", wildcard];
+		STAssertEquals([[self objectsInTable:mNotesTable database:database matchingPredicate:predicate] count], (NSUInteger)0, @"CONTAINS treated %@ as a wildcard.", wildcard);
+		
+		predicate = [NSPredicate predicateWithFormat:@"title CONTAINS[c] %@", wildcard];
+		STAssertEquals([[self objectsInTable:mNotesTable database:database matchingPredicate:predicate] count], (NSUInteger)0, @"CONTAINS[c] treated %@ as a wildcard.", wildcard);
+	}
+}
+
+- (void)testNilComparisonPredicates
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	[self insertPredicateTestNotesIntoDatabase:database];
+	
+	NSPredicate *predicate = [NSPredicate predicateWithFormat:@"title == nil"];
+	STAssertEqualObjects([self valuesOfColumn:@"count" inTable:mNotesTable database:database matchingPredicate:predicate],
+						 [NSSet setWithObject:[NSNumber numberWithInt:5]], @"Comparing with nil did not match NULL.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"title != nil"];
+	STAssertEquals([[self objectsInTable:mNotesTable database:database matchingPredicate:predicate] count], (NSUInteger)4, @"Comparing with nil matched NULL.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"title == %@", [NSNull null]];
+	STAssertEquals([[self objectsInTable:mNotesTable database:database matchingPredicate:predicate] count], (NSUInteger)1, @"Comparing with NSNull did not match NULL.");
+	
+	NSError *error = nil;
+	predicate = [NSPredicate predicateWithFormat:@"title < nil"];
+	STAssertNil([predicate SQLExpressionForTable:mNotesTable arguments:[NSMutableArray array] error:&error], @"An ordered comparison with nil was translated.");
+	STAssertNotNil(error, @"An untranslatable predicate did not produce an error.");
+}
+
+- (void)testOneToOneKeyPathPredicates
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	
+	DKManagedObject *ann = [self insertObjectIntoTable:mAuthorsTable database:database values:[NSDictionary dictionaryWithObject:@"Ann" forKey:@"name"]];
+	DKManagedObject *bob = [self insertObjectIntoTable:mAuthorsTable database:database values:[NSDictionary dictionaryWithObject:@"Bob" forKey:@"name"]];
+	[self insertObjectIntoTable:mBooksTable database:database values:[NSDictionary dictionaryWithObjectsAndKeys:@"First", @"title", ann, @"author", nil]];
+	[self insertObjectIntoTable:mBooksTable database:database values:[NSDictionary dictionaryWithObjectsAndKeys:@"Second", @"title", ann, @"author", nil]];
+	[self insertObjectIntoTable:mBooksTable database:database values:[NSDictionary dictionaryWithObjectsAndKeys:@"Third", @"title", bob, @"author", nil]];
+	[self insertObjectIntoTable:mBooksTable database:database values:[NSDictionary dictionaryWithObject:@"Anonymous" forKey:@"title"]];
+	
+	NSPredicate *predicate = [NSPredicate predicateWithFormat:@"author.name == %@", @"Ann"];
+	STAssertEqualObjects([self valuesOfColumn:@"title" inTable:mBooksTable database:database matchingPredicate:predicate],
+						 ([NSSet setWithObjects:@"First", @"Second", nil]), @"Key path through a relationship matched the wrong rows.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"author.name BEGINSWITH[c] %@ AND title != %@", @"b", @"First"];
+	STAssertEqualObjects([self valuesOfColumn:@"title" inTable:mBooksTable database:database matchingPredicate:predicate],
+						 [NSSet setWithObject:@"Third"], @"Key path in a compound predicate matched the wrong rows.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"author == %@", bob];
+	STAssertEqualObjects([self valuesOfColumn:@"title" inTable:mBooksTable database:database matchingPredicate:predicate],
+						 [NSSet setWithObject:@"Third"], @"Comparing a relationship with an object matched the wrong rows.");
+	
+	predicate = [NSPredicate predicateWithFormat:@"author == nil"];
+	STAssertEqualObjects([self valuesOfColumn:@"title" inTable:mBooksTable database:database matchingPredicate:predicate],
+						 [NSSet setWithObject:@"Anonymous"], @"Comparing a relationship with nil matched the wrong rows.");
+}
+
+- (void)testPredicateConstantsAreParameters
+{
+	NSMutableArray *firstArguments = [NSMutableArray array];
+	NSMutableArray *secondArguments = [NSMutableArray array];
+	
+	NSError *error = nil;
+	NSString *firstExpression = [[NSPredicate predicateWithFormat:@"title == %@ AND count > %d", @"O'Brien", 1] SQLExpressionForTable:mNotesTable arguments:firstArguments error:&error];
+	STAssertNotNil(firstExpression, @"Could not translate predicate. Got error %@.", error);
+	
+	NSString *secondExpression = [[NSPredicate predicateWithFormat:@"title == %@ AND count > %d", @"other", 2] SQLExpressionForTable:mNotesTable arguments:secondArguments error:&error];
+	STAssertNotNil(secondExpression, @"Could not translate predicate. Got error %@.", error);
+	
+	STAssertEqualObjects(firstExpression, secondExpression, @"Predicates that only differ by their constants produced different SQL.");
+	STAssertTrue([firstExpression rangeOfString:@"Brien"].location == NSNotFound, @"A constant was written into the SQL.");
+	STAssertEqualObjects(firstArguments, ([NSArray arrayWithObjects:@"O'Brien", [NSNumber numberWithInt:1], nil]), @"Constants were not given as arguments in order.");
+	
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	DKFetchRequest *fetchRequest = [DKFetchRequest fetchRequestWithTable:mNotesTable];
+	fetchRequest.predicate = [NSPredicate predicateWithFormat:@"title MATCHES %@", @".*"];
+	STAssertNil([database executeFetchRequest:fetchRequest error:&error], @"A fetch with an unsupported predicate succeeded.");
+	STAssertEqualObjects([error domain], DKEvaluationErrorDomain, @"A fetch with an unsupported predicate failed with the wrong error.");
+}
+
+#pragma mark -
+#pragma mark Paging
+
+- (void)testFetchLimitAndOffset
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	for (NSUInteger count = 1; count <= 10; count++)
+		[self insertObjectIntoTable:mNotesTable database:database values:[NSDictionary dictionaryWithObject:[NSNumber numberWithUnsignedInteger:count] forKey:@"count"]];
+	
+	DKFetchRequest *fetchRequest = [DKFetchRequest fetchRequestWithTable:mNotesTable];
+	fetchRequest.sortDescriptors = [NSArray arrayWithObject:[NSSortDescriptor sortDescriptorWithKey:@"count" ascending:YES]];
+	fetchRequest.fetchLimit = 3;
+	fetchRequest.fetchOffset = 2;
+	
+	NSError *error = nil;
+	NSArray *notes = [database executeFetchRequest:fetchRequest error:&error];
+	STAssertNotNil(notes, @"Could not fetch objects. Got error %@.", error);
+	STAssertEqualObjects([self valuesOfColumn:@"count" inObjects:notes], ([NSArray arrayWithObjects:[NSNumber numberWithInt:3], [NSNumber numberWithInt:4], [NSNumber numberWithInt:5], nil]), @"Limit and offset selected the wrong page.");
+	STAssertEquals([database countForFetchRequest:fetchRequest error:&error], (NSUInteger)3, @"Count did not honor the limit and offset.");
+	
+	//The last page is short.
+	fetchRequest.fetchOffset = 8;
+	notes = [database executeFetchRequest:fetchRequest error:&error];
+	STAssertEqualObjects([self valuesOfColumn:@"count" inObjects:notes], ([NSArray arrayWithObjects:[NSNumber numberWithInt:9], [NSNumber numberWithInt:10], nil]), @"Offset near the end selected the wrong page.");
+	STAssertEquals([database countForFetchRequest:fetchRequest error:&error], (NSUInteger)2, @"Count of the last page is wrong.");
+	
+	fetchRequest.fetchOffset = 20;
+	STAssertEquals([[database executeFetchRequest:fetchRequest error:&error] count], (NSUInteger)0, @"Offset past the end returned objects.");
+	STAssertEquals([database countForFetchRequest:fetchRequest error:&error], (NSUInteger)0, @"Count past the end is not 0.");
+	
+	//A limit without sort descriptors still limits.
+	fetchRequest.sortDescriptors = nil;
+	fetchRequest.fetchOffset = 0;
+	STAssertEquals([[database executeFetchRequest:fetchRequest error:&error] count], (NSUInteger)3, @"Limit without sort descriptors was ignored.");
+}
+
+- (void)testFetchAfterObjectBreaksTies
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	
+	//Every count is shared by three rows, so pages end in the middle of a tie.
+	NSUInteger numberOfObjects = 10;
+	for (NSUInteger index = 0; index < numberOfObjects; index++)
+		[self insertObjectIntoTable:mNotesTable database:database values:[NSDictionary dictionaryWithObject:[NSNumber numberWithUnsignedInteger:index / 3] forKey:@"count"]];
+	
+	DKFetchRequest *fetchRequest = [DKFetchRequest fetchRequestWithTable:mNotesTable];
+	fetchRequest.sortDescriptors = [NSArray arrayWithObject:[NSSortDescriptor sortDescriptorWithKey:@"count" ascending:NO]];
+	fetchRequest.fetchLimit = 4;
+	
+	NSMutableArray *pagedNotes = [NSMutableArray array];
+	NSError *error = nil;
+	for (;;)
+	{
+		NSArray *page = [database executeFetchRequest:fetchRequest error:&error];
+		STAssertNotNil(page, @"Could not fetch page. Got error %@.", error);
+		if([page count] == 0)
+			break;
+		
+		STAssertEquals([database countForFetchRequest:fetchRequest error:&error], [page count], @"Count of a page after an object is wrong.");
+		
+		[pagedNotes addObjectsFromArray:page];
+		fetchRequest.fetchAfterObject = [page lastObject];
+		
+		if([pagedNotes count] > numberOfObjects)
+			break;
+	}
+	
+	STAssertEquals([pagedNotes count], numberOfObjects, @"Paging skipped or repeated rows.");
+	STAssertEquals([[NSSet setWithArray:pagedNotes] count], numberOfObjects, @"Paging repeated rows.");
+	
+	NSInteger previousCount = NSIntegerMax;
+	for (DKManagedObject *note in pagedNotes)
+	{
+		NSInteger count = [[note valueForColumnNamed:@"count"] integerValue];
+		STAssertTrue(count <= previousCount, @"Pages are not in order.");
+		previousCount = count;
+	}
+}
+
+#pragma mark -
+#pragma mark Enumeration
+
+- (void)testEnumerationReadsEveryRowInBatches
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	
+	NSUInteger numberOfObjects = 100;
+	NSMutableArray *values = [NSMutableArray array];
+	for (NSUInteger index = 0; index < numberOfObjects; index++)
+		[values addObject:[NSDictionary dictionaryWithObject:[NSNumber numberWithUnsignedInteger:numberOfObjects - index] forKey:@"count"]];
+	
+	STAssertNotNil([database insertNewObjectsIntoTable:mNotesTable count:numberOfObjects values:values error:NULL], @"Could not insert objects.");
+	
+	DKFetchRequest *fetchRequest = [DKFetchRequest fetchRequestWithTable:mNotesTable];
+	fetchRequest.sortDescriptors = [NSArray arrayWithObject:[[[NSSortDescriptor alloc] initWithKey:@"count" ascending:YES] autorelease]];
+	fetchRequest.fetchBatchSize = 7;
+	
+	__block NSUInteger numberOfEnumeratedObjects = 0;
+	__block BOOL isInOrder = YES;
+	NSError *error = nil;
+	BOOL success = [database enumerateObjectsForFetchRequest:fetchRequest error:&error usingBlock:^(id object, BOOL *stop) {
+		numberOfEnumeratedObjects++;
+		if([[object valueForColumnNamed:@"count"] unsignedIntegerValue] != numberOfEnumeratedObjects)
+			isInOrder = NO;
+	}];
+	
+	STAssertTrue(success, @"Could not enumerate objects. Got error %@.", error);
+	STAssertEquals(numberOfEnumeratedObjects, numberOfObjects, @"Enumeration did not visit every row.");
+	STAssertTrue(isInOrder, @"Enumeration did not honor the sort descriptors across batches.");
+	
+	numberOfEnumeratedObjects = 0;
+	success = [database enumerateObjectsForFetchRequest:fetchRequest error:&error usingBlock:^(id object, BOOL *stop) {
+		if(++numberOfEnumeratedObjects == 10)
+			*stop = YES;
+	}];
+	
+	STAssertTrue(success, @"Could not enumerate objects. Got error %@.", error);
+	STAssertEquals(numberOfEnumeratedObjects, (NSUInteger)10, @"Enumeration continued after being stopped.");
+}
+
+#pragma mark -
+#pragma mark Concurrency
+
+- (void)testConcurrentReadsSeeCommittedRows
+{
+	DKDatabase *database = [self databaseAtURL:mTestDatabaseURL options:kDKDatabaseOptionConcurrentReads];
+	
+	NSUInteger numberOfObjects = 100;
+	STAssertNotNil([database insertNewObjectsIntoTable:mNotesTable count:numberOfObjects values:nil error:NULL], @"Could not insert objects.");
+	
+	NSUInteger numberOfReaders = 8;
+	NSUInteger *counts = calloc(numberOfReaders, sizeof(NSUInteger));
+	dispatch_apply(numberOfReaders, dispatch_get_global_queue(0, 0), ^(size_t index) {
+		NSAutoreleasePool *pool = [NSAutoreleasePool new];
+		counts[index] = [database countForFetchRequest:[DKFetchRequest fetchRequestWithTable:mNotesTable] error:NULL];
+		[pool drain];
+	});
+	
+	for (NSUInteger index = 0; index < numberOfReaders; index++)
+		STAssertEquals(counts[index], numberOfObjects, @"Reader %ld did not see every committed row.", (long)index);
+	
+	free(counts);
+}
+
+- (void)testReadsInsideTransactionSeeUncommittedRows
+{
+	DKDatabase *database = [self databaseAtURL:mTestDatabaseURL options:kDKDatabaseOptionConcurrentReads];
+	
+	//
+	//	The block is performed on the writer queue, so it doesn't make any assertions
+	//	itself. A failed assertion there would raise on a thread that isn't the test's.
+	//
+	__block NSUInteger countInsideTransaction = 0;
+	NSError *error = nil;
+	BOOL success = [database performTransaction:^(NSError **transactionError) {
+		if(![database insertNewObjectsIntoTable:mNotesTable count:1 values:nil error:transactionError])
+			return NO;
+		
+		countInsideTransaction = [database countForFetchRequest:[DKFetchRequest fetchRequestWithTable:mNotesTable] error:transactionError];
+		return YES;
+	} error:&error];
+	
+	STAssertTrue(success, @"Could not perform transaction. Got error %@.", error);
+	STAssertEquals(countInsideTransaction, (NSUInteger)1, @"A read inside of a transaction did not see its own write.");
+}
+
+#pragma mark -
+#pragma mark Asynchronous Work
+
+- (void)testAsynchronousFetchCallsBackOnMainQueue
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	STAssertNotNil([database insertNewObjectsIntoTable:mNotesTable count:3 values:nil error:NULL], @"Could not insert objects.");
+	
+	__block NSUInteger numberOfCallbacks = 0;
+	__block BOOL calledBackOnMainThread = NO;
+	__block NSArray *fetchedNotes = nil;
+	__block NSError *fetchError = nil;
+	DKDatabaseOperation *operation = [database executeFetchRequest:[DKFetchRequest fetchRequestWithTable:mNotesTable] completionHandler:^(NSArray *objects, NSError *error) {
+		numberOfCallbacks++;
+		calledBackOnMainThread = [NSThread isMainThread];
+		fetchedNotes = [objects retain];
+		fetchError = [error retain];
+	}];
+	STAssertNotNil(operation, @"Asynchronous fetch did not return an operation.");
+	
+	STAssertTrue([self runMainRunLoopUntil:^{ return (BOOL)(numberOfCallbacks > 0); }], @"Completion handler was never invoked.");
+	STAssertEquals(numberOfCallbacks, (NSUInteger)1, @"Completion handler was invoked more than once.");
+	STAssertTrue(calledBackOnMainThread, @"Completion handler was not invoked on the main queue.");
+	STAssertEquals([fetchedNotes count], (NSUInteger)3, @"Asynchronous fetch returned the wrong objects. Got error %@.", fetchError);
+	STAssertNil(fetchError, @"Successful fetch reported an error.");
+	
+	//Cancelling a finished operation has no effect.
+	[operation cancel];
+	[[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+	STAssertEquals(numberOfCallbacks, (NSUInteger)1, @"Cancelling a finished fetch invoked its completion handler again.");
+	
+	[fetchedNotes release];
+	[fetchError release];
+}
+
+- (void)testCancelledFetchReportsCancellation
+{
+	DKTableDescription *pendingTable = [[[DKTableDescription alloc] initWithName:@"Pending"
+															databaseObjectClass:[DKTestBlockingObject class]
+																	 properties:[NSArray arrayWithObject:[DKAttributeDescription attributeWithName:@"title" type:DKAttributeTypeString]]] autorelease];
+	DKDatabaseLayout *layout = [[[DKDatabaseLayout alloc] initWithName:@"DatabaseKitTest" version:1.0 tables:[NSArray arrayWithObject:pendingTable]] autorelease];
+	
+	NSUInteger numberOfObjects = 4;
+	NSError *error = nil;
+	NSAutoreleasePool *pool = [NSAutoreleasePool new];
+	{
+		DKDatabase *database = [[[DKDatabase alloc] initWithDatabaseAtURL:mTestDatabaseURL layout:layout options:kDKDatabaseOptionNone error:&error] autorelease];
+		STAssertNotNil(database, @"Could not open database. Got error %@.", error);
+		STAssertNotNil([database insertNewObjectsIntoTable:pendingTable count:numberOfObjects values:nil error:NULL], @"Could not insert objects.");
+	}
+	[pool drain];
+	
+	//A fresh database has to create an object for every row it fetches, and the first one waits for us.
+	DKDatabase *database = [[[DKDatabase alloc] initWithDatabaseAtURL:mTestDatabaseURL layout:layout options:kDKDatabaseOptionNone error:&error] autorelease];
+	STAssertNotNil(database, @"Could not open database. Got error %@.", error);
+	
+	DKTestBlockingObjectSemaphore = dispatch_semaphore_create(0);
+	
+	__block NSUInteger numberOfCallbacks = 0;
+	__block NSArray *fetchedObjects = nil;
+	__block NSError *fetchError = nil;
+	DKDatabaseOperation *operation = [database executeFetchRequest:[DKFetchRequest fetchRequestWithTable:pendingTable] completionHandler:^(NSArray *objects, NSError *error) {
+		numberOfCallbacks++;
+		fetchedObjects = [objects retain];
+		fetchError = [error retain];
+	}];
+	
+	[operation cancel];
+	STAssertTrue(operation.isCancelled, @"Cancelled operation does not report being cancelled.");
+	
+	for (NSUInteger index = 0; index < numberOfObjects; index++)
+		dispatch_semaphore_signal(DKTestBlockingObjectSemaphore);
+	
+	STAssertTrue([self runMainRunLoopUntil:^{ return (BOOL)(numberOfCallbacks > 0); }], @"Completion handler of a cancelled fetch was never invoked.");
+	STAssertEquals(numberOfCallbacks, (NSUInteger)1, @"Completion handler was invoked more than once.");
+	STAssertNil(fetchedObjects, @"Cancelled fetch returned objects.");
+	STAssertEqualObjects([fetchError domain], NSCocoaErrorDomain, @"Cancelled fetch reported the wrong error.");
+	STAssertEquals([fetchError code], (NSInteger)NSUserCancelledError, @"Cancelled fetch reported the wrong error.");
+	
+	dispatch_release(DKTestBlockingObjectSemaphore);
+	DKTestBlockingObjectSemaphore = NULL;
+	
+	[fetchedObjects release];
+	[fetchError release];
+}
+
+- (void)testAsynchronousSaveCallsBackOnMainQueue
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	database.defersChangesUntilSave = YES;
+	
+	DKManagedObject *note = [self insertObjectIntoTable:mNotesTable database:database values:nil];
+	[note setValue:@"saved" forColumnNamed:@"title"];
+	STAssertTrue(database.hasChanges, @"Database does not have the change that was made.");
+	
+	__block NSUInteger numberOfCallbacks = 0;
+	__block BOOL calledBackOnMainThread = NO;
+	__block BOOL saveSucceeded = NO;
+	[database saveWithCompletionHandler:^(BOOL success, NSError *error) {
+		numberOfCallbacks++;
+		calledBackOnMainThread = [NSThread isMainThread];
+		saveSucceeded = success;
+	}];
+	
+	STAssertTrue([self runMainRunLoopUntil:^{ return (BOOL)(numberOfCallbacks > 0); }], @"Completion handler was never invoked.");
+	STAssertEquals(numberOfCallbacks, (NSUInteger)1, @"Completion handler was invoked more than once.");
+	STAssertTrue(calledBackOnMainThread, @"Completion handler was not invoked on the main queue.");
+	STAssertTrue(saveSucceeded, @"Asynchronous save failed.");
+	STAssertFalse(database.hasChanges, @"Database still has changes after saving.");
+	
+	NSArray *savedNotes = [self objectsInTable:mNotesTable database:database matchingPredicate:[NSPredicate predicateWithFormat:@"title == %@", @"saved"]];
+	STAssertEquals([savedNotes count], (NSUInteger)1, @"Asynchronous save did not write its change.");
+}
+
+#pragma mark -
+#pragma mark Transactions
+
+- (void)testFailedNestedTransactionOnlyRollsBackItself
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	
+	__block BOOL innerSuccess = YES;
+	NSError *error = nil;
+	BOOL success = [database performTransaction:^(NSError **outerError) {
+		NSArray *outerValues = [NSArray arrayWithObject:[NSDictionary dictionaryWithObject:@"outer" forKey:@"title"]];
+		if(![database insertNewObjectsIntoTable:mNotesTable count:1 values:outerValues error:outerError])
+			return NO;
+		
+		innerSuccess = [database performTransaction:^(NSError **innerError) {
+			NSArray *innerValues = [NSArray arrayWithObject:[NSDictionary dictionaryWithObject:@"inner" forKey:@"title"]];
+			[database insertNewObjectsIntoTable:mNotesTable count:1 values:innerValues error:innerError];
+			return NO;
+		} error:NULL];
+		
+		return YES;
+	} error:&error];
+	
+	STAssertTrue(success, @"Could not perform transaction. Got error %@.", error);
+	STAssertFalse(innerSuccess, @"A rolled back transaction reported success.");
+	
+	NSArray *notes = [self objectsInTable:mNotesTable database:database matchingPredicate:nil];
+	STAssertEquals([notes count], (NSUInteger)1, @"The nested transaction was not rolled back on its own.");
+	STAssertEqualObjects([[notes lastObject] valueForColumnNamed:@"title"], @"outer", @"The wrong transaction was rolled back.");
+	STAssertEquals(database.transactionDepth, (NSUInteger)0, @"Transactions were left open.");
+}
+
+- (void)testGroupCommitKeepsEachTransactionsOutcome
+{
+	DKDatabase *database = [self databaseAtURL:mTestDatabaseURL options:kDKDatabaseOptionConcurrentReads];
+	database.groupCommitInterval = 0.05;
+	
+	//Every fourth transaction fails, and should take nothing else in its group with it.
+	NSUInteger numberOfTransactions = 16;
+	BOOL *outcomes = calloc(numberOfTransactions, sizeof(BOOL));
+	dispatch_apply(numberOfTransactions, dispatch_get_global_queue(0, 0), ^(size_t index) {
+		NSAutoreleasePool *pool = [NSAutoreleasePool new];
+		outcomes[index] = [database performTransaction:^(NSError **transactionError) {
+			NSArray *values = [NSArray arrayWithObject:[NSDictionary dictionaryWithObject:[NSNumber numberWithUnsignedInteger:index] forKey:@"count"]];
+			if(![database insertNewObjectsIntoTable:mNotesTable count:1 values:values error:transactionError])
+				return NO;
+			
+			return (BOOL)((index % 4) != 0);
+		} error:NULL];
+		[pool drain];
+	});
+	
+	for (NSUInteger index = 0; index < numberOfTransactions; index++)
+		STAssertEquals(outcomes[index], (BOOL)((index % 4) != 0), @"Transaction %ld reported the wrong outcome.", (long)index);
+	
+	free(outcomes);
+	
+	STAssertEquals([self countOfTable:mNotesTable database:database], (NSUInteger)12, @"Group commit did not keep each transaction's outcome.");
+	
+	NSArray *failedNotes = [self objectsInTable:mNotesTable database:database matchingPredicate:[NSPredicate predicateWithFormat:@"count IN %@", [NSArray arrayWithObjects:[NSNumber numberWithInt:0], [NSNumber numberWithInt:4], [NSNumber numberWithInt:8], [NSNumber numberWithInt:12], nil]]];
+	STAssertEquals([failedNotes count], (NSUInteger)0, @"Rows written by failed transactions were committed.");
+}
+
+#pragma mark -
+#pragma mark Generated Accessors
+
+- (void)testTypedAccessors
+{
+	int64_t largeCount = (1LL << 40) + 1;
+	
+	NSAutoreleasePool *pool = [NSAutoreleasePool new];
+	{
+		DKDatabase *database = [self databaseAtURL:mTestDatabaseURL options:kDKDatabaseOptionNone];
+		DKManagedObject *note = [self insertObjectIntoTable:mNotesTable database:database values:nil];
+		
+		note.title = @"typed";
+		note.count = largeCount;
+		note.score = 2.5;
+		
+		STAssertEqualObjects(note.title, @"typed", @"Object accessor did not round trip.");
+		STAssertEquals(note.count, largeCount, @"Integer accessor did not round trip.");
+		STAssertEquals(note.score, 2.5, @"Float accessor did not round trip.");
+		STAssertEqualObjects([note valueForColumnNamed:@"count"], [NSNumber numberWithLongLong:largeCount], @"Integer mutator wrote the wrong value.");
+		STAssertEqualObjects([note valueForColumnNamed:@"score"], [NSNumber numberWithDouble:2.5], @"Float mutator wrote the wrong value.");
+	}
+	[pool drain];
+	
+	//A fresh database reads the values back from the row instead of the values we set.
+	DKDatabase *database = [self databaseAtURL:mTestDatabaseURL options:kDKDatabaseOptionNone];
+	DKManagedObject *note = [[self objectsInTable:mNotesTable database:database matchingPredicate:nil] lastObject];
+	STAssertEquals(note.count, largeCount, @"Integer accessor read the wrong value from a fetched row.");
+	STAssertEquals(note.score, 2.5, @"Float accessor read the wrong value from a fetched row.");
+	
+	//Unsaved changes are seen by the accessors before they are written.
+	database.defersChangesUntilSave = YES;
+	note.count = 3;
+	STAssertEquals(note.count, (int64_t)3, @"Integer accessor did not see an unsaved change.");
+	
+	NSError *error = nil;
+	STAssertTrue([database save:&error], @"Could not save. Got error %@.", error);
+	STAssertEquals(note.count, (int64_t)3, @"Integer accessor lost a saved change.");
+}
+
+- (void)testKeyValueCodingUsesTypedAccessors
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	DKManagedObject *note = [self insertObjectIntoTable:mNotesTable database:database values:nil];
+	
+	[note setValue:[NSNumber numberWithInt:7] forKey:@"count"];
+	STAssertEquals(note.count, (int64_t)7, @"Setting an integer through key-value coding did not reach the column.");
+	STAssertEqualObjects([note valueForKey:@"score"], [NSNumber numberWithDouble:0.0], @"Reading an unset float through key-value coding did not give 0.");
+	
+	//Scalar mutators can't take nil, so key-value coding clears the column through setNilValueForKey:.
+	[note setValue:nil forKey:@"count"];
+	STAssertNil([note valueForColumnNamed:@"count"], @"Setting nil through key-value coding did not clear the column.");
+	STAssertEquals(note.count, (int64_t)0, @"Integer accessor of a cleared column did not give 0.");
+}
+
+#pragma mark -
+#pragma mark Dates
+
+- (void)testDatesAreStoredAsNumbers
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	
+	NSDate *created = [NSDate dateWithTimeIntervalSince1970:1252326600.25];
+	DKManagedObject *note = [self insertObjectIntoTable:mNotesTable database:database values:[NSDictionary dictionaryWithObject:created forKey:@"created"]];
+	
+	STAssertEqualObjects([self storageTypeOfColumn:@"created" forObject:note], @"real", @"Date was not stored as a number.");
+	STAssertEqualsWithAccuracy([[note valueForColumnNamed:@"created"] timeIntervalSince1970], [created timeIntervalSince1970], 0.001, @"Date did not round trip.");
+	
+	NSPredicate *predicate = [NSPredicate predicateWithFormat:@"created > %@ AND created < %@", [created dateByAddingTimeInterval:-1.0], [created dateByAddingTimeInterval:1.0]];
+	STAssertEquals([[self objectsInTable:mNotesTable database:database matchingPredicate:predicate] count], (NSUInteger)1, @"Date range did not match.");
+}
+
+- (void)testLegacyDatesAreMigrated
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	
+	//Older versions stored dates as local time text.
+	NSString *legacyDateString = @"2009-09-07 12:30:00.000";
+	NSDate *legacyDate = [NSCalendarDate dateWithString:legacyDateString calendarFormat:@"%Y-%m-%d %H:%M:%S.%F"];
+	
+	NSUInteger numberOfObjects = 5;
+	NSArray *notes = [database insertNewObjectsIntoTable:mNotesTable count:numberOfObjects values:nil error:NULL];
+	STAssertNotNil(notes, @"Could not insert objects.");
+	
+	NSError *error = nil;
+	BOOL success = [database performTransaction:^(NSError **transactionError) {
+		NSString *updateQueryString = [NSString stringWithFormat:@"UPDATE %@ SET %@ = '%@'", 
+									   [mNotesTable.name stringByEscapingStringForLiteralUseInSQLQueries], 
+									   [@"created" stringByEscapingStringForLiteralUseInSQLQueries], 
+									   legacyDateString];
+		return [database executeSQLQuery:updateQueryString error:transactionError];
+	} error:&error];
+	STAssertTrue(success, @"Could not write legacy dates. Got error %@.", error);
+	
+	DKManagedObject *note = [notes lastObject];
+	STAssertEqualObjects([self storageTypeOfColumn:@"created" forObject:note], @"text", @"Legacy date was not stored as text.");
+	STAssertEqualsWithAccuracy([[note valueForColumnNamed:@"created"] timeIntervalSince1970], [legacyDate timeIntervalSince1970], 0.001, @"Legacy date was not read correctly.");
+	
+	//A batch size smaller than the table makes the migration take several passes.
+	STAssertTrue([database migrateLegacyDatesWithBatchSize:2 error:&error], @"Could not migrate dates. Got error %@.", error);
+	
+	for (DKManagedObject *migratedNote in notes)
+	{
+		STAssertEqualObjects([self storageTypeOfColumn:@"created" forObject:migratedNote], @"real", @"Date was not migrated.");
+		STAssertEqualsWithAccuracy([[migratedNote valueForColumnNamed:@"created"] timeIntervalSince1970], [legacyDate timeIntervalSince1970], 0.001, @"Migrated date changed.");
+	}
+	
+	NSPredicate *predicate = [NSPredicate predicateWithFormat:@"created > %@ AND created < %@", [legacyDate dateByAddingTimeInterval:-1.0], [legacyDate dateByAddingTimeInterval:1.0]];
+	STAssertEquals([[self objectsInTable:mNotesTable database:database matchingPredicate:predicate] count], numberOfObjects, @"Migrated dates did not match a date range.");
+	
+	STAssertTrue([database migrateLegacyDatesWithBatchSize:0 error:&error], @"Migrating a migrated database failed. Got error %@.", error);
+}
+
+#pragma mark -
+#pragma mark Codecs and Compression
+
+- (void)testEncodedValuesSurviveReopening
+{
+	NSArray *list = [NSArray arrayWithObjects:@"one", [NSNumber numberWithInt:2], [NSDictionary dictionaryWithObject:@"value" forKey:@"key"], nil];
+	DKTestPoint *point = [[[DKTestPoint alloc] initWithX:1.5 y:-2.25] autorelease];
+	NSDictionary *archive = [NSDictionary dictionaryWithObject:[NSURL URLWithString:@"http://example.com/"] forKey:@"url"];
+	NSMutableData *payload = [NSMutableData dataWithLength:4096];
+	memset([payload mutableBytes], 'a', [payload length]);
+	NSData *raw = [@"DKZ1 looks compressed but is not" dataUsingEncoding:NSUTF8StringEncoding];
+	
+	NSAutoreleasePool *pool = [NSAutoreleasePool new];
+	{
+		DKDatabase *database = [self databaseAtURL:mTestDatabaseURL options:kDKDatabaseOptionNone];
+		[self insertObjectIntoTable:mNotesTable database:database values:[NSDictionary dictionaryWithObjectsAndKeys:
+																		  list, @"list",
+																		  point, @"point",
+																		  archive, @"archive",
+																		  payload, @"payload",
+																		  raw, @"raw",
+																		  nil]];
+	}
+	[pool drain];
+	
+	//A fresh database has nothing cached, so every value is decoded from what was stored.
+	DKDatabase *database = [self databaseAtURL:mTestDatabaseURL options:kDKDatabaseOptionNone];
+	DKManagedObject *note = [[self objectsInTable:mNotesTable database:database matchingPredicate:nil] lastObject];
+	STAssertNotNil(note, @"Stored object could not be fetched.");
+	
+	STAssertEqualObjects([note valueForColumnNamed:@"list"], list, @"Property list value did not round trip.");
+	STAssertEqualObjects([note valueForColumnNamed:@"point"], point, @"Custom coded value did not round trip.");
+	STAssertEqualObjects([note valueForColumnNamed:@"archive"], archive, @"Archived value did not round trip.");
+	STAssertEqualObjects([note valueForColumnNamed:@"payload"], payload, @"Compressed data did not round trip.");
+	STAssertEqualObjects([note encodedDataForColumnNamed:@"payload"], payload, @"Encoded data was not decompressed.");
+	STAssertEqualObjects([note valueForColumnNamed:@"raw"], raw, @"Data stored without compression was altered.");
+	
+	STAssertEqualObjects([self storageTypeOfColumn:@"payload" forObject:note], @"blob", @"Compressed data was not stored as a blob.");
+	
+	NSError *error = nil;
+	NSString *lengthQueryString = [NSString stringWithFormat:@"SELECT length(%@) FROM %@ WHERE _dk_uniqueIdentifier = ?", 
+								   [@"payload" stringByEscapingStringForLiteralUseInSQLQueries], 
+								   [mNotesTable.name stringByEscapingStringForLiteralUseInSQLQueries]];
+	DKCompiledSQLQuery *lengthQuery = [database compileSQLQuery:lengthQueryString error:&error];
+	STAssertNotNil(lengthQuery, @"Could not compile query. Got error %@.", error);
+	[lengthQuery setLongLong:note.uniqueIdentifier forParameterAtIndex:1];
+	STAssertTrue([lengthQuery nextRow], @"Stored payload could not be read.");
+	STAssertTrue([lengthQuery longLongForColumnAtIndex:0] < (long long)[payload length], @"Data over the compression threshold was not compressed.");
+	[lengthQuery reset];
+}
+
+#pragma mark -
+#pragma mark Incremental Data Access
+
+- (void)testDataIsReadAndWrittenIncrementally
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	DKManagedObject *note = [self insertObjectIntoTable:mNotesTable database:database values:nil];
+	STAssertEquals([note lengthOfDataForColumnNamed:@"raw"], (NSUInteger)0, @"A NULL column has a length.");
+	
+	NSError *error = nil;
+	STAssertTrue([note setZeroedDataOfLength:1024 forColumnNamed:@"raw" error:&error], @"Could not size column. Got error %@.", error);
+	STAssertEquals([note lengthOfDataForColumnNamed:@"raw"], (NSUInteger)1024, @"Column was not sized.");
+	STAssertEqualObjects([note valueForColumnNamed:@"raw"], [NSMutableData dataWithLength:1024], @"Sized column is not zeroed.");
+	
+	NSData *greeting = [@"hello" dataUsingEncoding:NSUTF8StringEncoding];
+	STAssertTrue([note writeData:greeting atOffset:100 forColumnNamed:@"raw" error:&error], @"Could not write data. Got error %@.", error);
+	STAssertEqualObjects([note dataForColumnNamed:@"raw" range:NSMakeRange(100, [greeting length]) error:&error], greeting, @"Written bytes were not read back.");
+	
+	NSMutableData *expectedData = [NSMutableData dataWithLength:1024];
+	[expectedData replaceBytesInRange:NSMakeRange(100, [greeting length]) withBytes:[greeting bytes]];
+	STAssertEqualObjects([note valueForColumnNamed:@"raw"], expectedData, @"An incremental write was not seen by the column's value.");
+	
+	//Values can't grow when they're written incrementally.
+	error = nil;
+	STAssertFalse([note writeData:greeting atOffset:1022 forColumnNamed:@"raw" error:&error], @"A write past the end of the value succeeded.");
+	STAssertNotNil(error, @"A failed write did not produce an error.");
+	STAssertNil([note dataForColumnNamed:@"raw" range:NSMakeRange(1020, 10) error:NULL], @"A read past the end of the value succeeded.");
+	STAssertEqualObjects([note valueForColumnNamed:@"raw"], expectedData, @"A failed write changed the value.");
+}
+
+- (void)testDataIsStreamed
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	DKManagedObject *note = [self insertObjectIntoTable:mNotesTable database:database values:nil];
+	
+	//Large enough to be streamed in several chunks.
+	NSMutableData *data = [NSMutableData dataWithLength:300000];
+	uint8_t *bytes = [data mutableBytes];
+	for (NSUInteger index = 0; index < [data length]; index++)
+		bytes[index] = (uint8_t)(index % 251);
+	
+	NSInputStream *inputStream = [NSInputStream inputStreamWithData:data];
+	[inputStream open];
+	NSError *error = nil;
+	BOOL success = [note setDataFromStream:inputStream length:[data length] forColumnNamed:@"raw" error:&error];
+	[inputStream close];
+	STAssertTrue(success, @"Could not write data from a stream. Got error %@.", error);
+	STAssertEqualObjects([note valueForColumnNamed:@"raw"], data, @"Streamed data was not stored.");
+	
+	NSOutputStream *outputStream = [NSOutputStream outputStreamToMemory];
+	[outputStream open];
+	success = [note writeDataForColumnNamed:@"raw" toStream:outputStream error:&error];
+	NSData *writtenData = [outputStream propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+	[outputStream close];
+	STAssertTrue(success, @"Could not write data to a stream. Got error %@.", error);
+	STAssertEqualObjects(writtenData, data, @"Data written to a stream is not the column's value.");
+	
+	//A stream that ends early leaves the column alone.
+	inputStream = [NSInputStream inputStreamWithData:[@"short" dataUsingEncoding:NSUTF8StringEncoding]];
+	[inputStream open];
+	error = nil;
+	success = [note setDataFromStream:inputStream length:1024 forColumnNamed:@"raw" error:&error];
+	[inputStream close];
+	STAssertFalse(success, @"Writing from a stream that ended early succeeded.");
+	STAssertNotNil(error, @"Writing from a stream that ended early did not produce an error.");
+	STAssertEqualObjects([note valueForColumnNamed:@"raw"], data, @"A stream that ended early changed the column.");
+}
+
+#pragma mark -
+#pragma mark To-Many Relationships
+
+- (void)testOneToManyMembership
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	
+	DKManagedObject *author = [self insertObjectIntoTable:mAuthorsTable database:database values:[NSDictionary dictionaryWithObject:@"Author" forKey:@"name"]];
+	NSArray *books = [database insertNewObjectsIntoTable:mBooksTable count:3 values:nil error:NULL];
+	STAssertNotNil(books, @"Could not insert objects.");
+	
+	NSSet *snapshot = [author valueForColumnNamed:@"books"];
+	STAssertEquals([snapshot count], (NSUInteger)0, @"New author already has books.");
+	
+	[author addObjects:[NSSet setWithArray:books] toRelationshipNamed:@"books"];
+	
+	NSSet *members = [author valueForColumnNamed:@"books"];
+	STAssertEqualObjects(members, [NSSet setWithArray:books], @"Added books are not members of the relationship.");
+	STAssertEquals([snapshot count], (NSUInteger)0, @"A relationship set changed after it was read.");
+	for (DKManagedObject *book in books)
+		STAssertEquals((DKManagedObject *)[book valueForColumnNamed:@"author"], author, @"Inverse of an added book does not point at its author.");
+	
+	DKManagedObject *removedBook = [books objectAtIndex:0];
+	[author removeObjects:[NSSet setWithObject:removedBook] fromRelationshipNamed:@"books"];
+	
+	STAssertEquals([[author valueForColumnNamed:@"books"] count], (NSUInteger)2, @"Removed book is still a member of the relationship.");
+	STAssertFalse([[author valueForColumnNamed:@"books"] containsObject:removedBook], @"Removed book is still a member of the relationship.");
+	STAssertNil([removedBook valueForColumnNamed:@"author"], @"Inverse of a removed book still points at its author.");
+}
+
+- (void)testManyToManyMembershipIsSeenFromBothEnds
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	
+	NSArray *books = [database insertNewObjectsIntoTable:mBooksTable count:2 values:nil error:NULL];
+	NSArray *tags = [database insertNewObjectsIntoTable:mTagsTable count:2 values:nil error:NULL];
+	STAssertNotNil(books, @"Could not insert objects.");
+	STAssertNotNil(tags, @"Could not insert objects.");
+	
+	DKManagedObject *firstTag = [tags objectAtIndex:0];
+	DKManagedObject *secondTag = [tags objectAtIndex:1];
+	
+	for (DKManagedObject *book in books)
+		[book addObjects:[NSSet setWithArray:tags] toRelationshipNamed:@"tags"];
+	
+	STAssertEqualObjects([firstTag valueForColumnNamed:@"books"], [NSSet setWithArray:books], @"Many-to-many membership is not seen from the inverse end.");
+	
+	[[books objectAtIndex:0] removeObjects:[NSSet setWithObject:secondTag] fromRelationshipNamed:@"tags"];
+	
+	STAssertEqualObjects([secondTag valueForColumnNamed:@"books"], [NSSet setWithObject:[books objectAtIndex:1]], @"Removal is not seen from the inverse end.");
+	STAssertEqualObjects([[books objectAtIndex:0] valueForColumnNamed:@"tags"], [NSSet setWithObject:firstTag], @"Removal only removed the wrong member.");
+	STAssertEquals([[firstTag valueForColumnNamed:@"books"] count], (NSUInteger)2, @"Removing one membership affected another.");
+}
+
+#pragma mark -
+#pragma mark Prefetching
+
+- (void)testPrefetchedRelationshipsAreReadWithoutQueries
+{
+	NSAutoreleasePool *pool = [NSAutoreleasePool new];
+	{
+		DKDatabase *database = [self databaseAtURL:mTestDatabaseURL options:kDKDatabaseOptionNone];
+		NSArray *tags = [database insertNewObjectsIntoTable:mTagsTable count:2 values:[NSArray arrayWithObjects:
+																					   [NSDictionary dictionaryWithObject:@"fiction" forKey:@"name"], 
+																					   [NSDictionary dictionaryWithObject:@"poetry" forKey:@"name"], 
+																					   nil] error:NULL];
+		STAssertNotNil(tags, @"Could not insert objects.");
+		
+		for (NSString *name in [NSArray arrayWithObjects:@"Ann", @"Bob", nil])
+		{
+			DKManagedObject *author = [self insertObjectIntoTable:mAuthorsTable database:database values:[NSDictionary dictionaryWithObject:name forKey:@"name"]];
+			for (NSUInteger index = 0; index < 2; index++)
+			{
+				NSString *title = [NSString stringWithFormat:@"%@ %ld", name, (long)index];
+				DKManagedObject *book = [self insertObjectIntoTable:mBooksTable database:database values:[NSDictionary dictionaryWithObjectsAndKeys:title, @"title", author, @"author", nil]];
+				[book addObjects:[NSSet setWithObject:[tags objectAtIndex:index]] toRelationshipNamed:@"tags"];
+			}
+		}
+	}
+	[pool drain];
+	
+	//A fresh database has nothing cached, so anything that isn't prefetched has to be queried.
+	DKDatabase *database = [self databaseAtURL:mTestDatabaseURL options:kDKDatabaseOptionNone];
+	
+	DKFetchRequest *fetchRequest = [DKFetchRequest fetchRequestWithTable:mAuthorsTable];
+	fetchRequest.relationshipKeyPathsForPrefetching = [NSArray arrayWithObjects:@"books", @"books.tags", nil];
+	
+	NSError *error = nil;
+	NSArray *authors = [database executeFetchRequest:fetchRequest error:&error];
+	STAssertEquals([authors count], (NSUInteger)2, @"Could not fetch objects. Got error %@.", error);
+	
+	NSUInteger numberOfQueries = database.compiledQueryCacheHitCount + database.compiledQueryCacheMissCount;
+	
+	NSMutableSet *titles = [NSMutableSet set];
+	NSMutableSet *tagNames = [NSMutableSet set];
+	for (DKManagedObject *author in authors)
+	{
+		NSSet *books = [author valueForColumnNamed:@"books"];
+		STAssertEquals([books count], (NSUInteger)2, @"Prefetched relationship has the wrong members.");
+		
+		for (DKManagedObject *book in books)
+		{
+			[titles addObject:[book valueForColumnNamed:@"title"]];
+			for (DKManagedObject *tag in [book valueForColumnNamed:@"tags"])
+				[tagNames addObject:[tag valueForColumnNamed:@"name"]];
+		}
+	}
+	
+	STAssertEquals(database.compiledQueryCacheHitCount + database.compiledQueryCacheMissCount, numberOfQueries, @"Reading prefetched relationships ran queries.");
+	STAssertEqualObjects(titles, ([NSSet setWithObjects:@"Ann 0", @"Ann 1", @"Bob 0", @"Bob 1", nil]), @"Prefetched objects have the wrong values.");
+	STAssertEqualObjects(tagNames, ([NSSet setWithObjects:@"fiction", @"poetry", nil]), @"Objects prefetched through a key path have the wrong values.");
+	
+	//One-to-one relationships are prefetched as well.
+	fetchRequest = [DKFetchRequest fetchRequestWithTable:mBooksTable];
+	fetchRequest.relationshipKeyPathsForPrefetching = [NSArray arrayWithObject:@"author"];
+	fetchRequest.predicate = [NSPredicate predicateWithFormat:@"title BEGINSWITH %@", @"Bob"];
+	NSArray *books = [database executeFetchRequest:fetchRequest error:&error];
+	STAssertEquals([books count], (NSUInteger)2, @"Could not fetch objects. Got error %@.", error);
+	
+	numberOfQueries = database.compiledQueryCacheHitCount + database.compiledQueryCacheMissCount;
+	for (DKManagedObject *book in books)
+		STAssertEqualObjects([[book valueForColumnNamed:@"author"] valueForColumnNamed:@"name"], @"Bob", @"Prefetched one-to-one relationship has the wrong object.");
+	
+	STAssertEquals(database.compiledQueryCacheHitCount + database.compiledQueryCacheMissCount, numberOfQueries, @"Reading a prefetched one-to-one relationship ran queries.");
+}
+
+#pragma mark -
+#pragma mark Deletion
+
+- (void)testDeletingAnObjectCascadesAndNullifies
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	
+	DKManagedObject *author = [self insertObjectIntoTable:mAuthorsTable database:database values:[NSDictionary dictionaryWithObject:@"Author" forKey:@"name"]];
+	NSMutableArray *books = [NSMutableArray array];
+	for (NSUInteger index = 0; index < 3; index++)
+	{
+		DKManagedObject *book = [self insertObjectIntoTable:mBooksTable database:database values:[NSDictionary dictionaryWithObject:@"Book" forKey:@"title"]];
+		[book setValue:author forColumnNamed:@"author"];
+		[books addObject:book];
+	}
+	
+	//Deleting a book nullifies the author's side of the relationship.
+	[database deleteObject:[books lastObject]];
+	STAssertTrue([[books lastObject] isDeleted], @"Deleted object was not marked as deleted.");
+	STAssertEquals([[author valueForColumnNamed:@"books"] count], (NSUInteger)2, @"Deleted book is still related to its author.");
+	
+	//Deleting the author cascades to the books it still has.
+	[database deleteObject:author];
+	STAssertEquals([self countOfTable:mBooksTable database:database], (NSUInteger)0, @"Deleting an author did not cascade to its books.");
+	for (DKManagedObject *book in books)
+		STAssertTrue(book.isDeleted, @"Book deleted by a cascade was not marked as deleted.");
+}
+
+- (void)testDeletingMatchingObjectsCascades
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	
+	for (NSString *name in [NSArray arrayWithObjects:@"Doomed", @"Spared", nil])
+	{
+		DKManagedObject *author = [self insertObjectIntoTable:mAuthorsTable database:database values:[NSDictionary dictionaryWithObject:name forKey:@"name"]];
+		for (NSUInteger index = 0; index < 3; index++)
+		{
+			DKManagedObject *book = [self insertObjectIntoTable:mBooksTable database:database values:[NSDictionary dictionaryWithObject:name forKey:@"title"]];
+			[book setValue:author forColumnNamed:@"author"];
+		}
+	}
+	
+	DKFetchRequest *fetchRequest = [DKFetchRequest fetchRequestWithTable:mAuthorsTable];
+	fetchRequest.predicate = [NSPredicate predicateWithFormat:@"name == %@", @"Doomed"];
+	
+	NSError *error = nil;
+	STAssertTrue([database deleteObjectsMatchingFetchRequest:fetchRequest error:&error], @"Could not delete objects. Got error %@.", error);
+	
+	STAssertEquals([self countOfTable:mAuthorsTable database:database], (NSUInteger)1, @"The wrong number of authors was deleted.");
+	
+	NSArray *remainingBooks = [self objectsInTable:mBooksTable database:database matchingPredicate:nil];
+	STAssertEquals([remainingBooks count], (NSUInteger)3, @"Deleting authors did not cascade to exactly their books.");
+	for (DKManagedObject *book in remainingBooks)
+		STAssertEqualObjects([book valueForColumnNamed:@"title"], @"Spared", @"A book of an author that wasn't deleted was deleted.");
+}
+
+- (void)testDeletingObjectsNullifiesRelationshipsWithoutInverses
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	
+	NSArray *books = [database insertNewObjectsIntoTable:mBooksTable count:2 values:[NSArray arrayWithObjects:
+																					 [NSDictionary dictionaryWithObject:@"Single" forKey:@"title"], 
+																					 [NSDictionary dictionaryWithObject:@"Matched" forKey:@"title"], 
+																					 nil] error:NULL];
+	STAssertNotNil(books, @"Could not insert objects.");
+	
+	DKManagedObject *tag = [self insertObjectIntoTable:mTagsTable database:database values:nil];
+	[tag addObjects:[NSSet setWithArray:books] toRelationshipNamed:@"books"];
+	
+	NSMutableArray *notes = [NSMutableArray array];
+	for (DKManagedObject *book in books)
+		[notes addObject:[self insertObjectIntoTable:mNotesTable database:database values:[NSDictionary dictionaryWithObject:book forKey:@"book"]]];
+	
+	//Notes point at books without an inverse, so only a scan of the Notes table can find them.
+	[database deleteObject:[books objectAtIndex:0]];
+	STAssertNil([[notes objectAtIndex:0] valueForColumnNamed:@"book"], @"A relationship without an inverse still points at a deleted object.");
+	STAssertEquals((DKManagedObject *)[[notes objectAtIndex:1] valueForColumnNamed:@"book"], [books objectAtIndex:1], @"Deleting an object nullified an unrelated relationship.");
+	STAssertEqualObjects([tag valueForColumnNamed:@"books"], [NSSet setWithObject:[books objectAtIndex:1]], @"A deleted object is still a member of a many-to-many relationship.");
+	
+	DKFetchRequest *fetchRequest = [DKFetchRequest fetchRequestWithTable:mBooksTable];
+	fetchRequest.predicate = [NSPredicate predicateWithFormat:@"title == %@", @"Matched"];
+	
+	NSError *error = nil;
+	STAssertTrue([database deleteObjectsMatchingFetchRequest:fetchRequest error:&error], @"Could not delete objects. Got error %@.", error);
+	STAssertNil([[notes objectAtIndex:1] valueForColumnNamed:@"book"], @"A relationship without an inverse still points at an object deleted by a fetch request.");
+	STAssertEquals([[tag valueForColumnNamed:@"books"] count], (NSUInteger)0, @"An object deleted by a fetch request is still a member of a many-to-many relationship.");
+	
+	NSArray *orphanedNotes = [self objectsInTable:mNotesTable database:database matchingPredicate:[NSPredicate predicateWithFormat:@"book == nil"]];
+	STAssertEquals([orphanedNotes count], (NSUInteger)2, @"Nullified relationships were not written to the database.");
+}
+
+#pragma mark -
+#pragma mark Batch Updates
+
+- (void)testBatchUpdateChangesMatchedRows
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	
+	NSMutableArray *values = [NSMutableArray array];
+	for (NSUInteger count = 1; count <= 10; count++)
+		[values addObject:[NSDictionary dictionaryWithObjectsAndKeys:@"old", @"title", [NSNumber numberWithUnsignedInteger:count], @"count", [NSNumber numberWithDouble:1.0], @"score", nil]];
+	
+	NSArray *notes = [database insertNewObjectsIntoTable:mNotesTable count:[values count] values:values error:NULL];
+	STAssertNotNil(notes, @"Could not insert objects.");
+	
+	DKFetchRequest *fetchRequest = [DKFetchRequest fetchRequestWithTable:mNotesTable];
+	fetchRequest.predicate = [NSPredicate predicateWithFormat:@"count > 5"];
+	
+	NSError *error = nil;
+	NSDictionary *newValues = [NSDictionary dictionaryWithObjectsAndKeys:@"new", @"title", [NSNull null], @"score", nil];
+	STAssertTrue([database updateObjectsMatchingFetchRequest:fetchRequest withValues:newValues error:&error], @"Could not update objects. Got error %@.", error);
+	
+	//The objects we're holding on to see the new values of their rows, and only those.
+	for (DKManagedObject *note in notes)
+	{
+		BOOL isMatched = ([[note valueForColumnNamed:@"count"] integerValue] > 5);
+		STAssertEqualObjects([note valueForColumnNamed:@"title"], (isMatched? @"new" : @"old"), @"Batch update changed the wrong rows.");
+		STAssertEqualObjects([note valueForColumnNamed:@"score"], (isMatched? nil : [NSNumber numberWithDouble:1.0]), @"NSNull did not clear a column.");
+	}
+	
+	//A limit only updates the first rows in order.
+	fetchRequest.predicate = nil;
+	fetchRequest.sortDescriptors = [NSArray arrayWithObject:[NSSortDescriptor sortDescriptorWithKey:@"count" ascending:YES]];
+	fetchRequest.fetchLimit = 2;
+	STAssertTrue([database updateObjectsMatchingFetchRequest:fetchRequest withValues:[NSDictionary dictionaryWithObject:@"first" forKey:@"title"] error:&error], 
+				 @"Could not update objects. Got error %@.", error);
+	
+	NSSet *firstCounts = [self valuesOfColumn:@"count" inTable:mNotesTable database:database matchingPredicate:[NSPredicate predicateWithFormat:@"title == %@", @"first"]];
+	STAssertEqualObjects(firstCounts, ([NSSet setWithObjects:[NSNumber numberWithInt:1], [NSNumber numberWithInt:2], nil]), @"Batch update ignored the fetch limit.");
+}
+
+- (void)testBatchUpdateKeepsUnsavedChanges
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	NSArray *notes = [database insertNewObjectsIntoTable:mNotesTable count:2 values:nil error:NULL];
+	STAssertNotNil(notes, @"Could not insert objects.");
+	
+	database.defersChangesUntilSave = YES;
+	DKManagedObject *changedNote = [notes objectAtIndex:0];
+	DKManagedObject *unchangedNote = [notes objectAtIndex:1];
+	[changedNote setValue:@"mine" forColumnNamed:@"title"];
+	
+	NSError *error = nil;
+	STAssertTrue([database updateObjectsMatchingFetchRequest:[DKFetchRequest fetchRequestWithTable:mNotesTable] 
+												  withValues:[NSDictionary dictionaryWithObject:@"batch" forKey:@"title"] 
+													   error:&error], @"Could not update objects. Got error %@.", error);
+	
+	STAssertEqualObjects([unchangedNote valueForColumnNamed:@"title"], @"batch", @"Batch update was not seen by an unchanged object.");
+	STAssertEqualObjects([changedNote valueForColumnNamed:@"title"], @"mine", @"Batch update overwrote an unsaved change.");
+	
+	STAssertTrue([database save:&error], @"Could not save. Got error %@.", error);
+	
+	NSSet *titles = [self valuesOfColumn:@"title" inTable:mNotesTable database:database matchingPredicate:nil];
+	STAssertEqualObjects(titles, ([NSSet setWithObjects:@"mine", @"batch", nil]), @"The unsaved change was not written by save:.");
+}
+
+#pragma mark -
+#pragma mark Aggregates
+
+- (void)testAggregatesAreComputedBySQLite
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	
+	NSDate *firstDate = [NSDate dateWithTimeIntervalSince1970:1252326600.0];
+	NSMutableArray *values = [NSMutableArray array];
+	for (NSUInteger count = 1; count <= 4; count++)
+		[values addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+						   (count <= 2)? @"a" : @"b", @"title", 
+						   [NSNumber numberWithUnsignedInteger:count], @"count", 
+						   [NSNumber numberWithDouble:count], @"score", 
+						   [firstDate dateByAddingTimeInterval:count - 1.0], @"created", 
+						   nil]];
+	STAssertNotNil([database insertNewObjectsIntoTable:mNotesTable count:[values count] values:values error:NULL], @"Could not insert objects.");
+	
+	DKFetchRequest *fetchRequest = [DKFetchRequest fetchRequestWithTable:mNotesTable];
+	fetchRequest.resultType = kDKFetchRequestResultTypeAggregate;
+	fetchRequest.aggregates = [NSArray arrayWithObjects:
+							   [DKAggregateDescription aggregateWithName:@"rows" function:kDKAggregateFunctionCount attributeName:nil],
+							   [DKAggregateDescription aggregateWithName:@"total" function:kDKAggregateFunctionSum attributeName:@"count"],
+							   [DKAggregateDescription aggregateWithName:@"mean" function:kDKAggregateFunctionAverage attributeName:@"score"],
+							   [DKAggregateDescription aggregateWithName:@"highest" function:kDKAggregateFunctionMaximum attributeName:@"count"],
+							   [DKAggregateDescription aggregateWithName:@"earliest" function:kDKAggregateFunctionMinimum attributeName:@"created"],
+							   nil];
+	
+	NSError *error = nil;
+	NSArray *results = [database executeFetchRequest:fetchRequest error:&error];
+	STAssertEquals([results count], (NSUInteger)1, @"Aggregates without groups did not produce one result. Got error %@.", error);
+	
+	NSDictionary *result = [results lastObject];
+	STAssertEqualObjects([result objectForKey:@"rows"], [NSNumber numberWithInt:4], @"Count is wrong.");
+	STAssertEqualObjects([result objectForKey:@"total"], [NSNumber numberWithInt:10], @"Sum is wrong.");
+	STAssertEqualsWithAccuracy([[result objectForKey:@"mean"] doubleValue], 2.5, 0.0001, @"Average is wrong.");
+	STAssertEqualObjects([result objectForKey:@"highest"], [NSNumber numberWithInt:4], @"Maximum is wrong.");
+	STAssertEqualsWithAccuracy([[result objectForKey:@"earliest"] timeIntervalSince1970], [firstDate timeIntervalSince1970], 0.001, @"Minimum was not decoded as its attribute.");
+	
+	//The sum of no rows is NULL, which is left out of the result.
+	fetchRequest.predicate = [NSPredicate predicateWithFormat:@"count > 100"];
+	result = [[database executeFetchRequest:fetchRequest error:&error] lastObject];
+	STAssertEqualObjects([result objectForKey:@"rows"], [NSNumber numberWithInt:0], @"Count of no rows is not 0.");
+	STAssertNil([result objectForKey:@"total"], @"Sum of no rows is not left out.");
+}
+
+- (void)testAggregatesAreGrouped
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	
+	NSMutableArray *values = [NSMutableArray array];
+	for (NSUInteger count = 1; count <= 5; count++)
+		[values addObject:[NSDictionary dictionaryWithObjectsAndKeys:(count <= 2)? @"a" : @"b", @"title", [NSNumber numberWithUnsignedInteger:count], @"count", nil]];
+	STAssertNotNil([database insertNewObjectsIntoTable:mNotesTable count:[values count] values:values error:NULL], @"Could not insert objects.");
+	
+	DKFetchRequest *fetchRequest = [DKFetchRequest fetchRequestWithTable:mNotesTable];
+	fetchRequest.resultType = kDKFetchRequestResultTypeAggregate;
+	fetchRequest.aggregates = [NSArray arrayWithObjects:
+							   [DKAggregateDescription aggregateWithName:@"rows" function:kDKAggregateFunctionCount attributeName:nil],
+							   [DKAggregateDescription aggregateWithName:@"total" function:kDKAggregateFunctionSum attributeName:@"count"],
+							   nil];
+	fetchRequest.propertiesToGroupBy = [NSArray arrayWithObject:@"title"];
+	fetchRequest.sortDescriptors = [NSArray arrayWithObject:[NSSortDescriptor sortDescriptorWithKey:@"total" ascending:NO]];
+	
+	NSError *error = nil;
+	NSArray *results = [database executeFetchRequest:fetchRequest error:&error];
+	STAssertNotNil(results, @"Could not fetch aggregates. Got error %@.", error);
+	
+	NSArray *expectedResults = [NSArray arrayWithObjects:
+								[NSDictionary dictionaryWithObjectsAndKeys:@"b", @"title", [NSNumber numberWithInt:3], @"rows", [NSNumber numberWithInt:12], @"total", nil],
+								[NSDictionary dictionaryWithObjectsAndKeys:@"a", @"title", [NSNumber numberWithInt:2], @"rows", [NSNumber numberWithInt:3], @"total", nil],
+								nil];
+	STAssertEqualObjects(results, expectedResults, @"Groups are wrong or not sorted by their aggregate.");
+	
+	//Filters apply to rows before they're grouped, and limits to the groups.
+	fetchRequest.predicate = [NSPredicate predicateWithFormat:@"count != 5"];
+	fetchRequest.fetchLimit = 1;
+	results = [database executeFetchRequest:fetchRequest error:&error];
+	expectedResults = [NSArray arrayWithObject:[NSDictionary dictionaryWithObjectsAndKeys:@"b", @"title", [NSNumber numberWithInt:2], @"rows", [NSNumber numberWithInt:7], @"total", nil]];
+	STAssertEqualObjects(results, expectedResults, @"Filtered and limited groups are wrong.");
+	
+	//Sorting by something that isn't grouped means nothing once rows are folded together.
+	fetchRequest.sortDescriptors = [NSArray arrayWithObject:[NSSortDescriptor sortDescriptorWithKey:@"score" ascending:YES]];
+	error = nil;
+	STAssertNil([database executeFetchRequest:fetchRequest error:&error], @"Groups were sorted by an attribute they aren't grouped by.");
+	STAssertNotNil(error, @"An unsupported aggregate sort did not produce an error.");
+}
+
+#pragma mark -
+#pragma mark Projections
+
+- (void)testUniqueIdentifierAndDictionaryProjections
+{
+	NSMutableArray *uniqueIdentifiers = [NSMutableArray array];
+	NSNumber *authorUniqueIdentifier = nil;
+	NSAutoreleasePool *pool = [NSAutoreleasePool new];
+	{
+		DKDatabase *database = [self databaseAtURL:mTestDatabaseURL options:kDKDatabaseOptionNone];
+		DKManagedObject *author = [self insertObjectIntoTable:mAuthorsTable database:database values:[NSDictionary dictionaryWithObject:@"Ann" forKey:@"name"]];
+		authorUniqueIdentifier = [[NSNumber alloc] initWithLongLong:author.uniqueIdentifier];
+		
+		for (NSString *title in [NSArray arrayWithObjects:@"First", @"Second", @"Third", nil])
+		{
+			NSMutableDictionary *values = [NSMutableDictionary dictionaryWithObject:title forKey:@"title"];
+			if(![title isEqualToString:@"Third"])
+				[values setObject:author forKey:@"author"];
+			
+			DKManagedObject *book = [self insertObjectIntoTable:mBooksTable database:database values:values];
+			[uniqueIdentifiers addObject:[NSNumber numberWithLongLong:book.uniqueIdentifier]];
+		}
+	}
+	[pool drain];
+	[authorUniqueIdentifier autorelease];
+	
+	//Projections read values straight out of the rows, so a fresh database never creates any objects.
+	DKDatabase *database = [self databaseAtURL:mTestDatabaseURL options:kDKDatabaseOptionNone];
+	
+	DKFetchRequest *fetchRequest = [DKFetchRequest fetchRequestWithTable:mBooksTable];
+	fetchRequest.sortDescriptors = [NSArray arrayWithObject:[NSSortDescriptor sortDescriptorWithKey:@"title" ascending:YES]];
+	fetchRequest.resultType = kDKFetchRequestResultTypeUniqueIdentifier;
+	
+	NSError *error = nil;
+	STAssertEqualObjects([database executeFetchRequest:fetchRequest error:&error], uniqueIdentifiers, @"Unique identifiers are wrong or out of order. Got error %@.", error);
+	
+	fetchRequest.resultType = kDKFetchRequestResultTypeDictionary;
+	fetchRequest.propertiesToFetch = [NSArray arrayWithObjects:@"title", @"author", nil];
+	
+	//One-to-one relationships are given as the unique identifier they point at, and NULL columns are left out.
+	NSArray *expectedResults = [NSArray arrayWithObjects:
+								[NSDictionary dictionaryWithObjectsAndKeys:@"First", @"title", authorUniqueIdentifier, @"author", nil],
+								[NSDictionary dictionaryWithObjectsAndKeys:@"Second", @"title", authorUniqueIdentifier, @"author", nil],
+								[NSDictionary dictionaryWithObject:@"Third" forKey:@"title"],
+								nil];
+	STAssertEqualObjects([database executeFetchRequest:fetchRequest error:&error], expectedResults, @"Dictionaries are wrong. Got error %@.", error);
+	
+	//Without properties to fetch every attribute is fetched.
+	fetchRequest.propertiesToFetch = nil;
+	fetchRequest.fetchLimit = 1;
+	STAssertEqualObjects([database executeFetchRequest:fetchRequest error:&error], [NSArray arrayWithObject:[NSDictionary dictionaryWithObject:@"First" forKey:@"title"]], 
+						 @"Dictionary of every attribute is wrong. Got error %@.", error);
+	
+	STAssertEquals([database numberOfManagedObjects], (NSUInteger)0, @"A projection created managed objects.");
+}
+
+#pragma mark -
+#pragma mark Managed Object Limit
+
+- (void)testManagedObjectLimitKeepsHeldAndChangedObjects
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	database.managedObjectLimit = 16;
+	database.defersChangesUntilSave = YES;
+	
+	NSUInteger numberOfObjects = 200;
+	NSMutableArray *values = [NSMutableArray array];
+	for (NSUInteger index = 0; index < numberOfObjects; index++)
+		[values addObject:[NSDictionary dictionaryWithObjectsAndKeys:@"unchanged", @"title", [NSNumber numberWithUnsignedInteger:index], @"count", nil]];
+	
+	DKManagedObject *heldNote = nil;
+	NSAutoreleasePool *pool = [NSAutoreleasePool new];
+	{
+		NSArray *notes = [database insertNewObjectsIntoTable:mNotesTable count:numberOfObjects values:values error:NULL];
+		STAssertEquals([notes count], numberOfObjects, @"Wrong number of objects inserted.");
+		
+		heldNote = [[notes objectAtIndex:0] retain];
+		[[notes objectAtIndex:1] setValue:@"changed" forColumnNamed:@"title"];
+	}
+	[pool drain];
+	
+	//Reading every row pushes the database well past its limit.
+	pool = [NSAutoreleasePool new];
+	{
+		for (DKManagedObject *note in [self objectsInTable:mNotesTable database:database matchingPredicate:nil])
+			STAssertNotNil([note valueForColumnNamed:@"title"], @"Evicted object lost its value.");
+	}
+	[pool drain];
+	
+	STAssertTrue([database numberOfManagedObjects] < numberOfObjects / 2, @"The database kept most of the objects it read despite its limit.");
+	
+	NSArray *firstNotes = [self objectsInTable:mNotesTable database:database matchingPredicate:[NSPredicate predicateWithFormat:@"count == 0"]];
+	STAssertEquals((DKManagedObject *)[firstNotes lastObject], heldNote, @"A held object was replaced while it was still in use.");
+	[heldNote release];
+	
+	NSArray *changedNotes = [self objectsInTable:mNotesTable database:database matchingPredicate:[NSPredicate predicateWithFormat:@"count == 1"]];
+	STAssertEqualObjects([[changedNotes lastObject] valueForColumnNamed:@"title"], @"changed", @"An object with unsaved changes was evicted.");
+	
+	NSError *error = nil;
+	STAssertTrue([database save:&error], @"Could not save. Got error %@.", error);
+	
+	changedNotes = [self objectsInTable:mNotesTable database:database matchingPredicate:[NSPredicate predicateWithFormat:@"title == %@", @"changed"]];
+	STAssertEquals([changedNotes count], (NSUInteger)1, @"The unsaved change was not written by save:.");
+}
+
+
+#pragma mark -
+#pragma mark Change Tracking
+
+- (void)testRawUpdatesInvalidateCachedValues
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	DKManagedObject *note = [self insertObjectIntoTable:mNotesTable database:database values:[NSDictionary dictionaryWithObject:@"before" forKey:@"title"]];
+	DKManagedObject *otherNote = [self insertObjectIntoTable:mNotesTable database:database values:[NSDictionary dictionaryWithObject:@"other" forKey:@"title"]];
+	STAssertEqualObjects([note valueForColumnNamed:@"title"], @"before", @"Value was not written.");
+	STAssertEqualObjects([otherNote valueForColumnNamed:@"title"], @"other", @"Value was not written.");
+	
+	//The notification is posted on the writer queue, so its observer only collects it.
+	NSMutableArray *notifications = [NSMutableArray array];
+	id observer = [[NSNotificationCenter defaultCenter] addObserverForName:DKDatabaseObjectsDidChangeNotification object:database queue:nil usingBlock:^(NSNotification *notification) {
+		@synchronized(notifications)
+		{
+			[notifications addObject:[notification userInfo]];
+		}
+	}];
+	
+	NSError *error = nil;
+	BOOL success = [database performTransaction:^(NSError **transactionError) {
+		NSString *updateQueryString = [NSString stringWithFormat:@"UPDATE %@ SET %@ = 'after' WHERE(_dk_uniqueIdentifier = %lld)", 
+									   [mNotesTable.name stringByEscapingStringForLiteralUseInSQLQueries], 
+									   [@"title" stringByEscapingStringForLiteralUseInSQLQueries], 
+									   note.uniqueIdentifier];
+		return [database executeSQLQuery:updateQueryString error:transactionError];
+	} error:&error];
+	STAssertTrue(success, @"Could not update row. Got error %@.", error);
+	
+	[self runMainRunLoopUntil:^{
+		@synchronized(notifications)
+		{
+			return (BOOL)([notifications count] > 0);
+		}
+	}];
+	[[NSNotificationCenter defaultCenter] removeObserver:observer];
+	
+	STAssertEqualObjects([note valueForColumnNamed:@"title"], @"after", @"A raw update did not invalidate the cached value.");
+	STAssertEqualObjects([otherNote valueForColumnNamed:@"title"], @"other", @"An untouched row changed.");
+	
+	@synchronized(notifications)
+	{
+		STAssertEquals([notifications count], (NSUInteger)1, @"Wrong number of notifications posted for one transaction.");
+		
+		NSDictionary *userInfo = [notifications lastObject];
+		NSSet *updatedUniqueIdentifiers = [[userInfo objectForKey:DKUpdatedUniqueIdentifiersKey] objectForKey:mNotesTable.name];
+		STAssertEqualObjects(updatedUniqueIdentifiers, [NSSet setWithObject:[NSNumber numberWithLongLong:note.uniqueIdentifier]], @"Updated row was not named in the notification.");
+		STAssertEquals([[userInfo objectForKey:DKInsertedUniqueIdentifiersKey] count], (NSUInteger)0, @"An update was reported as an insert.");
+		STAssertEquals([[userInfo objectForKey:DKChangedTableNamesKey] count], (NSUInteger)0, @"A single update was reported as a whole table change.");
+	}
+}
+
+- (void)testChangeNotificationsListCommittedChanges
+{
+	DKDatabase *database = [self databaseAtURL:nil options:kDKDatabaseOptionNone];
+	DKManagedObject *deletedNote = [self insertObjectIntoTable:mNotesTable database:database values:[NSDictionary dictionaryWithObject:@"deleted" forKey:@"title"]];
+	DKManagedObject *writtenNote = [self insertObjectIntoTable:mNotesTable database:database values:nil];
+	
+	NSError *error = nil;
+	STAssertTrue([writtenNote setZeroedDataOfLength:16 forColumnNamed:@"raw" error:&error], @"Could not size column. Got error %@.", error);
+	
+	NSMutableArray *notifications = [NSMutableArray array];
+	id observer = [[NSNotificationCenter defaultCenter] addObserverForName:DKDatabaseObjectsDidChangeNotification object:database queue:nil usingBlock:^(NSNotification *notification) {
+		@synchronized(notifications)
+		{
+			[notifications addObject:[notification userInfo]];
+		}
+	}];
+	
+	__block int64_t insertedUniqueIdentifier = 0;
+	__block int64_t rolledBackUniqueIdentifier = 0;
+	BOOL success = [database performTransaction:^(NSError **transactionError) {
+		NSArray *insertedValues = [NSArray arrayWithObject:[NSDictionary dictionaryWithObject:@"inserted" forKey:@"title"]];
+		DKManagedObject *insertedNote = [[database insertNewObjectsIntoTable:mNotesTable count:1 values:insertedValues error:transactionError] lastObject];
+		if(!insertedNote)
+			return NO;
+		
+		insertedUniqueIdentifier = insertedNote.uniqueIdentifier;
+		
+		[database deleteObject:deletedNote];
+		
+		//Changes rolled back to a savepoint are left out of the notification.
+		[database performTransaction:^(NSError **savepointError) {
+			NSArray *rolledBackValues = [NSArray arrayWithObject:[NSDictionary dictionaryWithObject:@"rolled back" forKey:@"title"]];
+			DKManagedObject *rolledBackNote = [[database insertNewObjectsIntoTable:mNotesTable count:1 values:rolledBackValues error:savepointError] lastObject];
+			rolledBackUniqueIdentifier = rolledBackNote.uniqueIdentifier;
+			return NO;
+		} error:NULL];
+		
+		return YES;
+	} error:&error];
+	STAssertTrue(success, @"Could not perform transaction. Got error %@.", error);
+	
+	//Incremental writes are committed, and reported, on their own.
+	NSData *greeting = [@"hello" dataUsingEncoding:NSUTF8StringEncoding];
+	STAssertTrue([writtenNote writeData:greeting atOffset:0 forColumnNamed:@"raw" error:&error], @"Could not write data. Got error %@.", error);
+	
+	[self runMainRunLoopUntil:^{
+		@synchronized(notifications)
+		{
+			return (BOOL)([notifications count] >= 2);
+		}
+	}];
+	[[NSNotificationCenter defaultCenter] removeObserver:observer];
+	
+	@synchronized(notifications)
+	{
+		STAssertEquals([notifications count], (NSUInteger)2, @"Wrong number of notifications posted.");
+		if([notifications count] < 2)
+			return;
+		
+		NSDictionary *transactionUserInfo = [notifications objectAtIndex:0];
+		NSSet *insertedUniqueIdentifiers = [[transactionUserInfo objectForKey:DKInsertedUniqueIdentifiersKey] objectForKey:mNotesTable.name];
+		STAssertTrue([insertedUniqueIdentifiers containsObject:[NSNumber numberWithLongLong:insertedUniqueIdentifier]], @"Inserted row was not named in the notification.");
+		STAssertFalse([insertedUniqueIdentifiers containsObject:[NSNumber numberWithLongLong:rolledBackUniqueIdentifier]], @"A row rolled back to a savepoint was named in the notification.");
+		
+		NSSet *deletedUniqueIdentifiers = [[transactionUserInfo objectForKey:DKDeletedUniqueIdentifiersKey] objectForKey:mNotesTable.name];
+		STAssertEqualObjects(deletedUniqueIdentifiers, [NSSet setWithObject:[NSNumber numberWithLongLong:deletedNote.uniqueIdentifier]], @"Deleted row was not named in the notification.");
+		
+		NSDictionary *writeUserInfo = [notifications objectAtIndex:1];
+		NSSet *updatedUniqueIdentifiers = [[writeUserInfo objectForKey:DKUpdatedUniqueIdentifiersKey] objectForKey:mNotesTable.name];
+		STAssertEqualObjects(updatedUniqueIdentifiers, [NSSet setWithObject:[NSNumber numberWithLongLong:writtenNote.uniqueIdentifier]], @"Incrementally written row was not named in the notification.");
+	}
+	
+	STAssertEquals([self countOfTable:mNotesTable database:database], (NSUInteger)2, @"Wrong number of rows committed.");
+}
+
 @end
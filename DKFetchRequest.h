@@ -8,7 +8,73 @@
 
 #import <Cocoa/Cocoa.h>
 
-@class DKTableDescription;
+@class DKTableDescription, DKManagedObject;
+
+/*!
+ @enum		DKFetchRequestResultType
+ @abstract	The kinds of results a fetch request can produce.
+ @constant	kDKFetchRequestResultTypeManagedObject		The request produces managed objects. This is the default.
+ @constant	kDKFetchRequestResultTypeAggregate			The request produces one dictionary per group of rows, mapping the names of its
+														aggregates and the attributes it groups by to their values.
+ @constant	kDKFetchRequestResultTypeUniqueIdentifier	The request produces the unique identifier of each row as an NSNumber.
+ @constant	kDKFetchRequestResultTypeDictionary			The request produces a dictionary per row mapping the names of its propertiesToFetch to
+														their values. One-to-one relationships are given as the unique identifier they point at.
+ */
+typedef enum _DKFetchRequestResultType {
+	kDKFetchRequestResultTypeManagedObject = 0,
+	kDKFetchRequestResultTypeAggregate,
+	kDKFetchRequestResultTypeUniqueIdentifier,
+	kDKFetchRequestResultTypeDictionary,
+} DKFetchRequestResultType;
+
+/*!
+ @enum		DKAggregateFunction
+ @abstract	The SQL aggregate functions an aggregate fetch can compute.
+ @constant	kDKAggregateFunctionCount	The number of rows, or of rows where the attribute isn't NULL.
+ @constant	kDKAggregateFunctionSum		The sum of the attribute.
+ @constant	kDKAggregateFunctionAverage	The average of the attribute, as a double.
+ @constant	kDKAggregateFunctionMinimum	The smallest value of the attribute.
+ @constant	kDKAggregateFunctionMaximum	The largest value of the attribute.
+ */
+typedef enum _DKAggregateFunction {
+	kDKAggregateFunctionCount = 0,
+	kDKAggregateFunctionSum,
+	kDKAggregateFunctionAverage,
+	kDKAggregateFunctionMinimum,
+	kDKAggregateFunctionMaximum,
+} DKAggregateFunction;
+
+/*!
+ @class
+ @abstract	This class is used to describe a value computed by an aggregate fetch request.
+ */
+@interface DKAggregateDescription : NSObject
+{
+	NSString *name;
+	DKAggregateFunction function;
+	NSString *attributeName;
+}
+/*!
+ @method
+ @abstract	Create an aggregate description.
+ @param		name			The key the value is returned under. May not be nil.
+ @param		function		The aggregate function to compute.
+ @param		attributeName	The attribute the function is computed over. May only be nil for kDKAggregateFunctionCount, which then counts rows.
+ */
++ (DKAggregateDescription *)aggregateWithName:(NSString *)name function:(DKAggregateFunction)function attributeName:(NSString *)attributeName;
+
+///The key the value is returned under.
+@property (copy) NSString *name;
+
+///The aggregate function to compute.
+@property DKAggregateFunction function;
+
+///The attribute the function is computed over.
+@property (copy) NSString *attributeName;
+@end
+
+#pragma mark -
+
 @interface DKFetchRequest : NSObject
 {
 	DKTableDescription *table;
@@ -16,6 +82,15 @@
 	NSPredicate *predicate;
 	NSArray *sortDescriptors;
 	BOOL returnsObjectsAsPromises;
+	NSUInteger fetchLimit;
+	NSUInteger fetchOffset;
+	DKManagedObject *fetchAfterObject;
+	NSUInteger fetchBatchSize;
+	NSArray *relationshipKeyPathsForPrefetching;
+	DKFetchRequestResultType resultType;
+	NSArray *aggregates;
+	NSArray *propertiesToGroupBy;
+	NSArray *propertiesToFetch;
 }
 + (DKFetchRequest *)fetchRequestWithTable:(DKTableDescription *)table;
 
@@ -28,4 +103,31 @@
 @property (retain) NSArray *sortDescriptors;
 
 @property BOOL returnsObjectsAsPromises;
+
+///The maximum number of objects to fetch. 0 means no limit.
+@property NSUInteger fetchLimit;
+
+///The number of matching objects to skip before fetching.
+@property NSUInteger fetchOffset;
+
+///Only fetch the objects that are sorted after this object. Used to page through results without an offset.
+@property (retain) DKManagedObject *fetchAfterObject;
+
+///The number of rows -[DKDatabase enumerateObjectsForFetchRequest:error:usingBlock:] reads at a time. 0 uses a default.
+@property NSUInteger fetchBatchSize;
+
+///Relationship key paths, e.g. `author` or `author.publisher`, whose objects are loaded along with the fetched objects.
+@property (copy) NSArray *relationshipKeyPathsForPrefetching;
+
+///The kind of results the request produces.
+@property DKFetchRequestResultType resultType;
+
+///The DKAggregateDescription objects computed by an aggregate request.
+@property (copy) NSArray *aggregates;
+
+///The names of the attributes an aggregate request groups rows by. If nil every row is aggregated together.
+@property (copy) NSArray *propertiesToGroupBy;
+
+///The names of the attributes and one-to-one relationships a dictionary request reads. If nil every attribute is read.
+@property (copy) NSArray *propertiesToFetch;
 @end
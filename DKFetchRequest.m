@@ -8,6 +8,39 @@
 
 #import "DKFetchRequest.h"
 
+@implementation DKAggregateDescription
+
+- (void)dealloc
+{
+	self.name = nil;
+	self.attributeName = nil;
+	
+	[super dealloc];
+}
+
++ (DKAggregateDescription *)aggregateWithName:(NSString *)name function:(DKAggregateFunction)function attributeName:(NSString *)attributeName
+{
+	NSParameterAssert(name);
+	NSAssert((attributeName != nil) || (function == kDKAggregateFunctionCount), 
+			 @"Only counts can be computed without an attribute.");
+	
+	DKAggregateDescription *aggregate = [[DKAggregateDescription new] autorelease];
+	
+	aggregate.name = name;
+	aggregate.function = function;
+	aggregate.attributeName = attributeName;
+	
+	return aggregate;
+}
+
+@synthesize name;
+@synthesize function;
+@synthesize attributeName;
+
+@end
+
+#pragma mark -
+
 @implementation DKFetchRequest
 
 #pragma mark Destruction
@@ -18,6 +51,11 @@
 	self.filterString = nil;
 	self.predicate = nil;
 	self.sortDescriptors = nil;
+	self.fetchAfterObject = nil;
+	self.relationshipKeyPathsForPrefetching = nil;
+	self.aggregates = nil;
+	self.propertiesToGroupBy = nil;
+	self.propertiesToFetch = nil;
 	
 	[super dealloc];
 }
@@ -53,5 +91,14 @@
 @synthesize predicate;
 @synthesize sortDescriptors;
 @synthesize returnsObjectsAsPromises;
+@synthesize fetchLimit;
+@synthesize fetchOffset;
+@synthesize fetchAfterObject;
+@synthesize fetchBatchSize;
+@synthesize relationshipKeyPathsForPrefetching;
+@synthesize resultType;
+@synthesize aggregates;
+@synthesize propertiesToGroupBy;
+@synthesize propertiesToFetch;
 
 @end
@@ -35,8 +35,12 @@
 	/* owner */		int64_t _dk_mUniqueIdentifier;
 	/* strong */	DKTableDescription *_dk_mTableDescription;
 	/* weak */		DKDatabase *_dk_mDatabase;
-	/* owner */		NSMutableDictionary *_dk_mCachedValues;
+	/* owner */		__strong void *_dk_mCachedValues;
+	/* owner */		NSMutableDictionary *_dk_mChangedValues;
 	/* n/a */		NSInteger _dk_mExtraRetainCount;
+	/* n/a */		BOOL _dk_mWasRecentlyUsed;
+	/* n/a */		BOOL _dk_mIsOwnedByDatabase;
+	/* n/a */		volatile BOOL _dk_mIsDeleted;
 }
 #pragma mark Accessing/Mutating Columns
 
@@ -58,6 +62,130 @@
  */
 - (id)valueForColumnNamed:(NSString *)key;
 
+/*!
+ @method
+ @abstract		Get the encoded data of a specified object or data column without decoding it.
+ @param			key		The name of an attribute of DKAttributeTypeObject or DKAttributeTypeData in the receiver's table description. May not be nil.
+ @result		The data the column's value is encoded as, after any compression is undone; nil if the column is NULL.
+ @discussion	This is useful when a value is only going to be copied somewhere else, or when the caller
+				can decode it more cheaply than the attribute's codec.
+ */
+- (NSData *)encodedDataForColumnNamed:(NSString *)key;
+
+#pragma mark -
+#pragma mark To-Many Relationships
+
+/*!
+ @method
+ @abstract		Add a set of objects to a specified to-many relationship.
+ @param			objects		The database objects to add. May not be nil.
+ @param			key			The name of a to-many relationship in the receiver's table description. May not be nil.
+ @discussion	All of the objects are added in a single transaction, a batch of rows per query.
+ */
+- (void)addObjects:(NSSet *)objects toRelationshipNamed:(NSString *)key;
+
+/*!
+ @method
+ @abstract		Remove a set of objects from a specified to-many relationship.
+ @param			objects		The database objects to remove. May not be nil.
+ @param			key			The name of a to-many relationship in the receiver's table description. May not be nil.
+ @discussion	All of the objects are removed in a single transaction, a batch of rows per query.
+ */
+- (void)removeObjects:(NSSet *)objects fromRelationshipNamed:(NSString *)key;
+
+#pragma mark -
+#pragma mark Incremental Data Access
+
+//
+//	These methods read and write the values of data columns in place, a range at a time,
+//	so that large values never have to be in memory all at once. They bypass the receiver's
+//	cache and unsaved changes, and can only be used with data attributes that are not compressed.
+//
+
+/*!
+ @method
+ @abstract	Get the length in bytes of the value of a specified data column.
+ @param		key		The name of a data attribute in the receiver's table description. May not be nil.
+ @result	The length of the column's value; 0 if the column is NULL.
+ */
+- (NSUInteger)lengthOfDataForColumnNamed:(NSString *)key;
+
+/*!
+ @method
+ @abstract	Read a range of the value of a specified data column.
+ @param		key		The name of a data attribute in the receiver's table description. May not be nil.
+ @param		range	The range of bytes to read. Must lie within the column's value.
+ @param		error	If the range cannot be read, on return this will contain an error. May be nil.
+ @result	The bytes in the range; nil if an error occurs.
+ */
+- (NSData *)dataForColumnNamed:(NSString *)key range:(NSRange)range error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Replace the value of a specified data column with a given number of zero bytes.
+ @param			length	The length of the new value.
+ @param			key		The name of a data attribute in the receiver's table description. May not be nil.
+ @param			error	If the value cannot be replaced, on return this will contain an error. May be nil.
+ @result		YES if the value was replaced; NO otherwise.
+ @discussion	Values cannot grow when they are written incrementally, so this method is used to
+				size a value up front before it is filled in with writeData:atOffset:forColumnNamed:error:.
+ */
+- (BOOL)setZeroedDataOfLength:(NSUInteger)length forColumnNamed:(NSString *)key error:(NSError **)error;
+
+/*!
+ @method
+ @abstract	Overwrite part of the value of a specified data column.
+ @param		data	The bytes to write. May not be nil.
+ @param		offset	The offset in the column's value to write the bytes at. The bytes must fit within the value.
+ @param		key		The name of a data attribute in the receiver's table description. May not be nil.
+ @param		error	If the bytes cannot be written, on return this will contain an error. May be nil.
+ @result	YES if the bytes were written; NO otherwise.
+ */
+- (BOOL)writeData:(NSData *)data atOffset:(NSUInteger)offset forColumnNamed:(NSString *)key error:(NSError **)error;
+
+#pragma mark -
+
+/*!
+ @method
+ @abstract		Replace the value of a specified data column with the contents of a stream.
+ @param			stream	An open stream to read the new value from. May not be nil.
+ @param			length	The number of bytes to read from the stream.
+ @param			key		The name of a data attribute in the receiver's table description. May not be nil.
+ @param			error	If the value cannot be replaced, on return this will contain an error. May be nil.
+ @result		YES if the value was replaced; NO otherwise.
+ @discussion	The value is written in chunks inside of a transaction. If the stream ends early or
+				fails the column keeps its old value.
+ */
+- (BOOL)setDataFromStream:(NSInputStream *)stream length:(NSUInteger)length forColumnNamed:(NSString *)key error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Write the value of a specified data column to a stream.
+ @param			key		The name of a data attribute in the receiver's table description. May not be nil.
+ @param			stream	An open stream to write the value to. May not be nil.
+ @param			error	If the value cannot be written, on return this will contain an error. May be nil.
+ @result		YES if the value was written; NO otherwise.
+ @discussion	The value is read in chunks. Nothing is written if the column is NULL.
+ */
+- (BOOL)writeDataForColumnNamed:(NSString *)key toStream:(NSOutputStream *)stream error:(NSError **)error;
+
+#pragma mark -
+#pragma mark Changes
+
+/*!
+ @property
+ @abstract		Whether or not the receiver has changes that have not been saved.
+ @discussion	Changes are only deferred when the receiver's database defers changes until save.
+ */
+@property (readonly) BOOL hasChanges;
+
+/*!
+ @method
+ @abstract		Get the receiver's unsaved changes.
+ @result		A dictionary of column names to their unsaved values. Columns being cleared map to NSNull.
+ */
+- (NSDictionary *)changedValues;
+
 #pragma mark -
 #pragma mark Database Notifications
 
@@ -86,8 +214,11 @@
  @abstract		Invoked by DatabaseKit when the receiver is about to be deleted from the database.
  @discussion	You do not typically invoke this method yourself, it is called automatically by DKDatabase.
 				
-				Subclasses _must_ invoke their superclass's implementation of this method. Relationships will
-				not be properly cleaned up and this can lead to corruption of the database.
+				Subclasses _must_ invoke their superclass's implementation of this method. Objects at the other
+				ends of cascading relationships are deleted by it, and skipping it leaves them behind. Everything
+				else that refers to the receiver is nullified by DKDatabase after this method returns.
+				
+				It is not invoked for rows deleted with -[DKDatabase deleteObjectsMatchingFetchRequest:error:].
  */
 - (void)prepareForDeletion;
 
@@ -105,4 +236,12 @@
  @abstract	The table description that the managed object represents.
  */
 @property (readonly) DKTableDescription *tableDescription;
+
+/*!
+ @property
+ @abstract		Whether or not the receiver's row has been deleted.
+ @discussion	A deleted object is no longer owned by its database. Its values read as nil, it cannot be
+				changed, and it is destroyed once the last object holding on to it releases it.
+ */
+@property (readonly) BOOL isDeleted;
 @end
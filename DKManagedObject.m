@@ -13,7 +13,9 @@
 #import "DKDatabasePrivate.h"
 
 #import "DKTableDescription.h"
+#import "DKTableDescriptionPrivate.h"
 #import "DKCompiledSQLQuery.h"
+#import "DKRelationshipSet.h"
 
 #import "NSString+Database.h"
 
@@ -21,16 +23,282 @@
 #import <libkern/OSAtomic.h>
 #import <objc/runtime.h>
 
+#pragma mark Undecoded Values
+
+//
+//	Decoding archived objects is expensive, and most fetched objects never have all of their
+//	object attributes looked at. So their encoded data is cached in one of these, and is only
+//	decoded the first time the value is accessed.
+//
+
+///The cached encoded data of an object attribute that has not been decoded yet.
+@interface DKUndecodedValue : NSObject
+{
+@package
+	/* owner */	NSData *mEncodedData;
+}
+
+- (id)initWithEncodedData:(NSData *)encodedData;
+
+@end
+
+@implementation DKUndecodedValue
+
+- (void)dealloc
+{
+	[mEncodedData release];
+	mEncodedData = nil;
+	
+	[super dealloc];
+}
+
+- (id)initWithEncodedData:(NSData *)encodedData
+{
+	NSParameterAssert(encodedData);
+	
+	if((self = [super init]))
+	{
+		mEncodedData = [encodedData copy];
+		
+		return self;
+	}
+	return nil;
+}
+
+@end
+
+#pragma mark -
+#pragma mark Relationship Caches
+
+//
+//	The value of a relationship can be changed through either of its ends, or by deleting
+//	the objects at the other end, so cached relationship values can't be kept up to date
+//	the way attributes are. Instead each one notes the generation of the table it's stored
+//	in when it was read, and is thrown away once that generation has moved on.
+//
+
+///The cached value of a relationship.
+@interface DKRelationshipCache : NSObject
+{
+@package
+	/* n/a */	int32_t mGeneration;
+	/* owner */	NSData *mUniqueIdentifiers;
+}
+
+- (id)initWithUniqueIdentifiers:(NSData *)uniqueIdentifiers generation:(int32_t)generation;
+
+@end
+
+@implementation DKRelationshipCache
+
+- (void)dealloc
+{
+	[mUniqueIdentifiers release];
+	mUniqueIdentifiers = nil;
+	
+	[super dealloc];
+}
+
+- (id)initWithUniqueIdentifiers:(NSData *)uniqueIdentifiers generation:(int32_t)generation
+{
+	NSParameterAssert(uniqueIdentifiers);
+	
+	if((self = [super init]))
+	{
+		mGeneration = generation;
+		mUniqueIdentifiers = [uniqueIdentifiers copy];
+		
+		return self;
+	}
+	return nil;
+}
+
+@end
+
+#pragma mark -
+#pragma mark Value Slots
+
+//
+//	Managed objects keep their cached values in a single block of memory allocated the
+//	first time something is cached. The block starts with a bitmap recording which of the
+//	table's properties are loaded, followed by one slot per property indexed by ordinal.
+//	Numeric values are stored as plain integers and doubles instead of as NSNumbers.
+//
+
+///The storage for the cached value of a single property.
+typedef union _DKManagedObjectSlot {
+	id object;
+	int64_t integer;
+	double real;
+} DKManagedObjectSlot;
+
+///Returns the number of words in the loaded bitmap of an object whose table has a specified number of properties.
+DK_INLINE NSUInteger DKManagedObjectBitmapWordCount(NSUInteger numberOfProperties)
+{
+	return (numberOfProperties + 63) / 64;
+}
+
+DK_INLINE uint64_t *DKManagedObjectLoadedBitmap(DKManagedObject *self)
+{
+	return (uint64_t *)self->_dk_mCachedValues;
+}
+
+DK_INLINE DKManagedObjectSlot *DKManagedObjectSlotAtOrdinal(DKManagedObject *self, NSUInteger ordinal)
+{
+	NSUInteger numberOfBitmapWords = DKManagedObjectBitmapWordCount(self->_dk_mTableDescription->mNumberOfProperties);
+	return ((DKManagedObjectSlot *)(DKManagedObjectLoadedBitmap(self) + numberOfBitmapWords)) + ordinal;
+}
+
+DK_INLINE BOOL DKManagedObjectSlotIsLoaded(DKManagedObject *self, NSUInteger ordinal)
+{
+	if(!self->_dk_mCachedValues)
+		return NO;
+	
+	return ((DKManagedObjectLoadedBitmap(self)[ordinal / 64] & (1ULL << (ordinal % 64))) != 0);
+}
+
+///Returns whether or not values of a specified attribute type are stored in a slot as an object.
+DK_INLINE BOOL DKAttributeTypeIsStoredAsObject(DKAttributeType type)
+{
+	switch (type)
+	{
+		case DKAttributeTypeInt8:
+		case DKAttributeTypeInt16:
+		case DKAttributeTypeInt32:
+		case DKAttributeTypeInt64:
+		case DKAttributeTypeFloat:
+			return NO;
+			
+		default:
+			break;
+	}
+	
+	return YES;
+}
+
+///Returns whether or not the value of a specified property is stored in a slot as an object.
+DK_INLINE BOOL DKPropertyIsStoredAsObject(DKPropertyDescription *property)
+{
+	//Relationships cache a DKRelationshipCache.
+	if(![property isKindOfClass:[DKAttributeDescription class]])
+		return YES;
+	
+	return DKAttributeTypeIsStoredAsObject(((DKAttributeDescription *)property)->type);
+}
+
+#pragma mark -
+
+///Empty the slot of a specified property, releasing the object in it.
+static void DKManagedObjectClearSlot(DKManagedObject *self, DKPropertyDescription *property)
+{
+	NSUInteger ordinal = property->mOrdinal;
+	if(!DKManagedObjectSlotIsLoaded(self, ordinal))
+		return;
+	
+	DKManagedObjectSlot *slot = DKManagedObjectSlotAtOrdinal(self, ordinal);
+	if(DKPropertyIsStoredAsObject(property))
+		[slot->object release];
+	slot->integer = 0;
+	
+	DKManagedObjectLoadedBitmap(self)[ordinal / 64] &= ~(1ULL << (ordinal % 64));
+}
+
+///Empty every slot of an object.
+static void DKManagedObjectClearAllSlots(DKManagedObject *self)
+{
+	if(!self->_dk_mCachedValues)
+		return;
+	
+	for (DKPropertyDescription *property in self->_dk_mTableDescription->mProperties)
+		DKManagedObjectClearSlot(self, property);
+}
+
+///Returns the emptied slot of a specified property, marked as loaded, creating the object's storage if it has none.
+static DKManagedObjectSlot *DKManagedObjectPrepareSlot(DKManagedObject *self, DKPropertyDescription *property)
+{
+	if(!self->_dk_mCachedValues)
+	{
+		//
+		//	Slots hold objects as well as numbers, so under garbage collection
+		//	the storage has to be scanned for pointers like any other object.
+		//
+		NSUInteger numberOfProperties = self->_dk_mTableDescription->mNumberOfProperties;
+		size_t size = (DKManagedObjectBitmapWordCount(numberOfProperties) * sizeof(uint64_t)) + (numberOfProperties * sizeof(DKManagedObjectSlot));
+		
+#if __OBJC_GC__
+		void *storage = NSAllocateCollectable(size, NSScannedOption);
+		bzero(storage, size);
+#else
+		void *storage = calloc(1, size);
+#endif /* __OBJC_GC__ */
+		self->_dk_mCachedValues = storage;
+	}
+	
+	DKManagedObjectClearSlot(self, property);
+	
+	NSUInteger ordinal = property->mOrdinal;
+	DKManagedObjectLoadedBitmap(self)[ordinal / 64] |= (1ULL << (ordinal % 64));
+	
+	return DKManagedObjectSlotAtOrdinal(self, ordinal);
+}
+
+///Returns the value in the slot of a specified attribute, boxing it if it's a number.
+static id DKManagedObjectValueInSlot(DKManagedObject *self, DKAttributeDescription *attribute)
+{
+	NSUInteger ordinal = attribute->mOrdinal;
+	if(!DKManagedObjectSlotIsLoaded(self, ordinal))
+		return nil;
+	
+	DKManagedObjectSlot *slot = DKManagedObjectSlotAtOrdinal(self, ordinal);
+	switch (attribute->type)
+	{
+		case DKAttributeTypeInt8:
+		case DKAttributeTypeInt16:
+		case DKAttributeTypeInt32:
+			return [NSNumber numberWithInt:(int)slot->integer];
+			
+		case DKAttributeTypeInt64:
+			return [NSNumber numberWithLongLong:slot->integer];
+			
+		case DKAttributeTypeFloat:
+			return [NSNumber numberWithDouble:slot->real];
+			
+		default:
+			break;
+	}
+	
+	if([slot->object isKindOfClass:[DKUndecodedValue class]])
+	{
+		DKUndecodedValue *undecodedValue = slot->object;
+		id value = [attribute valueForEncodedData:undecodedValue->mEncodedData];
+		
+		slot->object = [value retain];
+		[undecodedValue release];
+	}
+	
+	return [[slot->object retain] autorelease];
+}
+
+#pragma mark -
+
 @implementation DKManagedObject
 
 - (void)dealloc
 {
 	if(_dk_mCachedValues)
 	{
-		[_dk_mCachedValues release];
-		_dk_mCachedValues = nil;
+		DKManagedObjectClearAllSlots(self);
+		
+		//The collector owns the storage under garbage collection, so there we just let go of it.
+#if !__OBJC_GC__
+		free(_dk_mCachedValues);
+#endif /* !__OBJC_GC__ */
+		_dk_mCachedValues = NULL;
 	}
 	
+	[_dk_mChangedValues release];
+	_dk_mChangedValues = nil;
+	
 	[super dealloc];
 }
 
@@ -47,7 +315,6 @@
 		_dk_mTableDescription = table;
 		_dk_mDatabase = database;
 		
-		_dk_mCachedValues = [NSMutableDictionary new];
 		_dk_mExtraRetainCount = 1;
 		
 		return self;
@@ -59,24 +326,43 @@
 #pragma mark Life Cycle Methods
 
 //
-//	The life cycle of DKManagedObject is controlled by DKDatabase. It only tracks its retain count
-//	for the purpose of controlling cache. That is, if a managed object has a retain count of 1 it
-//	is eligible for removal from local database cache.
+//	DKDatabase looks managed objects up in a map that doesn't retain them. It holds a reference
+//	of its own to the objects it keeps in memory, which it gives up when it evicts them or their
+//	rows are deleted. Whoever releases an object last destroys it.
+//
+//	Lookups retain objects while holding the lock of the map's stripe. An object that looks
+//	like it's losing its last reference has the database take it out of the map under the
+//	same lock, so nobody can find it in there once it's on its way out.
 //
 - (oneway void)release
 {
-	//
-	//	Release does nothing if extra-retain-count is 1. We are simply tracking
-	//	this value for the purposes of cache-life-cycle management.
-	//
-	OSMemoryBarrier();
-	if(_dk_mExtraRetainCount > 1)
+	for (;;)
 	{
-#if __LP64__ || NS_BUILD_32_LIKE_64
-		OSAtomicDecrement64((volatile int64_t *)&_dk_mExtraRetainCount);
-#else
-		OSAtomicDecrement32((volatile int32_t *)&_dk_mExtraRetainCount);
-#endif /* __LP64__ || NS_BUILD_32_LIKE_64 */
+		long retainCount = _dk_mExtraRetainCount;
+		if(retainCount > 1)
+		{
+			if(OSAtomicCompareAndSwapLongBarrier(retainCount, retainCount - 1, (volatile long *)&_dk_mExtraRetainCount))
+				return;
+			
+			continue;
+		}
+		
+		//
+		//	If a lookup got hold of us first, the count is no longer 1 and we try again. Objects
+		//	outliving their database have nothing to be taken out of, so they just drop the count.
+		//
+		BOOL isUnreferenced = NO;
+		if(_dk_mDatabase)
+			isUnreferenced = [_dk_mDatabase removeDatabaseObjectIfUnreferenced:self];
+		else
+			isUnreferenced = OSAtomicCompareAndSwapLongBarrier(1, 0, (volatile long *)&_dk_mExtraRetainCount);
+		
+		if(isUnreferenced)
+		{
+			//NSObject's own count has been 1 since we were allocated, so this destroys us.
+			[super release];
+			return;
+		}
 	}
 }
 
@@ -100,26 +386,89 @@
 #pragma mark -
 #pragma mark Accessor/Mutator Generation
 
+//
+//	The generated accessors and mutators find their property in a map kept by the
+//	receiver's table. A class can be shared by several tables, so the property can't
+//	be bound to the method itself. The map is keyed by selector pointer, so there's
+//	no string work on any call.
+//
+DK_INLINE DKPropertyDescription *DKManagedObjectPropertyForSelector(DKManagedObject *self, SEL selector)
+{
+	DKPropertyDescription *property = NSMapGet(self->_dk_mTableDescription->mPropertiesBySelector, selector);
+	NSCAssert((property != nil), @"No property for selector %@ exists in the table %@.", NSStringFromSelector(selector), self->_dk_mTableDescription->mName);
+	
+	return property;
+}
+
+///Copy out the slot of a specified attribute if it is loaded and the receiver has no unsaved changes.
+static BOOL DKManagedObjectGetUnchangedSlot(DKManagedObject *self, DKAttributeDescription *attribute, DKManagedObjectSlot *outSlot)
+{
+	self->_dk_mWasRecentlyUsed = YES;
+	
+	@synchronized(self)
+	{
+		if(self->_dk_mChangedValues || !DKManagedObjectSlotIsLoaded(self, attribute->mOrdinal))
+			return NO;
+		
+		*outSlot = *DKManagedObjectSlotAtOrdinal(self, attribute->mOrdinal);
+	}
+	
+	return YES;
+}
+
+#pragma mark -
+
 static void _DKManagedObject_SetCallback(DKManagedObject *self, SEL _cmd, id value)
 {
-	NSMutableString *columnName = [NSMutableString stringWithString:NSStringFromSelector(_cmd)];
+	[self setValue:value forProperty:DKManagedObjectPropertyForSelector(self, _cmd)];
+}
+
+static id _DKManagedObject_GetCallback(DKManagedObject *self, SEL _cmd)
+{
+	return [self valueForProperty:DKManagedObjectPropertyForSelector(self, _cmd)];
+}
+
+static void _DKManagedObject_SetIntegerCallback(DKManagedObject *self, SEL _cmd, int64_t value)
+{
+	[self setValue:[NSNumber numberWithLongLong:value] forProperty:DKManagedObjectPropertyForSelector(self, _cmd)];
+}
+
+static int64_t _DKManagedObject_GetIntegerCallback(DKManagedObject *self, SEL _cmd)
+{
+	DKAttributeDescription *attribute = (DKAttributeDescription *)DKManagedObjectPropertyForSelector(self, _cmd);
 	
-	//Remove the set prefix
-	[columnName deleteCharactersInRange:NSMakeRange(0, 3)];
+	//Loaded integers are returned without ever being boxed.
+	DKManagedObjectSlot slot;
+	if(DKManagedObjectGetUnchangedSlot(self, attribute, &slot))
+		return slot.integer;
 	
-	//Remove the : suffix
-	[columnName deleteCharactersInRange:NSMakeRange([columnName length] - 1, 1)];
+	return [[self valueForProperty:attribute] longLongValue];
+}
+
+static void _DKManagedObject_SetFloatCallback(DKManagedObject *self, SEL _cmd, double value)
+{
+	[self setValue:[NSNumber numberWithDouble:value] forProperty:DKManagedObjectPropertyForSelector(self, _cmd)];
+}
+
+static double _DKManagedObject_GetFloatCallback(DKManagedObject *self, SEL _cmd)
+{
+	DKAttributeDescription *attribute = (DKAttributeDescription *)DKManagedObjectPropertyForSelector(self, _cmd);
 	
-	//Downcase the first character
-	[columnName replaceCharactersInRange:NSMakeRange(0, 1) withString:[[columnName substringToIndex:1] lowercaseString]];
+	DKManagedObjectSlot slot;
+	if(DKManagedObjectGetUnchangedSlot(self, attribute, &slot))
+		return slot.real;
 	
-	[self setValue:value forColumnNamed:columnName];
+	return [[self valueForProperty:attribute] doubleValue];
 }
 
-static id _DKManagedObject_GetCallback(DKManagedObject *self, SEL _cmd)
+static BOOL DKManagedObjectIsGeneratedAccessor(IMP implementation)
 {
-	NSString *columnName = NSStringFromSelector(_cmd);
-	return [self valueForColumnNamed:columnName];
+	return (implementation == (IMP)&_DKManagedObject_GetCallback ||
+			implementation == (IMP)&_DKManagedObject_SetCallback ||
+			implementation == (IMP)&_DKManagedObject_GetIntegerCallback ||
+			implementation == (IMP)&_DKManagedObject_SetIntegerCallback ||
+			implementation == (IMP)&_DKManagedObject_GetFloatCallback ||
+			implementation == (IMP)&_DKManagedObject_SetFloatCallback);
 }
 
 #pragma mark -
@@ -128,16 +477,63 @@ static id _DKManagedObject_GetCallback(DKManagedObject *self, SEL _cmd)
 {
 	NSParameterAssert(property);
 	
-	NSString *propertyName = property.name;
+	SEL accessorSelector = [property accessorSelector];
+	SEL mutatorSelector = [property mutatorSelector];
 	
-	SEL accessorSelector = NSSelectorFromString(propertyName);
-	SEL mutatorSelector = NSSelectorFromString([NSString stringWithFormat:@"set%C%@:", toupper([propertyName characterAtIndex:0]), [propertyName substringFromIndex:1]]);
+	//
+	//	Numeric attributes get accessors that deal in plain numbers,
+	//	everything else is passed around as an object.
+	//
+	IMP accessor = (IMP)&_DKManagedObject_GetCallback;
+	IMP mutator = (IMP)&_DKManagedObject_SetCallback;
+	const char *accessorTypes = "@@:";
+	const char *mutatorTypes = "v@:@";
+	if([property isKindOfClass:[DKAttributeDescription class]])
+	{
+		switch (((DKAttributeDescription *)property).type)
+		{
+			case DKAttributeTypeInt8:
+			case DKAttributeTypeInt16:
+			case DKAttributeTypeInt32:
+			case DKAttributeTypeInt64:
+				accessor = (IMP)&_DKManagedObject_GetIntegerCallback;
+				mutator = (IMP)&_DKManagedObject_SetIntegerCallback;
+				accessorTypes = "q@:";
+				mutatorTypes = "v@:q";
+				break;
+				
+			case DKAttributeTypeFloat:
+				accessor = (IMP)&_DKManagedObject_GetFloatCallback;
+				mutator = (IMP)&_DKManagedObject_SetFloatCallback;
+				accessorTypes = "d@:";
+				mutatorTypes = "v@:d";
+				break;
+				
+			default:
+				break;
+		}
+	}
 	
-	if(!class_getInstanceMethod(self, mutatorSelector))
-		class_addMethod(self, mutatorSelector, (IMP)&_DKManagedObject_SetCallback, "v@:@");
+	//
+	//	A class can back more than one table, so a pair generated for an earlier
+	//	table may already exist. Its types are fixed at that point, so a property
+	//	of the same name must have the same type in every table the class backs.
+	//
+	Method existingMutator = class_getInstanceMethod(self, mutatorSelector);
+	if(!existingMutator)
+		class_addMethod(self, mutatorSelector, mutator, mutatorTypes);
+	else if(DKManagedObjectIsGeneratedAccessor(method_getImplementation(existingMutator)))
+		NSAssert((strcmp(method_getTypeEncoding(existingMutator), mutatorTypes) == 0), 
+				 @"The property %@ of the table %@ does not have the same type as a property of the same name in another table backed by %@.", 
+				 [property name], [[property table] name], self);
 	
-	if(!class_getInstanceMethod(self, accessorSelector))
-		class_addMethod(self, accessorSelector, (IMP)&_DKManagedObject_GetCallback, "@@:");
+	Method existingAccessor = class_getInstanceMethod(self, accessorSelector);
+	if(!existingAccessor)
+		class_addMethod(self, accessorSelector, accessor, accessorTypes);
+	else if(DKManagedObjectIsGeneratedAccessor(method_getImplementation(existingAccessor)))
+		NSAssert((strcmp(method_getTypeEncoding(existingAccessor), accessorTypes) == 0), 
+				 @"The property %@ of the table %@ does not have the same type as a property of the same name in another table backed by %@.", 
+				 [property name], [[property table] name], self);
 }
 
 #pragma mark -
@@ -146,56 +542,341 @@ static id _DKManagedObject_GetCallback(DKManagedObject *self, SEL _cmd)
 @synthesize database = _dk_mDatabase;
 @synthesize tableDescription = _dk_mTableDescription;
 @synthesize uniqueIdentifier = _dk_mUniqueIdentifier;
+@synthesize isDeleted = _dk_mIsDeleted;
 
 #pragma mark -
 #pragma mark Cache Management
 
-- (void)cacheValue:(id)value forKey:(NSString *)key
-{
-	@synchronized(self)
-	{
-		[_dk_mCachedValues setObject:value forKey:key];
-	}
-}
-
-- (id)cachedValueForKey:(NSString *)key
+- (void)cacheValue:(id)value forAttribute:(DKAttributeDescription *)attribute
 {
+	NSParameterAssert(attribute);
+	
 	@synchronized(self)
 	{
-		return [_dk_mCachedValues objectForKey:key];
+		if(!value)
+		{
+			DKManagedObjectClearSlot(self, attribute);
+			return;
+		}
+		
+		DKManagedObjectSlot *slot = DKManagedObjectPrepareSlot(self, attribute);
+		switch (attribute->type)
+		{
+			case DKAttributeTypeInt8:
+			case DKAttributeTypeInt16:
+			case DKAttributeTypeInt32:
+			case DKAttributeTypeInt64:
+				slot->integer = [value longLongValue];
+				break;
+				
+			case DKAttributeTypeFloat:
+				slot->real = [value doubleValue];
+				break;
+				
+			default:
+				slot->object = [value retain];
+				break;
+		}
 	}
 }
 
-- (void)cacheAllColumnsInTable
-{
-	//
-	//	We enumerate all of the properties in our table description.
-	//	By asking ourselves for the value of the each property we
-	//	build a local cache of the row this object represents in the database.
-	//
-	for (DKPropertyDescription *property in _dk_mTableDescription.properties)
-		[self valueForColumnNamed:property.name];
-}
-
-#pragma mark -
-
-- (void)removeCacheForKey:(NSString *)key
+- (id)cachedValueForAttribute:(DKAttributeDescription *)attribute
 {
+	NSParameterAssert(attribute);
+	
 	@synchronized(self)
 	{
-		[_dk_mCachedValues removeObjectForKey:key];
+		return DKManagedObjectValueInSlot(self, attribute);
 	}
 }
 
-- (void)invalidateCache
+- (void)cacheAttributes:(NSArray *)attributes fromRowOfQuery:(DKCompiledSQLQuery *)query startingAtColumnIndex:(int)columnIndex
 {
+	NSParameterAssert(attributes);
+	NSParameterAssert(query);
+	
 	@synchronized(self)
 	{
-		[_dk_mCachedValues removeAllObjects];
-	}
-}
-
-#pragma mark -
+		//
+		//	Numbers are read straight into their slots so
+		//	that no NSNumbers are created while hydrating.
+		//
+		for (DKAttributeDescription *attribute in attributes)
+		{
+			if([query isNullColumnAtIndex:columnIndex])
+			{
+				DKManagedObjectClearSlot(self, attribute);
+				
+				columnIndex++;
+				continue;
+			}
+			
+			DKManagedObjectSlot *slot = DKManagedObjectPrepareSlot(self, attribute);
+			switch (attribute->type)
+			{
+				case DKAttributeTypeInt8:
+				case DKAttributeTypeInt16:
+				case DKAttributeTypeInt32:
+				case DKAttributeTypeInt64:
+					slot->integer = [query longLongForColumnAtIndex:columnIndex];
+					break;
+					
+				case DKAttributeTypeFloat:
+					slot->real = [query doubleForColumnAtIndex:columnIndex];
+					break;
+					
+				case DKAttributeTypeObject:
+					slot->object = [[DKUndecodedValue alloc] initWithEncodedData:[query dataForColumnAtIndex:columnIndex]];
+					break;
+					
+				default:
+					slot->object = [[query valueForColumnAtIndex:columnIndex attribute:attribute] retain];
+					break;
+			}
+			
+			columnIndex++;
+		}
+	}
+}
+
+- (void)cacheAllColumnsInTable
+{
+	NSArray *attributes = _dk_mTableDescription.attributes;
+	if([attributes count] == 0)
+		return;
+	
+	//
+	//	We select every attribute of the row this object represents in one
+	//	query and build our local cache from the result, rather than asking
+	//	ourselves for each column one select at a time.
+	//
+	NSString *selectQueryString = dk_string_from_format(
+		dk_stringify_sql(
+			SELECT %@ FROM %@ WHERE _dk_uniqueIdentifier = ?
+		),
+		[_dk_mTableDescription escapedAttributeColumnList], [_dk_mTableDescription.name stringByEscapingStringForLiteralUseInSQLQueries]
+	);
+	
+	NSError *error = nil;
+	DKCompiledSQLQuery *selectQuery = [_dk_mDatabase compileSQLQuery:selectQueryString error:&error];
+	NSAssert((selectQuery != nil), 
+			 @"Could not compile select query. Got error %@.", error);
+	
+	[selectQuery setLongLong:_dk_mUniqueIdentifier forParameterAtIndex:1];
+	if([selectQuery nextRow])
+		[self cacheAttributes:attributes fromRowOfQuery:selectQuery startingAtColumnIndex:0];
+	
+	[selectQuery reset];
+}
+
+- (void)cacheRelatedObjects:(NSArray *)objects forRelationship:(DKRelationshipDescription *)relationship generation:(int32_t)generation
+{
+	NSParameterAssert(objects);
+	NSParameterAssert(relationship);
+	NSAssert(([relationship isToMany] || ([objects count] <= 1)), 
+			 @"Cannot cache more than one object for the one-to-one relationship %@.", relationship.name);
+	
+	//
+	//	Only the unique identifiers are kept so that a cached relationship doesn't
+	//	keep the objects at its other end alive. They're cheap to look up again.
+	//
+	NSMutableData *uniqueIdentifiers = [NSMutableData dataWithLength:sizeof(int64_t) * [objects count]];
+	int64_t *uniqueIdentifierBytes = [uniqueIdentifiers mutableBytes];
+	for (DKManagedObject *object in objects)
+		*uniqueIdentifierBytes++ = object->_dk_mUniqueIdentifier;
+	
+	DKRelationshipCache *cache = [[DKRelationshipCache alloc] initWithUniqueIdentifiers:uniqueIdentifiers generation:generation];
+	@synchronized(self)
+	{
+		DKManagedObjectSlot *slot = DKManagedObjectPrepareSlot(self, relationship);
+		slot->object = cache;
+	}
+}
+
+///Returns the cached unique identifiers of the objects in a specified relationship, or nil if the relationship isn't cached or its cache is out of date.
+static NSData *DKManagedObjectCachedRelationship(DKManagedObject *self, DKRelationshipDescription *relationship)
+{
+	@synchronized(self)
+	{
+		NSUInteger ordinal = relationship->mOrdinal;
+		if(!DKManagedObjectSlotIsLoaded(self, ordinal))
+			return nil;
+		
+		DKRelationshipCache *cache = DKManagedObjectSlotAtOrdinal(self, ordinal)->object;
+		if(cache->mGeneration != [self->_dk_mDatabase generationOfRelationship:relationship])
+		{
+			DKManagedObjectClearSlot(self, relationship);
+			return nil;
+		}
+		
+		return [[cache->mUniqueIdentifiers retain] autorelease];
+	}
+}
+
+#pragma mark -
+
+- (void)removeCacheForAttribute:(DKAttributeDescription *)attribute
+{
+	NSParameterAssert(attribute);
+	
+	@synchronized(self)
+	{
+		DKManagedObjectClearSlot(self, attribute);
+	}
+}
+
+- (void)markDeleted
+{
+	//
+	//	The flag goes up first so that nobody reloads a value we're about to
+	//	throw away. It has to be visible before the database lets go of us.
+	//
+	_dk_mIsDeleted = YES;
+	OSMemoryBarrier();
+	
+	@synchronized(self)
+	{
+		DKManagedObjectClearAllSlots(self);
+		
+		[_dk_mChangedValues release];
+		_dk_mChangedValues = nil;
+	}
+}
+
+- (void)invalidateCache
+{
+	@synchronized(self)
+	{
+		DKManagedObjectClearAllSlots(self);
+	}
+}
+
+#pragma mark -
+#pragma mark Change Tracking
+
+- (void)recordChangedValue:(id)value forAttribute:(DKAttributeDescription *)attributeDescription
+{
+	NSParameterAssert(attributeDescription);
+	if(attributeDescription.isRequired)
+		NSParameterAssert(value);
+	
+	@synchronized(self)
+	{
+		if(!_dk_mChangedValues)
+			_dk_mChangedValues = [NSMutableDictionary new];
+		
+		//NSNull stands in for nil so we remember that the column is to be cleared.
+		[_dk_mChangedValues setObject:(value ?: [NSNull null]) forKey:attributeDescription.name];
+	}
+	
+	[_dk_mDatabase databaseObjectDidChange:self];
+}
+
+- (id)changedValueForKey:(NSString *)key
+{
+	@synchronized(self)
+	{
+		return [_dk_mChangedValues objectForKey:key];
+	}
+}
+
+@dynamic hasChanges;
+- (BOOL)hasChanges
+{
+	@synchronized(self)
+	{
+		return ([_dk_mChangedValues count] > 0);
+	}
+}
+
+- (NSDictionary *)changedValues
+{
+	@synchronized(self)
+	{
+		return [[_dk_mChangedValues copy] autorelease] ?: [NSDictionary dictionary];
+	}
+}
+
+- (NSDictionary *)takeChangedValues
+{
+	@synchronized(self)
+	{
+		if([_dk_mChangedValues count] == 0)
+			return nil;
+		
+		NSDictionary *changedValues = [_dk_mChangedValues autorelease];
+		_dk_mChangedValues = nil;
+		
+		return changedValues;
+	}
+}
+
+- (void)restoreChangedValues:(NSDictionary *)changedValues
+{
+	NSParameterAssert(changedValues);
+	
+	@synchronized(self)
+	{
+		if(!_dk_mChangedValues)
+			_dk_mChangedValues = [NSMutableDictionary new];
+		
+		//
+		//	Anything that was changed again while we were trying to
+		//	save is newer than what we're restoring, so it wins.
+		//
+		[changedValues enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+			if(![_dk_mChangedValues objectForKey:key])
+				[_dk_mChangedValues setObject:value forKey:key];
+		}];
+	}
+}
+
+- (BOOL)writeChangedValues:(NSDictionary *)changedValues error:(NSError **)error
+{
+	NSParameterAssert(changedValues);
+	
+	if([changedValues count] == 0)
+		return YES;
+	
+	//
+	//	We write every changed column of the row in a single UPDATE. The columns are
+	//	sorted so that objects with the same set of changes share one compiled query.
+	//
+	NSArray *columnNames = [[changedValues allKeys] sortedArrayUsingSelector:@selector(compare:)];
+	NSMutableString *assignments = [NSMutableString string];
+	for (NSString *columnName in columnNames)
+	{
+		if([assignments length] > 0)
+			[assignments appendString:@", "];
+		
+		[assignments appendFormat:@"'%@' = ?", [columnName stringByEscapingStringForLiteralUseInSQLQueries]];
+	}
+	
+	NSString *updateQueryString = dk_string_from_format(
+		dk_stringify_sql(
+			UPDATE %@ SET %@ WHERE _dk_uniqueIdentifier = ?
+		),
+		[_dk_mTableDescription.name stringByEscapingStringForLiteralUseInSQLQueries], assignments
+	);
+	DKCompiledSQLQuery *updateQuery = [_dk_mDatabase compileSQLQuery:updateQueryString error:error];
+	if(!updateQuery)
+		return NO;
+	
+	int parameterIndex = 1;
+	for (NSString *columnName in columnNames)
+	{
+		DKAttributeDescription *attributeDescription = (DKAttributeDescription *)[_dk_mTableDescription propertyWithName:columnName];
+		[updateQuery setValue:[changedValues objectForKey:columnName] attribute:attributeDescription forParameterAtIndex:parameterIndex];
+		
+		parameterIndex++;
+	}
+	[updateQuery setLongLong:_dk_mUniqueIdentifier forParameterAtIndex:parameterIndex];
+	
+	//The values being written were cached when they were changed, so committing them shouldn't drop them.
+	return [_dk_mDatabase evaluateQuery:updateQuery writingThroughDatabaseObject:self error:error];
+}
+
+#pragma mark -
 #pragma mark Database Accessor/Mutators
 
 - (void)setValue:(id)value forAttribute:(DKAttributeDescription *)attributeDescription
@@ -204,6 +885,17 @@ static id _DKManagedObject_GetCallback(DKManagedObject *self, SEL _cmd)
 	if(attributeDescription.isRequired)
 		NSParameterAssert(value);
 	
+	//Writes are always made on the database's writer queue.
+	if(![_dk_mDatabase isOnWriterQueue])
+	{
+		[_dk_mDatabase performWriterBlock:^(NSError **writerError) {
+			[self setValue:value forAttribute:attributeDescription];
+			return YES;
+		} error:NULL];
+		
+		return;
+	}
+	
 	NSError *error = nil;
 	
 	//We escape these values to prevent SQL injection.
@@ -215,13 +907,14 @@ static id _DKManagedObject_GetCallback(DKManagedObject *self, SEL _cmd)
 	//	We determine the row to update in `table` by our unique identifier.
 	//
 	//	Note that we use a ? so we don't have to escape the value. We set it directly
-	//	in the switch statement below.
+	//	in the switch statement below. The unique identifier is a parameter as well
+	//	so a single compiled query can be reused for every row in the table.
 	//
 	NSString *updateQueryString = dk_string_from_format(
 		dk_stringify_sql(
-			UPDATE %@ SET '%@' = ? WHERE _dk_uniqueIdentifier=%lld
+			UPDATE %@ SET '%@' = ? WHERE _dk_uniqueIdentifier = ?
 		),
-		escapedTableName, escapedAttributeName, _dk_mUniqueIdentifier
+		escapedTableName, escapedAttributeName
 	);
 	
 	//Evaluate the update query.
@@ -229,313 +922,1029 @@ static id _DKManagedObject_GetCallback(DKManagedObject *self, SEL _cmd)
 	NSAssert((updateQuery != nil), 
 			 @"Could not compile update query. Got error %@.", error);
 	
+	[updateQuery setLongLong:_dk_mUniqueIdentifier forParameterAtIndex:2];
+	
+	
+	//
+	//	We set the value of the first column in the query (key) based on the type
+	//	described in the attribute description for the specified key. nil becomes NULL.
+	//
+	[updateQuery setValue:value attribute:attributeDescription forParameterAtIndex:1];
+	
+	
+	//
+	//	This is where the actual update happens. If it doesn't work,
+	//	we fail catastrophically. Because really, who wants to fail nicely.
+	//
+	BOOL success = [_dk_mDatabase evaluateQuery:updateQuery writingThroughDatabaseObject:self error:&error];
+	NSAssert(success, @"Could not update value for key %@. Got error %@.", attributeDescription.name, error);
+}
+
+- (id)valueForAttribute:(DKAttributeDescription *)attributeDescription
+{
+	NSParameterAssert(attributeDescription);
+	
+	NSError *error = nil;
+	
+	//We escape these values to prevent SQL injection.
+	NSString *escapedAttributeName = [attributeDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
+	NSString *escapedTableName = [_dk_mTableDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
+	
+	//
+	//	We create an SQL SELECT query to find the value specified by `key` in
+	//	our row in the database. We find ourselves using our unique identifier.
+	//
+	NSString *selectQueryString = dk_string_from_format(
+		dk_stringify_sql(
+			SELECT %@ FROM %@ WHERE(_dk_uniqueIdentifier = ?)
+		),
+		escapedAttributeName, escapedTableName
+	);
+	
+	
+	//Evaluate the update query.
+	DKCompiledSQLQuery *selectQuery = [_dk_mDatabase compileSQLQuery:selectQueryString error:&error];
+	NSAssert((selectQuery != nil), 
+			 @"Could not compile select query. Got error %@.", error);
+	
+	[selectQuery setLongLong:_dk_mUniqueIdentifier forParameterAtIndex:1];
+	
+	//
+	//	The first row of the select query should contain the value specified by `key`.
+	//	If it doesn't its value is nil and we're just going to return that.
+	//
+	if(![selectQuery nextRow])
+		return nil;
+	
+	
+	//
+	//	We convert the returned value from the query to an object using
+	//	the type specified by `attributeDescription` to decide what to create.
+	//
+	id value = [selectQuery valueForColumnAtIndex:0 attribute:attributeDescription];
+	
+	//We're done with the row, let the query be reused.
+	[selectQuery reset];
+	
+	return value;
+}
+
+#pragma mark -
+
+- (void)setValue:(id)value forRelationship:(DKRelationshipDescription *)relationshipDescription
+{
+	NSParameterAssert(relationshipDescription);
+	
+	//We only require value to be non-nil if the relationship denotes it.
+	if(relationshipDescription.isRequired)
+		NSParameterAssert(value);
+	
+	//Writes are always made on the database's writer queue.
+	if(![_dk_mDatabase isOnWriterQueue])
+	{
+		[_dk_mDatabase performWriterBlock:^(NSError **writerError) {
+			[self setValue:value forRelationship:relationshipDescription];
+			return YES;
+		} error:NULL];
+		
+		return;
+	}
+	
+	NSError *error = nil;
+	DKRelationshipType relationshipType = relationshipDescription.relationshipType;
+	NSString *escapedRelationshipName = [relationshipDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
+	NSString *escapedTableName = [_dk_mTableDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
+	
+	if(relationshipType == kDKRelationshipTypeOneToOne)
+	{
+		if(value)
+			NSAssert([value isKindOfClass:[DKManagedObject class]], 
+					 @"Non-database-object of type %@ given.", NSStringFromClass([value class]));
+		
+		DKManagedObject *databaseObject = (DKManagedObject *)value;
+		
+		
+		//
+		//	One-to-one relationships are the simplest of relationships. They are represented in
+		//	the database by a column of type BIGINT. The value of this column is the (database)
+		//	unique identifier of the database value of the column.
+		//
+		//	If we've been given a value we update the relationship with the unique identifier
+		//	of the passed in database object. If we're given nil and the relationship allows
+		//	NULL values, we update the relationship with NULL.
+		//
+		NSString *updateQueryString = dk_string_from_format(
+			dk_stringify_sql(
+				UPDATE %@ SET '%@' = ? WHERE _dk_uniqueIdentifier = ?
+			),
+			escapedTableName, escapedRelationshipName
+		);
+		DKCompiledSQLQuery *updateQuery = [_dk_mDatabase compileSQLQuery:updateQueryString error:&error];
+		NSAssert((updateQuery != nil), 
+				 @"Could not compile relationship update query. Got error %@.", error);
+		
+		if(value)
+			[updateQuery setLongLong:databaseObject.uniqueIdentifier forParameterAtIndex:1];
+		else
+			[updateQuery nullifyParameterAtIndex:1];
+		[updateQuery setLongLong:_dk_mUniqueIdentifier forParameterAtIndex:2];
+		
+		
+		//
+		//	If this relationship has an inverse, we also need to update that.
+		//	Bad shit will happen if we don't, afterall.
+		//
+		//	When we're given a value, the inverse of that value is pointed at us. When we're
+		//	given nil, the existing value for the relationship has its column that tracks us set to NULL.
+		//
+		DKCompiledSQLQuery *inverseRelationshipUpdateQuery = nil;
+		DKRelationshipDescription *inverseRelationship = relationshipDescription.inverseRelationship;
+		DKManagedObject *inverseObject = value? databaseObject : [self valueForRelationship:relationshipDescription];
+		if(inverseRelationship && ![inverseRelationship isToMany] && inverseObject)
+		{
+			NSString *escapedInverseTableName = [inverseObject.tableDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
+			NSString *escapedInverseColumnName = [inverseRelationship.name stringByEscapingStringForLiteralUseInSQLQueries];
+			NSString *inverseRelationshipUpdateQueryString = dk_string_from_format(
+				dk_stringify_sql(
+					UPDATE %@ SET '%@' = ? WHERE _dk_uniqueIdentifier = ?
+				),
+				escapedInverseTableName, escapedInverseColumnName
+			);
+			inverseRelationshipUpdateQuery = [_dk_mDatabase compileSQLQuery:inverseRelationshipUpdateQueryString error:&error];
+			NSAssert((inverseRelationshipUpdateQuery != nil), 
+					 @"Could not compile inverse relationship update query. Got error %@.", error);
+			
+			if(value)
+				[inverseRelationshipUpdateQuery setLongLong:_dk_mUniqueIdentifier forParameterAtIndex:1];
+			else
+				[inverseRelationshipUpdateQuery nullifyParameterAtIndex:1];
+			[inverseRelationshipUpdateQuery setLongLong:inverseObject.uniqueIdentifier forParameterAtIndex:2];
+		}
+		
+		//
+		//	Its time to update the relationship column. If this doesn't work the world is going to end.
+		//
+		BOOL success = [updateQuery evaluateAndReturnError:&error];
+		NSAssert(success, @"Could not update relationship on object %@ with %@. Got error %@.", self, databaseObject, error);
+		
+		
+		//
+		//	We only run the inverse relationship update query if there's actually
+		//	an inverse relationship to update.
+		//
+		if(inverseRelationshipUpdateQuery)
+		{
+			success = [inverseRelationshipUpdateQuery evaluateAndReturnError:&error];
+			NSAssert(success, @"Could not update inverse relationship. Got error %@.", error);
+		}
+	}
+	else
+	{
+		if(value)
+			NSAssert([value isKindOfClass:[NSSet class]] || [value isKindOfClass:[NSArray class]], 
+					 @"Non-collection of type %@ given for to-many relationship.", NSStringFromClass([value class]));
+		
+		//
+		//	Setting a to-many relationship replaces its members. We only touch
+		//	the rows of the members that are actually coming or going.
+		//
+		NSSet *newMembers = [value isKindOfClass:[NSArray class]]? [NSSet setWithArray:value] : (value ?: [NSSet set]);
+		NSSet *existingMembers = [self membersOfRelationship:relationshipDescription];
+		
+		NSMutableSet *removedMembers = [[existingMembers mutableCopy] autorelease];
+		[removedMembers minusSet:newMembers];
+		
+		NSMutableSet *addedMembers = [[newMembers mutableCopy] autorelease];
+		[addedMembers minusSet:existingMembers];
+		
+		BOOL success = [_dk_mDatabase performTransaction:^(NSError **transactionError) {
+			return ([self removeMembers:removedMembers fromRelationship:relationshipDescription error:transactionError] && 
+					[self addMembers:addedMembers toRelationship:relationshipDescription error:transactionError]);
+		} error:&error];
+		NSAssert(success, @"Could not update relationship on object %@. Got error %@.", self, error);
+	}
+}
+
+- (id)valueForRelationship:(DKRelationshipDescription *)relationshipDescription
+{
+	NSParameterAssert(relationshipDescription);
+	
+	//
+	//	If the relationship was prefetched, or has been looked up
+	//	before and hasn't changed since, we don't touch the database.
+	//
+	NSData *cachedUniqueIdentifiers = DKManagedObjectCachedRelationship(self, relationshipDescription);
+	if(cachedUniqueIdentifiers)
+	{
+		const int64_t *uniqueIdentifiers = [cachedUniqueIdentifiers bytes];
+		NSUInteger numberOfUniqueIdentifiers = [cachedUniqueIdentifiers length] / sizeof(int64_t);
+		DKTableDescription *targetTable = relationshipDescription.targetTable;
+		
+		if([relationshipDescription isToMany])
+		{
+			NSMutableSet *members = [NSMutableSet setWithCapacity:numberOfUniqueIdentifiers];
+			for (NSUInteger index = 0; index < numberOfUniqueIdentifiers; index++)
+				[members addObject:[_dk_mDatabase databaseObjectInTable:targetTable withUniqueIdentifier:uniqueIdentifiers[index]]];
+			
+			return [[[DKRelationshipSet alloc] initWithObject:self relationship:relationshipDescription members:members] autorelease];
+		}
+		
+		if(numberOfUniqueIdentifiers == 0)
+			return nil;
+		
+		return [_dk_mDatabase databaseObjectInTable:targetTable withUniqueIdentifier:uniqueIdentifiers[0]];
+	}
+	
+	//
+	//	To-many relationships are read lazily. Nothing is looked up until the set is used.
+	//
+	if([relationshipDescription isToMany])
+		return [[[DKRelationshipSet alloc] initWithObject:self relationship:relationshipDescription] autorelease];
+	
+	//The generation is noted before reading so a change made while we read isn't hidden.
+	int32_t generation = [_dk_mDatabase generationOfRelationship:relationshipDescription];
+	
+	NSError *error = nil;
+	DKRelationshipType relationshipType = relationshipDescription.relationshipType;
+	NSString *escapedRelationshipName = [relationshipDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
+	NSString *escapedTableName = [_dk_mTableDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
+	
+	if(relationshipType == kDKRelationshipTypeOneToOne)
+	{
+		//
+		//	Look up the unique identifier of the value associated with this relationship.
+		//
+		NSString *selectQueryString = dk_string_from_format(
+			dk_stringify_sql(
+				SELECT %@ FROM %@ WHERE _dk_uniqueIdentifier = ?
+			),
+			escapedRelationshipName, escapedTableName
+		);
+		
+		
+		DKCompiledSQLQuery *selectQuery = [_dk_mDatabase compileSQLQuery:selectQueryString error:&error];
+		NSAssert((selectQuery != nil), 
+				 @"Could not select one-to-one relationship identifier. Got error %@.", error);
+		
+		[selectQuery setLongLong:_dk_mUniqueIdentifier forParameterAtIndex:1];
+		
+		if([selectQuery nextRow])
+		{
+			//
+			//	If the resultant unique identifier is 0, it is assumed this means NULL in the database.
+			//
+			int64_t relationshipResultUniqueIdentifier = [selectQuery longLongForColumnAtIndex:0];
+			[selectQuery reset];
+			
+			if(relationshipResultUniqueIdentifier == 0)
+			{
+				[self cacheRelatedObjects:[NSArray array] forRelationship:relationshipDescription generation:generation];
+				return nil;
+			}
+			
+			DKManagedObject *relatedObject = [_dk_mDatabase databaseObjectInTable:relationshipDescription.targetTable 
+															 withUniqueIdentifier:relationshipResultUniqueIdentifier];
+			[self cacheRelatedObjects:[NSArray arrayWithObject:relatedObject] forRelationship:relationshipDescription generation:generation];
+			
+			return relatedObject;
+		}
+	}
+	
+	return nil;
+}
+
+#pragma mark -
+#pragma mark To-Many Relationships
+
+///The largest number of members added or removed by a single query.
+enum {
+	kDKRelationshipMemberBatchSize = 250,
+};
+
+///Returns the unique identifiers of a set of database objects in a specified table as an array of NSNumbers.
+static NSArray *DKUniqueIdentifiersOfMembers(NSSet *objects, DKTableDescription *table)
+{
+	NSMutableArray *uniqueIdentifiers = [NSMutableArray arrayWithCapacity:[objects count]];
+	for (DKManagedObject *object in objects)
+	{
+		NSCAssert([object isKindOfClass:[DKManagedObject class]], 
+				  @"Non-database-object of type %@ given.", NSStringFromClass([object class]));
+		NSCAssert((object->_dk_mTableDescription == table), 
+				  @"Object %@ does not belong to the table %@.", object, table.name);
+		
+		[uniqueIdentifiers addObject:[NSNumber numberWithLongLong:object->_dk_mUniqueIdentifier]];
+	}
+	
+	return uniqueIdentifiers;
+}
+
+- (NSSet *)membersOfRelationship:(DKRelationshipDescription *)relationship
+{
+	NSParameterAssert(relationship);
+	NSAssert([relationship isToMany], @"Relationship %@ is not to-many.", relationship.name);
+	
+	DKTableDescription *targetTable = relationship.targetTable;
+	NSString *escapedTargetTableName = [targetTable.name stringByEscapingStringForLiteralUseInSQLQueries];
+	
+	//
+	//	Foreign keys are looked up through the index every one-to-one column has. Join
+	//	tables are looked up through their primary key or their destination index. The
+	//	target table is joined in so that rows left behind by deleted members are skipped.
+	//
+	NSString *selectQueryString = nil;
+	if([relationship usesJoinTable])
+	{
+		selectQueryString = dk_string_from_format(
+			dk_stringify_sql(
+				SELECT joinTable.%@ FROM %@ AS joinTable 
+				INNER JOIN %@ AS targetTable ON (targetTable._dk_uniqueIdentifier = joinTable.%@) 
+				WHERE (joinTable.%@ = ?)
+			),
+			[relationship joinTableDestinationColumnName], 
+			[[relationship joinTableName] stringByEscapingStringForLiteralUseInSQLQueries], 
+			escapedTargetTableName, 
+			[relationship joinTableDestinationColumnName], 
+			[relationship joinTableSourceColumnName]
+		);
+	}
+	else
+	{
+		selectQueryString = dk_string_from_format(
+			dk_stringify_sql(
+				SELECT _dk_uniqueIdentifier FROM %@ WHERE (%@ = ?)
+			),
+			escapedTargetTableName, [relationship.inverseRelationship.name stringByEscapingStringForLiteralUseInSQLQueries]
+		);
+	}
+	
+	NSError *error = nil;
+	DKCompiledSQLQuery *selectQuery = [_dk_mDatabase compileSQLQuery:selectQueryString error:&error];
+	NSAssert((selectQuery != nil), 
+			 @"Could not compile to-many relationship select query. Got error %@.", error);
+	
+	[selectQuery setLongLong:_dk_mUniqueIdentifier forParameterAtIndex:1];
+	
+	NSMutableSet *members = [NSMutableSet set];
+	while ([selectQuery nextRow])
+	{
+		[members addObject:[_dk_mDatabase databaseObjectInTable:targetTable 
+										   withUniqueIdentifier:[selectQuery longLongForColumnAtIndex:0]]];
+	}
+	
+	[selectQuery reset];
+	
+	return members;
+}
+
+- (BOOL)addMembers:(NSSet *)objects toRelationship:(DKRelationshipDescription *)relationship error:(NSError **)error
+{
+	NSParameterAssert(objects);
+	NSParameterAssert(relationship);
+	NSAssert([relationship isToMany], @"Relationship %@ is not to-many.", relationship.name);
+	NSAssert([_dk_mDatabase isOnWriterQueue], @"Relationships must be changed on the writer queue.");
+	
+	NSArray *uniqueIdentifiers = DKUniqueIdentifiersOfMembers(objects, relationship.targetTable);
+	NSUInteger numberOfMembers = [uniqueIdentifiers count];
+	for (NSUInteger batchStart = 0; batchStart < numberOfMembers; batchStart += kDKRelationshipMemberBatchSize)
+	{
+		NSArray *batch = [uniqueIdentifiers subarrayWithRange:NSMakeRange(batchStart, MIN(kDKRelationshipMemberBatchSize, numberOfMembers - batchStart))];
+		NSString *parameterList = [NSString SQLParameterListWithCount:[batch count]];
+		
+		if([relationship usesJoinTable])
+		{
+			NSString *escapedJoinTableName = [[relationship joinTableName] stringByEscapingStringForLiteralUseInSQLQueries];
+			NSString *sourceColumnName = [relationship joinTableSourceColumnName];
+			NSString *destinationColumnName = [relationship joinTableDestinationColumnName];
+			
+			//
+			//	Members of a one-to-many relationship can only have one owner, so
+			//	they're taken out of whichever relationship they were in first.
+			//
+			if(relationship.relationshipType == kDKRelationshipTypeOneToMany)
+			{
+				NSString *deleteQueryString = dk_string_from_format(
+					dk_stringify_sql(
+						DELETE FROM %@ WHERE %@ IN (%@)
+					),
+					escapedJoinTableName, destinationColumnName, parameterList
+				);
+				DKCompiledSQLQuery *deleteQuery = [_dk_mDatabase compileSQLQuery:deleteQueryString error:error];
+				if(!deleteQuery)
+					return NO;
+				
+				int parameterIndex = 1;
+				for (NSNumber *uniqueIdentifier in batch)
+					[deleteQuery setLongLong:[uniqueIdentifier longLongValue] forParameterAtIndex:parameterIndex++];
+				
+				if(![deleteQuery evaluateAndReturnError:error])
+					return NO;
+			}
+			
+			//
+			//	Our version of SQLite predates multi-row VALUES, so the
+			//	batch is inserted as a compound SELECT instead.
+			//
+			NSMutableArray *rowSelects = [NSMutableArray arrayWithCapacity:[batch count]];
+			for (NSUInteger index = 0, count = [batch count]; index < count; index++)
+				[rowSelects addObject:@"SELECT ?, ?"];
+			
+			NSString *insertQueryString = dk_string_from_format(
+				dk_stringify_sql(
+					INSERT OR IGNORE INTO %@ (%@, %@) %@
+				),
+				escapedJoinTableName, sourceColumnName, destinationColumnName, [rowSelects componentsJoinedByString:@" UNION ALL "]
+			);
+			DKCompiledSQLQuery *insertQuery = [_dk_mDatabase compileSQLQuery:insertQueryString error:error];
+			if(!insertQuery)
+				return NO;
+			
+			int parameterIndex = 1;
+			for (NSNumber *uniqueIdentifier in batch)
+			{
+				[insertQuery setLongLong:_dk_mUniqueIdentifier forParameterAtIndex:parameterIndex++];
+				[insertQuery setLongLong:[uniqueIdentifier longLongValue] forParameterAtIndex:parameterIndex++];
+			}
+			
+			if(![insertQuery evaluateAndReturnError:error])
+				return NO;
+		}
+		else
+		{
+			NSString *updateQueryString = dk_string_from_format(
+				dk_stringify_sql(
+					UPDATE %@ SET '%@' = ? WHERE _dk_uniqueIdentifier IN (%@)
+				),
+				[relationship.targetTable.name stringByEscapingStringForLiteralUseInSQLQueries], 
+				[relationship.inverseRelationship.name stringByEscapingStringForLiteralUseInSQLQueries], 
+				parameterList
+			);
+			DKCompiledSQLQuery *updateQuery = [_dk_mDatabase compileSQLQuery:updateQueryString error:error];
+			if(!updateQuery)
+				return NO;
+			
+			[updateQuery setLongLong:_dk_mUniqueIdentifier forParameterAtIndex:1];
+			
+			int parameterIndex = 2;
+			for (NSNumber *uniqueIdentifier in batch)
+				[updateQuery setLongLong:[uniqueIdentifier longLongValue] forParameterAtIndex:parameterIndex++];
+			
+			if(![updateQuery evaluateAndReturnError:error])
+				return NO;
+		}
+	}
+	
+	return YES;
+}
+
+- (BOOL)removeMembers:(NSSet *)objects fromRelationship:(DKRelationshipDescription *)relationship error:(NSError **)error
+{
+	NSParameterAssert(objects);
+	NSParameterAssert(relationship);
+	NSAssert([relationship isToMany], @"Relationship %@ is not to-many.", relationship.name);
+	NSAssert([_dk_mDatabase isOnWriterQueue], @"Relationships must be changed on the writer queue.");
+	
+	NSArray *uniqueIdentifiers = DKUniqueIdentifiersOfMembers(objects, relationship.targetTable);
+	NSUInteger numberOfMembers = [uniqueIdentifiers count];
+	for (NSUInteger batchStart = 0; batchStart < numberOfMembers; batchStart += kDKRelationshipMemberBatchSize)
+	{
+		NSArray *batch = [uniqueIdentifiers subarrayWithRange:NSMakeRange(batchStart, MIN(kDKRelationshipMemberBatchSize, numberOfMembers - batchStart))];
+		NSString *parameterList = [NSString SQLParameterListWithCount:[batch count]];
+		
+		//
+		//	Only rows that actually point at us are touched, so removing
+		//	an object that isn't a member doesn't disturb its real owner.
+		//
+		NSString *removeQueryString = nil;
+		if([relationship usesJoinTable])
+		{
+			removeQueryString = dk_string_from_format(
+				dk_stringify_sql(
+					DELETE FROM %@ WHERE (%@ = ?) AND %@ IN (%@)
+				),
+				[[relationship joinTableName] stringByEscapingStringForLiteralUseInSQLQueries], 
+				[relationship joinTableSourceColumnName], 
+				[relationship joinTableDestinationColumnName], 
+				parameterList
+			);
+		}
+		else
+		{
+			NSString *escapedForeignKeyName = [relationship.inverseRelationship.name stringByEscapingStringForLiteralUseInSQLQueries];
+			removeQueryString = dk_string_from_format(
+				dk_stringify_sql(
+					UPDATE %@ SET '%@' = NULL WHERE (%@ = ?) AND _dk_uniqueIdentifier IN (%@)
+				),
+				[relationship.targetTable.name stringByEscapingStringForLiteralUseInSQLQueries], 
+				escapedForeignKeyName, 
+				escapedForeignKeyName, 
+				parameterList
+			);
+		}
+		
+		DKCompiledSQLQuery *removeQuery = [_dk_mDatabase compileSQLQuery:removeQueryString error:error];
+		if(!removeQuery)
+			return NO;
+		
+		[removeQuery setLongLong:_dk_mUniqueIdentifier forParameterAtIndex:1];
+		
+		int parameterIndex = 2;
+		for (NSNumber *uniqueIdentifier in batch)
+			[removeQuery setLongLong:[uniqueIdentifier longLongValue] forParameterAtIndex:parameterIndex++];
+		
+		if(![removeQuery evaluateAndReturnError:error])
+			return NO;
+	}
+	
+	return YES;
+}
+
+#pragma mark -
+
+///Returns the to-many relationship of the receiver's table for a specified key.
+static DKRelationshipDescription *DKManagedObjectToManyRelationship(DKManagedObject *self, NSString *key)
+{
+	DKTableDescription *table = self->_dk_mTableDescription;
+	DKRelationshipDescription *relationship = (DKRelationshipDescription *)[table propertyWithName:key];
+	NSCAssert([relationship isKindOfClass:[DKRelationshipDescription class]] && [relationship isToMany], 
+			  @"No to-many relationship by name %@ exists in the table %@.", key, table.name);
+	
+	return relationship;
+}
+
+- (void)addObjects:(NSSet *)objects toRelationshipNamed:(NSString *)key
+{
+	NSParameterAssert(objects);
+	NSParameterAssert(key);
+	
+	DKRelationshipDescription *relationship = DKManagedObjectToManyRelationship(self, key);
+	
+	NSError *error = nil;
+	BOOL success = [_dk_mDatabase performTransaction:^(NSError **transactionError) {
+		return [self addMembers:objects toRelationship:relationship error:transactionError];
+	} error:&error];
+	NSAssert(success, @"Could not add objects to relationship %@ of %@. Got error %@.", key, self, error);
+}
+
+- (void)removeObjects:(NSSet *)objects fromRelationshipNamed:(NSString *)key
+{
+	NSParameterAssert(objects);
+	NSParameterAssert(key);
+	
+	DKRelationshipDescription *relationship = DKManagedObjectToManyRelationship(self, key);
+	
+	NSError *error = nil;
+	BOOL success = [_dk_mDatabase performTransaction:^(NSError **transactionError) {
+		return [self removeMembers:objects fromRelationship:relationship error:transactionError];
+	} error:&error];
+	NSAssert(success, @"Could not remove objects from relationship %@ of %@. Got error %@.", key, self, error);
+}
+
+#pragma mark -
+
+- (void)setValue:(id)value forColumnNamed:(NSString *)key
+{
+	NSParameterAssert(key);
+	
+	//
+	//	We look up the property associated with key in our table. If we can't find one
+	//	then key isn't a column in the table this database object represents.
+	//
+	DKPropertyDescription *property = [_dk_mTableDescription propertyWithName:key];
+	NSAssert((property != nil), @"No property by name %@ exists in the table %@.", key, _dk_mTableDescription.name);
+	
+	[self setValue:value forProperty:property];
+}
+
+- (NSData *)encodedDataForColumnNamed:(NSString *)key
+{
+	NSParameterAssert(key);
+	
+	DKAttributeDescription *attributeDescription = (DKAttributeDescription *)[_dk_mTableDescription propertyWithName:key];
+	NSAssert([attributeDescription isKindOfClass:[DKAttributeDescription class]], 
+			 @"No attribute by name %@ exists in the table %@.", key, _dk_mTableDescription.name);
+	NSAssert(((attributeDescription.type == DKAttributeTypeObject) || (attributeDescription.type == DKAttributeTypeData)), 
+			 @"Attribute %@ in the table %@ is not encoded.", key, _dk_mTableDescription.name);
+	
+	//
+	//	Unsaved changes have to be encoded, there's no way around that.
+	//
+	id changedValue = [self changedValueForKey:key];
+	if(changedValue)
+	{
+		if(changedValue == [NSNull null])
+			return nil;
+		
+		return [attributeDescription uncompressedDataForEncodedData:[attributeDescription encodedDataForValue:changedValue]];
+	}
+	
+	//
+	//	If the value hasn't been decoded yet we can hand out its data as is.
+	//
+	@synchronized(self)
+	{
+		NSUInteger ordinal = attributeDescription->mOrdinal;
+		if(DKManagedObjectSlotIsLoaded(self, ordinal))
+		{
+			id cachedValue = DKManagedObjectSlotAtOrdinal(self, ordinal)->object;
+			if([cachedValue isKindOfClass:[DKUndecodedValue class]])
+				return [attributeDescription uncompressedDataForEncodedData:((DKUndecodedValue *)cachedValue)->mEncodedData];
+		}
+	}
+	
+	//
+	//	Otherwise we read the column ourselves without caching it,
+	//	since the caller has made it clear they'll decode it.
+	//
+	NSError *error = nil;
+	NSString *selectQueryString = dk_string_from_format(
+		dk_stringify_sql(
+			SELECT %@ FROM %@ WHERE(_dk_uniqueIdentifier = ?)
+		),
+		[key stringByEscapingStringForLiteralUseInSQLQueries], [_dk_mTableDescription.name stringByEscapingStringForLiteralUseInSQLQueries]
+	);
+	DKCompiledSQLQuery *selectQuery = [_dk_mDatabase compileSQLQuery:selectQueryString error:&error];
+	NSAssert((selectQuery != nil), 
+			 @"Could not compile select query. Got error %@.", error);
+	
+	[selectQuery setLongLong:_dk_mUniqueIdentifier forParameterAtIndex:1];
+	
+	NSData *encodedData = nil;
+	if([selectQuery nextRow] && ![selectQuery isNullColumnAtIndex:0])
+		encodedData = [attributeDescription uncompressedDataForEncodedData:[selectQuery dataForColumnAtIndex:0]];
+	
+	[selectQuery reset];
+	
+	return encodedData;
+}
+
+#pragma mark -
+#pragma mark Incremental Data Access
+
+///The size of the chunks values are copied to and from streams in.
+enum {
+	kDKManagedObjectBlobChunkSize = 64 * 1024,
+};
+
+///Returns the attribute for a specified key, checking that its value can be accessed incrementally.
+static DKAttributeDescription *DKManagedObjectIncrementalDataAttribute(DKManagedObject *self, NSString *key)
+{
+	DKTableDescription *table = self->_dk_mTableDescription;
+	DKAttributeDescription *attribute = (DKAttributeDescription *)[table propertyWithName:key];
+	NSCAssert([attribute isKindOfClass:[DKAttributeDescription class]], 
+			  @"No attribute by name %@ exists in the table %@.", key, table.name);
+	NSCAssert((attribute.type == DKAttributeTypeData), 
+			  @"Attribute %@ in the table %@ is not a data attribute.", key, table.name);
+	NSCAssert((attribute.compressionThreshold == 0), 
+			  @"Attribute %@ in the table %@ is compressed and cannot be accessed incrementally.", key, table.name);
+	NSCAssert(([self changedValueForKey:key] == nil), 
+			  @"Attribute %@ of %@ has unsaved changes.", key, self);
+	
+	return attribute;
+}
+
+///Open the value of a specified attribute in an object's row for incremental access through a specified connection. The row's rowid is returned by reference if asked for.
+static sqlite3_blob *DKManagedObjectOpenBlob(DKManagedObject *self, sqlite3 *connection, DKAttributeDescription *attribute, BOOL isWritable, sqlite3_int64 *outRowIdentifier, NSError **error)
+{
+	NSString *tableName = self->_dk_mTableDescription.name;
+	
+	//
+	//	Our unique identifiers are declared BIGINT rather than INTEGER, so they
+	//	aren't aliases of the rowid that SQLite needs here. We look it up first.
+	//
+	NSString *rowidQueryString = dk_string_from_format(
+		dk_stringify_sql(
+			SELECT rowid FROM %@ WHERE(_dk_uniqueIdentifier = ?)
+		),
+		[tableName stringByEscapingStringForLiteralUseInSQLQueries]
+	);
+	DKCompiledSQLQuery *rowidQuery = [self->_dk_mDatabase compileSQLQuery:rowidQueryString error:error];
+	if(!rowidQuery)
+		return NULL;
+	
+	[rowidQuery setLongLong:self->_dk_mUniqueIdentifier forParameterAtIndex:1];
+	if(![rowidQuery nextRow])
+	{
+		[rowidQuery reset];
+		
+		if(error) *error = DKLocalizedError(DKEvaluationErrorDomain, 
+											SQLITE_NOTFOUND, 
+											nil, 
+											@"Missing row", self->_dk_mUniqueIdentifier, tableName);
+		return NULL;
+	}
+	
+	sqlite3_int64 rowid = [rowidQuery longLongForColumnAtIndex:0];
+	[rowidQuery reset];
+	
+	if(outRowIdentifier)
+		*outRowIdentifier = rowid;
+	
+	sqlite3_blob *blob = NULL;
+	SQLiteStatus status = sqlite3_blob_open(connection, //in connection
+											"main", //in databaseName
+											[[tableName stringByEscapingStringForLiteralUseInSQLQueries] UTF8String], //in tableName
+											[[attribute.name stringByEscapingStringForLiteralUseInSQLQueries] UTF8String], //in columnName
+											rowid, //in rowid
+											(isWritable? 1 : 0), //in flags
+											&blob); //out blob
+	if(status != SQLITE_OK)
+	{
+		if(error) *error = DKLocalizedError(DKEvaluationErrorDomain, 
+											status, 
+											nil, 
+											@"Could not open blob", attribute.name, tableName, status, sqlite3_errmsg(connection));
+		return NULL;
+	}
+	
+	return blob;
+}
+
+- (NSUInteger)lengthOfDataForColumnNamed:(NSString *)key
+{
+	NSParameterAssert(key);
+	
+	DKAttributeDescription *attributeDescription = DKManagedObjectIncrementalDataAttribute(self, key);
+	
+	NSError *error = nil;
+	NSString *selectQueryString = dk_string_from_format(
+		dk_stringify_sql(
+			SELECT length(%@) FROM %@ WHERE(_dk_uniqueIdentifier = ?)
+		),
+		[attributeDescription.name stringByEscapingStringForLiteralUseInSQLQueries], [_dk_mTableDescription.name stringByEscapingStringForLiteralUseInSQLQueries]
+	);
+	DKCompiledSQLQuery *selectQuery = [_dk_mDatabase compileSQLQuery:selectQueryString error:&error];
+	NSAssert((selectQuery != nil), 
+			 @"Could not compile select query. Got error %@.", error);
+	
+	[selectQuery setLongLong:_dk_mUniqueIdentifier forParameterAtIndex:1];
+	
+	NSUInteger length = 0;
+	if([selectQuery nextRow])
+		length = (NSUInteger)[selectQuery longLongForColumnAtIndex:0];
+	
+	[selectQuery reset];
+	
+	return length;
+}
+
+- (NSData *)dataForColumnNamed:(NSString *)key range:(NSRange)range error:(NSError **)error
+{
+	NSParameterAssert(key);
+	NSParameterAssert(NSMaxRange(range) <= INT_MAX);
+	
+	DKAttributeDescription *attributeDescription = DKManagedObjectIncrementalDataAttribute(self, key);
 	
-	if(value)
-	{
-		//
-		//	If value isn't nil we set the value of the first column in the query (key)
-		//	based on the type described in the attribute description for the specified key.
-		//
-		switch (attributeDescription.type)
-		{
-			case DKAttributeTypeString:
-				[updateQuery setString:value forParameterAtIndex:1];
-				break;
-				
-			case DKAttributeTypeDate:
-				[updateQuery setDate:value forParameterAtIndex:1];
-				break;
-				
-			case DKAttributeTypeInt8:
-			case DKAttributeTypeInt16:
-			case DKAttributeTypeInt32:
-				[updateQuery setInt:[value intValue] forParameterAtIndex:1];
-				break;
-				
-			case DKAttributeTypeInt64:
-				[updateQuery setLongLong:[value longLongValue] forParameterAtIndex:1];
-				break;
-				
-			case DKAttributeTypeFloat:
-				[updateQuery setDouble:[value doubleValue] forParameterAtIndex:1];
-				break;
-				
-			case DKAttributeTypeData:
-				[updateQuery setData:value forParameterAtIndex:1];
-				break;
-				
-			case DKAttributeTypeObject:
-				[updateQuery setObject:value forParameterAtIndex:1];
-				break;
-				
-			default:
-				//This should never happen, but if it does we just write null.
-				[updateQuery nullifyParameterAtIndex:1];
-				break;
-		}
-	}
-	else
+	sqlite3 *connection = [_dk_mDatabase sqliteConnectionForReadingAndReturnError:error];
+	if(!connection)
+		return nil;
+	
+	sqlite3_blob *blob = DKManagedObjectOpenBlob(self, connection, attributeDescription, NO, NULL, error);
+	if(!blob)
+		return nil;
+	
+	NSMutableData *data = [NSMutableData dataWithLength:range.length];
+	SQLiteStatus status = sqlite3_blob_read(blob, //in blob
+											[data mutableBytes], //out buffer
+											(int)range.length, //in length
+											(int)range.location); //in offset
+	if(status != SQLITE_OK)
 	{
-		[updateQuery nullifyParameterAtIndex:1];
+		if(error) *error = DKLocalizedError(DKEvaluationErrorDomain, 
+											status, 
+											nil, 
+											@"Could not read blob", attributeDescription.name, _dk_mTableDescription.name, status, sqlite3_errmsg(connection));
+		data = nil;
 	}
 	
+	sqlite3_blob_close(blob);
 	
-	//
-	//	This is where the actual update happens. If it doesn't work,
-	//	we fail catastrophically. Because really, who wants to fail nicely.
-	//
-	NSAssert([updateQuery evaluateAndReturnError:&error], 
-			 @"Could not update value for key %@. Got error %@.", attributeDescription.name, error);
+	return data;
 }
 
-- (id)valueForAttribute:(DKAttributeDescription *)attributeDescription
+- (BOOL)setZeroedDataOfLength:(NSUInteger)length forColumnNamed:(NSString *)key error:(NSError **)error
 {
-	NSParameterAssert(attributeDescription);
+	NSParameterAssert(key);
 	
-	NSError *error = nil;
+	//Writes are always made on the database's writer queue.
+	if(![_dk_mDatabase isOnWriterQueue])
+	{
+		return [_dk_mDatabase performWriterBlock:^(NSError **writerError) {
+			return [self setZeroedDataOfLength:length forColumnNamed:key error:writerError];
+		} error:error];
+	}
 	
-	//We escape these values to prevent SQL injection.
-	NSString *escapedAttributeName = [attributeDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
-	NSString *escapedTableName = [_dk_mTableDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
+	DKAttributeDescription *attributeDescription = DKManagedObjectIncrementalDataAttribute(self, key);
 	
 	//
-	//	We create an SQL SELECT query to find the value specified by `key` in
-	//	our row in the database. We find ourselves using our unique identifier.
+	//	zeroblob() doesn't allocate anything, so this is cheap no matter how large the value is.
 	//
-	NSString *selectQueryString = dk_string_from_format(
+	NSString *updateQueryString = dk_string_from_format(
 		dk_stringify_sql(
-			SELECT %@ FROM %@ WHERE(_dk_uniqueIdentifier=%lld)
+			UPDATE %@ SET '%@' = zeroblob(?) WHERE _dk_uniqueIdentifier = ?
 		),
-		escapedAttributeName, escapedTableName, _dk_mUniqueIdentifier
+		[_dk_mTableDescription.name stringByEscapingStringForLiteralUseInSQLQueries], [attributeDescription.name stringByEscapingStringForLiteralUseInSQLQueries]
 	);
+	DKCompiledSQLQuery *updateQuery = [_dk_mDatabase compileSQLQuery:updateQueryString error:error];
+	if(!updateQuery)
+		return NO;
 	
+	[updateQuery setLongLong:length forParameterAtIndex:1];
+	[updateQuery setLongLong:_dk_mUniqueIdentifier forParameterAtIndex:2];
 	
-	//Evaluate the update query.
-	DKCompiledSQLQuery *selectQuery = [_dk_mDatabase compileSQLQuery:selectQueryString error:&error];
-	NSAssert((selectQuery != nil), 
-			 @"Could not compile select query. Got error %@.", error);
+	if(![updateQuery evaluateAndReturnError:error])
+		return NO;
 	
-	//
-	//	The first row of the select query should contain the value specified by `key`.
-	//	If it doesn't its value is nil and we're just going to return that.
-	//
-	if(![selectQuery nextRow])
-		return nil;
+	[self removeCacheForAttribute:attributeDescription];
+	
+	return YES;
+}
+
+- (BOOL)writeData:(NSData *)data atOffset:(NSUInteger)offset forColumnNamed:(NSString *)key error:(NSError **)error
+{
+	NSParameterAssert(data);
+	NSParameterAssert(key);
+	NSParameterAssert((offset + [data length]) <= INT_MAX);
+	
+	//Writes are always made on the database's writer queue.
+	if(![_dk_mDatabase isOnWriterQueue])
+	{
+		return [_dk_mDatabase performWriterBlock:^(NSError **writerError) {
+			return [self writeData:data atOffset:offset forColumnNamed:key error:writerError];
+		} error:error];
+	}
 	
+	DKAttributeDescription *attributeDescription = DKManagedObjectIncrementalDataAttribute(self, key);
+	
+	sqlite3 *connection = _dk_mDatabase.sqliteConnection;
+	sqlite3_int64 rowid = 0;
+	sqlite3_blob *blob = DKManagedObjectOpenBlob(self, connection, attributeDescription, YES, &rowid, error);
+	if(!blob)
+		return NO;
+	
+	SQLiteStatus status = sqlite3_blob_write(blob, //in blob
+											 [data bytes], //in buffer
+											 (int)[data length], //in length
+											 (int)offset); //in offset
 	
 	//
-	//	We convert the returned value from the query to an object using
-	//	the type specified by `attributeDescription` to decide what to create.
+	//	Outside of a transaction the write is committed when the blob is closed,
+	//	so the change has to be noted before then for the commit hook to see it.
 	//
-	id value = nil;
-	switch (attributeDescription.type)
+	if(status == SQLITE_OK)
 	{
-		case DKAttributeTypeString:
-			value = [selectQuery stringForColumnAtIndex:0];
-			break;
-			
-		case DKAttributeTypeDate:
-			value = [selectQuery dateForColumnAtIndex:0];
-			break;
-			
-		case DKAttributeTypeInt8:
-		case DKAttributeTypeInt16:
-		case DKAttributeTypeInt32:
-			value = [NSNumber numberWithInt:[selectQuery intForColumnAtIndex:0]];
-			break;
-			
-		case DKAttributeTypeInt64:
-			value = [NSNumber numberWithLongLong:[selectQuery longLongForColumnAtIndex:0]];
-			break;
-			
-		case DKAttributeTypeFloat:
-			value = [NSNumber numberWithDouble:[selectQuery doubleForColumnAtIndex:0]];
-			break;
-			
-		case DKAttributeTypeData:
-			value = [selectQuery dataForColumnAtIndex:0];
-			break;
-			
-		case DKAttributeTypeObject:
-			value = [selectQuery objectForColumnAtIndex:0];
-			break;
-			
-		default:
-			break;
+		[_dk_mDatabase noteIncrementalWriteToRowWithIdentifier:rowid inTable:_dk_mTableDescription];
+		status = sqlite3_blob_close(blob);
 	}
+	else
+		sqlite3_blob_close(blob);
 	
-	return value;
+	//The cached value (if there is one) is out of date either way.
+	[self removeCacheForAttribute:attributeDescription];
+	
+	if(status != SQLITE_OK)
+	{
+		if(error) *error = DKLocalizedError(DKEvaluationErrorDomain, 
+											status, 
+											nil, 
+											@"Could not write blob", attributeDescription.name, _dk_mTableDescription.name, status, sqlite3_errmsg(connection));
+		return NO;
+	}
+	
+	return YES;
 }
 
 #pragma mark -
 
-- (void)setValue:(id)value forRelationship:(DKRelationshipDescription *)relationshipDescription
+- (BOOL)setDataFromStream:(NSInputStream *)stream length:(NSUInteger)length forColumnNamed:(NSString *)key error:(NSError **)error
 {
-	NSParameterAssert(relationshipDescription);
-	
-	//We only require value to be non-nil if the relationship denotes it.
-	if(relationshipDescription.isRequired)
-		NSParameterAssert(value);
-	
-	NSError *error = nil;
-	DKRelationshipType relationshipType = relationshipDescription.relationshipType;
-	NSString *escapedRelationshipName = [relationshipDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
-	NSString *escapedTableName = [_dk_mTableDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
+	NSParameterAssert(stream);
+	NSParameterAssert(key);
+	NSParameterAssert(length <= INT_MAX);
 	
-	if(relationshipType == kDKRelationshipTypeOneToOne)
-	{
-		if(value)
-			NSAssert([value isKindOfClass:[DKManagedObject class]], 
-					 @"Non-database-object of type %@ given.", NSStringFromClass([value class]));
+	//
+	//	The value is sized up front and then filled in one chunk at a time, so only
+	//	a single chunk is ever in memory. Doing it all in a transaction means a stream
+	//	that fails part of the way through doesn't leave a half written value behind.
+	//
+	return [_dk_mDatabase performTransaction:^(NSError **transactionError) {
+		if(![self setZeroedDataOfLength:length forColumnNamed:key error:transactionError])
+			return NO;
 		
-		DKManagedObject *databaseObject = (DKManagedObject *)value;
+		DKAttributeDescription *attributeDescription = DKManagedObjectIncrementalDataAttribute(self, key);
 		
+		sqlite3 *connection = _dk_mDatabase.sqliteConnection;
+		sqlite3_int64 rowid = 0;
+		sqlite3_blob *blob = DKManagedObjectOpenBlob(self, connection, attributeDescription, YES, &rowid, transactionError);
+		if(!blob)
+			return NO;
 		
-		//
-		//	If we've been given a value we update the relationship with the unique identifier
-		//	of the passed in database object.
-		//
-		//	If we're given nil and the relationship allows NULL values, we update the relationship with NULL.
-		//
-		NSString *updateQueryString = nil;
-		NSString *inverseRelationshipUpdateQueryString = nil;
-		if(value)
+		NSMutableData *buffer = [NSMutableData dataWithLength:kDKManagedObjectBlobChunkSize];
+		NSUInteger offset = 0;
+		BOOL success = YES;
+		while (offset < length)
 		{
-			//
-			//	One-to-one relationships are the simplest of relationships. They are represented in
-			//	the database by a column of type BIGINT. The value of this column is the (database)
-			//	unique identifier of the database value of the column.
-			//
-			updateQueryString = dk_string_from_format(
-				dk_stringify_sql(
-					UPDATE %@ SET '%@' = %lld WHERE _dk_uniqueIdentifier=%lld
-				),
-				escapedTableName, escapedRelationshipName, databaseObject.uniqueIdentifier, _dk_mUniqueIdentifier
-			);
-			
-			
-			//
-			//	If this relationship has an inverse, we also need to update that.
-			//	Bad shit will happen if we don't, afterall.
-			//
-			DKRelationshipDescription *inverseRelationship = relationshipDescription.inverseRelationship;
-			if(inverseRelationship)
+			NSInteger numberOfBytesRead = [stream read:[buffer mutableBytes] maxLength:MIN(kDKManagedObjectBlobChunkSize, length - offset)];
+			if(numberOfBytesRead <= 0)
 			{
-				NSString *escapedInverseTableName = [databaseObject.tableDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
-				NSString *escapedInverseColumnName = [inverseRelationship.name stringByEscapingStringForLiteralUseInSQLQueries];
-				inverseRelationshipUpdateQueryString = dk_string_from_format(
-					dk_stringify_sql(
-						UPDATE %@ SET '%@' = %lld WHERE _dk_uniqueIdentifier=%lld
-					),
-					escapedInverseTableName, escapedInverseColumnName, _dk_mUniqueIdentifier, databaseObject.uniqueIdentifier
-				);
+				//A stream that ends early has no error of its own.
+				if(transactionError) *transactionError = [stream streamError] ?: [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadUnknownError userInfo:nil];
+				success = NO;
+				break;
 			}
-		}
-		else
-		{
-			//
-			//	The update query is simple enough. Really. Its the same as the one above
-			//	only it sets the relationship to NULL instead of a unique identifier.
-			//
-			updateQueryString = dk_string_from_format(
-				dk_stringify_sql(
-					UPDATE %@ SET '%@' = NULL WHERE _dk_uniqueIdentifier=%lld
-				),
-				escapedTableName, escapedRelationshipName, _dk_mUniqueIdentifier
-			);
-			
 			
-			//
-			//	If this relationship has an inverse, we also need to update that.
-			//	Bad shit will happen if we don't, afterall.
-			//
-			DKRelationshipDescription *inverseRelationship = relationshipDescription.inverseRelationship;
-			if(inverseRelationship)
+			SQLiteStatus status = sqlite3_blob_write(blob, //in blob
+													 [buffer bytes], //in buffer
+													 (int)numberOfBytesRead, //in length
+													 (int)offset); //in offset
+			if(status != SQLITE_OK)
 			{
-				//
-				//	Fetch the existing value for the relationship. If one exists
-				//	we need to set its column that tracks us to NULL.
-				//
-				DKManagedObject *existingValue = [self valueForRelationship:relationshipDescription];
-				if(existingValue)
-				{
-					NSString *escapedInverseTableName = [existingValue.tableDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
-					NSString *escapedInverseColumnName = [inverseRelationship.name stringByEscapingStringForLiteralUseInSQLQueries];
-					
-					inverseRelationshipUpdateQueryString = dk_string_from_format(
-						dk_stringify_sql(
-							UPDATE %@ SET '%@' = NULL WHERE _dk_uniqueIdentifier=%lld
-						),
-						escapedInverseTableName, escapedInverseColumnName, existingValue.uniqueIdentifier
-					);
-				}
+				if(transactionError) *transactionError = DKLocalizedError(DKEvaluationErrorDomain, 
+																		  status, 
+																		  nil, 
+																		  @"Could not write blob", attributeDescription.name, _dk_mTableDescription.name, status, sqlite3_errmsg(connection));
+				success = NO;
+				break;
 			}
+			
+			offset += numberOfBytesRead;
 		}
 		
-		//
-		//	Its time to update the relationship column. If this doesn't work the world is going to end.
-		//
-		NSAssert([_dk_mDatabase executeSQLQuery:updateQueryString error:&error],
-				 @"Could not update relationship on object %@ with %@. Got error %@.", self, databaseObject, error);
+		if(success)
+			[_dk_mDatabase noteIncrementalWriteToRowWithIdentifier:rowid inTable:_dk_mTableDescription];
 		
+		sqlite3_blob_close(blob);
 		
-		//
-		//	We only run the inverse relationship update query if there's actually
-		//	an inverse relationship to update.
-		//
-		if(inverseRelationshipUpdateQueryString)
-			NSAssert([_dk_mDatabase executeSQLQuery:inverseRelationshipUpdateQueryString error:&error],
-					 @"Could not update inverse relationship. Got error %@.", error);
-	}
+		return success;
+	} error:error];
 }
 
-- (id)valueForRelationship:(DKRelationshipDescription *)relationshipDescription
+- (BOOL)writeDataForColumnNamed:(NSString *)key toStream:(NSOutputStream *)stream error:(NSError **)error
 {
-	NSParameterAssert(relationshipDescription);
+	NSParameterAssert(key);
+	NSParameterAssert(stream);
 	
-	NSError *error = nil;
-	DKRelationshipType relationshipType = relationshipDescription.relationshipType;
-	NSString *escapedRelationshipName = [relationshipDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
-	NSString *escapedTableName = [_dk_mTableDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
+	DKAttributeDescription *attributeDescription = DKManagedObjectIncrementalDataAttribute(self, key);
 	
-	if(relationshipType == kDKRelationshipTypeOneToOne)
+	//NULL columns can't be opened, but they don't have anything to write either.
+	if([self lengthOfDataForColumnNamed:key] == 0)
+		return YES;
+	
+	sqlite3 *connection = [_dk_mDatabase sqliteConnectionForReadingAndReturnError:error];
+	if(!connection)
+		return NO;
+	
+	sqlite3_blob *blob = DKManagedObjectOpenBlob(self, connection, attributeDescription, NO, NULL, error);
+	if(!blob)
+		return NO;
+	
+	NSMutableData *buffer = [NSMutableData dataWithLength:kDKManagedObjectBlobChunkSize];
+	int length = sqlite3_blob_bytes(blob);
+	int offset = 0;
+	BOOL success = YES;
+	while (success && (offset < length))
 	{
-		//
-		//	Look up the unique identifier of the value associated with this relationship.
-		//
-		NSString *selectQueryString = dk_string_from_format(
-			dk_stringify_sql(
-				SELECT %@ FROM %@ WHERE _dk_uniqueIdentifier=%lld
-			),
-			escapedRelationshipName, escapedTableName, _dk_mUniqueIdentifier
-		);
-		
-		
-		DKCompiledSQLQuery *selectQuery = [_dk_mDatabase compileSQLQuery:selectQueryString error:&error];
-		NSAssert((selectQuery != nil), 
-				 @"Could not select one-to-one relationship identifier. Got error %@.", error);
-		
+		int chunkLength = MIN(kDKManagedObjectBlobChunkSize, length - offset);
+		SQLiteStatus status = sqlite3_blob_read(blob, //in blob
+												[buffer mutableBytes], //out buffer
+												chunkLength, //in length
+												offset); //in offset
+		if(status != SQLITE_OK)
+		{
+			if(error) *error = DKLocalizedError(DKEvaluationErrorDomain, 
+												status, 
+												nil, 
+												@"Could not read blob", attributeDescription.name, _dk_mTableDescription.name, status, sqlite3_errmsg(connection));
+			success = NO;
+			break;
+		}
 		
-		if([selectQuery nextRow])
+		//Streams are free to accept less than they're given.
+		const uint8_t *chunkBytes = [buffer bytes];
+		NSInteger numberOfBytesWritten = 0;
+		while (numberOfBytesWritten < chunkLength)
 		{
-			//
-			//	If the resultant unique identifier is 0, it is assumed this means NULL in the database.
-			//
-			int64_t relationshipResultUniqueIdentifier = [selectQuery longLongForColumnAtIndex:0];
-			if(relationshipResultUniqueIdentifier == 0)
-				return nil;
+			NSInteger result = [stream write:(chunkBytes + numberOfBytesWritten) maxLength:(chunkLength - numberOfBytesWritten)];
+			if(result <= 0)
+			{
+				if(error) *error = [stream streamError] ?: [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:nil];
+				success = NO;
+				break;
+			}
 			
-			return [_dk_mDatabase databaseObjectInTable:relationshipDescription.targetTable 
-								   withUniqueIdentifier:relationshipResultUniqueIdentifier];
+			numberOfBytesWritten += result;
 		}
+		
+		offset += chunkLength;
 	}
 	
-	return nil;
+	sqlite3_blob_close(blob);
+	
+	return success;
 }
 
 #pragma mark -
 
-- (void)setValue:(id)value forColumnNamed:(NSString *)key
+- (id)valueForColumnNamed:(NSString *)key
 {
 	NSParameterAssert(key);
 	
@@ -546,18 +1955,36 @@ static id _DKManagedObject_GetCallback(DKManagedObject *self, SEL _cmd)
 	DKPropertyDescription *property = [_dk_mTableDescription propertyWithName:key];
 	NSAssert((property != nil), @"No property by name %@ exists in the table %@.", key, _dk_mTableDescription.name);
 	
+	return [self valueForProperty:property];
+}
+
+#pragma mark -
+
+- (void)setValue:(id)value forProperty:(DKPropertyDescription *)property
+{
+	NSParameterAssert(property);
+	NSAssert(!_dk_mIsDeleted, @"Attempting to change %@ after its row was deleted.", self);
+	
+	//The database's eviction sweep passes over objects that have been used since it last looked.
+	_dk_mWasRecentlyUsed = YES;
+	
 	if([property isKindOfClass:[DKAttributeDescription class]])
 	{
 		DKAttributeDescription *attributeDescription = (DKAttributeDescription *)property;
-		[self setValue:value forAttribute:attributeDescription];
 		
 		//
-		//	Update the cache. This allows for faster access times.
+		//	When the database is deferring changes we only note the new value.
+		//	It will be written along with the rest of our changes on the next save.
 		//
-		if(value)
-			[self cacheValue:value forKey:key];
+		if(_dk_mDatabase.defersChangesUntilSave)
+			[self recordChangedValue:value forAttribute:attributeDescription];
 		else
-			[self removeCacheForKey:key];
+			[self setValue:value forAttribute:attributeDescription];
+		
+		//
+		//	Update the cache. This allows for faster access times.
+		//
+		[self cacheValue:value forAttribute:attributeDescription];
 	}
 	else if([property isKindOfClass:[DKRelationshipDescription class]])
 	{
@@ -566,40 +1993,42 @@ static id _DKManagedObject_GetCallback(DKManagedObject *self, SEL _cmd)
 	}
 }
 
-- (id)valueForColumnNamed:(NSString *)key
+- (id)valueForProperty:(DKPropertyDescription *)property
 {
-	NSParameterAssert(key);
+	NSParameterAssert(property);
 	
-	//
-	//	We first attempt to find a cached value for key. This will
-	//	potentially save us quite a bit of time, especially if there
-	//	are a lot of pending operations in the transaction queue.
-	//
-	id cachedValue = [self cachedValueForKey:key];
-	if(cachedValue)
-		return cachedValue;
+	//There's nothing left to read.
+	if(_dk_mIsDeleted)
+		return nil;
 	
+	_dk_mWasRecentlyUsed = YES;
 	
 	//
-	//	We look up the property associated with key in our table. If we can't find one
-	//	then key isn't a column in the table this database object represents.
+	//	Unsaved changes take precedence over everything else.
 	//
-	DKPropertyDescription *property = [_dk_mTableDescription propertyWithName:key];
-	NSAssert((property != nil), @"No property by name %@ exists in the table %@.", key, _dk_mTableDescription.name);
+	id changedValue = [self changedValueForKey:property.name];
+	if(changedValue)
+		return (changedValue == [NSNull null])? nil : changedValue;
 	
 	if([property isKindOfClass:[DKAttributeDescription class]])
 	{
 		DKAttributeDescription *attributeDescription = (DKAttributeDescription *)property;
 		
+		//
+		//	We first attempt to find a cached value for the attribute. This will
+		//	potentially save us quite a bit of time, especially if there are a
+		//	lot of pending operations in the transaction queue.
+		//
+		id cachedValue = [self cachedValueForAttribute:attributeDescription];
+		if(cachedValue)
+			return cachedValue;
+		
 		id result = [self valueForAttribute:attributeDescription];
 		
 		//
 		//	Update the cache. This allows for faster access times.
 		//
-		if(result)
-			[self cacheValue:result forKey:key];
-		else
-			[self removeCacheForKey:key];
+		[self cacheValue:result forAttribute:attributeDescription];
 		
 		return result;
 	}
@@ -629,46 +2058,30 @@ static id _DKManagedObject_GetCallback(DKManagedObject *self, SEL _cmd)
 
 - (void)prepareForDeletion
 {
-	NSError *error = nil;
-	
 	for (DKPropertyDescription *property in _dk_mTableDescription.properties)
 	{
 		if(![property isKindOfClass:[DKRelationshipDescription class]])
 			continue;
 		
 		//
-		//	Destroy any remnants of this values relationships. We don't want
-		//	the database to become corrupted with stale references.
+		//	The objects at the other ends of cascading relationships are deleted along
+		//	with us. Everything else that refers to our row is nullified by the database
+		//	once we return, so we don't have to worry about stale references.
 		//
 		DKRelationshipDescription *relationship = (DKRelationshipDescription *)property;
-		DKRelationshipDescription *inverseRelationship = relationship.inverseRelationship;
-		if(inverseRelationship)
+		if(relationship.deleteAction != kDKRelationshipDeleteActionActionCascade)
+			continue;
+		
+		id value = [self valueForRelationship:relationship];
+		if([relationship isToMany])
 		{
-			DKManagedObject *existingValue = [self valueForRelationship:relationship];
-			if(existingValue)
-			{
-				DKRelationshipDeleteAction deleteAction = relationship.deleteAction;
-				if(deleteAction == kDKRelationshipDeleteActionActionNullify)
-				{
-					NSString *escapedInverseTableName = [existingValue.tableDescription.name stringByEscapingStringForLiteralUseInSQLQueries];
-					NSString *escapedInverseColumnName = [inverseRelationship.name stringByEscapingStringForLiteralUseInSQLQueries];
-					
-					NSString *inverseRelationshipUpdateQueryString = dk_string_from_format(
-						dk_stringify_sql(
-							UPDATE %@ SET '%@' = NULL WHERE _dk_uniqueIdentifier=%lld
-						),
-						escapedInverseTableName, escapedInverseColumnName, existingValue.uniqueIdentifier
-					);
-					NSLog(@"inverseRelationshipUpdateQueryString = %@", inverseRelationshipUpdateQueryString);
-					
-					NSAssert([_dk_mDatabase executeSQLQuery:inverseRelationshipUpdateQueryString error:&error],
-							 @"Could not nullify relationship. Got error %@.", error);
-				}
-				else if(deleteAction == kDKRelationshipDeleteActionActionCascade)
-				{
-					/* TODO: Implement cascade deletions */
-				}
-			}
+			//The set reads from the database, so we copy its members before deleting any of them.
+			for (DKManagedObject *member in [value allObjects])
+				[_dk_mDatabase deleteObject:member];
+		}
+		else if(value)
+		{
+			[_dk_mDatabase deleteObject:value];
 		}
 	}
 }
@@ -692,19 +2105,45 @@ static id _DKManagedObject_GetCallback(DKManagedObject *self, SEL _cmd)
 	return [super valueForUndefinedKey:key];
 }
 
+- (void)setNilValueForKey:(NSString *)key
+{
+	//
+	//	Numeric attributes have scalar mutators, so KVC hands
+	//	us nil for them here instead of calling the mutator.
+	//
+	if([_dk_mTableDescription propertyWithName:key])
+		[self setValue:nil forColumnNamed:key];
+	else
+		[super setNilValueForKey:key];
+}
+
 #pragma mark -
 
 - (NSString *)description
 {
 	/* <DKManagedObject:0x00000000 ([promise, ]UID: 0, table: Test, key: value, ...)> */
-	NSMutableString *description = [NSMutableString stringWithFormat:@"<%@:%p (%@UID: %lld, table: %@", [self className], self, ([_dk_mCachedValues count] == 0)? @"promise, " : @"", _dk_mUniqueIdentifier, _dk_mTableDescription.name];
-	
-	[_dk_mCachedValues enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
-		[description appendFormat:@", %@: %@", key, value];
-	}];
-	[description appendString:@")>"];
+	NSMutableString *cachedValuesDescription = [NSMutableString string];
+	@synchronized(self)
+	{
+		for (DKAttributeDescription *attribute in _dk_mTableDescription.attributes)
+		{
+			if(!DKManagedObjectSlotIsLoaded(self, attribute->mOrdinal))
+				continue;
+			
+			//Describing an object shouldn't have the side effect of decoding its values.
+			id slotObject = DKManagedObjectSlotAtOrdinal(self, attribute->mOrdinal)->object;
+			if(((attribute->type == DKAttributeTypeData) || (attribute->type == DKAttributeTypeObject)) && 
+			   [slotObject isKindOfClass:[DKUndecodedValue class]])
+			{
+				[cachedValuesDescription appendFormat:@", %@: <%lu encoded bytes>", attribute.name, (unsigned long)[((DKUndecodedValue *)slotObject)->mEncodedData length]];
+				continue;
+			}
+			
+			[cachedValuesDescription appendFormat:@", %@: %@", attribute.name, DKManagedObjectValueInSlot(self, attribute)];
+		}
+	}
 	
-	return description;
+	return [NSString stringWithFormat:@"<%@:%p (%@UID: %lld, table: %@%@)>", [self className], self, ([cachedValuesDescription length] == 0)? @"promise, " : @"", _dk_mUniqueIdentifier, _dk_mTableDescription.name, cachedValuesDescription];
 }
 
 @end
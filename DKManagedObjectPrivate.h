@@ -10,7 +10,7 @@
 #import <Cocoa/Cocoa.h>
 #import "DKManagedObject.h"
 
-@class DKPropertyDescription, DKAttributeDescription, DKRelationshipDescription;
+@class DKPropertyDescription, DKAttributeDescription, DKRelationshipDescription, DKCompiledSQLQuery;
 
 //! @abstract	The private interface continuation for DKManagedObject.
 @interface DKManagedObject () //Continuation
@@ -23,6 +23,9 @@
  @param			property	The property to generate an accessor/mutator pair for. May not be nil.
  @discussion	This method will not replace existing accessors/mutators whose names match those
 				of the specified property.
+				
+				Integer attributes get an accessor/mutator pair taking and returning int64_t, and float
+				attributes get a pair taking and returning double. Everything else uses objects.
  */
 + (void)addAccessorMutatorPairForProperty:(DKPropertyDescription *)property;
 
@@ -64,6 +67,56 @@
 - (void)setValue:(id)value forRelationship:(DKRelationshipDescription *)relationshipDescription;
 - (id)valueForRelationship:(DKRelationshipDescription *)relationshipDescription;
 
+/*!
+ @method
+ @abstract	Read the members of a specified to-many relationship of the receiver with a single query.
+ @param		relationship	The to-many relationship to read. May not be nil.
+ @result	A set of database objects.
+ */
+- (NSSet *)membersOfRelationship:(DKRelationshipDescription *)relationship;
+
+/*!
+ @method
+ @abstract		Add a set of objects to a specified to-many relationship of the receiver.
+ @param			objects			The database objects to add. May not be nil.
+ @param			relationship	The to-many relationship. May not be nil.
+ @param			error			If the objects cannot be added, on return this will contain an error. May be nil.
+ @result		YES if the objects were added; NO otherwise.
+ @discussion	This method must be invoked inside of a transaction on the writer queue. The objects are added
+				a batch at a time rather than one row at a time. Objects added to a one-to-many relationship
+				are taken out of the relationship they were in before.
+ */
+- (BOOL)addMembers:(NSSet *)objects toRelationship:(DKRelationshipDescription *)relationship error:(NSError **)error;
+
+/*!
+ @method
+ @abstract		Remove a set of objects from a specified to-many relationship of the receiver.
+ @param			objects			The database objects to remove. May not be nil.
+ @param			relationship	The to-many relationship. May not be nil.
+ @param			error			If the objects cannot be removed, on return this will contain an error. May be nil.
+ @result		YES if the objects were removed; NO otherwise.
+ @discussion	This method must be invoked inside of a transaction on the writer queue. The objects are removed a batch at a time.
+ */
+- (BOOL)removeMembers:(NSSet *)objects fromRelationship:(DKRelationshipDescription *)relationship error:(NSError **)error;
+
+#pragma mark -
+
+/*!
+ @method
+ @abstract	Set the value of a specified property of the receiver's table.
+ @param		value		The value to set. May be nil.
+ @param		property	The attribute or relationship to assign the value to. May not be nil.
+ */
+- (void)setValue:(id)value forProperty:(DKPropertyDescription *)property;
+
+/*!
+ @method
+ @abstract	Get the value of a specified property of the receiver's table.
+ @param		property	The attribute or relationship to look up the value of. May not be nil.
+ @result	The value of the property. This may be nil.
+ */
+- (id)valueForProperty:(DKPropertyDescription *)property;
+
 #pragma mark -
 #pragma mark Properties
 
@@ -74,40 +127,113 @@
 
 /*!
  @method
- @abstract	Cache the value for a specified key for later access.
- @param		value	The value to cache. May not be nil.
- @param		key		The key of the value. May not be nil. Will be copied.
+ @abstract		Cache the value for a specified attribute for later access.
+ @param			value		The value to cache. May be nil, in which case the attribute's cache is removed.
+ @param			attribute	The attribute of the value. May not be nil. Must belong to the receiver's table.
+ @discussion	Values are kept in a slot indexed by the attribute's ordinal. Numeric attributes are stored
+				as plain integers and doubles rather than as NSNumbers.
  */
-- (void)cacheValue:(id)value forKey:(NSString *)key;
+- (void)cacheValue:(id)value forAttribute:(DKAttributeDescription *)attribute;
 
 /*!
  @method
- @abstract	Look up the cached value associated with a specified key.
- @param		key		The key of the value to look up. May not be nil.
- @result	The value associated with the specified key if it is cached; nil otherwise.
+ @abstract	Look up the cached value of a specified attribute.
+ @param		attribute	The attribute of the value to look up. May not be nil. Must belong to the receiver's table.
+ @result	The cached value of the attribute if it is cached; nil otherwise.
  */
-- (id)cachedValueForKey:(NSString *)key;
+- (id)cachedValueForAttribute:(DKAttributeDescription *)attribute;
 
 /*!
  @method
- @abstract		Cache the values of all of the receiver's columns specified by its table description.
- @discussion	This method is used to implement fetching of objects as non-promises.
+ @abstract		Cache the values of all of the receiver's attributes specified by its table description.
+ @discussion	All of the attributes are read with a single query.
  */
 - (void)cacheAllColumnsInTable;
 
+/*!
+ @method
+ @abstract		Cache the values of a specified list of attributes from the current row of a query.
+ @param			attributes		The attributes to cache, in the order they appear in the query's columns. May not be nil.
+ @param			query			A query positioned on the row that this object represents. May not be nil.
+ @param			columnIndex		The index of the column containing the first attribute's value.
+ @discussion	This method is used to implement fetching of objects as non-promises.
+ */
+- (void)cacheAttributes:(NSArray *)attributes fromRowOfQuery:(DKCompiledSQLQuery *)query startingAtColumnIndex:(int)columnIndex;
+
+/*!
+ @method
+ @abstract		Cache the objects at the other end of a specified relationship of the receiver.
+ @param			objects			The related objects. May not be nil. Must contain at most one object for a one-to-one relationship.
+ @param			relationship	The relationship the objects belong to. May not be nil. Must belong to the receiver's table.
+ @param			generation		The relationship generation of the receiver's database from before the objects were read.
+ @discussion	This method is used to implement relationship prefetching. The cache is ignored once the
+				database's relationship generation no longer matches the one it was made with.
+ */
+- (void)cacheRelatedObjects:(NSArray *)objects forRelationship:(DKRelationshipDescription *)relationship generation:(int32_t)generation;
+
 #pragma mark -
 
 /*!
  @method
- @abstract		Remove the cached value associated with a specified key.
- @param			key		The key of the value whose cache is to be removed. May not be nil.
- @discussion	This method does nothing if there is no cache for the value specified by the key.
+ @abstract		Remove the cached value of a specified attribute.
+ @param			attribute	The attribute whose cache is to be removed. May not be nil.
+ @discussion	This method does nothing if there is no cache for the attribute.
  */
-- (void)removeCacheForKey:(NSString *)key;
+- (void)removeCacheForAttribute:(DKAttributeDescription *)attribute;
 
 /*!
  @method
  @abstract	Invalidate a database object's internal cache.
  */
 - (void)invalidateCache;
+
+/*!
+ @method
+ @abstract		Note that the receiver's row has been deleted.
+ @discussion	The receiver's cached values and unsaved changes are thrown away, and from then on its values
+				read as nil. This must be invoked before the receiver's database gives up its reference to it.
+ */
+- (void)markDeleted;
+
+#pragma mark -
+#pragma mark Change Tracking
+
+/*!
+ @method
+ @abstract	Note a new value for a specified attribute to be written on the next save.
+ @param		value					The new value. May be nil.
+ @param		attributeDescription	The attribute the value belongs to. May not be nil.
+ */
+- (void)recordChangedValue:(id)value forAttribute:(DKAttributeDescription *)attributeDescription;
+
+/*!
+ @method
+ @abstract	Look up the unsaved value for a specified key.
+ @result	The unsaved value, NSNull if the column is to be cleared, or nil if the column is unchanged.
+ */
+- (id)changedValueForKey:(NSString *)key;
+
+/*!
+ @method
+ @abstract	Remove and return the receiver's unsaved changes.
+ @result	A dictionary of column names to values; nil if the receiver has no changes.
+ */
+- (NSDictionary *)takeChangedValues;
+
+/*!
+ @method
+ @abstract		Put back changes that were taken but could not be saved.
+ @param			changedValues	The changes to restore. May not be nil.
+ @discussion	Columns that were changed again in the meantime keep their newer values.
+ */
+- (void)restoreChangedValues:(NSDictionary *)changedValues;
+
+/*!
+ @method
+ @abstract	Write a set of changes to the receiver's row with a single UPDATE.
+ @param		changedValues	A dictionary of column names to values. May not be nil.
+ @param		error			If the update fails, on return this will contain an error. May be nil.
+ @result	YES if the changes were written; NO otherwise.
+ */
+- (BOOL)writeChangedValues:(NSDictionary *)changedValues error:(NSError **)error;
 @end
@@ -0,0 +1,48 @@
+//
+//  DKRelationshipSet.h
+//  DatabaseKit
+//
+//  Created by agent on 10/17/26.
+//  Copyright 2026 Roundabout Software. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+@class DKManagedObject, DKRelationshipDescription;
+
+/*!
+ @class
+ @abstract		This class is used to represent the value of a to-many relationship.
+ @discussion	The members of a relationship set are read with a single query the first time the set
+				is asked about them, and are not read again. Changes made to the relationship before
+				that first read are reflected in the set, changes made after it are not.
+ */
+@interface DKRelationshipSet : NSSet
+{
+	/* owner */	DKManagedObject *mObject;
+	/* weak */	DKRelationshipDescription *mRelationship;
+	/* owner */	NSSet *mMembers;
+}
+/*!
+ @method
+ @abstract	Initialize a relationship set whose members are read the first time they are needed.
+ @param		object			The object the relationship belongs to. May not be nil.
+ @param		relationship	The to-many relationship. May not be nil.
+ */
+- (id)initWithObject:(DKManagedObject *)object relationship:(DKRelationshipDescription *)relationship;
+
+/*!
+ @method
+ @abstract	Initialize a relationship set whose members have already been read.
+ @param		object			The object the relationship belongs to. May not be nil.
+ @param		relationship	The to-many relationship. May not be nil.
+ @param		members			The members of the relationship. May be nil, in which case they are read when first needed.
+ */
+- (id)initWithObject:(DKManagedObject *)object relationship:(DKRelationshipDescription *)relationship members:(NSSet *)members;
+
+/*!
+ @property
+ @abstract	Whether or not the receiver has read its members.
+ */
+@property (readonly) BOOL isLoaded;
+@end
@@ -0,0 +1,106 @@
+//
+//  DKRelationshipSet.m
+//  DatabaseKit
+//
+//  Created by agent on 10/17/26.
+//  Copyright 2026 Roundabout Software. All rights reserved.
+//
+
+#import "DKRelationshipSet.h"
+#import "DKManagedObject.h"
+#import "DKManagedObjectPrivate.h"
+
+@implementation DKRelationshipSet
+
+#pragma mark Destruction
+
+- (void)dealloc
+{
+	[mObject release];
+	mObject = nil;
+	
+	mRelationship = nil;
+	
+	[mMembers release];
+	mMembers = nil;
+	
+	[super dealloc];
+}
+
+#pragma mark -
+#pragma mark Construction
+
+- (id)initWithObject:(DKManagedObject *)object relationship:(DKRelationshipDescription *)relationship
+{
+	return [self initWithObject:object relationship:relationship members:nil];
+}
+
+- (id)initWithObject:(DKManagedObject *)object relationship:(DKRelationshipDescription *)relationship members:(NSSet *)members
+{
+	NSParameterAssert(object);
+	NSParameterAssert(relationship);
+	
+	if((self = [super init]))
+	{
+		mObject = [object retain];
+		mRelationship = relationship;
+		mMembers = [members copy];
+		
+		return self;
+	}
+	return nil;
+}
+
+#pragma mark -
+#pragma mark Members
+
+///Returns the receiver's members, reading them if they haven't been read yet.
+- (NSSet *)members
+{
+	@synchronized(self)
+	{
+		if(!mMembers)
+			mMembers = [[mObject membersOfRelationship:mRelationship] copy];
+		
+		return mMembers;
+	}
+}
+
+@dynamic isLoaded;
+- (BOOL)isLoaded
+{
+	@synchronized(self)
+	{
+		return (mMembers != nil);
+	}
+}
+
+#pragma mark -
+#pragma mark NSSet Primitives
+
+- (NSUInteger)count
+{
+	return [[self members] count];
+}
+
+- (id)member:(id)object
+{
+	return [[self members] member:object];
+}
+
+- (NSEnumerator *)objectEnumerator
+{
+	return [[self members] objectEnumerator];
+}
+
+- (NSUInteger)countByEnumeratingWithState:(NSFastEnumerationState *)state objects:(id *)stackbuf count:(NSUInteger)length
+{
+	return [[self members] countByEnumeratingWithState:state objects:stackbuf count:length];
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+	return [[self members] copyWithZone:zone];
+}
+
+@end
@@ -8,7 +8,7 @@
 
 #import <Cocoa/Cocoa.h>
 
-@class DKPropertyDescription;
+@class DKPropertyDescription, DKIndexDescription;
 
 /*!
  @class
@@ -16,9 +16,16 @@
  */
 @interface DKTableDescription : NSObject
 {
+@package
 	/* owner */	NSString *mName;
 	/* weak */	Class mDatabaseObjectClass;
 	/* owner */	NSArray *mProperties;
+	/* owner */	NSArray *mAttributes;
+	/* owner */	NSString *mEscapedAttributeColumnList;
+	/* owner */	NSArray *mIndexes;
+	/* n/a */	NSUInteger mNumberOfProperties;
+	/* owner */	NSDictionary *mPropertiesByName;
+	/* owner */	NSMapTable *mPropertiesBySelector;
 }
 /*!
  @method
@@ -26,6 +33,15 @@
  */
 - (id)initWithName:(NSString *)name databaseObjectClass:(Class)databaseObjectClass properties:(NSArray *)properties;
 
+/*!
+ @method
+ @abstract		Initialize a table description with a name, database object class, an array of DK*Description objects, and an array of indexes.
+ @param			indexes		An array of DKIndexDescription objects describing the composite indexes of the table. May be nil.
+ @discussion	Single column indexes are better declared with DKAttributeDescription's isIndexed and isUnique.
+				One-to-one relationship columns are always indexed.
+ */
+- (id)initWithName:(NSString *)name databaseObjectClass:(Class)databaseObjectClass properties:(NSArray *)properties indexes:(NSArray *)indexes;
+
 /*!
  @property
  @abstract	The table's name.
@@ -44,11 +60,24 @@
  */
 @property (readonly) NSArray *properties;
 
+/*!
+ @property
+ @abstract	The DKAttributeDescription objects in the receiver's properties, in the order they appear there.
+ */
+@property (readonly) NSArray *attributes;
+
+/*!
+ @property
+ @abstract	The DKIndexDescription objects declared for the table.
+ */
+@property (readonly) NSArray *indexes;
+
 /*!
  @method
- @abstract	Look up a property by a specified name in the receiver's properties.
- @param		name	The name of the property to look up. May not be nil.
- @result	The first property found with `name`.
+ @abstract		Look up a property by a specified name in the receiver's properties.
+ @param			name	The name of the property to look up. May not be nil.
+ @result		The first property found with `name`.
+ @discussion	Properties are looked up in a hash table built when the receiver is initialized.
  */
 - (DKPropertyDescription *)propertyWithName:(NSString *)name;
 @end
@@ -61,8 +90,11 @@
  */
 @interface DKPropertyDescription : NSObject
 {
+@package
 	NSString *mName;
 	BOOL mIsRequired;
+	NSUInteger mOrdinal;
+	/* weak */	DKTableDescription *mTable;
 }
 
 /*!
@@ -77,6 +109,20 @@
  */
 @property BOOL isRequired;
 
+/*!
+ @property
+ @abstract		The position of the property in the properties of the table description it belongs to.
+ @discussion	This is assigned by DKTableDescription, so a property description may only belong to one table.
+ */
+@property (readonly) NSUInteger ordinal;
+
+/*!
+ @property
+ @abstract		The table description the property belongs to.
+ @discussion	This is assigned by DKTableDescription. It is not retained.
+ */
+@property (readonly) DKTableDescription *table;
+
 @end
 
 #pragma mark -
@@ -160,6 +206,56 @@ DK_EXTERN NSString *DKAttributeTypeToSQLiteType(DKAttributeType attributeType);
 
 #pragma mark -
 
+typedef enum _DKAttributeCodec {
+	/*!
+	 @enum		DKAttributeCodec
+	 @abstract	This enum is used to describe how the values of DKAttributeTypeObject attributes are stored.
+	 */
+	
+	/*!
+	 @constant	kDKAttributeCodecKeyedArchive
+	 @abstract	Values are stored with NSKeyedArchiver. This works for any object conforming to NSCoding, but is slow.
+	 */
+	kDKAttributeCodecKeyedArchive = 0,
+	
+	/*!
+	 @constant	kDKAttributeCodecPropertyList
+	 @abstract	Values are stored as binary property lists. Values must be property list objects.
+	 */
+	kDKAttributeCodecPropertyList,
+	
+	/*!
+	 @constant	kDKAttributeCodecCustom
+	 @abstract	Values are stored using their implementation of the DKCoding protocol.
+	 */
+	kDKAttributeCodecCustom,
+} DKAttributeCodec;
+
+/*!
+ @protocol
+ @abstract		Objects that implement this protocol can store themselves with their own hand written encoding.
+ @discussion	Attributes using kDKAttributeCodecCustom decode their values with their valueClass.
+ */
+@protocol DKCoding < NSObject >
+
+/*!
+ @method
+ @abstract	Get the data the receiver is stored as.
+ */
+- (NSData *)databaseRepresentation;
+
+/*!
+ @method
+ @abstract	Create an object from the data it was stored as.
+ @param		data	Data previously returned by databaseRepresentation. May not be nil.
+ @result	An autoreleased object; nil if the data cannot be decoded.
+ */
++ (id)objectWithDatabaseRepresentation:(NSData *)data;
+
+@end
+
+#pragma mark -
+
 /*!
  @class
  @abstract	This class is used to represent attributes in DatabaseKit.
@@ -171,6 +267,11 @@ DK_EXTERN NSString *DKAttributeTypeToSQLiteType(DKAttributeType attributeType);
 	/* owner */	NSNumber *minimumValue;
 	/* owner */	NSNumber *maximumValue;
 	/* owner */	id defaultValue;
+	/* n/a */	BOOL isIndexed;
+	/* n/a */	BOOL isUnique;
+	/* n/a */	DKAttributeCodec codec;
+	/* weak */	Class valueClass;
+	/* n/a */	NSUInteger compressionThreshold;
 }
 /*!
  @method
@@ -209,13 +310,72 @@ DK_EXTERN NSString *DKAttributeTypeToSQLiteType(DKAttributeType attributeType);
  @discussion	A default value can only be given to numbers and strings.
  */
 @property (retain) id defaultValue;
+
+/*!
+ @property
+ @abstract	Whether or not the attribute's column should be indexed.
+ */
+@property BOOL isIndexed;
+
+/*!
+ @property
+ @abstract		Whether or not the attribute's value must be unique within its table.
+ @discussion	Unique attributes are always indexed.
+ */
+@property BOOL isUnique;
+
+/*!
+ @property
+ @abstract		How the attribute's values are stored.
+ @discussion	This only applies to attributes of DKAttributeTypeObject. The default is kDKAttributeCodecKeyedArchive.
+				Changing the codec of an attribute that already has values stored makes those values unreadable.
+ */
+@property DKAttributeCodec codec;
+
+/*!
+ @property
+ @abstract	The class conforming to DKCoding used to decode the attribute's values when its codec is kDKAttributeCodecCustom.
+ */
+@property (assign) Class valueClass;
+
+/*!
+ @property
+ @abstract		The size in bytes at which the attribute's encoded values are compressed.
+ @discussion	The default value is 0, which disables compression. Only applies to attributes of DKAttributeTypeData
+				and DKAttributeTypeObject. Values are only decompressed while compression is enabled, so values
+				stored without it are always read back as they were written. Once values have been stored with
+				compression enabled the threshold can be changed freely, but should not be set back to 0.
+ */
+@property NSUInteger compressionThreshold;
 @end
 
 #pragma mark -
 
 typedef enum _DKRelationshipType {
+	/*!
+	 @enum		DKRelationshipType
+	 @abstract	This enum is used to describe how many objects are on each end of a relationship.
+	 */
+	
+	/*!
+	 @constant	kDKRelationshipTypeOneToOne
+	 @abstract	The relationship's value is a single object, stored in an indexed column of the relationship's table.
+	 */
 	kDKRelationshipTypeOneToOne = 0,
+	
+	/*!
+	 @constant		kDKRelationshipTypeOneToMany
+	 @abstract		The relationship's value is a set of objects that each belong to one object.
+	 @discussion	If the inverse relationship is one-to-one its column in the target table is used as a
+					foreign key. Otherwise the relationship is stored in a join table of its own.
+	 */
 	kDKRelationshipTypeOneToMany,
+	
+	/*!
+	 @constant		kDKRelationshipTypeManyToMany
+	 @abstract		The relationship's value is a set of objects that can belong to any number of objects.
+	 @discussion	The relationship is stored in a join table, which is shared with its inverse if it has one.
+	 */
 	kDKRelationshipTypeManyToMany,
 } DKRelationshipType;
 
@@ -268,3 +428,37 @@ typedef enum _DKRelationshipDeleteAction {
 @property DKRelationshipDeleteAction deleteAction;
 @end
 
+#pragma mark -
+
+/*!
+ @class
+ @abstract		This class is used to describe an index spanning one or more columns of a table.
+ @discussion	Indexes are created by DKDatabase when it opens a database using the table they belong to.
+				Indexes created by DatabaseKit that are no longer described are dropped.
+ */
+@interface DKIndexDescription : NSObject
+{
+	/* owner */	NSArray *mKeys;
+	/* n/a */	BOOL mIsUnique;
+}
+/*!
+ @method
+ @abstract	Create a new autoreleased index over a specified list of properties.
+ @param		keys		The names of the attributes and one-to-one relationships to index, most significant first. May not be nil.
+ @param		isUnique	Whether or not the combination of the values must be unique within the table.
+ @result	A new autoreleased index description.
+ */
++ (DKIndexDescription *)indexWithKeys:(NSArray *)keys unique:(BOOL)isUnique;
+
+/*!
+ @property
+ @abstract	The names of the properties the index covers, most significant first.
+ */
+@property (copy) NSArray *keys;
+
+/*!
+ @property
+ @abstract	Whether or not the combination of the indexed values must be unique.
+ */
+@property BOOL isUnique;
+@end
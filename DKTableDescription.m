@@ -7,11 +7,17 @@
 //
 
 #import "DKTableDescription.h"
+#import "DKTableDescriptionPrivate.h"
+#import "NSString+Database.h"
+#import <libkern/OSByteOrder.h>
+#import <zlib.h>
 
 @implementation DKTableDescription
 @synthesize name = mName;
 @synthesize databaseObjectClass = mDatabaseObjectClass;
 @synthesize properties = mProperties;
+@synthesize attributes = mAttributes;
+@synthesize indexes = mIndexes;
 
 #pragma mark -
 
@@ -23,6 +29,24 @@
 	[mProperties release];
 	mProperties = nil;
 	
+	[mAttributes release];
+	mAttributes = nil;
+	
+	[mEscapedAttributeColumnList release];
+	mEscapedAttributeColumnList = nil;
+	
+	[mIndexes release];
+	mIndexes = nil;
+	
+	[mPropertiesByName release];
+	mPropertiesByName = nil;
+	
+	if(mPropertiesBySelector)
+	{
+		NSFreeMapTable(mPropertiesBySelector);
+		mPropertiesBySelector = nil;
+	}
+	
 	[super dealloc];
 }
 
@@ -33,12 +57,57 @@
 }
 
 - (id)initWithName:(NSString *)name databaseObjectClass:(Class)databaseObjectClass properties:(NSArray *)properties
+{
+	return [self initWithName:name databaseObjectClass:databaseObjectClass properties:properties indexes:nil];
+}
+
+- (id)initWithName:(NSString *)name databaseObjectClass:(Class)databaseObjectClass properties:(NSArray *)properties indexes:(NSArray *)indexes
 {
 	if((self = [super init]))
 	{
 		mName = [name copy];
 		mDatabaseObjectClass = databaseObjectClass;
 		mProperties = [[NSArray alloc] initWithArray:properties copyItems:NO];
+		mIndexes = indexes? [indexes copy] : [NSArray new];
+		
+		//
+		//	We pull the attributes out of our properties up front. They're used to build
+		//	the column list of every query that reads whole rows out of the database.
+		//
+		NSMutableArray *attributes = [NSMutableArray array];
+		NSMutableArray *escapedAttributeNames = [NSMutableArray array];
+		NSMutableDictionary *propertiesByName = [NSMutableDictionary dictionary];
+		mPropertiesBySelector = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSNonRetainedObjectMapValueCallBacks, [mProperties count] * 2);
+		for (id property in mProperties)
+		{
+			//
+			//	Each property's ordinal is its position in our properties. Managed
+			//	objects use it to find the property's value in their storage.
+			//
+			[property setOrdinal:mNumberOfProperties++];
+			[property setTable:self];
+			
+			//
+			//	Properties are looked up by name and by the selectors of their generated
+			//	accessors far too often to scan for them. The first property wins.
+			//
+			if(![propertiesByName objectForKey:[property name]])
+			{
+				[propertiesByName setObject:property forKey:[property name]];
+				
+				NSMapInsertIfAbsent(mPropertiesBySelector, [property accessorSelector], property);
+				NSMapInsertIfAbsent(mPropertiesBySelector, [property mutatorSelector], property);
+			}
+			
+			if([property isKindOfClass:[DKAttributeDescription class]])
+			{
+				[attributes addObject:property];
+				[escapedAttributeNames addObject:[[property name] stringByEscapingStringForLiteralUseInSQLQueries]];
+			}
+		}
+		mAttributes = [attributes copy];
+		mEscapedAttributeColumnList = [[escapedAttributeNames componentsJoinedByString:@", "] copy];
+		mPropertiesByName = [propertiesByName copy];
 		
 		return self;
 	}
@@ -49,14 +118,64 @@
 {
 	NSParameterAssert(name);
 	
-	NSUInteger indexOfProperty = [mProperties indexOfObjectPassingTest:^(id property, NSUInteger index, BOOL *stop) {
-		return [[property name] isEqualToString:name];
-	}];
+	return [mPropertiesByName objectForKey:name];
+}
+
+- (DKPropertyDescription *)propertyForSelector:(SEL)selector
+{
+	return NSMapGet(mPropertiesBySelector, selector);
+}
+
+- (NSString *)escapedAttributeColumnList
+{
+	return mEscapedAttributeColumnList;
+}
+
+- (NSArray *)allIndexes
+{
+	NSMutableArray *allIndexes = [NSMutableArray arrayWithArray:mIndexes];
+	
+	//
+	//	Attributes can ask to be indexed by themselves, and one-to-one relationship
+	//	columns are always indexed. Relationships are looked up by the unique
+	//	identifier of their target far too often to leave them unindexed.
+	//
+	for (id property in mProperties)
+	{
+		if([property isKindOfClass:[DKAttributeDescription class]])
+		{
+			DKAttributeDescription *attribute = (DKAttributeDescription *)property;
+			if(attribute.isIndexed || attribute.isUnique)
+				[allIndexes addObject:[DKIndexDescription indexWithKeys:[NSArray arrayWithObject:attribute.name] unique:attribute.isUnique]];
+		}
+		else if([property isKindOfClass:[DKRelationshipDescription class]])
+		{
+			DKRelationshipDescription *relationship = (DKRelationshipDescription *)property;
+			if(relationship.relationshipType == kDKRelationshipTypeOneToOne)
+				[allIndexes addObject:[DKIndexDescription indexWithKeys:[NSArray arrayWithObject:relationship.name] unique:NO]];
+		}
+	}
 	
-	if(indexOfProperty != NSNotFound)
-		return [mProperties objectAtIndex:indexOfProperty];
+	return allIndexes;
+}
+
+- (NSString *)escapedColumnNameForKey:(NSString *)key
+{
+	NSParameterAssert(key);
 	
-	return nil;
+	if([key isEqualToString:@"SELF"] || [key isEqualToString:@"uniqueIdentifier"])
+		return @"_dk_uniqueIdentifier";
+	
+	DKPropertyDescription *property = [self propertyWithName:key];
+	if(!property)
+		return nil;
+	
+	//Only one-to-one relationships have a column of their own.
+	if([property isKindOfClass:[DKRelationshipDescription class]] && 
+	   ([(DKRelationshipDescription *)property relationshipType] != kDKRelationshipTypeOneToOne))
+		return nil;
+	
+	return [key stringByEscapingStringForLiteralUseInSQLQueries];
 }
 
 - (NSString *)description
@@ -72,6 +191,18 @@
 
 @synthesize name = mName;
 @synthesize isRequired = mIsRequired;
+@synthesize ordinal = mOrdinal;
+@synthesize table = mTable;
+
+- (SEL)accessorSelector
+{
+	return NSSelectorFromString(mName);
+}
+
+- (SEL)mutatorSelector
+{
+	return NSSelectorFromString([NSString stringWithFormat:@"set%C%@:", toupper([mName characterAtIndex:0]), [mName substringFromIndex:1]]);
+}
 
 - (void)dealloc
 {
@@ -123,7 +254,7 @@ NSString *DKAttributeTypeToSQLiteType(DKAttributeType attributeType)
 
 @implementation DKAttributeDescription
 
-@synthesize type, minimumValue, maximumValue, defaultValue;
+@synthesize type, minimumValue, maximumValue, defaultValue, isIndexed, isUnique, codec, valueClass, compressionThreshold;
 
 - (void)dealloc
 {
@@ -151,6 +282,167 @@ NSString *DKAttributeTypeToSQLiteType(DKAttributeType attributeType)
 	return [NSString stringWithFormat:@"<%@:%p (name: %@, type: %@)>", [self className], self, mName, DKAttributeTypeToSQLiteType(type)];
 }
 
+#pragma mark -
+#pragma mark Encoding
+
+//
+//	Compressed values are stored as the magic bytes `DKZ1`, followed by the length of the
+//	uncompressed value as a big endian 32 bit integer, followed by the deflated value.
+//
+static const char kDKCompressedDataMagic[4] = { 'D', 'K', 'Z', '1' };
+enum {
+	kDKCompressedDataHeaderLength = sizeof(kDKCompressedDataMagic) + sizeof(uint32_t),
+};
+
+///Returns whether or not a specified piece of data begins with the compressed data magic.
+static BOOL DKDataHasCompressedDataMagic(NSData *data)
+{
+	return (([data length] >= kDKCompressedDataHeaderLength) && 
+			(memcmp([data bytes], kDKCompressedDataMagic, sizeof(kDKCompressedDataMagic)) == 0));
+}
+
+- (NSData *)compressedDataForData:(NSData *)data
+{
+	NSParameterAssert(data);
+	
+	//
+	//	Values are only ever decompressed while compression is enabled, so nothing stored
+	//	without it can be mistaken for a compressed value. With it, data that happens to
+	//	start with our magic is always compressed so that it's read back as it was written.
+	//
+	if(compressionThreshold == 0)
+		return data;
+	
+	BOOL hasMagic = DKDataHasCompressedDataMagic(data);
+	if(!hasMagic && ([data length] < compressionThreshold))
+		return data;
+	
+	if([data length] > UINT32_MAX)
+		return data;
+	
+	uLongf compressedLength = compressBound([data length]);
+	NSMutableData *compressedData = [NSMutableData dataWithLength:kDKCompressedDataHeaderLength + compressedLength];
+	uint8_t *compressedBytes = [compressedData mutableBytes];
+	
+	memcpy(compressedBytes, kDKCompressedDataMagic, sizeof(kDKCompressedDataMagic));
+	OSWriteBigInt32(compressedBytes, sizeof(kDKCompressedDataMagic), (uint32_t)[data length]);
+	
+	int status = compress2(compressedBytes + kDKCompressedDataHeaderLength, //in/out destination
+						   &compressedLength, //in/out destinationLength
+						   [data bytes], //in source
+						   [data length], //in sourceLength
+						   Z_DEFAULT_COMPRESSION); //in level
+	NSAssert((status == Z_OK), @"Could not compress value for attribute %@. Got error %d.", mName, status);
+	
+	[compressedData setLength:kDKCompressedDataHeaderLength + compressedLength];
+	
+	//Payloads that don't shrink aren't worth inflating on every read.
+	if(!hasMagic && ([compressedData length] >= [data length]))
+		return data;
+	
+	return compressedData;
+}
+
+- (NSData *)uncompressedDataForEncodedData:(NSData *)data
+{
+	NSParameterAssert(data);
+	
+	//Raw data stored before compression was enabled may start with anything, including our magic.
+	if((compressionThreshold == 0) || !DKDataHasCompressedDataMagic(data))
+		return data;
+	
+	const uint8_t *compressedBytes = [data bytes];
+	uLongf uncompressedLength = OSReadBigInt32(compressedBytes, sizeof(kDKCompressedDataMagic));
+	NSMutableData *uncompressedData = [NSMutableData dataWithLength:uncompressedLength];
+	
+	int status = uncompress([uncompressedData mutableBytes], //in/out destination
+							&uncompressedLength, //in/out destinationLength
+							compressedBytes + kDKCompressedDataHeaderLength, //in source
+							[data length] - kDKCompressedDataHeaderLength); //in sourceLength
+	if((status != Z_OK) || (uncompressedLength != [uncompressedData length]))
+		return nil;
+	
+	return uncompressedData;
+}
+
+#pragma mark -
+
+- (NSData *)encodedDataForValue:(id)value
+{
+	NSParameterAssert(value);
+	
+	NSData *data = nil;
+	if(type == DKAttributeTypeData)
+	{
+		data = value;
+	}
+	else
+	{
+		NSAssert((type == DKAttributeTypeObject), @"Attribute %@ is not of a type that is encoded.", mName);
+		
+		switch (codec)
+		{
+			case kDKAttributeCodecPropertyList:
+			{
+				NSError *error = nil;
+				data = [NSPropertyListSerialization dataWithPropertyList:value 
+																  format:NSPropertyListBinaryFormat_v1_0 
+																 options:0 
+																   error:&error];
+				NSAssert((data != nil), @"Could not encode %@ for attribute %@ as a property list. Got error %@.", value, mName, error);
+				break;
+			}
+				
+			case kDKAttributeCodecCustom:
+			{
+				NSAssert([value conformsToProtocol:@protocol(DKCoding)], @"Value %@ for attribute %@ does not conform to DKCoding.", value, mName);
+				
+				data = [value databaseRepresentation];
+				NSAssert((data != nil), @"Value %@ for attribute %@ returned no database representation.", value, mName);
+				break;
+			}
+				
+			default:
+			{
+				data = [NSKeyedArchiver archivedDataWithRootObject:value];
+				break;
+			}
+		}
+	}
+	
+	return [self compressedDataForData:data];
+}
+
+- (id)valueForEncodedData:(NSData *)data
+{
+	NSParameterAssert(data);
+	
+	data = [self uncompressedDataForEncodedData:data];
+	if(!data || (type == DKAttributeTypeData))
+		return data;
+	
+	if([data length] == 0)
+		return nil;
+	
+	switch (codec)
+	{
+		case kDKAttributeCodecPropertyList:
+			return [NSPropertyListSerialization propertyListWithData:data 
+															 options:NSPropertyListImmutable 
+															  format:NULL 
+															   error:NULL];
+			
+		case kDKAttributeCodecCustom:
+			NSAssert((valueClass != Nil), @"Attribute %@ uses a custom codec but has no value class.", mName);
+			return [valueClass objectWithDatabaseRepresentation:data];
+			
+		default:
+			break;
+	}
+	
+	return [NSKeyedUnarchiver unarchiveObjectWithData:data];
+}
+
 @end
 
 @implementation DKRelationshipDescription
@@ -183,4 +475,87 @@ NSString *DKAttributeTypeToSQLiteType(DKAttributeType attributeType)
 	return [NSString stringWithFormat:@"<%@:%p (name: %@, from %@ to %@)>", [self className], self, mName, targetTable.name, inverseRelationship.targetTable.name];
 }
 
+#pragma mark -
+#pragma mark Storage
+
+- (BOOL)isToMany
+{
+	return (relationshipType != kDKRelationshipTypeOneToOne);
+}
+
+- (BOOL)usesJoinTable
+{
+	if(relationshipType == kDKRelationshipTypeOneToOne)
+		return NO;
+	
+	return !((relationshipType == kDKRelationshipTypeOneToMany) && 
+			 inverseRelationship && (inverseRelationship.relationshipType == kDKRelationshipTypeOneToOne));
+}
+
+///Returns whether or not the receiver's end of its join table is the one the table is named after.
+- (BOOL)ownsJoinTable
+{
+	if(!inverseRelationship || (inverseRelationship == self) || ![inverseRelationship usesJoinTable])
+		return YES;
+	
+	NSString *qualifiedName = [NSString stringWithFormat:@"%@_%@", mTable.name, mName];
+	NSString *inverseQualifiedName = [NSString stringWithFormat:@"%@_%@", inverseRelationship.table.name, inverseRelationship.name];
+	return ([qualifiedName compare:inverseQualifiedName] != NSOrderedDescending);
+}
+
+- (NSString *)joinTableName
+{
+	NSAssert([self usesJoinTable], @"Relationship %@ is not stored in a join table.", mName);
+	
+	if(![self ownsJoinTable])
+		return [inverseRelationship joinTableName];
+	
+	return [NSString stringWithFormat:@"_dk_join_%@_%@", mTable.name, mName];
+}
+
+- (NSString *)joinTableSourceColumnName
+{
+	return [self ownsJoinTable]? @"sourceID" : @"destinationID";
+}
+
+- (NSString *)joinTableDestinationColumnName
+{
+	return [self ownsJoinTable]? @"destinationID" : @"sourceID";
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKIndexDescription
+
+@synthesize keys = mKeys;
+@synthesize isUnique = mIsUnique;
+
+- (void)dealloc
+{
+	[mKeys release];
+	mKeys = nil;
+	
+	[super dealloc];
+}
+
++ (DKIndexDescription *)indexWithKeys:(NSArray *)keys unique:(BOOL)isUnique
+{
+	NSParameterAssert(keys);
+	NSAssert(([keys count] > 0), @"Cannot create an index without any keys.");
+	
+	DKIndexDescription *index = [[self new] autorelease];
+	
+	index.keys = keys;
+	index.isUnique = isUnique;
+	
+	return index;
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"<%@:%p (keys: [%@], unique: %d)>", [self className], self, [mKeys componentsJoinedByString:@", "], mIsUnique];
+}
+
 @end
@@ -0,0 +1,154 @@
+/*
+ *  DKTableDescriptionPrivate.h
+ *  DatabaseKit
+ *
+ *  Created by agent on 10/17/26.
+ *  Copyright 2026 Roundabout Software. All rights reserved.
+ *
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "DKTableDescription.h"
+
+//! @abstract	The DKTableDescription private continuation.
+@interface DKTableDescription () //Continuation
+
+/*!
+ @method
+ @abstract		Get a comma separated list of the escaped column names of the receiver's attributes.
+ @discussion	The columns are listed in the same order as the receiver's attributes array.
+ */
+- (NSString *)escapedAttributeColumnList;
+
+/*!
+ @method
+ @abstract		Look up the escaped name of the column that stores a specified key.
+ @param			key		The name of a property, or `SELF` or `uniqueIdentifier` for the unique identifier column. May not be nil.
+ @result		The escaped column name; nil if the key does not have a column of its own in the receiver.
+ @discussion	Only attributes and one-to-one relationships have columns.
+ */
+- (NSString *)escapedColumnNameForKey:(NSString *)key;
+
+/*!
+ @method
+ @abstract		Get every index the receiver's table should have.
+ @discussion	This includes the receiver's declared indexes as well as the indexes implied by
+				indexed and unique attributes and by one-to-one relationships.
+ */
+- (NSArray *)allIndexes;
+
+/*!
+ @method
+ @abstract		Look up the property whose generated accessor or mutator has a specified selector.
+ @param			selector	The selector of the accessor or mutator.
+ @result		The property; nil if no property in the receiver uses the selector.
+ @discussion	Managed objects look up properties with their table's map directly
+				in their generated accessors. This method is for everyone else.
+ */
+- (DKPropertyDescription *)propertyForSelector:(SEL)selector;
+
+@end
+
+#pragma mark -
+
+//! @abstract	The DKPropertyDescription private continuation.
+@interface DKPropertyDescription () //Continuation
+
+/*!
+ @property
+ @abstract	The position of the property in the properties of the table description it belongs to.
+ */
+@property NSUInteger ordinal;
+
+/*!
+ @property
+ @abstract	The table description the property belongs to.
+ */
+@property (assign) DKTableDescription *table;
+
+/*!
+ @method
+ @abstract	Returns the selector of the accessor generated for the receiver, e.g. `age`.
+ */
+- (SEL)accessorSelector;
+
+/*!
+ @method
+ @abstract	Returns the selector of the mutator generated for the receiver, e.g. `setAge:`.
+ */
+- (SEL)mutatorSelector;
+
+@end
+
+#pragma mark -
+
+//! @abstract	The DKRelationshipDescription private continuation.
+@interface DKRelationshipDescription () //Continuation
+
+/*!
+ @method
+ @abstract	Whether or not the receiver's value is a set of objects.
+ */
+- (BOOL)isToMany;
+
+/*!
+ @method
+ @abstract		Whether or not the receiver is stored in a join table.
+ @discussion	To-many relationships whose inverse is one-to-one use the inverse's column as a foreign key instead.
+ */
+- (BOOL)usesJoinTable;
+
+/*!
+ @method
+ @abstract		Returns the name of the join table the receiver is stored in.
+ @discussion	A relationship and its inverse share a join table. It is named after whichever of
+				the two sorts first, so both ends agree on its name.
+ */
+- (NSString *)joinTableName;
+
+/*!
+ @method
+ @abstract	Returns the column of the receiver's join table that holds the unique identifiers of the receiver's table.
+ */
+- (NSString *)joinTableSourceColumnName;
+
+/*!
+ @method
+ @abstract	Returns the column of the receiver's join table that holds the unique identifiers of the receiver's target table.
+ */
+- (NSString *)joinTableDestinationColumnName;
+
+@end
+
+#pragma mark -
+
+//! @abstract	The DKAttributeDescription private continuation.
+@interface DKAttributeDescription () //Continuation
+
+/*!
+ @method
+ @abstract		Encode a value of the receiver for storage in the database.
+ @param			value	The value to encode. May not be nil.
+ @result		The encoded value, compressed if it is larger than the receiver's compression threshold.
+ @discussion	Only attributes of DKAttributeTypeData and DKAttributeTypeObject are encoded.
+ */
+- (NSData *)encodedDataForValue:(id)value;
+
+/*!
+ @method
+ @abstract	Decode a value of the receiver read from the database.
+ @param		data	Data previously returned by encodedDataForValue:. May not be nil.
+ @result	The decoded value; nil if it could not be decoded.
+ */
+- (id)valueForEncodedData:(NSData *)data;
+
+/*!
+ @method
+ @abstract		Undo any compression applied to a value read from the database without decoding it.
+ @param			data	Data previously returned by encodedDataForValue:. May not be nil.
+ @result		The uncompressed encoding of the value; nil if the data is corrupt.
+ @discussion	Data that is not compressed is returned as is.
+ */
+- (NSData *)uncompressedDataForEncodedData:(NSData *)data;
+
+@end
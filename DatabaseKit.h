@@ -10,6 +10,7 @@
 #import <DatabaseKit/DatabaseKitDefines.h>
 #import <DatabaseKit/DKDatabase.h>
 #import <DatabaseKit/DKDatabaseLayout.h>
+#import <DatabaseKit/DKDatabaseOperation.h>
 #import <DatabaseKit/DKFetchRequest.h>
 #import <DatabaseKit/DKManagedObject.h>
 #import <DatabaseKit/DKTableDescription.h>
\ No newline at end of file
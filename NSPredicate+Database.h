@@ -0,0 +1,30 @@
+//
+//  NSPredicate+Database.h
+//  DatabaseKit
+//
+//  Created by agent on 10/17/26.
+//  Copyright 2026 Roundabout Software. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+@class DKTableDescription;
+
+@interface NSPredicate (DatabaseKit)
+
+/*!
+ @method
+ @abstract		Translate the receiver into an SQL expression suitable for use in a WHERE clause.
+ @param			table		The table the receiver's key paths are relative to. May not be nil.
+ @param			arguments	On return the constants in the receiver, in the order their parameters appear in the result. May not be nil.
+ @param			error		If the receiver cannot be translated, on return this will contain an error. May be nil.
+ @result		An SQL expression whose constants have been replaced with `?` parameters; nil if the receiver cannot be translated.
+ @discussion	Comparison, compound, IN, BETWEEN, LIKE, BEGINSWITH, ENDSWITH and CONTAINS predicates are supported.
+				Key paths may traverse one-to-one relationships, which are translated into sub-selects.
+
+				Because constants are never written into the result, predicates that only differ by their
+				constants produce identical SQL and share a compiled query in the database's query cache.
+ */
+- (NSString *)SQLExpressionForTable:(DKTableDescription *)table arguments:(NSMutableArray *)arguments error:(NSError **)error;
+
+@end
@@ -0,0 +1,466 @@
+//
+//  NSPredicate+Database.m
+//  DatabaseKit
+//
+//  Created by agent on 10/17/26.
+//  Copyright 2026 Roundabout Software. All rights reserved.
+//
+
+#import "NSPredicate+Database.h"
+#import "NSString+Database.h"
+#import "DKTableDescription.h"
+#import "DKTableDescriptionPrivate.h"
+#import "DKManagedObject.h"
+#import "DKManagedObjectPrivate.h"
+
+static NSString *DKSQLExpressionForPredicate(NSPredicate *predicate, DKTableDescription *table, NSMutableArray *arguments, NSError **error);
+
+#pragma mark Tools
+
+static NSString *DKUnsupportedPredicate(NSPredicate *predicate, NSError **error)
+{
+	if(error) *error = DKLocalizedError(DKEvaluationErrorDomain, 0, nil, @"Unsupported predicate", [predicate predicateFormat]);
+	return nil;
+}
+
+///Returns the key path an expression refers to, or nil if it is not a key path.
+static NSString *DKKeyPathForExpression(NSExpression *expression)
+{
+	switch ([expression expressionType])
+	{
+		case NSKeyPathExpressionType:
+			return [expression keyPath];
+		
+		case NSEvaluatedObjectExpressionType:
+			return @"SELF";
+		
+		default:
+			return nil;
+	}
+}
+
+///Looks up the constant value of an expression, flattening aggregates like `{1, 2}` into arrays.
+static BOOL DKGetConstantForExpression(NSExpression *expression, id *outConstant)
+{
+	switch ([expression expressionType])
+	{
+		case NSConstantValueExpressionType:
+			*outConstant = [expression constantValue];
+			return YES;
+		
+		case NSAggregateExpressionType:
+		{
+			NSMutableArray *values = [NSMutableArray array];
+			for (NSExpression *subexpression in [expression collection])
+			{
+				id value = nil;
+				if(!DKGetConstantForExpression(subexpression, &value))
+					return NO;
+				
+				[values addObject:(value? value : [NSNull null])];
+			}
+			
+			*outConstant = values;
+			return YES;
+		}
+		
+		default:
+			return NO;
+	}
+}
+
+///Converts a constant into something DKCompiledSQLQuery can bind.
+static id DKSQLArgumentForConstant(id constant)
+{
+	if(!constant)
+		return [NSNull null];
+	
+	//Relationship columns hold the unique identifier of the object they point to.
+	if([constant isKindOfClass:[DKManagedObject class]])
+		return [NSNumber numberWithLongLong:[(DKManagedObject *)constant uniqueIdentifier]];
+	
+	return constant;
+}
+
+#pragma mark -
+#pragma mark Patterns
+
+///Escapes a string for use with `LIKE ... ESCAPE '\'`, optionally translating NSPredicate's `*` and `?` wildcards.
+static NSString *DKLikePatternForString(NSString *string, BOOL translateWildcards)
+{
+	NSMutableString *pattern = [NSMutableString stringWithString:string];
+	
+	[pattern replaceOccurrencesOfString:@"\\" withString:@"\\\\" options:0 range:NSMakeRange(0, [pattern length])];
+	[pattern replaceOccurrencesOfString:@"%" withString:@"\\%" options:0 range:NSMakeRange(0, [pattern length])];
+	[pattern replaceOccurrencesOfString:@"_" withString:@"\\_" options:0 range:NSMakeRange(0, [pattern length])];
+	
+	if(translateWildcards)
+	{
+		[pattern replaceOccurrencesOfString:@"*" withString:@"%" options:0 range:NSMakeRange(0, [pattern length])];
+		[pattern replaceOccurrencesOfString:@"?" withString:@"_" options:0 range:NSMakeRange(0, [pattern length])];
+	}
+	
+	return pattern;
+}
+
+///Escapes a string for use with GLOB. NSPredicate's wildcards are the same as GLOB's so they're left alone if requested.
+static NSString *DKGlobPatternForString(NSString *string, BOOL translateWildcards)
+{
+	NSMutableString *pattern = [NSMutableString stringWithString:string];
+	
+	//This has to come first, the other replacements introduce brackets of their own.
+	[pattern replaceOccurrencesOfString:@"[" withString:@"[[]" options:0 range:NSMakeRange(0, [pattern length])];
+	
+	if(!translateWildcards)
+	{
+		[pattern replaceOccurrencesOfString:@"*" withString:@"[*]" options:0 range:NSMakeRange(0, [pattern length])];
+		[pattern replaceOccurrencesOfString:@"?" withString:@"[?]" options:0 range:NSMakeRange(0, [pattern length])];
+	}
+	
+	return pattern;
+}
+
+#pragma mark -
+#pragma mark Comparisons
+
+static NSString *DKSQLOperatorForOperatorType(NSPredicateOperatorType operatorType)
+{
+	switch (operatorType)
+	{
+		case NSLessThanPredicateOperatorType:
+			return @"<";
+		
+		case NSLessThanOrEqualToPredicateOperatorType:
+			return @"<=";
+		
+		case NSGreaterThanPredicateOperatorType:
+			return @">";
+		
+		case NSGreaterThanOrEqualToPredicateOperatorType:
+			return @">=";
+		
+		case NSEqualToPredicateOperatorType:
+			return @"=";
+		
+		case NSNotEqualToPredicateOperatorType:
+			return @"!=";
+		
+		default:
+			return nil;
+	}
+}
+
+///Translates the comparison of a column against the right hand side of a comparison predicate.
+static NSString *DKSQLExpressionForColumnComparison(NSString *column, NSPredicateOperatorType operatorType, NSComparisonPredicate *predicate, NSExpression *rightExpression, DKTableDescription *table, NSMutableArray *arguments, NSError **error)
+{
+	NSUInteger options = [predicate options];
+	if(options & NSDiacriticInsensitivePredicateOption)
+		return DKUnsupportedPredicate(predicate, error);
+	
+	BOOL isCaseInsensitive = ((options & NSCaseInsensitivePredicateOption) != 0);
+	NSString *collation = isCaseInsensitive? @" COLLATE NOCASE" : @"";
+	
+	//
+	//	Comparisons between two columns of the same row don't have any constants.
+	//
+	NSString *rightKeyPath = DKKeyPathForExpression(rightExpression);
+	if(rightKeyPath)
+	{
+		NSString *sqlOperator = DKSQLOperatorForOperatorType(operatorType);
+		NSString *rightColumn = ([rightKeyPath rangeOfString:@"."].location == NSNotFound)? [table escapedColumnNameForKey:rightKeyPath] : nil;
+		if(!sqlOperator || !rightColumn)
+			return DKUnsupportedPredicate(predicate, error);
+		
+		return dk_string_from_format(@"%@ %@ %@%@", column, sqlOperator, rightColumn, collation);
+	}
+	
+	id constant = nil;
+	if(!DKGetConstantForExpression(rightExpression, &constant))
+		return DKUnsupportedPredicate(predicate, error);
+	
+	switch (operatorType)
+	{
+		case NSLessThanPredicateOperatorType:
+		case NSLessThanOrEqualToPredicateOperatorType:
+		case NSGreaterThanPredicateOperatorType:
+		case NSGreaterThanOrEqualToPredicateOperatorType:
+		case NSEqualToPredicateOperatorType:
+		case NSNotEqualToPredicateOperatorType:
+		{
+			//
+			//	NULL never compares equal to anything in SQL, so nil
+			//	has to be spelled out with IS NULL and IS NOT NULL.
+			//
+			if(!constant || (constant == [NSNull null]))
+			{
+				if(operatorType == NSEqualToPredicateOperatorType)
+					return dk_string_from_format(@"%@ IS NULL", column);
+				else if(operatorType == NSNotEqualToPredicateOperatorType)
+					return dk_string_from_format(@"%@ IS NOT NULL", column);
+				
+				return DKUnsupportedPredicate(predicate, error);
+			}
+			
+			[arguments addObject:DKSQLArgumentForConstant(constant)];
+			return dk_string_from_format(@"%@ %@ ?%@", column, DKSQLOperatorForOperatorType(operatorType), collation);
+		}
+		
+		case NSInPredicateOperatorType:
+		{
+			//`x IN "string"` is a substring test, which we don't support.
+			NSArray *values = nil;
+			if([constant isKindOfClass:[NSArray class]])
+				values = constant;
+			else if([constant isKindOfClass:[NSSet class]])
+				values = [constant allObjects];
+			else if([constant isKindOfClass:[NSDictionary class]])
+				values = [constant allValues];
+			else
+				return DKUnsupportedPredicate(predicate, error);
+			
+			if([values count] == 0)
+				return @"0";
+			
+			NSMutableArray *parameters = [NSMutableArray arrayWithCapacity:[values count]];
+			for (id value in values)
+			{
+				[parameters addObject:@"?"];
+				[arguments addObject:DKSQLArgumentForConstant(value)];
+			}
+			
+			return dk_string_from_format(@"%@%@ IN (%@)", column, collation, [parameters componentsJoinedByString:@", "]);
+		}
+		
+		case NSBetweenPredicateOperatorType:
+		{
+			if(![constant isKindOfClass:[NSArray class]] || ([constant count] != 2))
+				return DKUnsupportedPredicate(predicate, error);
+			
+			[arguments addObject:DKSQLArgumentForConstant([constant objectAtIndex:0])];
+			[arguments addObject:DKSQLArgumentForConstant([constant objectAtIndex:1])];
+			return dk_string_from_format(@"%@ BETWEEN ? AND ?%@", column, collation);
+		}
+		
+		case NSLikePredicateOperatorType:
+		case NSBeginsWithPredicateOperatorType:
+		case NSEndsWithPredicateOperatorType:
+		case NSContainsPredicateOperatorType:
+		{
+			if(![constant isKindOfClass:[NSString class]])
+				return DKUnsupportedPredicate(predicate, error);
+			
+			//
+			//	SQLite's LIKE ignores case and its GLOB doesn't, so we pick
+			//	whichever one matches the predicate's options. The pattern
+			//	is passed as a parameter like any other constant.
+			//
+			BOOL isLike = (operatorType == NSLikePredicateOperatorType);
+			NSString *pattern = isCaseInsensitive? DKLikePatternForString(constant, isLike) : DKGlobPatternForString(constant, isLike);
+			NSString *wildcard = isCaseInsensitive? @"%" : @"*";
+			
+			if(operatorType == NSBeginsWithPredicateOperatorType)
+				pattern = [pattern stringByAppendingString:wildcard];
+			else if(operatorType == NSEndsWithPredicateOperatorType)
+				pattern = [wildcard stringByAppendingString:pattern];
+			else if(operatorType == NSContainsPredicateOperatorType)
+				pattern = dk_string_from_format(@"%@%@%@", wildcard, pattern, wildcard);
+			
+			[arguments addObject:pattern];
+			
+			if(isCaseInsensitive)
+				return dk_string_from_format(@"%@ LIKE ? ESCAPE '\\'", column);
+			
+			return dk_string_from_format(@"%@ GLOB ?", column);
+		}
+		
+		default:
+			return DKUnsupportedPredicate(predicate, error);
+	}
+}
+
+static NSString *DKSQLExpressionForComparisonPredicate(NSComparisonPredicate *predicate, DKTableDescription *table, NSMutableArray *arguments, NSError **error)
+{
+	if(([predicate comparisonPredicateModifier] != NSDirectPredicateModifier) ||
+	   ([predicate predicateOperatorType] == NSCustomSelectorPredicateOperatorType))
+		return DKUnsupportedPredicate(predicate, error);
+	
+	NSExpression *leftExpression = [predicate leftExpression];
+	NSExpression *rightExpression = [predicate rightExpression];
+	NSPredicateOperatorType operatorType = [predicate predicateOperatorType];
+	
+	//
+	//	We always want the key path on the left. Predicates written the other way
+	//	around (`5 < age`) are flipped, which only works for plain comparisons.
+	//
+	if(!DKKeyPathForExpression(leftExpression) && DKKeyPathForExpression(rightExpression))
+	{
+		switch (operatorType)
+		{
+			case NSLessThanPredicateOperatorType:
+				operatorType = NSGreaterThanPredicateOperatorType;
+				break;
+			
+			case NSLessThanOrEqualToPredicateOperatorType:
+				operatorType = NSGreaterThanOrEqualToPredicateOperatorType;
+				break;
+			
+			case NSGreaterThanPredicateOperatorType:
+				operatorType = NSLessThanPredicateOperatorType;
+				break;
+			
+			case NSGreaterThanOrEqualToPredicateOperatorType:
+				operatorType = NSLessThanOrEqualToPredicateOperatorType;
+				break;
+			
+			case NSEqualToPredicateOperatorType:
+			case NSNotEqualToPredicateOperatorType:
+				break;
+			
+			default:
+				return DKUnsupportedPredicate(predicate, error);
+		}
+		
+		NSExpression *temporaryExpression = leftExpression;
+		leftExpression = rightExpression;
+		rightExpression = temporaryExpression;
+	}
+	
+	NSString *keyPath = DKKeyPathForExpression(leftExpression);
+	if(!keyPath)
+		return DKUnsupportedPredicate(predicate, error);
+	
+	//
+	//	Every key but the last one in the key path has to be a one-to-one
+	//	relationship. We walk them to find the table the comparison is
+	//	actually made against.
+	//
+	NSArray *keys = [keyPath componentsSeparatedByString:@"."];
+	NSMutableArray *relationships = [NSMutableArray array];
+	DKTableDescription *targetTable = table;
+	for (NSUInteger index = 0, count = [keys count]; index < (count - 1); index++)
+	{
+		DKRelationshipDescription *relationship = (DKRelationshipDescription *)[targetTable propertyWithName:[keys objectAtIndex:index]];
+		if(![relationship isKindOfClass:[DKRelationshipDescription class]] ||
+		   (relationship.relationshipType != kDKRelationshipTypeOneToOne))
+			return DKUnsupportedPredicate(predicate, error);
+		
+		[relationships addObject:relationship];
+		targetTable = relationship.targetTable;
+	}
+	
+	NSString *column = [targetTable escapedColumnNameForKey:[keys lastObject]];
+	if(!column)
+		return DKUnsupportedPredicate(predicate, error);
+	
+	//Comparing two columns only makes sense when they're in the same row.
+	if(([relationships count] > 0) && DKKeyPathForExpression(rightExpression))
+		return DKUnsupportedPredicate(predicate, error);
+	
+	NSString *expression = DKSQLExpressionForColumnComparison(column, operatorType, predicate, rightExpression, targetTable, arguments, error);
+	if(!expression)
+		return nil;
+	
+	//
+	//	Now we wrap the comparison in a sub-select for each relationship, innermost
+	//	first. `owner.name == ?` becomes `owner IN (SELECT uid FROM Owner WHERE name = ?)`,
+	//	which SQLite can answer using the target table's primary key.
+	//
+	for (DKRelationshipDescription *relationship in [relationships reverseObjectEnumerator])
+	{
+		expression = dk_string_from_format(
+			dk_stringify_sql(
+				%@ IN (SELECT _dk_uniqueIdentifier FROM %@ WHERE %@)
+			),
+			[relationship.name stringByEscapingStringForLiteralUseInSQLQueries],
+			[relationship.targetTable.name stringByEscapingStringForLiteralUseInSQLQueries],
+			expression
+		);
+	}
+	
+	return expression;
+}
+
+#pragma mark -
+#pragma mark Compound Predicates
+
+static NSString *DKSQLExpressionForCompoundPredicate(NSCompoundPredicate *predicate, DKTableDescription *table, NSMutableArray *arguments, NSError **error)
+{
+	NSArray *subpredicates = [predicate subpredicates];
+	switch ([predicate compoundPredicateType])
+	{
+		case NSAndPredicateType:
+		case NSOrPredicateType:
+		{
+			BOOL isAnd = ([predicate compoundPredicateType] == NSAndPredicateType);
+			if([subpredicates count] == 0)
+				return isAnd? @"1" : @"0";
+			
+			NSMutableArray *expressions = [NSMutableArray arrayWithCapacity:[subpredicates count]];
+			for (NSPredicate *subpredicate in subpredicates)
+			{
+				NSString *expression = DKSQLExpressionForPredicate(subpredicate, table, arguments, error);
+				if(!expression)
+					return nil;
+				
+				[expressions addObject:dk_string_from_format(@"(%@)", expression)];
+			}
+			
+			return [expressions componentsJoinedByString:(isAnd? @" AND " : @" OR ")];
+		}
+		
+		case NSNotPredicateType:
+		{
+			NSPredicate *subpredicate = ([subpredicates count] == 1)? [subpredicates objectAtIndex:0] : [NSCompoundPredicate andPredicateWithSubpredicates:subpredicates];
+			NSString *expression = DKSQLExpressionForPredicate(subpredicate, table, arguments, error);
+			if(!expression)
+				return nil;
+			
+			return dk_string_from_format(@"NOT (%@)", expression);
+		}
+		
+		default:
+			return DKUnsupportedPredicate(predicate, error);
+	}
+}
+
+#pragma mark -
+
+static NSString *DKSQLExpressionForPredicate(NSPredicate *predicate, DKTableDescription *table, NSMutableArray *arguments, NSError **error)
+{
+	if([predicate isKindOfClass:[NSComparisonPredicate class]])
+		return DKSQLExpressionForComparisonPredicate((NSComparisonPredicate *)predicate, table, arguments, error);
+	
+	if([predicate isKindOfClass:[NSCompoundPredicate class]])
+		return DKSQLExpressionForCompoundPredicate((NSCompoundPredicate *)predicate, table, arguments, error);
+	
+	//TRUEPREDICATE and FALSEPREDICATE.
+	if([predicate isEqual:[NSPredicate predicateWithValue:YES]])
+		return @"1";
+	else if([predicate isEqual:[NSPredicate predicateWithValue:NO]])
+		return @"0";
+	
+	return DKUnsupportedPredicate(predicate, error);
+}
+
+#pragma mark -
+
+@implementation NSPredicate (DatabaseKit)
+
+- (NSString *)SQLExpressionForTable:(DKTableDescription *)table arguments:(NSMutableArray *)arguments error:(NSError **)error
+{
+	NSParameterAssert(table);
+	NSParameterAssert(arguments);
+	
+	//
+	//	If translation fails part way through we don't want to leave
+	//	the arguments of the predicates that did work lying around.
+	//
+	NSUInteger originalArgumentCount = [arguments count];
+	NSString *expression = DKSQLExpressionForPredicate(self, table, arguments, error);
+	if(!expression)
+		[arguments removeObjectsInRange:NSMakeRange(originalArgumentCount, [arguments count] - originalArgumentCount)];
+	
+	return expression;
+}
+
+@end
@@ -0,0 +1,46 @@
+//
+//  NSSortDescriptor+Database.h
+//  DatabaseKit
+//
+//  Created by agent on 10/17/26.
+//  Copyright 2026 Roundabout Software. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+
+@class DKTableDescription;
+
+@interface NSSortDescriptor (DatabaseKit)
+
+/*!
+ @method
+ @abstract		Translate the receiver into an SQL ORDER BY term.
+ @param			table	The table the receiver's key is relative to. May not be nil.
+ @result		An ordering term; nil if the receiver cannot be evaluated by SQLite.
+ @discussion	Only sort descriptors on a single string, number or date attribute using
+				compare: or caseInsensitiveCompare: can be translated.
+ */
+- (NSString *)SQLOrderingTermForTable:(DKTableDescription *)table;
+
+/*!
+ @method
+ @abstract		Create an SQL expression matching the rows the receiver orders after a specified value.
+ @param			value		The value to compare against. May be nil.
+ @param			table		The table the receiver's key is relative to. May not be nil.
+ @param			arguments	On return the value will have been added if the expression uses it. May not be nil.
+ @result		An SQL expression; nil if the receiver cannot be evaluated by SQLite.
+ @discussion	NULL columns are treated the way SQLite sorts them, before every other value.
+ */
+- (NSString *)SQLExpressionForRowsAfterValue:(id)value inTable:(DKTableDescription *)table arguments:(NSMutableArray *)arguments;
+
+/*!
+ @method
+ @abstract	Create an SQL expression matching the rows the receiver considers equal to a specified value.
+ @param		value		The value to compare against. May be nil.
+ @param		table		The table the receiver's key is relative to. May not be nil.
+ @param		arguments	On return the value will have been added if the expression uses it. May not be nil.
+ @result	An SQL expression; nil if the receiver cannot be evaluated by SQLite.
+ */
+- (NSString *)SQLExpressionForRowsEqualToValue:(id)value inTable:(DKTableDescription *)table arguments:(NSMutableArray *)arguments;
+
+@end
@@ -0,0 +1,106 @@
+//
+//  NSSortDescriptor+Database.m
+//  DatabaseKit
+//
+//  Created by agent on 10/17/26.
+//  Copyright 2026 Roundabout Software. All rights reserved.
+//
+
+#import "NSSortDescriptor+Database.h"
+#import "DKTableDescription.h"
+#import "DKTableDescriptionPrivate.h"
+
+@implementation NSSortDescriptor (DatabaseKit)
+
+///Returns the column the receiver sorts on, or nil if SQLite can't sort it the way the receiver would.
+- (NSString *)_dk_SQLColumnForTable:(DKTableDescription *)table collation:(NSString **)outCollation
+{
+	NSParameterAssert(table);
+	
+	NSString *key = [self key];
+	if(!key || ([key rangeOfString:@"."].location != NSNotFound))
+		return nil;
+	
+	//
+	//	compare: on strings, numbers and dates is the same as SQLite's
+	//	BINARY collation for the values we store. caseInsensitiveCompare:
+	//	is close enough to NOCASE. Anything else has to be sorted in memory.
+	//
+	SEL selector = [self selector];
+	if(selector == @selector(compare:))
+		*outCollation = @"";
+	else if(selector == @selector(caseInsensitiveCompare:))
+		*outCollation = @" COLLATE NOCASE";
+	else
+		return nil;
+	
+	DKPropertyDescription *property = [table propertyWithName:key];
+	if(property)
+	{
+		//Relationships sort by unique identifier, which isn't what compare: would do.
+		if(![property isKindOfClass:[DKAttributeDescription class]])
+			return nil;
+		
+		DKAttributeType type = [(DKAttributeDescription *)property type];
+		if((type == DKAttributeTypeData) || (type == DKAttributeTypeObject))
+			return nil;
+	}
+	
+	return [table escapedColumnNameForKey:key];
+}
+
+- (NSString *)SQLOrderingTermForTable:(DKTableDescription *)table
+{
+	NSString *collation = nil;
+	NSString *column = [self _dk_SQLColumnForTable:table collation:&collation];
+	if(!column)
+		return nil;
+	
+	return dk_string_from_format(@"%@%@ %@", column, collation, ([self ascending]? @"ASC" : @"DESC"));
+}
+
+- (NSString *)SQLExpressionForRowsAfterValue:(id)value inTable:(DKTableDescription *)table arguments:(NSMutableArray *)arguments
+{
+	NSParameterAssert(arguments);
+	
+	NSString *collation = nil;
+	NSString *column = [self _dk_SQLColumnForTable:table collation:&collation];
+	if(!column)
+		return nil;
+	
+	//
+	//	SQLite sorts NULL before everything else. Ascending, everything
+	//	that isn't NULL comes after NULL; descending, NULL comes last.
+	//
+	if(!value || (value == [NSNull null]))
+	{
+		if([self ascending])
+			return dk_string_from_format(@"%@ IS NOT NULL", column);
+		
+		return @"0";
+	}
+	
+	[arguments addObject:value];
+	if([self ascending])
+		return dk_string_from_format(@"%@ > ?%@", column, collation);
+	
+	return dk_string_from_format(@"(%@ < ?%@ OR %@ IS NULL)", column, collation, column);
+}
+
+- (NSString *)SQLExpressionForRowsEqualToValue:(id)value inTable:(DKTableDescription *)table arguments:(NSMutableArray *)arguments
+{
+	NSParameterAssert(arguments);
+	
+	NSString *collation = nil;
+	NSString *column = [self _dk_SQLColumnForTable:table collation:&collation];
+	if(!column)
+		return nil;
+	
+	if(!value || (value == [NSNull null]))
+		return dk_string_from_format(@"%@ IS NULL", column);
+	
+	[arguments addObject:value];
+	return dk_string_from_format(@"%@ = ?%@", column, collation);
+}
+
+@end
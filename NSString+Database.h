@@ -16,4 +16,11 @@
  */
 - (NSString *)stringByEscapingStringForLiteralUseInSQLQueries;
 
+/*!
+ @method
+ @abstract	Create a comma separated list of a specified number of SQL parameters, e.g. `?, ?, ?`.
+ @param		count	The number of parameters in the list. Must be greater than 0.
+ */
++ (NSString *)SQLParameterListWithCount:(NSUInteger)count;
+
 @end
@@ -59,4 +59,16 @@
 	return cleansedString;
 }
 
++ (NSString *)SQLParameterListWithCount:(NSUInteger)count
+{
+	NSParameterAssert(count > 0);
+	
+	NSMutableString *parameterList = [NSMutableString stringWithCapacity:(count * 3)];
+	[parameterList appendString:@"?"];
+	for (NSUInteger index = 1; index < count; index++)
+		[parameterList appendString:@", ?"];
+	
+	return parameterList;
+}
+
 @end